@@ -0,0 +1,451 @@
+/*
+ * gstprojectm-bench: drives synthetic audio through the projectm element
+ * across a matrix of render settings and prints one JSON object per run.
+ *
+ * Runs headless on Mesa llvmpipe with --surfaceless --software, which is the
+ * configuration used on CPU-only CI machines.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gst/audio/audio.h>
+#include <gst/gst.h>
+
+#ifndef GST_PROJECTM_BENCH_PLUGIN_DIR
+#define GST_PROJECTM_BENCH_PLUGIN_DIR NULL
+#endif
+
+#define BENCH_AUDIO_RATE 44100
+
+typedef struct {
+  gint width;
+  gint height;
+  gchar *mesh;
+  gchar *format;
+  gchar *readback_mode;
+} BenchConfig;
+
+typedef struct {
+  GArray *timestamps; /* gint64 monotonic microseconds per output frame */
+  guint frames_seen;
+  guint warmup;
+} BenchProbeData;
+
+static gchar *opt_plugin_path = GST_PROJECTM_BENCH_PLUGIN_DIR;
+static gchar *opt_resolutions = "640x360,1280x720,1920x1080";
+static gchar *opt_mesh_sizes = "48x32,128x72";
+static gchar *opt_formats = "ABGR";
+static gchar *opt_readback_modes = "sync,pbo,persistent,zero-copy";
+static gchar *opt_preset = NULL;
+static gchar *opt_output = NULL;
+static gint opt_frames = 300;
+static gint opt_warmup = 30;
+static gint opt_fps = 60;
+static gint opt_timeout = 600;
+static gboolean opt_surfaceless = FALSE;
+static gboolean opt_software = FALSE;
+
+static GOptionEntry bench_entries[] = {
+    {"plugin-path", 0, 0, G_OPTION_ARG_FILENAME, &opt_plugin_path,
+     "Directory containing libgstprojectm", "DIR"},
+    {"resolutions", 'r', 0, G_OPTION_ARG_STRING, &opt_resolutions,
+     "Comma separated output sizes", "WxH,..."},
+    {"mesh-sizes", 'm', 0, G_OPTION_ARG_STRING, &opt_mesh_sizes,
+     "Comma separated projectM mesh sizes", "WxH,..."},
+    {"formats", 'f', 0, G_OPTION_ARG_STRING, &opt_formats,
+     "Comma separated video formats", "FMT,..."},
+    {"readback-modes", 'R', 0, G_OPTION_ARG_STRING, &opt_readback_modes,
+     "Comma separated readback-mode values", "MODE,..."},
+    {"preset", 'p', 0, G_OPTION_ARG_FILENAME, &opt_preset,
+     "Preset file or directory passed to the element", "PATH"},
+    {"frames", 'n', 0, G_OPTION_ARG_INT, &opt_frames,
+     "Frames rendered per run", "N"},
+    {"warmup", 'w', 0, G_OPTION_ARG_INT, &opt_warmup,
+     "Frames excluded from the measurement", "N"},
+    {"fps", 0, 0, G_OPTION_ARG_INT, &opt_fps, "Output frame rate", "N"},
+    {"timeout", 0, 0, G_OPTION_ARG_INT, &opt_timeout,
+     "Seconds before a run is aborted", "SECONDS"},
+    {"surfaceless", 0, 0, G_OPTION_ARG_NONE, &opt_surfaceless,
+     "Use EGL surfaceless rendering into an FBO", NULL},
+    {"software", 0, 0, G_OPTION_ARG_NONE, &opt_software,
+     "Force Mesa llvmpipe software rendering", NULL},
+    {"output", 'o', 0, G_OPTION_ARG_FILENAME, &opt_output,
+     "Write JSON lines to FILE instead of stdout", "FILE"},
+    {NULL}};
+
+static void bench_setup_environment(void) {
+  /* Same environment convert.sh uses for headless EGL; only set what the
+   * caller has not overridden. */
+  if (opt_surfaceless) {
+    g_setenv("GST_GL_PLATFORM", "egl", FALSE);
+    g_setenv("GST_GL_WINDOW", "surfaceless", FALSE);
+    g_setenv("GST_GL_EGL_PLATFORM", "surfaceless", FALSE);
+    g_setenv("EGL_PLATFORM", "surfaceless", FALSE);
+    g_setenv("GST_PROJECTM_FORCE_FBO", "1", FALSE);
+  }
+
+  if (opt_software) {
+    g_setenv("LIBGL_ALWAYS_SOFTWARE", "1", FALSE);
+    g_setenv("GALLIUM_DRIVER", "llvmpipe", FALSE);
+  }
+}
+
+static gboolean bench_parse_size(const gchar *value, gint *width,
+                                 gint *height) {
+  gchar **parts = g_strsplit_set(value, "x,", 2);
+  gboolean ok = FALSE;
+
+  if (g_strv_length(parts) == 2) {
+    *width = atoi(parts[0]);
+    *height = atoi(parts[1]);
+    ok = *width > 0 && *height > 0;
+  }
+
+  g_strfreev(parts);
+  return ok;
+}
+
+static gint64 bench_read_proc_status_kb(const gchar *key) {
+#ifdef __linux__
+  gchar *contents = NULL;
+  gint64 value = -1;
+
+  if (!g_file_get_contents("/proc/self/status", &contents, NULL, NULL)) {
+    return -1;
+  }
+
+  gchar **lines = g_strsplit(contents, "\n", -1);
+  for (gchar **line = lines; *line != NULL; line++) {
+    if (g_str_has_prefix(*line, key) && (*line)[strlen(key)] == ':') {
+      value = g_ascii_strtoll(*line + strlen(key) + 1, NULL, 10);
+      break;
+    }
+  }
+
+  g_strfreev(lines);
+  g_free(contents);
+  return value;
+#else
+  return -1;
+#endif
+}
+
+static GstPadProbeReturn bench_frame_probe(GstPad *pad, GstPadProbeInfo *info,
+                                           gpointer user_data) {
+  BenchProbeData *data = user_data;
+
+  data->frames_seen++;
+  if (data->frames_seen > data->warmup) {
+    gint64 now = g_get_monotonic_time();
+    g_array_append_val(data->timestamps, now);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static gint bench_compare_int64(gconstpointer a, gconstpointer b) {
+  gint64 left = *(const gint64 *)a;
+  gint64 right = *(const gint64 *)b;
+
+  return (left > right) - (left < right);
+}
+
+static gint64 bench_percentile(GArray *sorted, gdouble percentile) {
+  if (sorted->len == 0) {
+    return 0;
+  }
+
+  guint index = (guint)((sorted->len - 1) * percentile);
+  return g_array_index(sorted, gint64, index);
+}
+
+static gboolean bench_append_field(GQuark field_id, const GValue *value,
+                                   gpointer user_data) {
+  GString *json = user_data;
+  const gchar *name = g_quark_to_string(field_id);
+
+  if (G_VALUE_HOLDS_UINT64(value)) {
+    g_string_append_printf(json, ",\"%s\":%" G_GUINT64_FORMAT, name,
+                           g_value_get_uint64(value));
+  } else if (G_VALUE_HOLDS_INT64(value)) {
+    g_string_append_printf(json, ",\"%s\":%" G_GINT64_FORMAT, name,
+                           g_value_get_int64(value));
+  } else if (G_VALUE_HOLDS_DOUBLE(value)) {
+    g_string_append_printf(json, ",\"%s\":%.3f", name,
+                           g_value_get_double(value));
+  } else if (G_VALUE_HOLDS_UINT(value)) {
+    g_string_append_printf(json, ",\"%s\":%u", name, g_value_get_uint(value));
+  } else if (G_VALUE_HOLDS_INT(value)) {
+    g_string_append_printf(json, ",\"%s\":%d", name, g_value_get_int(value));
+  }
+
+  return TRUE;
+}
+
+static void bench_append_string(GString *json, const gchar *name,
+                                const gchar *value) {
+  gchar *escaped = g_strescape(value != NULL ? value : "", NULL);
+  g_string_append_printf(json, "\"%s\":\"%s\"", name, escaped);
+  g_free(escaped);
+}
+
+static GstElement *bench_build_pipeline(const BenchConfig *config,
+                                        GstElement **visualizer) {
+  GstElement *pipeline = gst_pipeline_new("bench");
+  GstElement *src = gst_element_factory_make("audiotestsrc", NULL);
+  GstElement *audio_filter = gst_element_factory_make("capsfilter", NULL);
+  GstElement *projectm = gst_element_factory_make("projectm", NULL);
+  GstElement *video_filter = gst_element_factory_make("capsfilter", NULL);
+  GstElement *sink = gst_element_factory_make("fakesink", NULL);
+
+  if (!src || !audio_filter || !projectm || !video_filter || !sink) {
+    g_printerr("Failed to create pipeline elements (is the projectm plugin "
+               "on the plugin path?)\n");
+    gst_clear_object(&src);
+    gst_clear_object(&audio_filter);
+    gst_clear_object(&projectm);
+    gst_clear_object(&video_filter);
+    gst_clear_object(&sink);
+    gst_object_unref(pipeline);
+    return NULL;
+  }
+
+  /* One audio buffer per video frame keeps the frame count exact. */
+  gint samples_per_buffer = BENCH_AUDIO_RATE / opt_fps;
+  gst_util_set_object_arg(G_OBJECT(src), "wave", "pink-noise");
+  g_object_set(src, "samplesperbuffer", samples_per_buffer, "num-buffers",
+               opt_frames + opt_warmup, "is-live", FALSE, NULL);
+
+  GstCaps *audio_caps = gst_caps_from_string(
+      "audio/x-raw, format=" GST_AUDIO_NE(S16) ", layout=interleaved, "
+      "channels=2, rate=44100, channel-mask=(bitmask)0x3");
+  g_object_set(audio_filter, "caps", audio_caps, NULL);
+  gst_caps_unref(audio_caps);
+
+  gint mesh_width = 0;
+  gint mesh_height = 0;
+  if (bench_parse_size(config->mesh, &mesh_width, &mesh_height)) {
+    gchar *mesh = g_strdup_printf("%d,%d", mesh_width, mesh_height);
+    g_object_set(projectm, "mesh-size", mesh, NULL);
+    g_free(mesh);
+  }
+  gst_util_set_object_arg(G_OBJECT(projectm), "readback-mode",
+                          config->readback_mode);
+  if (opt_preset != NULL) {
+    g_object_set(projectm, "preset", opt_preset, NULL);
+  }
+
+  GstCaps *video_caps = gst_caps_new_simple(
+      "video/x-raw", "format", G_TYPE_STRING, config->format, "width",
+      G_TYPE_INT, config->width, "height", G_TYPE_INT, config->height,
+      "framerate", GST_TYPE_FRACTION, opt_fps, 1, NULL);
+  g_object_set(video_filter, "caps", video_caps, NULL);
+  gst_caps_unref(video_caps);
+
+  g_object_set(sink, "sync", FALSE, NULL);
+
+  gst_bin_add_many(GST_BIN(pipeline), src, audio_filter, projectm,
+                   video_filter, sink, NULL);
+  if (!gst_element_link_many(src, audio_filter, projectm, video_filter, sink,
+                             NULL)) {
+    g_printerr("Failed to link benchmark pipeline\n");
+    gst_object_unref(pipeline);
+    return NULL;
+  }
+
+  *visualizer = projectm;
+  return pipeline;
+}
+
+static gboolean bench_run(const BenchConfig *config, GString *json) {
+  GstElement *projectm = NULL;
+  GstElement *pipeline = bench_build_pipeline(config, &projectm);
+  gboolean ok = TRUE;
+  gchar *error_message = NULL;
+
+  g_string_append_c(json, '{');
+  gchar *resolution = g_strdup_printf("%dx%d", config->width, config->height);
+  bench_append_string(json, "resolution", resolution);
+  g_free(resolution);
+  g_string_append_c(json, ',');
+  bench_append_string(json, "mesh", config->mesh);
+  g_string_append_c(json, ',');
+  bench_append_string(json, "format", config->format);
+  g_string_append_c(json, ',');
+  bench_append_string(json, "readback_mode", config->readback_mode);
+
+  if (pipeline == NULL) {
+    g_string_append(json, ",\"error\":\"pipeline construction failed\"}");
+    return FALSE;
+  }
+
+  BenchProbeData probe_data;
+  probe_data.timestamps = g_array_new(FALSE, FALSE, sizeof(gint64));
+  probe_data.frames_seen = 0;
+  probe_data.warmup = (guint)opt_warmup;
+
+  GstPad *src_pad = gst_element_get_static_pad(projectm, "src");
+  gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_BUFFER, bench_frame_probe,
+                    &probe_data, NULL);
+  gst_object_unref(src_pad);
+
+  gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+  GstBus *bus = gst_element_get_bus(pipeline);
+  GstMessage *msg = gst_bus_timed_pop_filtered(
+      bus, (GstClockTime)opt_timeout * GST_SECOND,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+
+  if (msg == NULL) {
+    error_message = g_strdup("timeout");
+    ok = FALSE;
+  } else if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+    GError *error = NULL;
+    gst_message_parse_error(msg, &error, NULL);
+    error_message = g_strdup(error->message);
+    g_clear_error(&error);
+    ok = FALSE;
+  }
+  gst_clear_message(&msg);
+  gst_object_unref(bus);
+
+  GstStructure *element_stats = NULL;
+  g_object_get(projectm, "stats", &element_stats, NULL);
+
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+
+  GArray *timestamps = probe_data.timestamps;
+  GArray *intervals = g_array_sized_new(FALSE, FALSE, sizeof(gint64),
+                                        timestamps->len);
+  for (guint i = 1; i < timestamps->len; i++) {
+    gint64 interval = g_array_index(timestamps, gint64, i) -
+                      g_array_index(timestamps, gint64, i - 1);
+    g_array_append_val(intervals, interval);
+  }
+  g_array_sort(intervals, bench_compare_int64);
+
+  gdouble fps = 0.0;
+  if (timestamps->len > 1) {
+    gint64 elapsed = g_array_index(timestamps, gint64, timestamps->len - 1) -
+                     g_array_index(timestamps, gint64, 0);
+    if (elapsed > 0) {
+      fps = (gdouble)(timestamps->len - 1) * G_USEC_PER_SEC / elapsed;
+    }
+  }
+
+  g_string_append_printf(json,
+                         ",\"frames\":%u,\"fps\":%.3f,"
+                         "\"interval_p50_us\":%" G_GINT64_FORMAT
+                         ",\"interval_p95_us\":%" G_GINT64_FORMAT
+                         ",\"interval_p99_us\":%" G_GINT64_FORMAT
+                         ",\"rss_kb\":%" G_GINT64_FORMAT
+                         ",\"peak_rss_kb\":%" G_GINT64_FORMAT,
+                         timestamps->len, fps,
+                         bench_percentile(intervals, 0.50),
+                         bench_percentile(intervals, 0.95),
+                         bench_percentile(intervals, 0.99),
+                         bench_read_proc_status_kb("VmRSS"),
+                         bench_read_proc_status_kb("VmHWM"));
+
+  if (element_stats != NULL) {
+    gst_structure_foreach(element_stats, bench_append_field, json);
+    gst_structure_free(element_stats);
+  }
+
+  if (error_message != NULL) {
+    g_string_append_c(json, ',');
+    bench_append_string(json, "error", error_message);
+    g_free(error_message);
+  }
+  g_string_append_c(json, '}');
+
+  g_array_free(intervals, TRUE);
+  g_array_free(timestamps, TRUE);
+  gst_object_unref(pipeline);
+
+  return ok;
+}
+
+int main(int argc, char *argv[]) {
+  GError *error = NULL;
+  GOptionContext *context =
+      g_option_context_new("- benchmark the projectm GStreamer element");
+
+  g_option_context_add_main_entries(context, bench_entries, NULL);
+  g_option_context_add_group(context, gst_init_get_option_group());
+
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    g_clear_error(&error);
+    g_option_context_free(context);
+    return 2;
+  }
+  g_option_context_free(context);
+
+  /* GL platform selection happens when the first pipeline starts, so the
+   * environment only needs to be in place before the first run. */
+  bench_setup_environment();
+  gst_init(NULL, NULL);
+
+  if (opt_plugin_path != NULL) {
+    gst_registry_scan_path(gst_registry_get(), opt_plugin_path);
+  }
+
+  FILE *out = stdout;
+  if (opt_output != NULL) {
+    out = fopen(opt_output, "w");
+    if (out == NULL) {
+      g_printerr("Unable to open %s for writing\n", opt_output);
+      return 2;
+    }
+  }
+
+  gchar **resolutions = g_strsplit(opt_resolutions, ",", -1);
+  gchar **meshes = g_strsplit(opt_mesh_sizes, ",", -1);
+  gchar **formats = g_strsplit(opt_formats, ",", -1);
+  gchar **modes = g_strsplit(opt_readback_modes, ",", -1);
+  gint failures = 0;
+
+  for (gchar **res = resolutions; *res != NULL; res++) {
+    BenchConfig config;
+
+    if (!bench_parse_size(*res, &config.width, &config.height)) {
+      g_printerr("Ignoring invalid resolution '%s'\n", *res);
+      continue;
+    }
+
+    for (gchar **mesh = meshes; *mesh != NULL; mesh++) {
+      for (gchar **format = formats; *format != NULL; format++) {
+        for (gchar **mode = modes; *mode != NULL; mode++) {
+          GString *json = g_string_new(NULL);
+
+          config.mesh = *mesh;
+          config.format = *format;
+          config.readback_mode = *mode;
+
+          if (!bench_run(&config, json)) {
+            failures++;
+          }
+
+          fprintf(out, "%s\n", json->str);
+          fflush(out);
+          g_string_free(json, TRUE);
+        }
+      }
+    }
+  }
+
+  g_strfreev(resolutions);
+  g_strfreev(meshes);
+  g_strfreev(formats);
+  g_strfreev(modes);
+
+  if (out != stdout) {
+    fclose(out);
+  }
+
+  gst_deinit();
+  return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,343 @@
+/*
+ * gstprojectm-microbench: times the CPU-side hot paths of the projectm
+ * element (timeline parsing and lookup, preset path resolution, caps parsing
+ * and frame copies) without a GL context, printing one JSON object per
+ * benchmark. Results are cross-checked against straightforward reference
+ * implementations and the process exits non-zero on any mismatch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gst/gst.h>
+
+#include "caps.h"
+#include "frame.h"
+#include "timeline.h"
+
+#define MICROBENCH_TIMELINE_ENTRIES 100000
+#define MICROBENCH_SEGMENT_SECONDS 2.0
+#define MICROBENCH_FRAME_WIDTH 3840
+#define MICROBENCH_FRAME_HEIGHT 2160
+
+static gint opt_iterations = 0;
+static gint failures = 0;
+
+static GOptionEntry microbench_entries[] = {
+    {"iterations", 'i', 0, G_OPTION_ARG_INT, &opt_iterations,
+     "Override the iteration count of every benchmark", "N"},
+    {NULL}};
+
+static guint microbench_iterations(guint fallback) {
+  return opt_iterations > 0 ? (guint)opt_iterations : fallback;
+}
+
+static void microbench_report_full(const gchar *name, guint iterations,
+                                   gint64 elapsed_us, gdouble bytes_per_op,
+                                   const gchar *impl, guint threads) {
+  gdouble ns_per_op = (gdouble)elapsed_us * 1000.0 / MAX(iterations, 1);
+
+  printf("{\"benchmark\":\"%s\",\"iterations\":%u,\"ns_per_op\":%.1f", name,
+         iterations, ns_per_op);
+  if (bytes_per_op > 0.0 && ns_per_op > 0.0) {
+    printf(",\"gb_per_s\":%.3f", bytes_per_op / ns_per_op);
+  }
+  if (impl != NULL) {
+    printf(",\"impl\":\"%s\"", impl);
+  }
+  if (threads > 0) {
+    printf(",\"threads\":%u", threads);
+  }
+  printf("}\n");
+  fflush(stdout);
+}
+
+static void microbench_report(const gchar *name, guint iterations,
+                              gint64 elapsed_us, gdouble bytes_per_op) {
+  microbench_report_full(name, iterations, elapsed_us, bytes_per_op, NULL, 0);
+}
+
+static void microbench_fail(const gchar *name, const gchar *detail) {
+  g_printerr("%s: verification failed: %s\n", name, detail);
+  failures++;
+}
+
+static GKeyFile *microbench_build_timeline(guint entries) {
+  GString *data = g_string_sized_new(entries * 64);
+
+  /* Emit segments in reverse so the parser also has to sort. */
+  for (guint i = entries; i > 0; i--) {
+    guint index = i - 1;
+    g_string_append_printf(data,
+                           "[segment-%u]\nstart=%.3f\nduration=%.3f\n"
+                           "preset=pack/preset-%u.milk\n",
+                           index, index * MICROBENCH_SEGMENT_SECONDS,
+                           MICROBENCH_SEGMENT_SECONDS, index);
+  }
+
+  GKeyFile *key_file = g_key_file_new();
+  g_key_file_load_from_data(key_file, data->str, data->len, G_KEY_FILE_NONE,
+                            NULL);
+  g_string_free(data, TRUE);
+
+  return key_file;
+}
+
+static gint microbench_reference_index(GPtrArray *entries, gdouble elapsed) {
+  gint result = -1;
+
+  for (guint i = 0; i < entries->len; i++) {
+    GstProjectMTimelineEntry *entry = g_ptr_array_index(entries, i);
+    if (entry->start_time <= elapsed + GST_PROJECTM_TIMELINE_EPSILON) {
+      result = (gint)i;
+    }
+  }
+
+  return result;
+}
+
+static GPtrArray *microbench_timeline_parse(void) {
+  const gchar *name = "timeline_parse_100k";
+  GKeyFile *key_file = microbench_build_timeline(MICROBENCH_TIMELINE_ENTRIES);
+  GPtrArray *entries = gst_projectm_timeline_entries_new();
+
+  gint64 start = g_get_monotonic_time();
+  gboolean parsed =
+      gst_projectm_timeline_parse(entries, key_file, name, NULL);
+  gint64 elapsed = g_get_monotonic_time() - start;
+
+  microbench_report(name, 1, elapsed, 0.0);
+  g_key_file_free(key_file);
+
+  if (!parsed || entries->len != MICROBENCH_TIMELINE_ENTRIES) {
+    microbench_fail(name, "unexpected segment count");
+  }
+
+  for (guint i = 1; i < entries->len; i++) {
+    GstProjectMTimelineEntry *prev = g_ptr_array_index(entries, i - 1);
+    GstProjectMTimelineEntry *entry = g_ptr_array_index(entries, i);
+    if (prev->start_time > entry->start_time) {
+      microbench_fail(name, "segments not sorted");
+      break;
+    }
+  }
+
+  return entries;
+}
+
+static void microbench_timeline_sequential(GPtrArray *entries) {
+  const gchar *name = "timeline_lookup_sequential_100k";
+  gdouble duration = MICROBENCH_TIMELINE_ENTRIES * MICROBENCH_SEGMENT_SECONDS;
+  guint iterations = microbench_iterations(1000000);
+  gdouble step = duration / iterations;
+  gint current = -1;
+
+  gint64 start = g_get_monotonic_time();
+  for (guint i = 0; i < iterations; i++) {
+    current =
+        gst_projectm_timeline_find_target_index(entries, current, i * step);
+  }
+  gint64 elapsed = g_get_monotonic_time() - start;
+
+  microbench_report(name, iterations, elapsed, 0.0);
+
+  if (current != microbench_reference_index(entries,
+                                            (iterations - 1) * step)) {
+    microbench_fail(name, "final index does not match reference");
+  }
+}
+
+static void microbench_timeline_random(GPtrArray *entries) {
+  const gchar *name = "timeline_lookup_random_100k";
+  gdouble duration = MICROBENCH_TIMELINE_ENTRIES * MICROBENCH_SEGMENT_SECONDS;
+  guint iterations = microbench_iterations(1000000);
+  GRand *rand = g_rand_new_with_seed(42);
+  gdouble *positions = g_new(gdouble, iterations);
+  gint *results = g_new(gint, iterations);
+
+  for (guint i = 0; i < iterations; i++) {
+    positions[i] = g_rand_double_range(rand, -1.0, duration + 1.0);
+  }
+
+  gint64 start = g_get_monotonic_time();
+  for (guint i = 0; i < iterations; i++) {
+    results[i] =
+        gst_projectm_timeline_find_target_index(entries, -1, positions[i]);
+  }
+  gint64 elapsed = g_get_monotonic_time() - start;
+
+  microbench_report(name, iterations, elapsed, 0.0);
+
+  for (guint i = 0; i < MIN(iterations, 200); i++) {
+    if (results[i] != microbench_reference_index(entries, positions[i])) {
+      microbench_fail(name, "index does not match reference");
+      break;
+    }
+  }
+
+  g_free(results);
+  g_free(positions);
+  g_rand_free(rand);
+}
+
+static void microbench_resolve_preset_path(void) {
+  const gchar *name = "resolve_preset_path";
+  guint iterations = microbench_iterations(200000);
+  gsize total = 0;
+
+  gint64 start = g_get_monotonic_time();
+  for (guint i = 0; i < iterations; i++) {
+    gchar *resolved = gst_projectm_resolve_preset_path(
+        "/usr/local/share/projectM/presets", "pack/../pack/preset.milk");
+    total += strlen(resolved);
+    g_free(resolved);
+  }
+  gint64 elapsed = g_get_monotonic_time() - start;
+
+  microbench_report(name, iterations, elapsed, 0.0);
+
+  gchar *resolved = gst_projectm_resolve_preset_path(
+      "/usr/local/share/projectM/presets", "pack/../pack/preset.milk");
+  if (g_strcmp0(resolved,
+                "/usr/local/share/projectM/presets/pack/preset.milk") != 0 ||
+      total == 0) {
+    microbench_fail(name, "unexpected resolved path");
+  }
+  g_free(resolved);
+}
+
+static void microbench_caps(void) {
+  const gchar *name = "caps_from_template";
+  guint iterations = microbench_iterations(20000);
+
+  gint64 start = g_get_monotonic_time();
+  for (guint i = 0; i < iterations; i++) {
+    GstCaps *audio = gst_caps_from_string(get_audio_sink_cap(0));
+    GstCaps *video = gst_caps_from_string(get_video_src_cap(0));
+    gst_caps_unref(audio);
+    gst_caps_unref(video);
+  }
+  gint64 elapsed = g_get_monotonic_time() - start;
+
+  microbench_report(name, iterations, elapsed, 0.0);
+
+  GstCaps *video = gst_caps_from_string(get_video_src_cap(0));
+  if (video == NULL || gst_caps_is_empty(video)) {
+    microbench_fail(name, "video template does not parse");
+  }
+  gst_clear_caps(&video);
+}
+
+static void microbench_frame_copy(const gchar *name, gsize width, gsize height,
+                                  gsize dest_padding,
+                                  GstProjectMFrameCopyFlags flags,
+                                  const guint8 *swizzle,
+                                  GstProjectMFrameCopyPool *pool) {
+  gsize row_size = width * 4;
+  gsize dest_stride = row_size + dest_padding;
+  guint iterations = microbench_iterations(100);
+
+  guint8 *src = g_malloc(row_size * height);
+  guint8 *dest = g_malloc0(dest_stride * height);
+
+  for (gsize i = 0; i < row_size * height; i++) {
+    src[i] = (guint8)(i * 31 + (i >> 12));
+  }
+
+  gint64 start = g_get_monotonic_time();
+  for (guint i = 0; i < iterations; i++) {
+    if (pool != NULL) {
+      gst_projectm_frame_copy_pool_copy(pool, dest, dest_stride, src,
+                                        row_size, width, height, flags,
+                                        swizzle);
+    } else {
+      gst_projectm_frame_copy_full(dest, dest_stride, src, row_size, width,
+                                   height, flags, swizzle);
+    }
+  }
+  gint64 elapsed = g_get_monotonic_time() - start;
+
+  microbench_report_full(name, iterations, elapsed,
+                         (gdouble)(row_size * height),
+                         gst_projectm_frame_copy_impl_name(),
+                         pool != NULL
+                             ? gst_projectm_frame_copy_pool_get_threads(pool)
+                             : 1);
+
+  for (gsize y = 0; y < height; y++) {
+    gsize dest_row = (flags & GST_PROJECTM_FRAME_COPY_FLIP) ? height - 1 - y : y;
+    const guint8 *expected = src + (y * row_size);
+    const guint8 *actual = dest + (dest_row * dest_stride);
+    gboolean match = TRUE;
+
+    if (swizzle == NULL) {
+      match = memcmp(actual, expected, row_size) == 0;
+    } else {
+      for (gsize x = 0; x < row_size && match; x++) {
+        match = actual[x] == expected[(x & ~(gsize)3) + swizzle[x & 3]];
+      }
+    }
+
+    if (!match) {
+      microbench_fail(name, "row contents differ");
+      break;
+    }
+  }
+
+  g_free(dest);
+  g_free(src);
+}
+
+int main(int argc, char *argv[]) {
+  GError *error = NULL;
+  GOptionContext *context =
+      g_option_context_new("- microbenchmarks for projectm CPU paths");
+
+  g_option_context_add_main_entries(context, microbench_entries, NULL);
+  g_option_context_add_group(context, gst_init_get_option_group());
+
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    g_clear_error(&error);
+    g_option_context_free(context);
+    return 2;
+  }
+  g_option_context_free(context);
+
+  GPtrArray *entries = microbench_timeline_parse();
+  microbench_timeline_sequential(entries);
+  microbench_timeline_random(entries);
+  g_ptr_array_free(entries, TRUE);
+
+  microbench_resolve_preset_path();
+  microbench_caps();
+  static const guint8 reverse[4] = {3, 2, 1, 0};
+  microbench_frame_copy("frame_copy_4k_packed", MICROBENCH_FRAME_WIDTH,
+                        MICROBENCH_FRAME_HEIGHT, 0,
+                        GST_PROJECTM_FRAME_COPY_NONE, NULL, NULL);
+  microbench_frame_copy("frame_copy_4k_strided", MICROBENCH_FRAME_WIDTH,
+                        MICROBENCH_FRAME_HEIGHT, 256,
+                        GST_PROJECTM_FRAME_COPY_NONE, NULL, NULL);
+  microbench_frame_copy("frame_copy_4k_flip", MICROBENCH_FRAME_WIDTH,
+                        MICROBENCH_FRAME_HEIGHT, 0,
+                        GST_PROJECTM_FRAME_COPY_FLIP, NULL, NULL);
+  microbench_frame_copy("frame_copy_4k_swizzle_flip", MICROBENCH_FRAME_WIDTH,
+                        MICROBENCH_FRAME_HEIGHT, 256,
+                        GST_PROJECTM_FRAME_COPY_FLIP, reverse, NULL);
+
+  GstProjectMFrameCopyPool *pool = gst_projectm_frame_copy_pool_new(0);
+  microbench_frame_copy("frame_copy_4k_swizzle_flip_parallel",
+                        MICROBENCH_FRAME_WIDTH, MICROBENCH_FRAME_HEIGHT, 256,
+                        GST_PROJECTM_FRAME_COPY_FLIP, reverse, pool);
+  microbench_frame_copy("frame_copy_8k_swizzle_flip", MICROBENCH_FRAME_WIDTH * 2,
+                        MICROBENCH_FRAME_HEIGHT * 2, 0,
+                        GST_PROJECTM_FRAME_COPY_FLIP, reverse, NULL);
+  microbench_frame_copy("frame_copy_8k_swizzle_flip_parallel",
+                        MICROBENCH_FRAME_WIDTH * 2, MICROBENCH_FRAME_HEIGHT * 2,
+                        0, GST_PROJECTM_FRAME_COPY_FLIP, reverse, pool);
+  gst_projectm_frame_copy_pool_free(pool);
+
+  gst_deinit();
+  return failures > 0 ? 1 : 0;
+}
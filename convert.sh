@@ -18,6 +18,8 @@ FORCE_GPU=0
 FORCE_XVFB=0
 FORCE_GL_DOWNLOAD=${FORCE_GL_DOWNLOAD:-0}
 MESH_CUSTOM=0
+# llvmpipe rasterizer threads when rendering on the CPU, 0 for one per CPU
+CPU_THREADS=${CPU_THREADS:-0}
 
 # Process IDs for the gst-launch process and X servers
 GST_PID=""
@@ -208,8 +210,9 @@ start_x_with_gpu() {
                 if command -v glxinfo >/dev/null 2>&1; then
                     GLX_TEST=$(glxinfo 2>&1 | grep -i "OpenGL renderer" | head -1)
                     echo "GLX renderer: $GLX_TEST"
-                    # Only accept real GPU renderers (NVIDIA, AMD, Intel)
-                    # Do NOT accept llvmpipe - gst-projectm outputs black frames with software rendering
+                    # Only accept real GPU renderers (NVIDIA, AMD, Intel); llvmpipe here
+                    # means this method did not reach the GPU. The CPU path is set up
+                    # explicitly below once every GPU method has been tried.
                     if echo "$GLX_TEST" | grep -qiE "nvidia|amd|intel|radeon" && ! echo "$GLX_TEST" | grep -qi "llvmpipe"; then
                         echo "GPU rendering confirmed: $GLX_TEST"
                         RENDER_MODE="Xorg modesetting (GPU)"
@@ -392,8 +395,8 @@ except Exception as e:
 
         # If no GPU method worked, fall back to Mesa software rendering
         # NOTE: This is common on Vast.ai where nvidia-drm modeset=N prevents GPU OpenGL.
-        # WARNING: Mesa llvmpipe produces BLACK FRAMES with gst-projectm plugin!
-        # However, NVENC hardware encoding (nvh264enc) may still work - it's independent of GL.
+        # projectm renders with its CPU profile there, and NVENC hardware encoding
+        # (nvh264enc) may still work - it's independent of GL.
         if [ "$GPU_METHOD_FOUND" -eq 0 ]; then
             echo ""
             echo "❌ CRITICAL: No GPU OpenGL method found!"
@@ -402,10 +405,9 @@ except Exception as e:
             echo "   - Method 2 (Xvfb + NVIDIA GLX): requires nvidia GLX libs + DRI access"
             echo "   - Method 3 (EGL): requires nvidia-drm modeset=1"
             echo ""
-            echo "⚠️  WARNING: Mesa llvmpipe produces BLACK FRAMES with gst-projectm!"
-            echo "   The output video will likely be all black."
-            echo "   To fix: Use a host with nvidia-drm modeset=Y"
-            echo "           or ensure NVIDIA GLX libraries are properly configured."
+            echo "Falling back to Mesa llvmpipe (CPU rendering, slower than a GPU)."
+            echo "   For GPU rendering use a host with nvidia-drm modeset=Y"
+            echo "   or ensure NVIDIA GLX libraries are properly configured."
             USE_NVIDIA_GPU=0
             export MESA_FALLBACK=1
         fi
@@ -503,6 +505,7 @@ start_xvfb_fallback() {
     export DISPLAY=:${DISPLAY_NUM}
 
     # Force Mesa software rendering
+    export MESA_FALLBACK=1
     export LIBGL_ALWAYS_SOFTWARE=1
     export GALLIUM_DRIVER=llvmpipe
     export LIBGL_DRIVERS_PATH=/usr/lib/x86_64-linux-gnu/dri
@@ -661,7 +664,8 @@ show_help() {
     echo "  -p, --preset DIR       Path to projectM preset directory (default: $PRESET_PATH)"
     echo "  -t, --texture DIR      Path to projectM texture directory (default: $TEXTURE_DIR)"
     echo "  -d, --duration SEC     Preset duration in seconds (default: $PRESET_DURATION)"
-    echo "  --mesh WxH             Mesh size (default: ${MESH_X}x${MESH_Y})"
+    echo "  --mesh WxH             Mesh size (default: ${MESH_X}x${MESH_Y}, or projectm's CPU default on llvmpipe)"
+    echo "  --cpu-threads N        llvmpipe rasterizer threads when rendering on the CPU (default: one per CPU)"
     echo "  --video-size WxH       Output video size (default: ${VIDEO_WIDTH}x${VIDEO_HEIGHT})"
     echo "  -r, --framerate FPS    Output video framerate (default: $FRAMERATE)"
     echo "  -b, --bitrate KBPS     Output video bitrate in kbps (default: $BITRATE)"
@@ -711,6 +715,10 @@ while [[ $# -gt 0 ]]; do
             MESH_CUSTOM=1
             shift 2
             ;;
+        --cpu-threads)
+            CPU_THREADS="$2"
+            shift 2
+            ;;
         --video-size)
             VIDEO_SIZE="$2"
             VIDEO_WIDTH=$(echo "$VIDEO_SIZE" | cut -d'x' -f1)
@@ -902,7 +910,16 @@ if [ -n "$TIMELINE_PROPERTY" ]; then
 else
     PROJECTM_ARGS+=("preset-duration=$PRESET_DURATION")
 fi
-PROJECTM_ARGS+=("mesh-size=${MESH_X},${MESH_Y}")
+if [ "${MESA_FALLBACK:-0}" = "1" ]; then
+    # projectm detects llvmpipe and switches to its CPU render profile; let it
+    # pick the CPU mesh unless one was given
+    PROJECTM_ARGS+=("cpu-threads=${CPU_THREADS}")
+    if [ $MESH_CUSTOM -eq 1 ]; then
+        PROJECTM_ARGS+=("mesh-size=${MESH_X},${MESH_Y}")
+    fi
+else
+    PROJECTM_ARGS+=("mesh-size=${MESH_X},${MESH_Y}")
+fi
 # Disable easter egg (W logo that appears at startup)
 PROJECTM_ARGS+=("easter-egg=0")
 
@@ -925,7 +942,7 @@ if [ "$use_gpu" -eq 1 ]; then
 else
     # CPU/Mesa mode: projectm outputs raw video
     echo "  Testing CPU/Mesa pipeline..."
-    TEST_PIPELINE="audiotestsrc num-buffers=30 ! audioconvert ! audio/x-raw,format=S16LE,channels=2,rate=44100 ! projectm preset=$PRESET_PATH mesh-size=32,24 ! video/x-raw,width=320,height=240,framerate=30/1 ! videoconvert ! pngenc ! filesink location=$TEST_PNG"
+    TEST_PIPELINE="audiotestsrc num-buffers=30 ! audioconvert ! audio/x-raw,format=S16LE,channels=2,rate=44100 ! projectm preset=$PRESET_PATH ! video/x-raw,width=320,height=240,framerate=30/1 ! videoconvert ! pngenc ! filesink location=$TEST_PNG"
 fi
 
 if timeout 15 gst-launch-1.0 -e $TEST_PIPELINE 2>&1; then
@@ -947,16 +964,14 @@ else
     PREFLIGHT_FAILED=1
 fi
 
-# If GPU mode test failed, do NOT fall back to Mesa - it produces black frames!
+# If GPU mode test failed, warn but keep the GPU setup
 if [ "$PREFLIGHT_FAILED" -eq 1 ] && [ "$use_gpu" -eq 1 ]; then
     echo ""
     echo "❌ GPU preflight test failed!"
     echo ""
-    echo "⚠️  IMPORTANT: Mesa/llvmpipe fallback is NOT viable for gst-projectm."
-    echo "   The gst-projectm plugin outputs BLACK FRAMES with software rendering."
-    echo ""
-    echo "   The rendering will proceed but will likely produce black video."
-    echo "   To fix this, ensure the Vast.ai/RunPod host has:"
+    echo "   The rendering will proceed, but may fail or produce black video."
+    echo "   For a CPU-only host, run with --force-xvfb to render on llvmpipe."
+    echo "   To fix GPU rendering, ensure the Vast.ai/RunPod host has:"
     echo "   1. NVIDIA GLX libraries accessible"
     echo "   2. DRI render node access (/dev/dri/renderD*)"
     echo "   3. Or nvidia-drm modeset=Y for proper EGL support"
@@ -1000,9 +1015,11 @@ nvh264)
         ;;
 esac
 
-AUDIO_QUEUE_OPTS="queue max-size-buffers=2048 max-size-bytes=0 max-size-time=0"
-# ProjectM needs larger buffers to avoid stalls when processing audio for visualization
-VIDEO_QUEUE_OPTS="queue max-size-buffers=256 max-size-bytes=0 max-size-time=0"
+# projectm forwards its input on audio_src interleaved with the video it
+# renders, so the queues only absorb encoder latency. Audio is bounded by
+# time (a few hundred KB), video by a handful of raw frames.
+AUDIO_QUEUE_OPTS="queue max-size-buffers=0 max-size-bytes=0 max-size-time=3000000000"
+VIDEO_QUEUE_OPTS="queue max-size-buffers=8 max-size-bytes=0 max-size-time=0"
 H264_POST_ENCODE_PIPELINE="h264parse config-interval=-1 ! video/x-h264,stream-format=avc,alignment=au"
 
 # Increase GST_DEBUG for ProjectM visualization issues
@@ -1013,22 +1030,22 @@ OUTPUT_DIR=$(dirname "$OUTPUT_FILE")
 mkdir -p "$OUTPUT_DIR"
 
 echo "Starting GStreamer pipeline..."
-echo "Pipeline: filesrc -> decodebin -> audioconvert/audioresample -> tee"
-echo "  Branch 1 (audio): -> AAC encoder -> muxer"
-echo "  Branch 2 (video): -> ProjectM -> ${ENCODER} encoder -> muxer"
+echo "Pipeline: filesrc -> decodebin -> audioconvert/audioresample -> ProjectM"
+echo "  video: ProjectM -> ${ENCODER} encoder -> muxer"
+echo "  audio: ProjectM audio_src -> AAC encoder -> muxer"
 
 # Run the actual conversion
 # Note: ProjectM requires S16LE audio format, not F32LE
-# We decode audio once, then split: one branch converts to F32LE for AAC, other stays S16LE for ProjectM
+# We decode audio once; ProjectM passes it on through audio_src, which is
+# converted to F32LE for AAC
 gst-launch-1.0 -e \
   filesrc location="$INPUT_FILE" ! \
     decodebin ! audioconvert ! audioresample ! \
     audio/x-raw,format=S16LE,channels=2,rate=44100 ! \
-    tee name=t \
-      t. ! $AUDIO_QUEUE_OPTS ! audioconvert ! audio/x-raw,format=F32LE ! avenc_aac bitrate=320000 ! queue ! mux. \
-      t. ! $VIDEO_QUEUE_OPTS ! projectm ${PROJECTM_ARGS[@]} ! \
-            ${ENCODER_PIPELINE} ! \
-            ${H264_POST_ENCODE_PIPELINE} ! queue ! mux. \
+    projectm name=pm ${PROJECTM_ARGS[@]} ! $VIDEO_QUEUE_OPTS ! \
+      ${ENCODER_PIPELINE} ! \
+      ${H264_POST_ENCODE_PIPELINE} ! queue ! mux. \
+    pm.audio_src ! $AUDIO_QUEUE_OPTS ! audioconvert ! audio/x-raw,format=F32LE ! avenc_aac bitrate=320000 ! queue ! mux. \
     mp4mux name=mux faststart=true ! filesink location="$OUTPUT_FILE" &
 
 GST_PID=$!
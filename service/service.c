@@ -0,0 +1,555 @@
+/*
+ * gstprojectm-service: keeps a pool of warmed audio-to-video pipelines and
+ * renders jobs submitted over a local UNIX socket.
+ *
+ * Every pipeline is built once and taken through a warm-up render, which
+ * creates its GL context, initialises projectM and compiles the shaders.
+ * Between jobs pipelines only go back to READY, where the projectm element
+ * keeps all of that and merely resets its stream state, so a job starts in
+ * milliseconds instead of paying convert.sh's start-up on every request.
+ *
+ * Protocol: a client connects, sends one "key=value" line per setting and
+ * an empty line, then reads a single reply line, "ok <milliseconds>" or
+ * "error <message>". Keys:
+ *
+ *   input=PATH          audio file to render (required)
+ *   output=PATH         MP4 file to write (required)
+ *   timeline=PATH       timeline .ini file, as the timeline-path property
+ *   projectm.NAME=VALUE any other projectm property, for this job only;
+ *                       properties read only when projectM is created
+ *                       (preset, texture-dir, mesh-size, ...) are refused,
+ *                       as the warmed instance would ignore them
+ *
+ * Jobs wait for a free pipeline when all are busy.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gio/gio.h>
+#include <gio/gunixsocketaddress.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+
+#ifndef GST_PROJECTM_SERVICE_PLUGIN_DIR
+#define GST_PROJECTM_SERVICE_PLUGIN_DIR NULL
+#endif
+
+#define SERVICE_WARMUP_SECONDS 1
+#define SERVICE_AUDIO_RATE 44100
+#define SERVICE_MAX_REQUEST_LINES 256
+
+typedef struct {
+  gchar *name;
+  GValue value;
+} ServiceOverride;
+
+typedef struct {
+  guint index;
+  GstElement *pipeline;
+  GstElement *filesrc;
+  GstElement *filesink;
+  GstElement *audio_in;
+  GstElement *projectm;
+  /* Service-wide property values replaced by the current job. */
+  GArray *overrides;
+} ServiceSlot;
+
+static gchar *opt_socket = "/tmp/gstprojectm.sock";
+static gint opt_pipelines = 1;
+static gint opt_width = 1920;
+static gint opt_height = 1080;
+static gint opt_fps = 60;
+static gchar *opt_preset = NULL;
+static gchar *opt_texture_dir = NULL;
+static gchar *opt_video_encoder = "x264enc speed-preset=veryfast";
+static gchar *opt_audio_encoder = "avenc_aac bitrate=320000";
+static gint opt_timeout = 10800;
+static gboolean opt_surfaceless = FALSE;
+static gboolean opt_software = FALSE;
+static gchar *opt_plugin_path = GST_PROJECTM_SERVICE_PLUGIN_DIR;
+
+static GOptionEntry service_entries[] = {
+    {"socket", 's', 0, G_OPTION_ARG_FILENAME, &opt_socket,
+     "UNIX socket to accept jobs on", "PATH"},
+    {"pipelines", 'j', 0, G_OPTION_ARG_INT, &opt_pipelines,
+     "Number of warmed pipelines, i.e. concurrent jobs", "N"},
+    {"width", 0, 0, G_OPTION_ARG_INT, &opt_width, "Output width", "PIXELS"},
+    {"height", 0, 0, G_OPTION_ARG_INT, &opt_height, "Output height",
+     "PIXELS"},
+    {"fps", 0, 0, G_OPTION_ARG_INT, &opt_fps, "Output frame rate", "N"},
+    {"preset", 'p', 0, G_OPTION_ARG_FILENAME, &opt_preset,
+     "Preset file or directory", "PATH"},
+    {"texture-dir", 't', 0, G_OPTION_ARG_FILENAME, &opt_texture_dir,
+     "projectM texture directory", "DIR"},
+    {"video-encoder", 0, 0, G_OPTION_ARG_STRING, &opt_video_encoder,
+     "H.264 encoder and its properties, in gst-launch syntax", "ELEMENT"},
+    {"audio-encoder", 0, 0, G_OPTION_ARG_STRING, &opt_audio_encoder,
+     "AAC encoder and its properties, in gst-launch syntax", "ELEMENT"},
+    {"timeout", 0, 0, G_OPTION_ARG_INT, &opt_timeout,
+     "Seconds before a job is aborted", "SECONDS"},
+    {"surfaceless", 0, 0, G_OPTION_ARG_NONE, &opt_surfaceless,
+     "Use EGL surfaceless rendering into an FBO", NULL},
+    {"software", 0, 0, G_OPTION_ARG_NONE, &opt_software,
+     "Force Mesa llvmpipe software rendering", NULL},
+    {"plugin-path", 0, 0, G_OPTION_ARG_FILENAME, &opt_plugin_path,
+     "Directory to load the projectm plugin from", "DIR"},
+    {NULL}};
+
+/* Free pipelines; a job pops one, blocking while all are busy. */
+static GAsyncQueue *idle_slots = NULL;
+
+static void service_setup_environment(void) {
+  /* Same environment convert.sh uses for headless EGL; only set what the
+   * caller has not overridden. */
+  if (opt_surfaceless) {
+    g_setenv("GST_GL_PLATFORM", "egl", FALSE);
+    g_setenv("GST_GL_WINDOW", "surfaceless", FALSE);
+    g_setenv("GST_GL_EGL_PLATFORM", "surfaceless", FALSE);
+    g_setenv("EGL_PLATFORM", "surfaceless", FALSE);
+    g_setenv("GST_PROJECTM_FORCE_FBO", "1", FALSE);
+  }
+
+  if (opt_software) {
+    g_setenv("LIBGL_ALWAYS_SOFTWARE", "1", FALSE);
+    g_setenv("GALLIUM_DRIVER", "llvmpipe", FALSE);
+  }
+}
+
+static void service_decoder_pad_added(GstElement *decoder, GstPad *pad,
+                                      gpointer user_data) {
+  ServiceSlot *slot = user_data;
+  GstPad *sink = gst_element_get_static_pad(slot->audio_in, "sink");
+  GstCaps *caps = gst_pad_get_current_caps(pad);
+
+  /* decodebin adds its pads again for every job, so the link is made here
+   * rather than once by gst_parse_launch(). */
+  if (!gst_pad_is_linked(sink) &&
+      (caps == NULL ||
+       g_str_has_prefix(
+           gst_structure_get_name(gst_caps_get_structure(caps, 0)),
+           "audio/"))) {
+    if (gst_pad_link(pad, sink) != GST_PAD_LINK_OK) {
+      g_printerr("Pipeline %u: failed to link decoded audio\n", slot->index);
+    }
+  }
+
+  gst_clear_caps(&caps);
+  gst_object_unref(sink);
+}
+
+static ServiceSlot *service_slot_new(guint index, GError **error) {
+  /* Mirrors the convert.sh pipeline: projectm forwards its input on
+   * audio_src interleaved with the video it renders, so the queues only
+   * absorb encoder latency. */
+  gchar *description = g_strdup_printf(
+      "filesrc name=src ! decodebin name=dec "
+      "audioconvert name=ain ! audioresample ! "
+      "audio/x-raw,format=S16LE,channels=2,rate=%d ! "
+      "projectm name=projectm ! "
+      "video/x-raw,width=%d,height=%d,framerate=%d/1 ! "
+      "queue max-size-buffers=8 max-size-bytes=0 max-size-time=0 ! "
+      "videoconvert ! %s ! h264parse config-interval=-1 ! "
+      "video/x-h264,stream-format=avc,alignment=au ! queue ! mux. "
+      "projectm.audio_src ! "
+      "queue max-size-buffers=0 max-size-bytes=0 max-size-time=3000000000 ! "
+      "audioconvert ! audio/x-raw,format=F32LE ! %s ! queue ! mux. "
+      "mp4mux name=mux faststart=true ! filesink name=sink",
+      SERVICE_AUDIO_RATE, opt_width, opt_height, opt_fps, opt_video_encoder,
+      opt_audio_encoder);
+  GstElement *pipeline = gst_parse_launch(description, error);
+
+  g_free(description);
+  if (pipeline == NULL) {
+    return NULL;
+  }
+
+  ServiceSlot *slot = g_new0(ServiceSlot, 1);
+  slot->index = index;
+  slot->pipeline = pipeline;
+  slot->filesrc = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+  slot->filesink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+  slot->audio_in = gst_bin_get_by_name(GST_BIN(pipeline), "ain");
+  slot->projectm = gst_bin_get_by_name(GST_BIN(pipeline), "projectm");
+  slot->overrides = g_array_new(FALSE, TRUE, sizeof(ServiceOverride));
+
+  GstElement *decoder = gst_bin_get_by_name(GST_BIN(pipeline), "dec");
+  g_signal_connect(decoder, "pad-added",
+                   G_CALLBACK(service_decoder_pad_added), slot);
+  gst_object_unref(decoder);
+
+  if (opt_preset != NULL) {
+    g_object_set(slot->projectm, "preset", opt_preset, NULL);
+  }
+  if (opt_texture_dir != NULL) {
+    g_object_set(slot->projectm, "texture-dir", opt_texture_dir, NULL);
+  }
+
+  return slot;
+}
+
+/* projectm properties that only take effect when projectM is created. The
+ * pipelines keep their instance between jobs, so a job cannot change them. */
+static const gchar *const service_creation_properties[] = {
+    "preset",
+    "texture-dir",
+    "preset-index",
+    "texture-prefetch-budget",
+    "compress-textures",
+    "enable-playlist",
+    "shuffle-presets",
+    "mesh-size",
+    "render-profile",
+    "cpu-threads",
+    "beat-sensitivity",
+    "hard-cut-duration",
+    "hard-cut-enabled",
+    "hard-cut-sensitivity",
+    "soft-cut-duration",
+    "preset-duration",
+    "aspect-correction",
+    "easter-egg",
+    "preset-locked",
+    NULL};
+
+/* Remembers the service-wide value of a property before a job changes it. */
+static gboolean service_slot_override(ServiceSlot *slot, const gchar *name,
+                                      const gchar *value, GString *error) {
+  GParamSpec *pspec =
+      g_object_class_find_property(G_OBJECT_GET_CLASS(slot->projectm), name);
+
+  if (pspec == NULL || !(pspec->flags & G_PARAM_WRITABLE)) {
+    g_string_printf(error, "unknown projectm property '%s'", name);
+    return FALSE;
+  }
+
+  if (g_strv_contains(service_creation_properties, pspec->name)) {
+    g_string_printf(error,
+                    "projectm property '%s' is fixed for the service; set it "
+                    "when starting gstprojectm-service",
+                    pspec->name);
+    return FALSE;
+  }
+
+  ServiceOverride override = {g_strdup(pspec->name), G_VALUE_INIT};
+  g_value_init(&override.value, pspec->value_type);
+  g_object_get_property(G_OBJECT(slot->projectm), pspec->name,
+                        &override.value);
+  g_array_append_val(slot->overrides, override);
+
+  gst_util_set_object_arg(G_OBJECT(slot->projectm), pspec->name, value);
+  return TRUE;
+}
+
+static void service_slot_restore(ServiceSlot *slot) {
+  /* In reverse, so a property set twice ends at its original value. */
+  for (guint i = slot->overrides->len; i > 0; i--) {
+    ServiceOverride *override =
+        &g_array_index(slot->overrides, ServiceOverride, i - 1);
+
+    g_object_set_property(G_OBJECT(slot->projectm), override->name,
+                          &override->value);
+    g_value_unset(&override->value);
+    g_free(override->name);
+  }
+
+  g_array_set_size(slot->overrides, 0);
+}
+
+/* Renders input to output on a READY pipeline and returns it to READY. */
+static gboolean service_slot_run(ServiceSlot *slot, const gchar *input,
+                                 const gchar *output, GString *error) {
+  gboolean ok = TRUE;
+
+  g_object_set(slot->filesrc, "location", input, NULL);
+  g_object_set(slot->filesink, "location", output, NULL);
+
+  if (gst_element_set_state(slot->pipeline, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_FAILURE) {
+    g_string_assign(error, "pipeline failed to start");
+    ok = FALSE;
+  }
+
+  GstBus *bus = gst_element_get_bus(slot->pipeline);
+  GstMessage *msg = NULL;
+
+  if (ok) {
+    msg = gst_bus_timed_pop_filtered(bus, (GstClockTime)opt_timeout * GST_SECOND,
+                                     GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+    if (msg == NULL) {
+      g_string_assign(error, "timeout");
+      ok = FALSE;
+    } else if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+      GError *gerror = NULL;
+
+      gst_message_parse_error(msg, &gerror, NULL);
+      g_string_assign(error, gerror->message);
+      g_clear_error(&gerror);
+      ok = FALSE;
+    }
+  }
+
+  gst_clear_message(&msg);
+
+  /* READY rather than NULL keeps the GL context and projectM instance. */
+  gst_element_set_state(slot->pipeline, GST_STATE_READY);
+  gst_bus_set_flushing(bus, TRUE);
+  gst_bus_set_flushing(bus, FALSE);
+  gst_object_unref(bus);
+
+  return ok;
+}
+
+static gboolean service_write_silence(const gchar *path, GError **error) {
+  guint32 data_size = SERVICE_AUDIO_RATE * SERVICE_WARMUP_SECONDS * 4;
+  guint8 header[44];
+  gboolean ok;
+
+  /* 16-bit stereo PCM WAV header. */
+  memcpy(header, "RIFF", 4);
+  GST_WRITE_UINT32_LE(header + 4, 36 + data_size);
+  memcpy(header + 8, "WAVEfmt ", 8);
+  GST_WRITE_UINT32_LE(header + 16, 16);
+  GST_WRITE_UINT16_LE(header + 20, 1);
+  GST_WRITE_UINT16_LE(header + 22, 2);
+  GST_WRITE_UINT32_LE(header + 24, SERVICE_AUDIO_RATE);
+  GST_WRITE_UINT32_LE(header + 28, SERVICE_AUDIO_RATE * 4);
+  GST_WRITE_UINT16_LE(header + 32, 4);
+  GST_WRITE_UINT16_LE(header + 34, 16);
+  memcpy(header + 36, "data", 4);
+  GST_WRITE_UINT32_LE(header + 40, data_size);
+
+  gchar *contents = g_malloc0(sizeof(header) + data_size);
+  memcpy(contents, header, sizeof(header));
+  ok = g_file_set_contents(path, contents, sizeof(header) + data_size, error);
+  g_free(contents);
+
+  return ok;
+}
+
+/* Takes every pipeline through one short render, so GL context creation,
+ * projectM initialisation and encoder start-up happen before the first
+ * job arrives. */
+static gboolean service_warm_up(ServiceSlot **slots, guint count) {
+  GError *error = NULL;
+  gchar *dir = g_dir_make_tmp("gstprojectm-service-XXXXXX", &error);
+
+  if (dir == NULL) {
+    g_printerr("Warm-up failed: %s\n", error->message);
+    g_clear_error(&error);
+    return FALSE;
+  }
+
+  gchar *input = g_build_filename(dir, "silence.wav", NULL);
+  gchar *output = g_build_filename(dir, "warmup.mp4", NULL);
+  gboolean ok = service_write_silence(input, &error);
+
+  if (!ok) {
+    g_printerr("Warm-up failed: %s\n", error->message);
+    g_clear_error(&error);
+  }
+
+  for (guint i = 0; ok && i < count; i++) {
+    GString *message = g_string_new(NULL);
+    gint64 start = g_get_monotonic_time();
+
+    ok = service_slot_run(slots[i], input, output, message);
+    if (ok) {
+      g_print("Pipeline %u warmed up in %" G_GINT64_FORMAT " ms\n", i,
+              (g_get_monotonic_time() - start) / 1000);
+    } else {
+      g_printerr("Pipeline %u warm-up failed: %s\n", i, message->str);
+    }
+    g_string_free(message, TRUE);
+  }
+
+  g_unlink(output);
+  g_unlink(input);
+  g_rmdir(dir);
+  g_free(output);
+  g_free(input);
+  g_free(dir);
+
+  return ok;
+}
+
+static gboolean service_handle_job(GSocketConnection *connection,
+                                   GObject *source_object,
+                                   gpointer user_data) {
+  GInputStream *in =
+      g_io_stream_get_input_stream(G_IO_STREAM(connection));
+  GOutputStream *out =
+      g_io_stream_get_output_stream(G_IO_STREAM(connection));
+  GDataInputStream *lines = g_data_input_stream_new(in);
+  GPtrArray *settings = g_ptr_array_new_with_free_func(g_free);
+  gchar *input = NULL;
+  gchar *output = NULL;
+  gchar *timeline = NULL;
+  GString *error = g_string_new(NULL);
+  gboolean ok = TRUE;
+
+  for (guint n = 0; n < SERVICE_MAX_REQUEST_LINES; n++) {
+    gchar *line = g_data_input_stream_read_line_utf8(lines, NULL, NULL, NULL);
+
+    if (line == NULL || *g_strstrip(line) == '\0') {
+      g_free(line);
+      break;
+    }
+
+    gchar *value = strchr(line, '=');
+    if (value == NULL) {
+      g_string_printf(error, "malformed line '%s'", line);
+      g_free(line);
+      ok = FALSE;
+      break;
+    }
+    *value++ = '\0';
+
+    if (g_strcmp0(line, "input") == 0) {
+      g_free(input);
+      input = g_strdup(value);
+    } else if (g_strcmp0(line, "output") == 0) {
+      g_free(output);
+      output = g_strdup(value);
+    } else if (g_strcmp0(line, "timeline") == 0) {
+      g_free(timeline);
+      timeline = g_strdup(value);
+    } else if (g_str_has_prefix(line, "projectm.")) {
+      g_ptr_array_add(settings, g_strdup(line + strlen("projectm.")));
+      g_ptr_array_add(settings, g_strdup(value));
+    } else {
+      g_string_printf(error, "unknown key '%s'", line);
+      ok = FALSE;
+    }
+
+    g_free(line);
+    if (!ok) {
+      break;
+    }
+  }
+
+  if (ok && (input == NULL || output == NULL)) {
+    g_string_assign(error, "input and output are required");
+    ok = FALSE;
+  }
+
+  gint64 start = g_get_monotonic_time();
+
+  if (ok) {
+    ServiceSlot *slot = g_async_queue_pop(idle_slots);
+
+    if (timeline != NULL) {
+      ok = service_slot_override(slot, "timeline-path", timeline, error);
+    }
+    for (guint i = 0; ok && i + 1 < settings->len; i += 2) {
+      ok = service_slot_override(slot, g_ptr_array_index(settings, i),
+                                 g_ptr_array_index(settings, i + 1), error);
+    }
+
+    if (ok) {
+      ok = service_slot_run(slot, input, output, error);
+    }
+
+    service_slot_restore(slot);
+    g_async_queue_push(idle_slots, slot);
+  }
+
+  gchar *reply =
+      ok ? g_strdup_printf("ok %" G_GINT64_FORMAT "\n",
+                           (g_get_monotonic_time() - start) / 1000)
+         : g_strdup_printf("error %s\n", error->str);
+
+  g_print("Job %s -> %s: %s", input ? input : "?", output ? output : "?",
+          reply);
+  g_output_stream_write_all(out, reply, strlen(reply), NULL, NULL, NULL);
+
+  g_free(reply);
+  g_free(input);
+  g_free(output);
+  g_free(timeline);
+  g_string_free(error, TRUE);
+  g_ptr_array_unref(settings);
+  g_object_unref(lines);
+
+  return TRUE;
+}
+
+int main(int argc, char *argv[]) {
+  GError *error = NULL;
+  GOptionContext *context =
+      g_option_context_new("- render projectM jobs with warmed pipelines");
+
+  g_option_context_add_main_entries(context, service_entries, NULL);
+  g_option_context_add_group(context, gst_init_get_option_group());
+
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    g_clear_error(&error);
+    g_option_context_free(context);
+    return 2;
+  }
+  g_option_context_free(context);
+
+  if (opt_pipelines < 1 || opt_width < 1 || opt_height < 1 || opt_fps < 1) {
+    g_printerr("--pipelines, --width, --height and --fps must be positive\n");
+    return 2;
+  }
+
+  /* GL platform selection happens when the first pipeline starts, so the
+   * environment only needs to be in place before warm-up. */
+  service_setup_environment();
+  gst_init(NULL, NULL);
+
+  if (opt_plugin_path != NULL) {
+    gst_registry_scan_path(gst_registry_get(), opt_plugin_path);
+  }
+
+  ServiceSlot **slots = g_new0(ServiceSlot *, opt_pipelines);
+  idle_slots = g_async_queue_new();
+
+  for (gint i = 0; i < opt_pipelines; i++) {
+    slots[i] = service_slot_new(i, &error);
+    if (slots[i] == NULL) {
+      g_printerr("Failed to build pipeline: %s\n", error->message);
+      g_clear_error(&error);
+      return 1;
+    }
+  }
+
+  if (!service_warm_up(slots, opt_pipelines)) {
+    return 1;
+  }
+
+  for (gint i = 0; i < opt_pipelines; i++) {
+    g_async_queue_push(idle_slots, slots[i]);
+  }
+
+  /* One thread per connection; a job blocks its thread until a pipeline
+   * is free and the render has finished. */
+  GSocketService *service = g_threaded_socket_service_new(opt_pipelines * 2);
+  GSocketAddress *address = g_unix_socket_address_new(opt_socket);
+
+  g_unlink(opt_socket);
+  if (!g_socket_listener_add_address(G_SOCKET_LISTENER(service), address,
+                                     G_SOCKET_TYPE_STREAM,
+                                     G_SOCKET_PROTOCOL_DEFAULT, NULL, NULL,
+                                     &error)) {
+    g_printerr("Unable to listen on %s: %s\n", opt_socket, error->message);
+    g_clear_error(&error);
+    return 1;
+  }
+  g_object_unref(address);
+
+  g_signal_connect(service, "run", G_CALLBACK(service_handle_job), NULL);
+  g_socket_service_start(service);
+  g_print("Accepting jobs on %s with %d pipeline(s)\n", opt_socket,
+          opt_pipelines);
+
+  GMainLoop *loop = g_main_loop_new(NULL, FALSE);
+  g_main_loop_run(loop);
+
+  g_main_loop_unref(loop);
+  g_object_unref(service);
+  return 0;
+}
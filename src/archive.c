@@ -0,0 +1,680 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+
+#include "archive.h"
+
+GST_DEBUG_CATEGORY_STATIC(gst_projectm_archive_debug);
+#define GST_CAT_DEFAULT gst_projectm_archive_debug
+
+#define GST_PROJECTM_ZIP_LOCAL_HEADER 0x04034b50
+#define GST_PROJECTM_ZIP_CENTRAL_HEADER 0x02014b50
+#define GST_PROJECTM_ZIP_END_OF_CENTRAL_DIR 0x06054b50
+#define GST_PROJECTM_ZIP_STORED 0
+#define GST_PROJECTM_ZIP_DEFLATED 8
+#define GST_PROJECTM_TAR_BLOCK 512
+
+typedef struct {
+  gchar *name;
+  /* Offset of the member data in the archive bytes. */
+  gsize offset;
+  /* Stored size; equals size unless the member is deflated. */
+  gsize stored_size;
+  gsize size;
+  gboolean deflated;
+} GstProjectMArchiveMember;
+
+struct _GstProjectMArchive {
+  gint ref_count;
+  gchar *path;
+  guint64 file_size;
+  gint64 file_mtime;
+
+  GMappedFile *mapped;
+  /* Archive contents: the mapping, or a decompressed copy for .tar.gz. */
+  GBytes *data;
+
+  GArray *members;
+  /* Member name -> index + 1, and base name -> index + 1. */
+  GHashTable *by_name;
+  GHashTable *by_basename;
+  /* Indices of preset members, sorted by name. */
+  GArray *presets;
+
+  GMutex extract_lock;
+  gchar *extract_dir;
+};
+
+/* Open archives by path; entries are dropped when the file changes. */
+static GMutex gst_projectm_archive_cache_lock;
+static GHashTable *gst_projectm_archive_cache = NULL;
+
+static void gst_projectm_archive_init_debug(void) {
+  static gsize debug_initialized = 0;
+
+  if (g_once_init_enter(&debug_initialized)) {
+    GST_DEBUG_CATEGORY_INIT(gst_projectm_archive_debug, "projectm-archive", 0,
+                            "projectM preset and texture archives");
+    g_once_init_leave(&debug_initialized, 1);
+  }
+}
+
+gboolean gst_projectm_archive_is_archive(const gchar *path) {
+  if (path == NULL || !g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+    return FALSE;
+  }
+
+  gchar *lower = g_ascii_strdown(path, -1);
+  gboolean archive = g_str_has_suffix(lower, ".zip") ||
+                     g_str_has_suffix(lower, ".tar") ||
+                     g_str_has_suffix(lower, ".tar.gz") ||
+                     g_str_has_suffix(lower, ".tgz");
+
+  g_free(lower);
+  return archive;
+}
+
+static gboolean gst_projectm_archive_is_preset(const gchar *name) {
+  const gchar *dot = strrchr(name, '.');
+
+  return dot != NULL && (g_ascii_strcasecmp(dot, ".milk") == 0 ||
+                         g_ascii_strcasecmp(dot, ".prjm") == 0);
+}
+
+static void gst_projectm_archive_add_member(GstProjectMArchive *archive,
+                                            const gchar *name, gsize offset,
+                                            gsize stored_size, gsize size,
+                                            gboolean deflated) {
+  while (g_str_has_prefix(name, "./")) {
+    name += 2;
+  }
+
+  if (*name == '\0' || g_str_has_suffix(name, "/")) {
+    return;
+  }
+
+  GstProjectMArchiveMember member = {g_strdup(name), offset, stored_size,
+                                     size, deflated};
+  g_array_append_val(archive->members, member);
+}
+
+static void gst_projectm_archive_member_clear(gpointer data) {
+  GstProjectMArchiveMember *member = data;
+
+  g_free(member->name);
+}
+
+static gboolean gst_projectm_archive_parse_zip(GstProjectMArchive *archive,
+                                               const guint8 *data, gsize size,
+                                               GError **error) {
+  /* The end of central directory record is at most a 64 KiB comment away
+   * from the end of the file. */
+  gssize eocd = -1;
+  for (gssize i = (gssize)size - 22; i >= 0 && (gsize)i + 65557 >= size;
+       i--) {
+    if (GST_READ_UINT32_LE(data + i) == GST_PROJECTM_ZIP_END_OF_CENTRAL_DIR) {
+      eocd = i;
+      break;
+    }
+  }
+
+  if (eocd < 0) {
+    g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                "%s: no zip central directory", archive->path);
+    return FALSE;
+  }
+
+  guint count = GST_READ_UINT16_LE(data + eocd + 10);
+  gsize offset = GST_READ_UINT32_LE(data + eocd + 16);
+
+  for (guint i = 0; i < count; i++) {
+    if (offset + 46 > size ||
+        GST_READ_UINT32_LE(data + offset) != GST_PROJECTM_ZIP_CENTRAL_HEADER) {
+      g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                  "%s: corrupt zip central directory (zip64 archives are "
+                  "not supported)",
+                  archive->path);
+      return FALSE;
+    }
+
+    guint method = GST_READ_UINT16_LE(data + offset + 10);
+    gsize stored_size = GST_READ_UINT32_LE(data + offset + 20);
+    gsize member_size = GST_READ_UINT32_LE(data + offset + 24);
+    gsize name_length = GST_READ_UINT16_LE(data + offset + 28);
+    gsize extra_length = GST_READ_UINT16_LE(data + offset + 30);
+    gsize comment_length = GST_READ_UINT16_LE(data + offset + 32);
+    gsize local = GST_READ_UINT32_LE(data + offset + 42);
+
+    if (offset + 46 + name_length > size || local + 30 > size ||
+        GST_READ_UINT32_LE(data + local) != GST_PROJECTM_ZIP_LOCAL_HEADER) {
+      g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                  "%s: corrupt zip member %u", archive->path, i);
+      return FALSE;
+    }
+
+    gsize data_offset = local + 30 + GST_READ_UINT16_LE(data + local + 26) +
+                        GST_READ_UINT16_LE(data + local + 28);
+    gchar *name = g_strndup((const gchar *)data + offset + 46, name_length);
+
+    if (data_offset + stored_size > size) {
+      GST_WARNING("%s: member %s is truncated", archive->path, name);
+    } else if (method == GST_PROJECTM_ZIP_STORED ||
+               method == GST_PROJECTM_ZIP_DEFLATED) {
+      gst_projectm_archive_add_member(archive, name, data_offset, stored_size,
+                                      member_size,
+                                      method == GST_PROJECTM_ZIP_DEFLATED);
+    } else {
+      GST_WARNING("%s: member %s uses unsupported compression method %u",
+                  archive->path, name, method);
+    }
+
+    g_free(name);
+    offset += 46 + name_length + extra_length + comment_length;
+  }
+
+  return TRUE;
+}
+
+static gsize gst_projectm_archive_tar_number(const guint8 *field, gsize length) {
+  gchar *text = g_strndup((const gchar *)field, length);
+  gsize value = g_ascii_strtoull(g_strstrip(text), NULL, 8);
+
+  g_free(text);
+  return value;
+}
+
+/* Returns the "path" record of a pax extended header, if any. Records are
+ * "<length> <key>=<value>\n", length counting the whole record; parsing
+ * stops at the first one that does not fit the header. */
+static gchar *gst_projectm_archive_pax_path(const guint8 *data, gsize length) {
+  gsize offset = 0;
+
+  while (offset < length) {
+    gsize record = 0;
+    gsize digits = offset;
+
+    /* The header is not NUL-terminated, so the length is parsed in place. */
+    while (digits < length && g_ascii_isdigit(data[digits]) &&
+           record <= (length - offset) / 10) {
+      record = record * 10 + (data[digits] - '0');
+      digits++;
+    }
+
+    if (digits == offset || record == 0 || record > length - offset ||
+        digits >= length || data[digits] != ' ') {
+      break;
+    }
+
+    const gchar *key = (const gchar *)data + digits + 1;
+    const gchar *record_end = (const gchar *)data + offset + record;
+
+    /* Room for at least the trailing newline after the key. */
+    if (key >= record_end) {
+      break;
+    }
+
+    gsize key_length = record_end - 1 - key;
+    if (key_length > 5 && strncmp(key, "path=", 5) == 0) {
+      return g_strndup(key + 5, key_length - 5);
+    }
+
+    offset += record;
+  }
+
+  return NULL;
+}
+
+static gboolean gst_projectm_archive_parse_tar(GstProjectMArchive *archive,
+                                               const guint8 *data, gsize size,
+                                               GError **error) {
+  gsize offset = 0;
+  gchar *long_name = NULL;
+
+  while (offset + GST_PROJECTM_TAR_BLOCK <= size) {
+    const guint8 *header = data + offset;
+
+    if (header[0] == '\0') {
+      /* End of archive marker. */
+      break;
+    }
+
+    gsize member_size = gst_projectm_archive_tar_number(header + 124, 12);
+    gchar type = (gchar)header[156];
+    gsize data_offset = offset + GST_PROJECTM_TAR_BLOCK;
+
+    if (data_offset + member_size > size) {
+      g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                  "%s: truncated tar member at offset %" G_GSIZE_FORMAT,
+                  archive->path, offset);
+      g_free(long_name);
+      return FALSE;
+    }
+
+    if (type == 'L') {
+      g_free(long_name);
+      long_name = g_strndup((const gchar *)data + data_offset, member_size);
+    } else if (type == 'x') {
+      gchar *path = gst_projectm_archive_pax_path(data + data_offset,
+                                                  member_size);
+      if (path != NULL) {
+        g_free(long_name);
+        long_name = path;
+      }
+    } else if (type == '0' || type == '\0') {
+      gchar *name;
+
+      if (long_name != NULL) {
+        name = g_steal_pointer(&long_name);
+      } else if (memcmp(header + 257, "ustar", 5) == 0 && header[345] != '\0') {
+        gchar *prefix = g_strndup((const gchar *)header + 345, 155);
+        gchar *base = g_strndup((const gchar *)header, 100);
+        name = g_strconcat(prefix, "/", base, NULL);
+        g_free(prefix);
+        g_free(base);
+      } else {
+        name = g_strndup((const gchar *)header, 100);
+      }
+
+      gst_projectm_archive_add_member(archive, name, data_offset, member_size,
+                                      member_size, FALSE);
+      g_free(name);
+    } else {
+      g_clear_pointer(&long_name, g_free);
+    }
+
+    offset = data_offset + ((member_size + GST_PROJECTM_TAR_BLOCK - 1) /
+                            GST_PROJECTM_TAR_BLOCK) *
+                               GST_PROJECTM_TAR_BLOCK;
+  }
+
+  g_free(long_name);
+  return TRUE;
+}
+
+/* Runs a zlib decompressor over a whole buffer. expected_size is a hint,
+ * 0 if unknown. */
+static GBytes *gst_projectm_archive_inflate(const guint8 *data, gsize size,
+                                            GZlibCompressorFormat format,
+                                            gsize expected_size,
+                                            GError **error) {
+  GZlibDecompressor *decompressor = g_zlib_decompressor_new(format);
+  GByteArray *out = g_byte_array_sized_new(
+      expected_size > 0 ? expected_size + 1 : size * 4 + 1);
+  gsize in_offset = 0;
+  GConverterResult result = G_CONVERTER_CONVERTED;
+
+  while (result != G_CONVERTER_FINISHED) {
+    guint used = out->len;
+    gsize bytes_read = 0;
+    gsize bytes_written = 0;
+
+    g_byte_array_set_size(out, MAX(used * 2, used + 65536));
+    result = g_converter_convert(G_CONVERTER(decompressor), data + in_offset,
+                                 size - in_offset, out->data + used,
+                                 out->len - used, G_CONVERTER_INPUT_AT_END,
+                                 &bytes_read, &bytes_written, error);
+    g_byte_array_set_size(out, used + bytes_written);
+    in_offset += bytes_read;
+
+    if (result == G_CONVERTER_ERROR) {
+      break;
+    }
+  }
+
+  g_object_unref(decompressor);
+
+  if (result == G_CONVERTER_ERROR) {
+    g_byte_array_unref(out);
+    return NULL;
+  }
+
+  return g_byte_array_free_to_bytes(out);
+}
+
+static gint gst_projectm_archive_compare_presets(gconstpointer a,
+                                                 gconstpointer b,
+                                                 gpointer user_data) {
+  GArray *members = user_data;
+
+  return strcmp(
+      g_array_index(members, GstProjectMArchiveMember, *(const guint *)a).name,
+      g_array_index(members, GstProjectMArchiveMember, *(const guint *)b).name);
+}
+
+static void gst_projectm_archive_build_index(GstProjectMArchive *archive) {
+  for (guint i = 0; i < archive->members->len; i++) {
+    GstProjectMArchiveMember *member =
+        &g_array_index(archive->members, GstProjectMArchiveMember, i);
+    const gchar *slash = strrchr(member->name, '/');
+    const gchar *basename = slash != NULL ? slash + 1 : member->name;
+
+    g_hash_table_insert(archive->by_name, member->name,
+                        GUINT_TO_POINTER(i + 1));
+    if (!g_hash_table_contains(archive->by_basename, basename)) {
+      g_hash_table_insert(archive->by_basename, (gpointer)basename,
+                          GUINT_TO_POINTER(i + 1));
+    }
+
+    if (gst_projectm_archive_is_preset(member->name)) {
+      g_array_append_val(archive->presets, i);
+    }
+  }
+
+  g_array_sort_with_data(archive->presets,
+                         gst_projectm_archive_compare_presets,
+                         archive->members);
+}
+
+static GstProjectMArchive *gst_projectm_archive_load(const gchar *path,
+                                                     const GStatBuf *st,
+                                                     GError **error) {
+  GMappedFile *mapped = g_mapped_file_new(path, FALSE, error);
+
+  if (mapped == NULL) {
+    return NULL;
+  }
+
+  GstProjectMArchive *archive = g_new0(GstProjectMArchive, 1);
+  archive->ref_count = 1;
+  archive->path = g_strdup(path);
+  archive->file_size = st->st_size;
+  archive->file_mtime = st->st_mtime;
+  archive->mapped = mapped;
+  archive->data = g_mapped_file_get_bytes(mapped);
+  archive->members = g_array_new(FALSE, FALSE, sizeof(GstProjectMArchiveMember));
+  g_array_set_clear_func(archive->members, gst_projectm_archive_member_clear);
+  archive->by_name = g_hash_table_new(g_str_hash, g_str_equal);
+  archive->by_basename = g_hash_table_new(g_str_hash, g_str_equal);
+  archive->presets = g_array_new(FALSE, FALSE, sizeof(guint));
+  g_mutex_init(&archive->extract_lock);
+
+  gsize size = 0;
+  const guint8 *data = g_bytes_get_data(archive->data, &size);
+  gboolean ok;
+
+  if (size >= 4 && GST_READ_UINT32_LE(data) == GST_PROJECTM_ZIP_LOCAL_HEADER) {
+    ok = gst_projectm_archive_parse_zip(archive, data, size, error);
+  } else if (size >= 2 && data[0] == 0x1f && data[1] == 0x8b) {
+    GBytes *tar = gst_projectm_archive_inflate(
+        data, size, G_ZLIB_COMPRESSOR_FORMAT_GZIP, 0, error);
+
+    ok = tar != NULL;
+    if (ok) {
+      g_bytes_unref(archive->data);
+      archive->data = tar;
+      data = g_bytes_get_data(tar, &size);
+      ok = gst_projectm_archive_parse_tar(archive, data, size, error);
+    }
+  } else {
+    ok = gst_projectm_archive_parse_tar(archive, data, size, error);
+  }
+
+  if (!ok) {
+    gst_projectm_archive_unref(archive);
+    return NULL;
+  }
+
+  gst_projectm_archive_build_index(archive);
+  return archive;
+}
+
+GstProjectMArchive *gst_projectm_archive_open(const gchar *path,
+                                              GError **error) {
+  gst_projectm_archive_init_debug();
+
+  GStatBuf st;
+  if (g_stat(path, &st) != 0) {
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                "%s: %s", path, g_strerror(errno));
+    return NULL;
+  }
+
+  g_mutex_lock(&gst_projectm_archive_cache_lock);
+
+  if (gst_projectm_archive_cache == NULL) {
+    gst_projectm_archive_cache =
+        g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                              (GDestroyNotify)gst_projectm_archive_unref);
+  }
+
+  GstProjectMArchive *archive =
+      g_hash_table_lookup(gst_projectm_archive_cache, path);
+
+  if (archive != NULL && (archive->file_size != (guint64)st.st_size ||
+                          archive->file_mtime != (gint64)st.st_mtime)) {
+    GST_INFO("%s changed on disk, indexing it again", path);
+    g_hash_table_remove(gst_projectm_archive_cache, path);
+    archive = NULL;
+  }
+
+  if (archive == NULL) {
+    gint64 start = g_get_monotonic_time();
+
+    archive = gst_projectm_archive_load(path, &st, error);
+    if (archive != NULL) {
+      GST_INFO("Indexed %s: %u members, %u presets in %" G_GINT64_FORMAT
+               " us",
+               path, archive->members->len, archive->presets->len,
+               g_get_monotonic_time() - start);
+      g_hash_table_insert(gst_projectm_archive_cache, g_strdup(path),
+                          archive);
+    }
+  }
+
+  if (archive != NULL) {
+    gst_projectm_archive_ref(archive);
+  }
+
+  g_mutex_unlock(&gst_projectm_archive_cache_lock);
+  return archive;
+}
+
+GstProjectMArchive *gst_projectm_archive_ref(GstProjectMArchive *archive) {
+  g_atomic_int_inc(&archive->ref_count);
+  return archive;
+}
+
+void gst_projectm_archive_unref(GstProjectMArchive *archive) {
+  if (archive == NULL || !g_atomic_int_dec_and_test(&archive->ref_count)) {
+    return;
+  }
+
+  g_hash_table_unref(archive->by_name);
+  g_hash_table_unref(archive->by_basename);
+  g_array_unref(archive->presets);
+  g_array_unref(archive->members);
+  g_bytes_unref(archive->data);
+  g_mapped_file_unref(archive->mapped);
+  g_mutex_clear(&archive->extract_lock);
+  g_free(archive->extract_dir);
+  g_free(archive->path);
+  g_free(archive);
+}
+
+guint gst_projectm_archive_get_n_presets(GstProjectMArchive *archive) {
+  return archive->presets->len;
+}
+
+const gchar *gst_projectm_archive_get_preset(GstProjectMArchive *archive,
+                                             guint index) {
+  g_return_val_if_fail(index < archive->presets->len, NULL);
+
+  return g_array_index(archive->members, GstProjectMArchiveMember,
+                       g_array_index(archive->presets, guint, index))
+      .name;
+}
+
+static GstProjectMArchiveMember *
+gst_projectm_archive_lookup(GstProjectMArchive *archive, const gchar *name) {
+  while (name != NULL && g_str_has_prefix(name, "./")) {
+    name += 2;
+  }
+
+  if (name == NULL || *name == '\0') {
+    return NULL;
+  }
+
+  guint index = GPOINTER_TO_UINT(g_hash_table_lookup(archive->by_name, name));
+
+  if (index == 0 && strchr(name, '/') == NULL) {
+    index = GPOINTER_TO_UINT(g_hash_table_lookup(archive->by_basename, name));
+  }
+
+  return index > 0 ? &g_array_index(archive->members,
+                                    GstProjectMArchiveMember, index - 1)
+                   : NULL;
+}
+
+gboolean gst_projectm_archive_contains(GstProjectMArchive *archive,
+                                       const gchar *name) {
+  return gst_projectm_archive_lookup(archive, name) != NULL;
+}
+
+/* Members are binary (textures), so their contents carry their length
+ * rather than being cut at the first NUL. Stored members share the
+ * archive's mapping. */
+static GBytes *gst_projectm_archive_read_member(GstProjectMArchive *archive,
+                                                GstProjectMArchiveMember *member,
+                                                GError **error) {
+  const guint8 *data = g_bytes_get_data(archive->data, NULL);
+
+  if (!member->deflated) {
+    return g_bytes_new_from_bytes(archive->data, member->offset, member->size);
+  }
+
+  GBytes *inflated = gst_projectm_archive_inflate(
+      data + member->offset, member->stored_size,
+      G_ZLIB_COMPRESSOR_FORMAT_RAW, member->size, error);
+
+  if (inflated == NULL) {
+    g_prefix_error(error, "%s: %s: ", archive->path, member->name);
+    return NULL;
+  }
+
+  return inflated;
+}
+
+gchar *gst_projectm_archive_read(GstProjectMArchive *archive,
+                                 const gchar *name, GError **error) {
+  GstProjectMArchiveMember *member = gst_projectm_archive_lookup(archive, name);
+
+  if (member == NULL) {
+    g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_NOENT, "%s: no member %s",
+                archive->path, name);
+    return NULL;
+  }
+
+  GBytes *bytes = gst_projectm_archive_read_member(archive, member, error);
+  if (bytes == NULL) {
+    return NULL;
+  }
+
+  gsize size = 0;
+  const gchar *data = g_bytes_get_data(bytes, &size);
+  gchar *contents = g_malloc(size + 1);
+
+  memcpy(contents, data, size);
+  contents[size] = '\0';
+  g_bytes_unref(bytes);
+  return contents;
+}
+
+/* Members that could escape the extraction directory are skipped. */
+static gboolean gst_projectm_archive_safe_name(const gchar *name) {
+  if (g_path_is_absolute(name)) {
+    return FALSE;
+  }
+
+  gchar **parts = g_strsplit(name, "/", -1);
+  gboolean safe = TRUE;
+
+  for (guint i = 0; parts[i] != NULL; i++) {
+    if (strcmp(parts[i], "..") == 0) {
+      safe = FALSE;
+    }
+  }
+
+  g_strfreev(parts);
+  return safe;
+}
+
+static gboolean gst_projectm_archive_extract_to(GstProjectMArchive *archive,
+                                                const gchar *directory,
+                                                GError **error) {
+  for (guint i = 0; i < archive->members->len; i++) {
+    GstProjectMArchiveMember *member =
+        &g_array_index(archive->members, GstProjectMArchiveMember, i);
+
+    if (!gst_projectm_archive_safe_name(member->name)) {
+      GST_WARNING("%s: skipping unsafe member %s", archive->path,
+                  member->name);
+      continue;
+    }
+
+    gchar *target = g_build_filename(directory, member->name, NULL);
+    gchar *parent = g_path_get_dirname(target);
+    GBytes *contents = gst_projectm_archive_read_member(archive, member, error);
+    gsize length = 0;
+    const gchar *data =
+        contents != NULL ? g_bytes_get_data(contents, &length) : NULL;
+    gboolean ok = contents != NULL && g_mkdir_with_parents(parent, 0755) == 0 &&
+                  g_file_set_contents(target, data != NULL ? data : "",
+                                      length, error);
+
+    if (contents != NULL && !ok && error != NULL && *error == NULL) {
+      g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                  "%s: %s", parent, g_strerror(errno));
+    }
+
+    if (contents != NULL) {
+      g_bytes_unref(contents);
+    }
+    g_free(parent);
+    g_free(target);
+
+    if (!ok) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+const gchar *gst_projectm_archive_extract(GstProjectMArchive *archive,
+                                          GError **error) {
+  g_mutex_lock(&archive->extract_lock);
+
+  if (archive->extract_dir == NULL) {
+    gchar *key = g_strdup_printf("%s:%" G_GUINT64_FORMAT ":%" G_GINT64_FORMAT,
+                                 archive->path, archive->file_size,
+                                 archive->file_mtime);
+    gchar *hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, key, -1);
+    gchar *directory = g_build_filename(g_get_user_cache_dir(), "gst-projectm",
+                                        "archives", hash, NULL);
+    gchar *marker = g_build_filename(directory, ".complete", NULL);
+
+    /* A marker written last makes half-finished extractions from crashed
+     * or concurrent processes distinguishable from usable ones. */
+    if (g_file_test(marker, G_FILE_TEST_EXISTS) ||
+        (gst_projectm_archive_extract_to(archive, directory, error) &&
+         g_file_set_contents(marker, "", 0, error))) {
+      GST_INFO("Using %s extracted into %s", archive->path, directory);
+      archive->extract_dir = g_steal_pointer(&directory);
+    }
+
+    g_free(marker);
+    g_free(directory);
+    g_free(hash);
+    g_free(key);
+  }
+
+  g_mutex_unlock(&archive->extract_lock);
+  return archive->extract_dir;
+}
@@ -0,0 +1,79 @@
+#ifndef __GST_PROJECTM_ARCHIVE_H__
+#define __GST_PROJECTM_ARCHIVE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief A preset or texture pack in a single zip, tar or gzipped tar file.
+ *
+ * The file is memory-mapped and its member list read once; gzipped tars are
+ * decompressed into memory once. Archives are shared process-wide, so every
+ * element using the same unchanged file reuses the same index.
+ */
+typedef struct _GstProjectMArchive GstProjectMArchive;
+
+/**
+ * @brief Check whether a path names an archive rather than a preset file or
+ * directory, going by its extension (.zip, .tar, .tar.gz, .tgz).
+ */
+gboolean gst_projectm_archive_is_archive(const gchar *path);
+
+/**
+ * @brief Open an archive, or return a new reference to the already indexed
+ * one if the file has not changed.
+ *
+ * @return The archive, or NULL with error set.
+ */
+GstProjectMArchive *gst_projectm_archive_open(const gchar *path,
+                                              GError **error);
+
+GstProjectMArchive *gst_projectm_archive_ref(GstProjectMArchive *archive);
+
+void gst_projectm_archive_unref(GstProjectMArchive *archive);
+
+/**
+ * @brief Number of presets (.milk and .prjm members) in the archive.
+ */
+guint gst_projectm_archive_get_n_presets(GstProjectMArchive *archive);
+
+/**
+ * @brief Member name of a preset, in name order.
+ */
+const gchar *gst_projectm_archive_get_preset(GstProjectMArchive *archive,
+                                             guint index);
+
+/**
+ * @brief Check whether a member exists.
+ *
+ * Names are matched exactly, ignoring a leading "./"; failing that, a name
+ * without directories matches the first member with that base name.
+ */
+gboolean gst_projectm_archive_contains(GstProjectMArchive *archive,
+                                       const gchar *name);
+
+/**
+ * @brief Read a member into a NUL-terminated buffer, decompressing it if
+ * needed.
+ *
+ * @return The contents, free with g_free(), or NULL with error set.
+ */
+gchar *gst_projectm_archive_read(GstProjectMArchive *archive,
+                                 const gchar *name, GError **error);
+
+/**
+ * @brief Extract all members into a cache directory.
+ *
+ * For consumers that can only read files, such as projectM's texture
+ * loader. The directory is keyed by the archive's path, size and mtime, so
+ * it is reused by later runs and other processes.
+ *
+ * @return The directory, owned by the archive, or NULL with error set.
+ */
+const gchar *gst_projectm_archive_extract(GstProjectMArchive *archive,
+                                          GError **error);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_ARCHIVE_H__ */
@@ -0,0 +1,1145 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/audio/audio.h>
+#include <gst/base/gstadapter.h>
+#include <gst/gl/gl.h>
+#include <gst/gl/gstglfuncs.h>
+#include <gst/video/gstvideopool.h>
+#include <gst/video/video.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef GL_MAP_READ_BIT
+#define GL_MAP_READ_BIT 0x0001
+#endif
+
+/* Frames of audio a stream may have queued before its streaming thread
+ * waits for the scheduler. */
+#define GST_PROJECTM_BATCH_QUEUED_FRAMES 2
+
+/* Output format picked when downstream accepts a range. */
+#define GST_PROJECTM_BATCH_DEFAULT_WIDTH 1280
+#define GST_PROJECTM_BATCH_DEFAULT_HEIGHT 720
+#define GST_PROJECTM_BATCH_DEFAULT_FPS 30
+
+#include "batch.h"
+#include "caps.h"
+#include "config.h"
+#include "enums.h"
+#include "frame.h"
+#include "framegrid.h"
+#include "instance.h"
+#include "stats.h"
+
+GST_DEBUG_CATEGORY_STATIC(gst_projectm_batch_debug);
+#define GST_CAT_DEFAULT gst_projectm_batch_debug
+
+typedef struct {
+  GstProjectMBatch *batch;
+  guint id;
+  GstPad *sinkpad;
+  GstPad *srcpad;
+
+  /* Under the batch lock. */
+  GstAdapter *adapter;
+  GstAudioInfo ainfo;
+  GstVideoInfo vinfo;
+  GstSegment segment;
+  GstBufferPool *pool;
+  gboolean negotiated;
+  gboolean flushing;
+  GstFlowReturn flow;
+  /* Part of the batch being rendered; the scheduler owns the GL fields and
+   * pushes on the src pad until it clears this. */
+  gboolean busy;
+  /* Frame grid: frame n starts at base_pts + n / fps and consumes the audio
+   * from sample n * rate / fps on. run_samples counts what was queued. */
+  GstClockTime base_pts;
+  guint64 frame;
+  guint64 run_samples;
+
+  /* GL thread only. */
+  GstProjectMInstance *instance;
+  GLuint pbo;
+  guint8 *staging;
+} GstProjectMBatchStream;
+
+typedef struct {
+  GstProjectMBatchStream *stream;
+  GstBuffer *audio;
+  GstBuffer *out;
+  GstClockTime pts;
+  GstClockTime duration;
+  GstFlowReturn flow;
+  gboolean rendered;
+  gboolean copied;
+} GstProjectMBatchItem;
+
+typedef struct {
+  GstProjectMBatch *batch;
+  GArray *items;
+} GstProjectMBatchJob;
+
+struct _GstProjectMBatchPrivate {
+  GRecMutex context_lock;
+  GstGLDisplay *display;
+  GstGLContext *context;
+  GstGLContext *other_context;
+
+  GMutex lock;
+  GCond cond;
+  GPtrArray *streams;
+  guint next_pad_id;
+  /* Stream the next batch starts with. */
+  guint next_stream;
+  gboolean running;
+
+  GstTask *task;
+  GRecMutex task_lock;
+
+  GstProjectMStats stats;
+  guint64 batches;
+  guint64 batched_frames;
+};
+
+struct _GstProjectMBatchClass {
+  GstElementClass parent_class;
+};
+
+#define gst_projectm_batch_parent_class parent_class
+G_DEFINE_TYPE_WITH_CODE(GstProjectMBatch, gst_projectm_batch,
+                        GST_TYPE_ELEMENT,
+                        G_ADD_PRIVATE(GstProjectMBatch)
+                            GST_DEBUG_CATEGORY_INIT(gst_projectm_batch_debug,
+                                                    "projectmbatch", 0,
+                                                    "projectM batch renderer"));
+
+static GstStaticPadTemplate gst_projectm_batch_src_template =
+    GST_STATIC_PAD_TEMPLATE(
+        "src_%u", GST_PAD_SRC, GST_PAD_SOMETIMES,
+        GST_STATIC_CAPS("video/x-raw, format = (string) ABGR, "
+                        "width = (int) [ 16, 8192 ], "
+                        "height = (int) [ 16, 8192 ], "
+                        "framerate = (fraction) [ 1/1, MAX ]"));
+
+static const GstGLAPI gst_projectm_batch_gl_api =
+    GST_GL_API_OPENGL3 | GST_GL_API_GLES2;
+
+/* RGBA readback to ABGR output, as for the projectm element. */
+static const guint8 gst_projectm_batch_swizzle[4] = {3, 2, 1, 0};
+
+static gsize gst_projectm_batch_stream_frame_bytes(GstProjectMBatchStream *stream,
+                                                   guint64 n) {
+  return (gsize)gst_projectm_frame_grid_samples(
+             GST_AUDIO_INFO_RATE(&stream->ainfo),
+             GST_VIDEO_INFO_FPS_N(&stream->vinfo),
+             GST_VIDEO_INFO_FPS_D(&stream->vinfo), n) *
+         GST_AUDIO_INFO_BPF(&stream->ainfo);
+}
+
+static GstClockTime
+gst_projectm_batch_stream_frame_pts(GstProjectMBatchStream *stream, guint64 n) {
+  return stream->base_pts +
+         gst_projectm_frame_grid_time(GST_VIDEO_INFO_FPS_N(&stream->vinfo),
+                                      GST_VIDEO_INFO_FPS_D(&stream->vinfo), n);
+}
+
+/* Restarts the frame grid at the next buffer. Called with the lock held. */
+static void gst_projectm_batch_stream_reset(GstProjectMBatchStream *stream) {
+  gst_adapter_clear(stream->adapter);
+  stream->base_pts = GST_CLOCK_TIME_NONE;
+  stream->frame = 0;
+  stream->run_samples = 0;
+}
+
+static gboolean
+gst_projectm_batch_stream_has_frame(GstProjectMBatchStream *stream) {
+  return stream->negotiated &&
+         gst_adapter_available(stream->adapter) >=
+             gst_projectm_batch_stream_frame_bytes(stream, stream->frame);
+}
+
+/* Waits until the scheduler has rendered every whole frame queued before a
+ * serialized event, so the event goes downstream after them. With clear, the
+ * partial frame left over is dropped and the grid restarted. Called with the
+ * lock held. */
+static void gst_projectm_batch_stream_drain(GstProjectMBatch *batch,
+                                            GstProjectMBatchStream *stream,
+                                            gboolean clear) {
+  GstProjectMBatchPrivate *priv = batch->priv;
+
+  while (stream->busy ||
+         (!stream->flushing && priv->running &&
+          stream->flow == GST_FLOW_OK &&
+          gst_projectm_batch_stream_has_frame(stream))) {
+    g_cond_wait(&priv->cond, &priv->lock);
+  }
+
+  if (clear) {
+    gst_projectm_batch_stream_reset(stream);
+  }
+}
+
+static gboolean gst_projectm_batch_ensure_gl_context(GstProjectMBatch *batch) {
+  GstProjectMBatchPrivate *priv = batch->priv;
+  gboolean ret = TRUE;
+
+  g_rec_mutex_lock(&priv->context_lock);
+  if (priv->context == NULL) {
+    ret = gst_projectm_instance_find_gl_context(
+        GST_ELEMENT(batch), gst_projectm_batch_gl_api, &priv->display,
+        &priv->other_context, &priv->context);
+  }
+  g_rec_mutex_unlock(&priv->context_lock);
+
+  return ret;
+}
+
+static void gst_projectm_batch_stream_free_gl(GstGLContext *context,
+                                              gpointer data) {
+  GstProjectMBatchStream *stream = data;
+
+  g_clear_pointer(&stream->instance, gst_projectm_instance_free);
+  if (stream->pbo != 0) {
+    context->gl_vtable->DeleteBuffers(1, &stream->pbo);
+    stream->pbo = 0;
+  }
+  g_clear_pointer(&stream->staging, g_free);
+}
+
+static void gst_projectm_batch_release_gl(GstProjectMBatch *batch,
+                                          GstProjectMBatchStream *stream) {
+  GstProjectMBatchPrivate *priv = batch->priv;
+
+  g_rec_mutex_lock(&priv->context_lock);
+  if (priv->context != NULL) {
+    gst_gl_context_thread_add(priv->context, gst_projectm_batch_stream_free_gl,
+                              stream);
+  }
+  g_rec_mutex_unlock(&priv->context_lock);
+}
+
+/* Creates or resizes the stream's instance and readback buffer. */
+static gboolean gst_projectm_batch_stream_ensure_gl(GstProjectMBatch *batch,
+                                                    GstProjectMBatchStream *stream,
+                                                    GstGLContext *context,
+                                                    gboolean use_pbo) {
+  const GstGLFuncs *gl = context->gl_vtable;
+  guint width = GST_VIDEO_INFO_WIDTH(&stream->vinfo);
+  guint height = GST_VIDEO_INFO_HEIGHT(&stream->vinfo);
+  guint instance_width, instance_height;
+
+  if (stream->instance != NULL) {
+    gst_projectm_instance_get_size(stream->instance, &instance_width,
+                                   &instance_height);
+    if (instance_width == width && instance_height == height) {
+      return TRUE;
+    }
+    gst_projectm_batch_stream_free_gl(context, stream);
+  }
+
+  GST_OBJECT_LOCK(batch);
+  GstProjectMInstanceSettings settings = {
+      .preset_path = batch->preset_path,
+      .texture_dir_path = batch->texture_dir_path,
+      .beat_sensitivity = batch->beat_sensitivity,
+      .preset_duration = batch->preset_duration,
+      .mesh_width = batch->mesh_width,
+      .mesh_height = batch->mesh_height,
+      .shuffle_presets = batch->shuffle_presets,
+  };
+  stream->instance = gst_projectm_instance_new(
+      context, &settings, width, height, GST_VIDEO_INFO_FPS_N(&stream->vinfo),
+      GST_VIDEO_INFO_FPS_D(&stream->vinfo));
+  GST_OBJECT_UNLOCK(batch);
+
+  if (stream->instance == NULL) {
+    return FALSE;
+  }
+
+  gsize size = (gsize)width * height * 4;
+  if (use_pbo) {
+    gl->GenBuffers(1, &stream->pbo);
+    gl->BindBuffer(GL_PIXEL_PACK_BUFFER, stream->pbo);
+    gl->BufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+    gl->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  } else {
+    stream->staging = g_malloc(size);
+  }
+
+  GST_DEBUG_OBJECT(stream->srcpad, "Created %ux%u instance", width, height);
+  return TRUE;
+}
+
+static void gst_projectm_batch_gl_render(GstGLContext *context,
+                                         gpointer data) {
+  GstProjectMBatchJob *job = data;
+  GstProjectMBatch *batch = job->batch;
+  GstProjectMBatchPrivate *priv = batch->priv;
+  const GstGLFuncs *gl = context->gl_vtable;
+  gboolean use_pbo = gl->GenBuffers && gl->BufferData &&
+                     (gl->MapBufferRange || gl->MapBuffer) && gl->UnmapBuffer;
+  GstProjectMFrameCopyFlags flags = batch->vertical_flip
+                                        ? GST_PROJECTM_FRAME_COPY_FLIP
+                                        : GST_PROJECTM_FRAME_COPY_NONE;
+  gint64 start;
+
+  /* Render every stream and queue its readback before mapping any of them:
+   * the GPU copies one stream's pixels out while it renders the next. */
+  for (guint i = 0; i < job->items->len; i++) {
+    GstProjectMBatchItem *item =
+        &g_array_index(job->items, GstProjectMBatchItem, i);
+    GstProjectMBatchStream *stream = item->stream;
+    GstMapInfo map;
+
+    if (item->out == NULL ||
+        !gst_projectm_batch_stream_ensure_gl(batch, stream, context, use_pbo)) {
+      continue;
+    }
+
+    start = g_get_monotonic_time();
+    if (gst_buffer_map(item->audio, &map, GST_MAP_READ)) {
+      gst_projectm_instance_add_pcm(
+          stream->instance, (const gint16 *)map.data,
+          map.size / GST_AUDIO_INFO_BPF(&stream->ainfo));
+      gst_buffer_unmap(item->audio, &map);
+    }
+    gst_projectm_stats_record(&priv->stats, GST_PROJECTM_PHASE_AUDIO,
+                              g_get_monotonic_time() - start);
+
+    start = g_get_monotonic_time();
+    gst_projectm_instance_render(stream->instance,
+                                 (gdouble)item->pts / GST_SECOND);
+    gst_projectm_stats_record(&priv->stats, GST_PROJECTM_PHASE_RENDER,
+                              g_get_monotonic_time() - start);
+
+    gl->BindFramebuffer(GL_FRAMEBUFFER,
+                        gst_projectm_instance_get_framebuffer(stream->instance));
+    if (use_pbo) {
+      gl->BindBuffer(GL_PIXEL_PACK_BUFFER, stream->pbo);
+      gl->ReadPixels(0, 0, GST_VIDEO_INFO_WIDTH(&stream->vinfo),
+                     GST_VIDEO_INFO_HEIGHT(&stream->vinfo), GL_RGBA,
+                     GL_UNSIGNED_BYTE, 0);
+      gl->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    } else {
+      gl->ReadPixels(0, 0, GST_VIDEO_INFO_WIDTH(&stream->vinfo),
+                     GST_VIDEO_INFO_HEIGHT(&stream->vinfo), GL_RGBA,
+                     GL_UNSIGNED_BYTE, stream->staging);
+    }
+    item->rendered = TRUE;
+  }
+
+  for (guint i = 0; i < job->items->len; i++) {
+    GstProjectMBatchItem *item =
+        &g_array_index(job->items, GstProjectMBatchItem, i);
+    GstProjectMBatchStream *stream = item->stream;
+    guint width = GST_VIDEO_INFO_WIDTH(&stream->vinfo);
+    guint height = GST_VIDEO_INFO_HEIGHT(&stream->vinfo);
+    const guint8 *pixels = stream->staging;
+    GstVideoFrame frame;
+
+    if (!item->rendered) {
+      continue;
+    }
+
+    start = g_get_monotonic_time();
+    if (use_pbo) {
+      gsize size = (gsize)width * height * 4;
+      gl->BindBuffer(GL_PIXEL_PACK_BUFFER, stream->pbo);
+      pixels = gl->MapBufferRange
+                   ? gl->MapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size,
+                                        GL_MAP_READ_BIT)
+                   : gl->MapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    }
+    gst_projectm_stats_record(&priv->stats, GST_PROJECTM_PHASE_READBACK,
+                              g_get_monotonic_time() - start);
+
+    start = g_get_monotonic_time();
+    if (pixels != NULL &&
+        gst_video_frame_map(&frame, &stream->vinfo, item->out, GST_MAP_WRITE)) {
+      gst_projectm_frame_copy_full(GST_VIDEO_FRAME_PLANE_DATA(&frame, 0),
+                                   GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0),
+                                   pixels, (gsize)width * 4, width, height,
+                                   flags, gst_projectm_batch_swizzle);
+      gst_video_frame_unmap(&frame);
+      item->copied = TRUE;
+    }
+    gst_projectm_stats_record(&priv->stats, GST_PROJECTM_PHASE_COPY,
+                              g_get_monotonic_time() - start);
+
+    if (use_pbo) {
+      if (pixels != NULL) {
+        gl->UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+      }
+      gl->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+  }
+}
+
+/* Takes the next frame of audio from up to max-batch streams, starting one
+ * stream further than the previous batch did. Called with the lock held. */
+static gboolean gst_projectm_batch_collect(GstProjectMBatch *batch,
+                                           GArray *items) {
+  GstProjectMBatchPrivate *priv = batch->priv;
+  guint n = priv->streams->len;
+  guint limit = batch->max_batch > 0 ? batch->max_batch : n;
+
+  for (guint i = 0; i < n && items->len < limit; i++) {
+    GstProjectMBatchStream *stream =
+        g_ptr_array_index(priv->streams, (priv->next_stream + i) % n);
+
+    if (stream->busy || stream->flushing || stream->flow != GST_FLOW_OK ||
+        !gst_projectm_batch_stream_has_frame(stream)) {
+      continue;
+    }
+
+    GstProjectMBatchItem item = {0};
+    item.stream = stream;
+    item.audio = gst_adapter_take_buffer(
+        stream->adapter,
+        gst_projectm_batch_stream_frame_bytes(stream, stream->frame));
+    item.pts = gst_projectm_batch_stream_frame_pts(stream, stream->frame);
+    item.duration =
+        gst_projectm_batch_stream_frame_pts(stream, stream->frame + 1) -
+        item.pts;
+    item.flow = GST_FLOW_OK;
+    stream->frame++;
+    stream->busy = TRUE;
+    g_array_append_val(items, item);
+  }
+
+  if (n > 0) {
+    priv->next_stream = (priv->next_stream + 1) % n;
+  }
+
+  if (items->len > 0) {
+    /* Wake streaming threads waiting for queue space. */
+    g_cond_broadcast(&priv->cond);
+  }
+
+  return items->len > 0;
+}
+
+static void gst_projectm_batch_loop(gpointer data) {
+  GstProjectMBatch *batch = GST_PROJECTM_BATCH(data);
+  GstProjectMBatchPrivate *priv = batch->priv;
+  GArray *items = g_array_new(FALSE, TRUE, sizeof(GstProjectMBatchItem));
+
+  g_mutex_lock(&priv->lock);
+  while (priv->running && !gst_projectm_batch_collect(batch, items)) {
+    g_cond_wait(&priv->cond, &priv->lock);
+  }
+  if (!priv->running) {
+    g_mutex_unlock(&priv->lock);
+    g_array_unref(items);
+    gst_task_pause(priv->task);
+    return;
+  }
+  g_mutex_unlock(&priv->lock);
+
+  for (guint i = 0; i < items->len; i++) {
+    GstProjectMBatchItem *item = &g_array_index(items, GstProjectMBatchItem, i);
+
+    item->flow =
+        gst_buffer_pool_acquire_buffer(item->stream->pool, &item->out, NULL);
+    if (item->flow == GST_FLOW_OK) {
+      GST_BUFFER_PTS(item->out) = item->pts;
+      GST_BUFFER_DURATION(item->out) = item->duration;
+    }
+  }
+
+  gint64 start = g_get_monotonic_time();
+  GstProjectMBatchJob job = {batch, items};
+  gst_gl_context_thread_add(priv->context, gst_projectm_batch_gl_render, &job);
+  gst_projectm_stats_record(&priv->stats, GST_PROJECTM_PHASE_FRAME,
+                            g_get_monotonic_time() - start);
+
+  for (guint i = 0; i < items->len; i++) {
+    GstProjectMBatchItem *item = &g_array_index(items, GstProjectMBatchItem, i);
+    GstProjectMBatchStream *stream = item->stream;
+    GstFlowReturn flow = item->flow;
+
+    if (item->copied) {
+      flow = gst_pad_push(stream->srcpad, g_steal_pointer(&item->out));
+    } else if (flow == GST_FLOW_OK) {
+      GST_ELEMENT_ERROR(batch, RESOURCE, FAILED,
+                        ("Failed to render stream %u", stream->id), (NULL));
+      flow = GST_FLOW_ERROR;
+    }
+    gst_clear_buffer(&item->out);
+    gst_buffer_unref(item->audio);
+
+    g_mutex_lock(&priv->lock);
+    stream->busy = FALSE;
+    if (flow != GST_FLOW_OK && stream->flow == GST_FLOW_OK) {
+      GST_DEBUG_OBJECT(stream->srcpad, "Stream stopped: %s",
+                       gst_flow_get_name(flow));
+      stream->flow = flow;
+    }
+    g_mutex_unlock(&priv->lock);
+  }
+
+  g_mutex_lock(&priv->lock);
+  priv->batches++;
+  priv->batched_frames += items->len;
+  g_cond_broadcast(&priv->cond);
+  g_mutex_unlock(&priv->lock);
+
+  g_array_unref(items);
+}
+
+static gboolean gst_projectm_batch_stream_negotiate(GstProjectMBatch *batch,
+                                                    GstProjectMBatchStream *stream) {
+  GstProjectMBatchPrivate *priv = batch->priv;
+  GstVideoInfo vinfo;
+
+  if (!gst_projectm_batch_ensure_gl_context(batch)) {
+    return FALSE;
+  }
+
+  GstCaps *templ = gst_pad_get_pad_template_caps(stream->srcpad);
+  GstCaps *caps = gst_pad_peer_query_caps(stream->srcpad, templ);
+  gst_caps_unref(templ);
+
+  if (gst_caps_is_empty(caps)) {
+    GST_WARNING_OBJECT(stream->srcpad, "Downstream accepts no video format");
+    gst_caps_unref(caps);
+    return FALSE;
+  }
+
+  caps = gst_caps_make_writable(gst_caps_truncate(caps));
+  GstStructure *s = gst_caps_get_structure(caps, 0);
+  gst_structure_fixate_field_nearest_int(s, "width",
+                                         GST_PROJECTM_BATCH_DEFAULT_WIDTH);
+  gst_structure_fixate_field_nearest_int(s, "height",
+                                         GST_PROJECTM_BATCH_DEFAULT_HEIGHT);
+  gst_structure_fixate_field_nearest_fraction(
+      s, "framerate", GST_PROJECTM_BATCH_DEFAULT_FPS, 1);
+  caps = gst_caps_fixate(caps);
+
+  if (!gst_video_info_from_caps(&vinfo, caps) ||
+      GST_VIDEO_INFO_FPS_N(&vinfo) <= 0 ||
+      !gst_pad_set_caps(stream->srcpad, caps)) {
+    GST_WARNING_OBJECT(stream->srcpad, "Could not set caps %" GST_PTR_FORMAT,
+                       caps);
+    gst_caps_unref(caps);
+    return FALSE;
+  }
+
+  GstBufferPool *pool = gst_video_buffer_pool_new();
+  GstStructure *config = gst_buffer_pool_get_config(pool);
+  gst_buffer_pool_config_set_params(config, caps, GST_VIDEO_INFO_SIZE(&vinfo),
+                                    GST_PROJECTM_BATCH_QUEUED_FRAMES, 0);
+  gst_caps_unref(caps);
+
+  if (!gst_buffer_pool_set_config(pool, config) ||
+      !gst_buffer_pool_set_active(pool, TRUE)) {
+    GST_WARNING_OBJECT(stream->srcpad, "Could not activate buffer pool");
+    gst_object_unref(pool);
+    return FALSE;
+  }
+
+  g_mutex_lock(&priv->lock);
+  GstBufferPool *old_pool = stream->pool;
+  stream->pool = pool;
+  stream->vinfo = vinfo;
+  stream->negotiated = TRUE;
+  g_mutex_unlock(&priv->lock);
+
+  if (old_pool != NULL) {
+    gst_buffer_pool_set_active(old_pool, FALSE);
+    gst_object_unref(old_pool);
+  }
+
+  GST_INFO_OBJECT(stream->srcpad, "Rendering %dx%d at %d/%d",
+                  GST_VIDEO_INFO_WIDTH(&vinfo), GST_VIDEO_INFO_HEIGHT(&vinfo),
+                  GST_VIDEO_INFO_FPS_N(&vinfo), GST_VIDEO_INFO_FPS_D(&vinfo));
+  return TRUE;
+}
+
+static GstFlowReturn gst_projectm_batch_sink_chain(GstPad *pad,
+                                                   GstObject *parent,
+                                                   GstBuffer *buffer) {
+  GstProjectMBatch *batch = GST_PROJECTM_BATCH(parent);
+  GstProjectMBatchPrivate *priv = batch->priv;
+  GstProjectMBatchStream *stream = gst_pad_get_element_private(pad);
+  GstFlowReturn ret;
+
+  g_mutex_lock(&priv->lock);
+
+  if (!stream->negotiated) {
+    g_mutex_unlock(&priv->lock);
+    gst_buffer_unref(buffer);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  guint rate = GST_AUDIO_INFO_RATE(&stream->ainfo);
+
+  /* Restart the grid on the new timestamps when a discontinuity moves the
+   * audio by more than half a frame. */
+  if (GST_BUFFER_IS_DISCONT(buffer) && GST_BUFFER_PTS_IS_VALID(buffer) &&
+      GST_CLOCK_TIME_IS_VALID(stream->base_pts)) {
+    GstClockTime expected =
+        stream->base_pts +
+        gst_util_uint64_scale_int(stream->run_samples, GST_SECOND, rate);
+    GstClockTime half_frame = gst_util_uint64_scale_int(
+        GST_SECOND, GST_VIDEO_INFO_FPS_D(&stream->vinfo),
+        2 * GST_VIDEO_INFO_FPS_N(&stream->vinfo));
+    GstClockTime pts = GST_BUFFER_PTS(buffer);
+
+    if (pts > expected + half_frame || pts + half_frame < expected) {
+      GST_DEBUG_OBJECT(pad, "Discontinuity at %" GST_TIME_FORMAT,
+                       GST_TIME_ARGS(pts));
+      gst_projectm_batch_stream_reset(stream);
+    }
+  }
+
+  if (!GST_CLOCK_TIME_IS_VALID(stream->base_pts)) {
+    stream->base_pts = GST_BUFFER_PTS_IS_VALID(buffer) ? GST_BUFFER_PTS(buffer)
+                                                       : stream->segment.start;
+  }
+
+  stream->run_samples +=
+      gst_buffer_get_size(buffer) / GST_AUDIO_INFO_BPF(&stream->ainfo);
+  gst_adapter_push(stream->adapter, buffer);
+  g_cond_broadcast(&priv->cond);
+
+  while (!stream->flushing && priv->running && stream->flow == GST_FLOW_OK &&
+         gst_adapter_available(stream->adapter) >=
+             GST_PROJECTM_BATCH_QUEUED_FRAMES *
+                 gst_projectm_batch_stream_frame_bytes(stream, stream->frame)) {
+    g_cond_wait(&priv->cond, &priv->lock);
+  }
+
+  ret = (stream->flushing || !priv->running) ? GST_FLOW_FLUSHING : stream->flow;
+  g_mutex_unlock(&priv->lock);
+
+  return ret;
+}
+
+static gboolean gst_projectm_batch_sink_event(GstPad *pad, GstObject *parent,
+                                              GstEvent *event) {
+  GstProjectMBatch *batch = GST_PROJECTM_BATCH(parent);
+  GstProjectMBatchPrivate *priv = batch->priv;
+  GstProjectMBatchStream *stream = gst_pad_get_element_private(pad);
+
+  switch (GST_EVENT_TYPE(event)) {
+  case GST_EVENT_FLUSH_START:
+    g_mutex_lock(&priv->lock);
+    stream->flushing = TRUE;
+    g_cond_broadcast(&priv->cond);
+    g_mutex_unlock(&priv->lock);
+    break;
+
+  case GST_EVENT_FLUSH_STOP:
+    g_mutex_lock(&priv->lock);
+    while (stream->busy) {
+      g_cond_wait(&priv->cond, &priv->lock);
+    }
+    gst_projectm_batch_stream_reset(stream);
+    stream->flushing = FALSE;
+    stream->flow = GST_FLOW_OK;
+    g_mutex_unlock(&priv->lock);
+    break;
+
+  case GST_EVENT_CAPS: {
+    GstCaps *caps;
+    GstAudioInfo ainfo;
+
+    gst_event_parse_caps(event, &caps);
+    if (!gst_audio_info_from_caps(&ainfo, caps)) {
+      gst_event_unref(event);
+      return FALSE;
+    }
+
+    g_mutex_lock(&priv->lock);
+    gst_projectm_batch_stream_drain(batch, stream, TRUE);
+    stream->ainfo = ainfo;
+    g_mutex_unlock(&priv->lock);
+
+    gst_event_unref(event);
+    return gst_projectm_batch_stream_negotiate(batch, stream);
+  }
+
+  case GST_EVENT_SEGMENT: {
+    GstSegment segment;
+
+    gst_event_copy_segment(event, &segment);
+    if (segment.format != GST_FORMAT_TIME) {
+      GST_WARNING_OBJECT(pad, "Segment in %s format, expected time",
+                         gst_format_get_name(segment.format));
+      gst_event_unref(event);
+      return FALSE;
+    }
+
+    g_mutex_lock(&priv->lock);
+    gst_projectm_batch_stream_drain(batch, stream, TRUE);
+    stream->segment = segment;
+    g_mutex_unlock(&priv->lock);
+    break;
+  }
+
+  case GST_EVENT_STREAM_START:
+  case GST_EVENT_EOS:
+    g_mutex_lock(&priv->lock);
+    gst_projectm_batch_stream_drain(batch, stream, TRUE);
+    g_mutex_unlock(&priv->lock);
+    break;
+
+  default:
+    if (GST_EVENT_IS_SERIALIZED(event)) {
+      g_mutex_lock(&priv->lock);
+      gst_projectm_batch_stream_drain(batch, stream, FALSE);
+      g_mutex_unlock(&priv->lock);
+    }
+    break;
+  }
+
+  return gst_pad_push_event(stream->srcpad, event);
+}
+
+static gboolean gst_projectm_batch_src_event(GstPad *pad, GstObject *parent,
+                                             GstEvent *event) {
+  GstProjectMBatchStream *stream = gst_pad_get_element_private(pad);
+
+  return gst_pad_push_event(stream->sinkpad, event);
+}
+
+static gboolean gst_projectm_batch_query(GstPad *pad, GstObject *parent,
+                                         GstQuery *query) {
+  GstProjectMBatch *batch = GST_PROJECTM_BATCH(parent);
+  GstProjectMBatchPrivate *priv = batch->priv;
+
+  if (GST_QUERY_TYPE(query) == GST_QUERY_CONTEXT) {
+    gboolean ret;
+
+    g_rec_mutex_lock(&priv->context_lock);
+    ret = gst_gl_handle_context_query(GST_ELEMENT(batch), query,
+                                      priv->display, priv->context,
+                                      priv->other_context);
+    g_rec_mutex_unlock(&priv->context_lock);
+
+    if (ret) {
+      return TRUE;
+    }
+  }
+
+  return gst_pad_query_default(pad, parent, query);
+}
+
+static GstPad *gst_projectm_batch_request_new_pad(GstElement *element,
+                                                  GstPadTemplate *templ,
+                                                  const gchar *name,
+                                                  const GstCaps *caps) {
+  GstProjectMBatch *batch = GST_PROJECTM_BATCH(element);
+  GstProjectMBatchPrivate *priv = batch->priv;
+  guint id;
+
+  g_mutex_lock(&priv->lock);
+  if (name != NULL && sscanf(name, "sink_%u", &id) == 1) {
+    for (guint i = 0; i < priv->streams->len; i++) {
+      GstProjectMBatchStream *other = g_ptr_array_index(priv->streams, i);
+      if (other->id == id) {
+        g_mutex_unlock(&priv->lock);
+        GST_WARNING_OBJECT(batch, "Pad %s already exists", name);
+        return NULL;
+      }
+    }
+    priv->next_pad_id = MAX(priv->next_pad_id, id + 1);
+  } else {
+    id = priv->next_pad_id++;
+  }
+
+  GstProjectMBatchStream *stream = g_new0(GstProjectMBatchStream, 1);
+  stream->batch = batch;
+  stream->id = id;
+  stream->adapter = gst_adapter_new();
+  stream->flow = GST_FLOW_OK;
+  gst_segment_init(&stream->segment, GST_FORMAT_TIME);
+  gst_projectm_batch_stream_reset(stream);
+
+  gchar *pad_name = g_strdup_printf("sink_%u", id);
+  stream->sinkpad = gst_pad_new_from_template(templ, pad_name);
+  g_free(pad_name);
+  pad_name = g_strdup_printf("src_%u", id);
+  stream->srcpad = gst_pad_new_from_static_template(
+      &gst_projectm_batch_src_template, pad_name);
+  g_free(pad_name);
+
+  gst_pad_set_element_private(stream->sinkpad, stream);
+  gst_pad_set_chain_function(stream->sinkpad,
+                             GST_DEBUG_FUNCPTR(gst_projectm_batch_sink_chain));
+  gst_pad_set_event_function(stream->sinkpad,
+                             GST_DEBUG_FUNCPTR(gst_projectm_batch_sink_event));
+  gst_pad_set_query_function(stream->sinkpad,
+                             GST_DEBUG_FUNCPTR(gst_projectm_batch_query));
+
+  gst_pad_set_element_private(stream->srcpad, stream);
+  gst_pad_set_event_function(stream->srcpad,
+                             GST_DEBUG_FUNCPTR(gst_projectm_batch_src_event));
+  gst_pad_set_query_function(stream->srcpad,
+                             GST_DEBUG_FUNCPTR(gst_projectm_batch_query));
+  gst_pad_use_fixed_caps(stream->srcpad);
+
+  g_ptr_array_add(priv->streams, stream);
+  g_mutex_unlock(&priv->lock);
+
+  gst_element_add_pad(element, stream->srcpad);
+  gst_element_add_pad(element, stream->sinkpad);
+
+  return stream->sinkpad;
+}
+
+static void gst_projectm_batch_stream_free(GstProjectMBatchStream *stream) {
+  if (stream->pool != NULL) {
+    gst_buffer_pool_set_active(stream->pool, FALSE);
+    gst_object_unref(stream->pool);
+  }
+  g_object_unref(stream->adapter);
+  g_free(stream);
+}
+
+static void gst_projectm_batch_release_pad(GstElement *element, GstPad *pad) {
+  GstProjectMBatch *batch = GST_PROJECTM_BATCH(element);
+  GstProjectMBatchPrivate *priv = batch->priv;
+  GstProjectMBatchStream *stream = gst_pad_get_element_private(pad);
+
+  g_mutex_lock(&priv->lock);
+  stream->flushing = TRUE;
+  g_cond_broadcast(&priv->cond);
+  while (stream->busy) {
+    g_cond_wait(&priv->cond, &priv->lock);
+  }
+  g_ptr_array_remove(priv->streams, stream);
+  g_mutex_unlock(&priv->lock);
+
+  gst_projectm_batch_release_gl(batch, stream);
+
+  gst_element_remove_pad(element, stream->srcpad);
+  gst_element_remove_pad(element, stream->sinkpad);
+  gst_projectm_batch_stream_free(stream);
+}
+
+static void gst_projectm_batch_set_context(GstElement *element,
+                                           GstContext *context) {
+  GstProjectMBatch *batch = GST_PROJECTM_BATCH(element);
+  GstProjectMBatchPrivate *priv = batch->priv;
+
+  g_rec_mutex_lock(&priv->context_lock);
+  gst_gl_handle_set_context(element, context, &priv->display,
+                            &priv->other_context);
+  if (priv->display)
+    gst_gl_display_filter_gl_api(priv->display, gst_projectm_batch_gl_api);
+  g_rec_mutex_unlock(&priv->context_lock);
+
+  GST_ELEMENT_CLASS(parent_class)->set_context(element, context);
+}
+
+static GstStateChangeReturn
+gst_projectm_batch_change_state(GstElement *element,
+                                GstStateChange transition) {
+  GstProjectMBatch *batch = GST_PROJECTM_BATCH(element);
+  GstProjectMBatchPrivate *priv = batch->priv;
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+  case GST_STATE_CHANGE_READY_TO_PAUSED:
+    g_mutex_lock(&priv->lock);
+    priv->running = TRUE;
+    g_mutex_unlock(&priv->lock);
+    gst_task_start(priv->task);
+    break;
+  case GST_STATE_CHANGE_PAUSED_TO_READY:
+    /* Wake the scheduler and any streaming thread waiting on it. */
+    g_mutex_lock(&priv->lock);
+    priv->running = FALSE;
+    g_cond_broadcast(&priv->cond);
+    g_mutex_unlock(&priv->lock);
+    gst_task_stop(priv->task);
+    gst_task_join(priv->task);
+    break;
+  default:
+    break;
+  }
+
+  ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+  if (ret == GST_STATE_CHANGE_FAILURE)
+    return ret;
+
+  switch (transition) {
+  case GST_STATE_CHANGE_PAUSED_TO_READY:
+    g_mutex_lock(&priv->lock);
+    for (guint i = 0; i < priv->streams->len; i++) {
+      GstProjectMBatchStream *stream = g_ptr_array_index(priv->streams, i);
+      gst_projectm_batch_stream_reset(stream);
+      stream->negotiated = FALSE;
+      stream->flushing = FALSE;
+      stream->flow = GST_FLOW_OK;
+      gst_projectm_batch_release_gl(batch, stream);
+    }
+    g_mutex_unlock(&priv->lock);
+    break;
+  case GST_STATE_CHANGE_READY_TO_NULL:
+    g_rec_mutex_lock(&priv->context_lock);
+    gst_clear_object(&priv->context);
+    gst_clear_object(&priv->other_context);
+    gst_clear_object(&priv->display);
+    g_rec_mutex_unlock(&priv->context_lock);
+    break;
+  default:
+    break;
+  }
+
+  return ret;
+}
+
+static void gst_projectm_batch_set_property(GObject *object, guint prop_id,
+                                            const GValue *value,
+                                            GParamSpec *pspec) {
+  GstProjectMBatch *batch = GST_PROJECTM_BATCH(object);
+
+  GST_OBJECT_LOCK(batch);
+  switch (prop_id) {
+  case PROP_PRESET_PATH:
+    g_free(batch->preset_path);
+    batch->preset_path = g_value_dup_string(value);
+    break;
+  case PROP_TEXTURE_DIR_PATH:
+    g_free(batch->texture_dir_path);
+    batch->texture_dir_path = g_value_dup_string(value);
+    break;
+  case PROP_BEAT_SENSITIVITY:
+    batch->beat_sensitivity = g_value_get_float(value);
+    break;
+  case PROP_PRESET_DURATION:
+    batch->preset_duration = g_value_get_double(value);
+    break;
+  case PROP_MESH_SIZE: {
+    gchar **parts = g_strsplit(g_value_get_string(value), ",", 2);
+
+    if (g_strv_length(parts) == 2) {
+      batch->mesh_width = atoi(parts[0]);
+      batch->mesh_height = atoi(parts[1]);
+    }
+    g_strfreev(parts);
+  } break;
+  case PROP_SHUFFLE_PRESETS:
+    batch->shuffle_presets = g_value_get_boolean(value);
+    break;
+  case PROP_VERTICAL_FLIP:
+    batch->vertical_flip = g_value_get_boolean(value);
+    break;
+  case PROP_MAX_BATCH:
+    batch->max_batch = g_value_get_uint(value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+  GST_OBJECT_UNLOCK(batch);
+}
+
+static void gst_projectm_batch_get_property(GObject *object, guint prop_id,
+                                            GValue *value, GParamSpec *pspec) {
+  GstProjectMBatch *batch = GST_PROJECTM_BATCH(object);
+  GstProjectMBatchPrivate *priv = batch->priv;
+
+  switch (prop_id) {
+  case PROP_PRESET_PATH:
+    GST_OBJECT_LOCK(batch);
+    g_value_set_string(value, batch->preset_path);
+    GST_OBJECT_UNLOCK(batch);
+    break;
+  case PROP_TEXTURE_DIR_PATH:
+    GST_OBJECT_LOCK(batch);
+    g_value_set_string(value, batch->texture_dir_path);
+    GST_OBJECT_UNLOCK(batch);
+    break;
+  case PROP_BEAT_SENSITIVITY:
+    g_value_set_float(value, batch->beat_sensitivity);
+    break;
+  case PROP_PRESET_DURATION:
+    g_value_set_double(value, batch->preset_duration);
+    break;
+  case PROP_MESH_SIZE:
+    g_value_take_string(value, g_strdup_printf("%lu,%lu", batch->mesh_width,
+                                               batch->mesh_height));
+    break;
+  case PROP_SHUFFLE_PRESETS:
+    g_value_set_boolean(value, batch->shuffle_presets);
+    break;
+  case PROP_VERTICAL_FLIP:
+    g_value_set_boolean(value, batch->vertical_flip);
+    break;
+  case PROP_MAX_BATCH:
+    g_value_set_uint(value, batch->max_batch);
+    break;
+  case PROP_STATS: {
+    GstStructure *stats = gst_projectm_stats_to_structure(&priv->stats);
+
+    g_mutex_lock(&priv->lock);
+    gst_structure_set(stats, "streams", G_TYPE_UINT, priv->streams->len,
+                      "batches", G_TYPE_UINT64, priv->batches,
+                      "batched-frames", G_TYPE_UINT64, priv->batched_frames,
+                      NULL);
+    g_mutex_unlock(&priv->lock);
+    g_value_take_boxed(value, stats);
+  } break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void gst_projectm_batch_init(GstProjectMBatch *batch) {
+  GstProjectMBatchPrivate *priv = gst_projectm_batch_get_instance_private(batch);
+
+  batch->priv = priv;
+
+  batch->preset_path = g_strdup(DEFAULT_PRESET_PATH);
+  batch->texture_dir_path = g_strdup(DEFAULT_TEXTURE_DIR_PATH);
+  batch->beat_sensitivity = DEFAULT_BEAT_SENSITIVITY;
+  batch->preset_duration = DEFAULT_PRESET_DURATION;
+  batch->shuffle_presets = DEFAULT_SHUFFLE_PRESETS;
+  batch->vertical_flip = DEFAULT_VERTICAL_FLIP;
+  batch->max_batch = DEFAULT_MAX_BATCH;
+
+  gchar **mesh = g_strsplit(DEFAULT_MESH_SIZE, ",", 2);
+  batch->mesh_width = atoi(mesh[0]);
+  batch->mesh_height = atoi(mesh[1]);
+  g_strfreev(mesh);
+
+  g_rec_mutex_init(&priv->context_lock);
+  g_mutex_init(&priv->lock);
+  g_cond_init(&priv->cond);
+  priv->streams = g_ptr_array_new();
+
+  g_rec_mutex_init(&priv->task_lock);
+  priv->task = gst_task_new(gst_projectm_batch_loop, batch, NULL);
+  gst_task_set_lock(priv->task, &priv->task_lock);
+
+  gst_projectm_stats_init(&priv->stats);
+}
+
+static void gst_projectm_batch_finalize(GObject *object) {
+  GstProjectMBatch *batch = GST_PROJECTM_BATCH(object);
+  GstProjectMBatchPrivate *priv = batch->priv;
+
+  gst_object_unref(priv->task);
+  g_rec_mutex_clear(&priv->task_lock);
+  g_ptr_array_unref(priv->streams);
+  g_cond_clear(&priv->cond);
+  g_mutex_clear(&priv->lock);
+  g_rec_mutex_clear(&priv->context_lock);
+  gst_projectm_stats_clear(&priv->stats);
+
+  g_free(batch->preset_path);
+  g_free(batch->texture_dir_path);
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void gst_projectm_batch_class_init(GstProjectMBatchClass *klass) {
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+
+  gst_element_class_add_pad_template(
+      element_class,
+      gst_pad_template_new("sink_%u", GST_PAD_SINK, GST_PAD_REQUEST,
+                           gst_caps_from_string(get_audio_sink_cap(0))));
+  gst_element_class_add_static_pad_template(element_class,
+                                            &gst_projectm_batch_src_template);
+
+  gst_element_class_set_static_metadata(
+      element_class, "ProjectM Batch Visualizer", "Generic",
+      "Visualizes several audio streams with ProjectM on one OpenGL context",
+      "AnomieVision <anomievision@gmail.com> | Tristan Charpentier "
+      "<tristan_charpentier@hotmail.com>");
+
+  element_class->change_state =
+      GST_DEBUG_FUNCPTR(gst_projectm_batch_change_state);
+  element_class->request_new_pad =
+      GST_DEBUG_FUNCPTR(gst_projectm_batch_request_new_pad);
+  element_class->release_pad = GST_DEBUG_FUNCPTR(gst_projectm_batch_release_pad);
+  element_class->set_context = GST_DEBUG_FUNCPTR(gst_projectm_batch_set_context);
+
+  gobject_class->set_property = gst_projectm_batch_set_property;
+  gobject_class->get_property = gst_projectm_batch_get_property;
+  gobject_class->finalize = gst_projectm_batch_finalize;
+
+  g_object_class_install_property(
+      gobject_class, PROP_PRESET_PATH,
+      g_param_spec_string("preset", "Preset",
+                          "Preset file or directory every stream plays. "
+                          "Applies to streams negotiated afterwards.",
+                          DEFAULT_PRESET_PATH,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_TEXTURE_DIR_PATH,
+      g_param_spec_string("texture-dir", "Texture Directory",
+                          "Sets the path to the directory containing textures "
+                          "used in the visualizer.",
+                          DEFAULT_TEXTURE_DIR_PATH,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_BEAT_SENSITIVITY,
+      g_param_spec_float(
+          "beat-sensitivity", "Beat Sensitivity",
+          "Controls the sensitivity to audio beats. Higher values make the "
+          "visualizer respond more strongly to beats.",
+          0.0, 5.0, DEFAULT_BEAT_SENSITIVITY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_PRESET_DURATION,
+      g_param_spec_double("preset-duration", "Preset Duration",
+                          "Sets the duration, in seconds, for each preset. A "
+                          "zero value causes the preset to play indefinitely.",
+                          0.0, 999999.0, DEFAULT_PRESET_DURATION,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_MESH_SIZE,
+      g_param_spec_string("mesh-size", "Mesh Size",
+                          "Sets the size of the mesh used in rendering. The "
+                          "format is 'width,height'.",
+                          DEFAULT_MESH_SIZE,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_SHUFFLE_PRESETS,
+      g_param_spec_boolean("shuffle-presets", "Shuffle Presets",
+                           "Play the presets of a directory in random order.",
+                           DEFAULT_SHUFFLE_PRESETS,
+                           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_VERTICAL_FLIP,
+      g_param_spec_boolean(
+          "vertical-flip", "Vertical Flip",
+          "Output frames top-down instead of in OpenGL's bottom-up row order.",
+          DEFAULT_VERTICAL_FLIP, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_MAX_BATCH,
+      g_param_spec_uint(
+          "max-batch", "Maximum Batch",
+          "Most streams rendered in one batch, 0 for every stream with a "
+          "frame ready. Smaller batches bound the latency a stream waits "
+          "for the others.",
+          0, G_MAXUINT, DEFAULT_MAX_BATCH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_STATS,
+      g_param_spec_boxed(
+          "stats", "Statistics",
+          "Per-frame audio, render, readback and copy timing, whole-batch "
+          "timing as the frame phase, and stream, batch and frame counts.",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+}
@@ -0,0 +1,43 @@
+#ifndef __GST_PROJECTM_BATCH_H__
+#define __GST_PROJECTM_BATCH_H__
+
+#include <gst/gst.h>
+
+typedef struct _GstProjectMBatchPrivate GstProjectMBatchPrivate;
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_PROJECTM_BATCH (gst_projectm_batch_get_type())
+G_DECLARE_FINAL_TYPE(GstProjectMBatch, gst_projectm_batch, GST, PROJECTM_BATCH,
+                     GstElement)
+
+/**
+ * @brief Renders any number of audio streams, each with its own projectM
+ * instance, on one shared GL context.
+ *
+ * Every "sink_%u" request pad gets a matching "src_%u" pad. A scheduler
+ * thread collects the streams that have a frame's worth of audio and renders
+ * them as a batch: all instances render and queue their readback first, and
+ * the frames are copied out afterwards, so the readback of one stream
+ * overlaps the rendering of the next. The stream that goes first rotates
+ * between batches.
+ */
+struct _GstProjectMBatch {
+  GstElement element;
+
+  gchar *preset_path;
+  gchar *texture_dir_path;
+  gfloat beat_sensitivity;
+  gdouble preset_duration;
+  gulong mesh_width;
+  gulong mesh_height;
+  gboolean shuffle_presets;
+  gboolean vertical_flip;
+  guint max_batch;
+
+  GstProjectMBatchPrivate *priv;
+};
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_BATCH_H__ */
@@ -7,7 +7,6 @@
 #include <gst/video/video-format.h>
 
 #include "caps.h"
-#include "plugin.h"
 
 GST_DEBUG_CATEGORY_STATIC(gst_projectm_caps_debug);
 #define GST_CAT_DEFAULT gst_projectm_caps_debug
@@ -39,8 +38,14 @@ const gchar *get_video_src_cap(unsigned int type) {
 
   switch (type) {
   case 0:
-    format = GST_VIDEO_CAPS_MAKE("video/x-raw, format = (string) { ABGR }, "
-                                 "framerate=(fraction)[0/1,MAX]");
+    /* DMABuf first so hardware encoders that import it are preferred; the
+     * element drops it again when the GL context cannot export. */
+    format =
+#ifdef __linux__
+        GST_VIDEO_CAPS_MAKE_WITH_FEATURES("memory:DMABuf", "NV12") "; "
+#endif
+        GST_VIDEO_CAPS_MAKE("video/x-raw, format = (string) { ABGR }, "
+                            "framerate=(fraction)[0/1,MAX]");
     break;
   default:
     format = NULL;
@@ -3,8 +3,6 @@
 
 #include <glib.h>
 
-#include "plugin.h"
-
 G_BEGIN_DECLS
 
 /**
@@ -34,6 +34,24 @@ G_BEGIN_DECLS
 #define DEFAULT_ENABLE_PLAYLIST TRUE
 #define DEFAULT_SHUFFLE_PRESETS TRUE // depends on ENABLE_PLAYLIST
 #define DEFAULT_TIMELINE_PATH NULL
+#define DEFAULT_READBACK_MODE GST_PROJECTM_READBACK_AUTO
+#define DEFAULT_VERTICAL_FLIP FALSE
+#define DEFAULT_COPY_THREADS 0
+#define DEFAULT_RENDER_RATE_N 0 // 0/1 renders every output frame
+#define DEFAULT_RENDER_RATE_D 1
+#define DEFAULT_KEYFRAME_INTERVAL 0 // disabled
+#define DEFAULT_KEYFRAME_TIMESTAMPS NULL
+#define DEFAULT_KEYFRAME_WARMUP 0
+#define DEFAULT_PRESET_INDEX_PATH NULL
+#define DEFAULT_TEXTURE_PREFETCH_BUDGET 0 // MiB, 0 disables prefetching
+#define DEFAULT_COMPRESS_TEXTURES FALSE
+#define DEFAULT_MAX_BATCH 0 // every stream with a frame ready
+#define DEFAULT_COLUMNS 0   // smallest square grid
+#define DEFAULT_RENDER_PROFILE GST_PROJECTM_RENDER_PROFILE_AUTO
+#define DEFAULT_CPU_THREADS 0 // Mesa's default
+#define DEFAULT_CPU_MESH_SIZE "32,24" // mesh-size under the CPU profile
+#define DEFAULT_ANALYSIS_WINDOW 0 // each frame's own audio
+#define DEFAULT_ANALYSIS_HOP 0    // advance with every frame
 
 G_END_DECLS
 
@@ -0,0 +1,667 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gl/gstglconfig.h>
+#include <gst/gl/gstglfuncs.h>
+
+#include "dmabuf.h"
+
+#if GST_GL_HAVE_PLATFORM_EGL && GST_GL_HAVE_DMABUF
+#define GST_PROJECTM_HAVE_DMABUF 1
+#include <gst/allocators/gstdmabuf.h>
+#include <gst/gl/egl/gsteglimage.h>
+#include <unistd.h>
+#endif
+
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#endif
+#ifndef GL_SYNC_FLUSH_COMMANDS_BIT
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#endif
+#ifndef GL_ALREADY_SIGNALED
+#define GL_ALREADY_SIGNALED 0x911A
+#endif
+#ifndef GL_CONDITION_SATISFIED
+#define GL_CONDITION_SATISFIED 0x911C
+#endif
+#ifndef GL_COLOR_ATTACHMENT0
+#define GL_COLOR_ATTACHMENT0 0x8CE0
+#endif
+
+#define GST_PROJECTM_DMABUF_FENCE_TIMEOUT_NS (G_GUINT64_CONSTANT(1000000000))
+
+/* Size of the texture exported once per context to confirm the driver
+ * really hands out DMABufs, not just advertises the extension. */
+#define GST_PROJECTM_DMABUF_PROBE_SIZE 64
+
+GST_DEBUG_CATEGORY_STATIC(gst_projectm_dmabuf_debug);
+#define GST_CAT_DEFAULT gst_projectm_dmabuf_debug
+
+static void gst_projectm_dmabuf_init_debug(void) {
+  static gsize done = 0;
+
+  if (g_once_init_enter(&done)) {
+    GST_DEBUG_CATEGORY_INIT(gst_projectm_dmabuf_debug, "projectm-dmabuf", 0,
+                            "projectM DMABuf export");
+    g_once_init_leave(&done, 1);
+  }
+}
+
+gboolean gst_projectm_caps_are_dmabuf(const GstCaps *caps) {
+  if (caps == NULL) {
+    return FALSE;
+  }
+
+  for (guint i = 0; i < gst_caps_get_size(caps); i++) {
+    GstCapsFeatures *features = gst_caps_get_features(caps, i);
+
+    if (features != NULL &&
+        gst_caps_features_contains(features,
+                                   GST_PROJECTM_CAPS_FEATURE_MEMORY_DMABUF)) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+void gst_projectm_caps_strip_dmabuf(GstCaps *caps) {
+  g_return_if_fail(gst_caps_is_writable(caps));
+
+  for (guint i = gst_caps_get_size(caps); i > 0; i--) {
+    GstCapsFeatures *features = gst_caps_get_features(caps, i - 1);
+
+    if (features != NULL &&
+        gst_caps_features_contains(features,
+                                   GST_PROJECTM_CAPS_FEATURE_MEMORY_DMABUF)) {
+      gst_caps_remove_structure(caps, i - 1);
+    }
+  }
+}
+
+#ifdef GST_PROJECTM_HAVE_DMABUF
+
+static GQuark gst_projectm_dmabuf_textures_quark(void) {
+  static GQuark quark = 0;
+
+  if (quark == 0) {
+    quark = g_quark_from_static_string("GstProjectMDmaBufTextures");
+  }
+
+  return quark;
+}
+
+typedef struct {
+  GstBuffer *gl_buffer;
+  guint n_planes;
+  gint fds[GST_VIDEO_MAX_PLANES];
+  gint strides[GST_VIDEO_MAX_PLANES];
+  gsize offsets[GST_VIDEO_MAX_PLANES];
+  gboolean result;
+} GstProjectMDmaBufExport;
+
+static void gst_projectm_dmabuf_export_gl(GstGLContext *context,
+                                          gpointer data) {
+  GstProjectMDmaBufExport *export = (GstProjectMDmaBufExport *)data;
+
+  export->result = TRUE;
+
+  for (guint i = 0; i < export->n_planes; i++) {
+    GstGLMemory *gl_mem =
+        (GstGLMemory *)gst_buffer_peek_memory(export->gl_buffer, i);
+    GstEGLImage *image = gst_egl_image_from_texture(context, gl_mem, NULL);
+
+    export->fds[i] = -1;
+    if (image == NULL) {
+      GST_DEBUG("Failed to create EGL image of plane %u", i);
+      export->result = FALSE;
+      continue;
+    }
+
+    /* Fails for tiled layouts too, which caps without modifiers cannot
+     * describe. */
+    if (!gst_egl_image_export_dmabuf(image, &export->fds[i],
+                                     &export->strides[i],
+                                     &export->offsets[i])) {
+      GST_DEBUG("Failed to export plane %u as DMABuf", i);
+      export->fds[i] = -1;
+      export->result = FALSE;
+    }
+    gst_egl_image_unref(image);
+  }
+
+  if (!export->result) {
+    for (guint i = 0; i < export->n_planes; i++) {
+      if (export->fds[i] >= 0) {
+        close(export->fds[i]);
+        export->fds[i] = -1;
+      }
+    }
+  }
+}
+
+/* Allocates NV12 textures for info and exports them. On success the caller
+ * owns gl_buffer and the file descriptors in export. */
+static gboolean gst_projectm_dmabuf_export_new(GstGLContext *context,
+                                               const GstVideoInfo *info,
+                                               GstProjectMDmaBufExport *export) {
+  GstGLMemoryAllocator *allocator =
+      gst_gl_memory_allocator_get_default(context);
+  GstGLVideoAllocationParams *params = gst_gl_video_allocation_params_new(
+      context, NULL, info, 0, NULL, GST_GL_TEXTURE_TARGET_2D, 0);
+
+  memset(export, 0, sizeof(*export));
+  export->gl_buffer = gst_buffer_new();
+  export->n_planes = GST_VIDEO_INFO_N_PLANES(info);
+
+  gboolean ok = gst_gl_memory_setup_buffer(allocator, export->gl_buffer,
+                                           params, NULL, NULL, 0);
+  gst_gl_allocation_params_free((GstGLAllocationParams *)params);
+  gst_object_unref(allocator);
+
+  if (ok) {
+    gst_gl_context_thread_add(context, gst_projectm_dmabuf_export_gl, export);
+    ok = export->result;
+  }
+
+  if (!ok) {
+    gst_clear_buffer(&export->gl_buffer);
+  }
+
+  return ok;
+}
+
+static gboolean gst_projectm_dmabuf_formats_supported(GstGLContext *context) {
+  /* NV12 planes are rendered into R8 and RG8 textures. */
+  return gst_gl_context_check_gl_version(context, GST_GL_API_OPENGL3, 3, 0) ||
+         gst_gl_context_check_gl_version(context, GST_GL_API_GLES2, 3, 0) ||
+         gst_gl_context_check_feature(context, "GL_ARB_texture_rg") ||
+         gst_gl_context_check_feature(context, "GL_EXT_texture_rg");
+}
+
+gboolean gst_projectm_dmabuf_supported(GstGLContext *context) {
+  GstProjectMDmaBufExport export;
+  GstVideoInfo info;
+
+  gst_projectm_dmabuf_init_debug();
+
+  if (gst_gl_context_get_gl_platform(context) != GST_GL_PLATFORM_EGL) {
+    GST_INFO("DMABuf export needs an EGL context");
+    return FALSE;
+  }
+
+  if (!gst_gl_context_check_feature(context, "EGL_MESA_image_dma_buf_export") ||
+      !gst_gl_context_check_feature(context, "EGL_KHR_gl_texture_2D_image")) {
+    GST_INFO("EGL does not support exporting textures as DMABuf");
+    return FALSE;
+  }
+
+  if (!gst_projectm_dmabuf_formats_supported(context)) {
+    GST_INFO("No renderable R8/RG8 textures for NV12 planes");
+    return FALSE;
+  }
+
+  gst_video_info_set_format(&info, GST_VIDEO_FORMAT_NV12,
+                            GST_PROJECTM_DMABUF_PROBE_SIZE,
+                            GST_PROJECTM_DMABUF_PROBE_SIZE);
+  if (!gst_projectm_dmabuf_export_new(context, &info, &export)) {
+    GST_INFO("Driver failed to export a linear NV12 texture");
+    return FALSE;
+  }
+
+  for (guint i = 0; i < export.n_planes; i++) {
+    close(export.fds[i]);
+  }
+  gst_buffer_unref(export.gl_buffer);
+
+  GST_INFO("DMABuf export supported");
+  return TRUE;
+}
+
+typedef struct {
+  GstBufferPool parent;
+
+  GstGLContext *context;
+  GstAllocator *allocator;
+  GstVideoInfo info;
+} GstProjectMDmaBufPool;
+
+typedef struct {
+  GstBufferPoolClass parent_class;
+} GstProjectMDmaBufPoolClass;
+
+G_DEFINE_TYPE(GstProjectMDmaBufPool, gst_projectm_dmabuf_pool,
+              GST_TYPE_BUFFER_POOL);
+
+/* Wraps exported planes into a buffer of one DMABuf memory per plane. */
+static GstBuffer *gst_projectm_dmabuf_pool_wrap(GstProjectMDmaBufPool *self,
+                                                GstProjectMDmaBufExport *export) {
+  GstBuffer *buffer = gst_buffer_new();
+  gsize offsets[GST_VIDEO_MAX_PLANES];
+  gint strides[GST_VIDEO_MAX_PLANES];
+  gsize total = 0;
+
+  for (guint i = 0; i < export->n_planes; i++) {
+    gsize plane_end =
+        export->offsets[i] +
+        (gsize)export->strides[i] *
+            GST_VIDEO_INFO_COMP_HEIGHT(&self->info, i == 0 ? 0 : 1);
+    off_t size = lseek(export->fds[i], 0, SEEK_END);
+    GstMemory *mem = gst_dmabuf_allocator_alloc(
+        self->allocator, export->fds[i],
+        size > 0 ? (gsize)size : plane_end);
+
+    /* Only the plane itself, so buffer sizes do not depend on how much the
+     * driver padded the allocation. */
+    gst_memory_resize(mem, 0, plane_end);
+    gst_buffer_append_memory(buffer, mem);
+
+    offsets[i] = total + export->offsets[i];
+    strides[i] = export->strides[i];
+    total += plane_end;
+  }
+
+  gst_mini_object_set_qdata(
+      GST_MINI_OBJECT_CAST(gst_buffer_peek_memory(buffer, 0)),
+      gst_projectm_dmabuf_textures_quark(), export->gl_buffer,
+      (GDestroyNotify)gst_buffer_unref);
+
+  gst_buffer_add_video_meta_full(
+      buffer, GST_VIDEO_FRAME_FLAG_NONE, GST_VIDEO_INFO_FORMAT(&self->info),
+      GST_VIDEO_INFO_WIDTH(&self->info), GST_VIDEO_INFO_HEIGHT(&self->info),
+      export->n_planes, offsets, strides);
+
+  return buffer;
+}
+
+static const gchar **gst_projectm_dmabuf_pool_get_options(GstBufferPool *pool) {
+  static const gchar *options[] = {GST_BUFFER_POOL_OPTION_VIDEO_META, NULL};
+
+  return options;
+}
+
+static gboolean gst_projectm_dmabuf_pool_set_config(GstBufferPool *pool,
+                                                    GstStructure *config) {
+  GstProjectMDmaBufPool *self = (GstProjectMDmaBufPool *)pool;
+  GstProjectMDmaBufExport export;
+  GstCaps *caps = NULL;
+  guint min_buffers, max_buffers;
+
+  if (!gst_buffer_pool_config_get_params(config, &caps, NULL, &min_buffers,
+                                         &max_buffers) ||
+      caps == NULL) {
+    GST_WARNING_OBJECT(pool, "No caps in pool configuration");
+    return FALSE;
+  }
+
+  if (!gst_video_info_from_caps(&self->info, caps) ||
+      GST_VIDEO_INFO_FORMAT(&self->info) != GST_VIDEO_FORMAT_NV12) {
+    GST_WARNING_OBJECT(pool, "Unsupported caps %" GST_PTR_FORMAT, caps);
+    return FALSE;
+  }
+
+  /* Strides are up to the driver, so export one frame to learn the buffer
+   * size the pool checks returned buffers against. */
+  if (!gst_projectm_dmabuf_export_new(self->context, &self->info, &export)) {
+    GST_WARNING_OBJECT(pool, "Failed to export %dx%d NV12 frame",
+                       GST_VIDEO_INFO_WIDTH(&self->info),
+                       GST_VIDEO_INFO_HEIGHT(&self->info));
+    return FALSE;
+  }
+
+  GstBuffer *probe = gst_projectm_dmabuf_pool_wrap(self, &export);
+  gsize size = gst_buffer_get_size(probe);
+  gst_buffer_unref(probe);
+
+  gst_buffer_pool_config_set_params(config, caps, (guint)size, min_buffers,
+                                    max_buffers);
+
+  return GST_BUFFER_POOL_CLASS(gst_projectm_dmabuf_pool_parent_class)
+      ->set_config(pool, config);
+}
+
+static GstFlowReturn
+gst_projectm_dmabuf_pool_alloc_buffer(GstBufferPool *pool, GstBuffer **buffer,
+                                      GstBufferPoolAcquireParams *params) {
+  GstProjectMDmaBufPool *self = (GstProjectMDmaBufPool *)pool;
+  GstProjectMDmaBufExport export;
+
+  if (!gst_projectm_dmabuf_export_new(self->context, &self->info, &export)) {
+    GST_WARNING_OBJECT(pool, "Failed to export NV12 frame");
+    return GST_FLOW_ERROR;
+  }
+
+  *buffer = gst_projectm_dmabuf_pool_wrap(self, &export);
+
+  GST_DEBUG_OBJECT(pool, "Exported NV12 frame as fds %d/%d", export.fds[0],
+                   export.fds[1]);
+
+  return GST_FLOW_OK;
+}
+
+static void gst_projectm_dmabuf_pool_finalize(GObject *object) {
+  GstProjectMDmaBufPool *self = (GstProjectMDmaBufPool *)object;
+
+  gst_clear_object(&self->allocator);
+  gst_clear_object(&self->context);
+
+  G_OBJECT_CLASS(gst_projectm_dmabuf_pool_parent_class)->finalize(object);
+}
+
+static void
+gst_projectm_dmabuf_pool_class_init(GstProjectMDmaBufPoolClass *klass) {
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+  GstBufferPoolClass *pool_class = GST_BUFFER_POOL_CLASS(klass);
+
+  gobject_class->finalize = gst_projectm_dmabuf_pool_finalize;
+
+  pool_class->get_options = gst_projectm_dmabuf_pool_get_options;
+  pool_class->set_config = gst_projectm_dmabuf_pool_set_config;
+  pool_class->alloc_buffer = gst_projectm_dmabuf_pool_alloc_buffer;
+}
+
+static void gst_projectm_dmabuf_pool_init(GstProjectMDmaBufPool *self) {
+  gst_video_info_init(&self->info);
+}
+
+GstBufferPool *gst_projectm_dmabuf_pool_new(GstGLContext *context) {
+  GstProjectMDmaBufPool *self;
+
+  gst_projectm_dmabuf_init_debug();
+
+  self = g_object_new(gst_projectm_dmabuf_pool_get_type(), NULL);
+  gst_object_ref_sink(self);
+  self->context = gst_object_ref(context);
+  self->allocator = gst_dmabuf_allocator_new();
+
+  return GST_BUFFER_POOL_CAST(self);
+}
+
+gboolean gst_projectm_dmabuf_buffer_get_textures(GstBuffer *buffer,
+                                                 guint *y_texture,
+                                                 guint *uv_texture) {
+  GstBuffer *gl_buffer;
+
+  if (gst_buffer_n_memory(buffer) == 0) {
+    return FALSE;
+  }
+
+  gl_buffer = gst_mini_object_get_qdata(
+      GST_MINI_OBJECT_CAST(gst_buffer_peek_memory(buffer, 0)),
+      gst_projectm_dmabuf_textures_quark());
+  if (gl_buffer == NULL || gst_buffer_n_memory(gl_buffer) != 2) {
+    return FALSE;
+  }
+
+  *y_texture = gst_gl_memory_get_texture_id(
+      (GstGLMemory *)gst_buffer_peek_memory(gl_buffer, 0));
+  *uv_texture = gst_gl_memory_get_texture_id(
+      (GstGLMemory *)gst_buffer_peek_memory(gl_buffer, 1));
+
+  return TRUE;
+}
+
+#else /* !GST_PROJECTM_HAVE_DMABUF */
+
+gboolean gst_projectm_dmabuf_supported(GstGLContext *context) {
+  return FALSE;
+}
+
+GstBufferPool *gst_projectm_dmabuf_pool_new(GstGLContext *context) {
+  return NULL;
+}
+
+gboolean gst_projectm_dmabuf_buffer_get_textures(GstBuffer *buffer,
+                                                 guint *y_texture,
+                                                 guint *uv_texture) {
+  return FALSE;
+}
+
+#endif /* GST_PROJECTM_HAVE_DMABUF */
+
+static const gchar *gst_projectm_nv12_y_fragment =
+    "#ifdef GL_ES\n"
+    "precision highp float;\n"
+    "#endif\n"
+    "varying vec2 v_texcoord;\n"
+    "uniform sampler2D tex;\n"
+    "uniform float flip;\n"
+    "uniform vec3 y_coeffs;\n"
+    "uniform float y_offset;\n"
+    "void main() {\n"
+    "  vec2 tc = vec2(v_texcoord.x, mix(v_texcoord.y, 1.0 - v_texcoord.y, "
+    "flip));\n"
+    "  vec3 rgb = texture2D(tex, tc).rgb;\n"
+    "  gl_FragColor = vec4(dot(rgb, y_coeffs) + y_offset, 0.0, 0.0, 1.0);\n"
+    "}\n";
+
+/* Rendered at half size: with linear filtering each sample averages the
+ * 2x2 block of source pixels the chroma sample covers. */
+static const gchar *gst_projectm_nv12_uv_fragment =
+    "#ifdef GL_ES\n"
+    "precision highp float;\n"
+    "#endif\n"
+    "varying vec2 v_texcoord;\n"
+    "uniform sampler2D tex;\n"
+    "uniform float flip;\n"
+    "uniform vec3 u_coeffs;\n"
+    "uniform vec3 v_coeffs;\n"
+    "uniform float uv_offset;\n"
+    "void main() {\n"
+    "  vec2 tc = vec2(v_texcoord.x, mix(v_texcoord.y, 1.0 - v_texcoord.y, "
+    "flip));\n"
+    "  vec3 rgb = texture2D(tex, tc).rgb;\n"
+    "  gl_FragColor = vec4(dot(rgb, u_coeffs) + uv_offset,\n"
+    "                      dot(rgb, v_coeffs) + uv_offset, 0.0, 1.0);\n"
+    "}\n";
+
+/* x, y, z, s, t of a fullscreen triangle fan. */
+static const GLfloat gst_projectm_nv12_vertices[] = {
+    -1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f,  -1.0f, 0.0f, 1.0f, 0.0f,
+    1.0f,  1.0f,  0.0f, 1.0f, 1.0f, -1.0f, 1.0f,  0.0f, 0.0f, 1.0f};
+
+struct _GstProjectMNv12Converter {
+  GstGLContext *context;
+  GstGLShader *y_shader;
+  GstGLShader *uv_shader;
+  GLuint fbo;
+  GLuint vbo;
+  GLuint vao;
+};
+
+static GstGLShader *gst_projectm_nv12_shader_new(GstGLContext *context,
+                                                 const gchar *fragment) {
+  GError *error = NULL;
+  GstGLShader *shader = gst_gl_shader_new_link_with_stages(
+      context, &error, gst_glsl_stage_new_default_vertex(context),
+      gst_glsl_stage_new_with_string(
+          context, GL_FRAGMENT_SHADER, GST_GLSL_VERSION_NONE,
+          GST_GLSL_PROFILE_ES | GST_GLSL_PROFILE_COMPATIBILITY, fragment),
+      NULL);
+
+  if (shader == NULL) {
+    GST_WARNING("Failed to build NV12 shader: %s",
+                error ? error->message : "unknown error");
+    g_clear_error(&error);
+  }
+
+  return shader;
+}
+
+GstProjectMNv12Converter *
+gst_projectm_nv12_converter_new(GstGLContext *context) {
+  const GstGLFuncs *gl = context->gl_vtable;
+  GstProjectMNv12Converter *converter;
+
+  gst_projectm_dmabuf_init_debug();
+
+  converter = g_new0(GstProjectMNv12Converter, 1);
+  converter->context = gst_object_ref(context);
+  converter->y_shader =
+      gst_projectm_nv12_shader_new(context, gst_projectm_nv12_y_fragment);
+  converter->uv_shader =
+      gst_projectm_nv12_shader_new(context, gst_projectm_nv12_uv_fragment);
+
+  if (converter->y_shader == NULL || converter->uv_shader == NULL) {
+    gst_projectm_nv12_converter_free(converter);
+    return NULL;
+  }
+
+  gl->GenFramebuffers(1, &converter->fbo);
+  gl->GenBuffers(1, &converter->vbo);
+  gl->BindBuffer(GL_ARRAY_BUFFER, converter->vbo);
+  gl->BufferData(GL_ARRAY_BUFFER, sizeof(gst_projectm_nv12_vertices),
+                 gst_projectm_nv12_vertices, GL_STATIC_DRAW);
+  gl->BindBuffer(GL_ARRAY_BUFFER, 0);
+
+  /* Core profiles cannot draw without a vertex array object. */
+  if (gl->GenVertexArrays) {
+    gl->GenVertexArrays(1, &converter->vao);
+  }
+
+  return converter;
+}
+
+void gst_projectm_nv12_converter_free(GstProjectMNv12Converter *converter) {
+  const GstGLFuncs *gl = converter->context->gl_vtable;
+
+  if (converter->vao != 0) {
+    gl->DeleteVertexArrays(1, &converter->vao);
+  }
+  if (converter->vbo != 0) {
+    gl->DeleteBuffers(1, &converter->vbo);
+  }
+  if (converter->fbo != 0) {
+    gl->DeleteFramebuffers(1, &converter->fbo);
+  }
+  gst_clear_object(&converter->y_shader);
+  gst_clear_object(&converter->uv_shader);
+  gst_clear_object(&converter->context);
+  g_free(converter);
+}
+
+static gboolean gst_projectm_nv12_converter_draw(
+    GstProjectMNv12Converter *converter, GstGLShader *shader,
+    guint dest_texture, gint width, gint height) {
+  const GstGLFuncs *gl = converter->context->gl_vtable;
+  GLint position = gst_gl_shader_get_attribute_location(shader, "a_position");
+  GLint texcoord = gst_gl_shader_get_attribute_location(shader, "a_texcoord");
+
+  gl->FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           dest_texture, 0);
+  if (gl->CheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    GST_WARNING("Plane texture %u is not renderable", dest_texture);
+    return FALSE;
+  }
+
+  gl->Viewport(0, 0, width, height);
+
+  gl->VertexAttribPointer(position, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat),
+                          (gpointer)0);
+  gl->VertexAttribPointer(texcoord, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat),
+                          (gpointer)(3 * sizeof(GLfloat)));
+  gl->EnableVertexAttribArray(position);
+  gl->EnableVertexAttribArray(texcoord);
+
+  gl->DrawArrays(GL_TRIANGLE_FAN, 0, 4);
+
+  gl->DisableVertexAttribArray(position);
+  gl->DisableVertexAttribArray(texcoord);
+
+  return TRUE;
+}
+
+gboolean gst_projectm_nv12_converter_convert(
+    GstProjectMNv12Converter *converter, guint src_texture,
+    const GstVideoInfo *info, guint y_texture, guint uv_texture,
+    gboolean flip) {
+  GstGLContext *context = converter->context;
+  const GstGLFuncs *gl = context->gl_vtable;
+  gdouble Kr, Kb;
+  gboolean ok;
+
+  if (!gst_video_color_matrix_get_Kr_Kb(info->colorimetry.matrix, &Kr, &Kb)) {
+    gst_video_color_matrix_get_Kr_Kb(GST_VIDEO_COLOR_MATRIX_BT709, &Kr, &Kb);
+  }
+
+  /* Full range maps [0, 1] onto itself; limited range onto 16-235 luma and
+   * 16-240 chroma. */
+  gboolean full_range = info->colorimetry.range == GST_VIDEO_COLOR_RANGE_0_255;
+  gfloat y_scale = full_range ? 1.0f : 219.0f / 255.0f;
+  gfloat c_scale = full_range ? 1.0f : 224.0f / 255.0f;
+  gfloat Kg = (gfloat)(1.0 - Kr - Kb);
+  gfloat u_div = (gfloat)(2.0 * (1.0 - Kb));
+  gfloat v_div = (gfloat)(2.0 * (1.0 - Kr));
+
+  if (converter->vao != 0) {
+    gl->BindVertexArray(converter->vao);
+  }
+  gl->BindBuffer(GL_ARRAY_BUFFER, converter->vbo);
+  gl->BindFramebuffer(GL_FRAMEBUFFER, converter->fbo);
+  gl->ActiveTexture(GL_TEXTURE0);
+  gl->BindTexture(GL_TEXTURE_2D, src_texture);
+  gl->Disable(GL_BLEND);
+
+  gst_gl_shader_use(converter->y_shader);
+  gst_gl_shader_set_uniform_1i(converter->y_shader, "tex", 0);
+  gst_gl_shader_set_uniform_1f(converter->y_shader, "flip", flip ? 1.0f : 0.0f);
+  gst_gl_shader_set_uniform_3f(converter->y_shader, "y_coeffs",
+                               (gfloat)Kr * y_scale, Kg * y_scale,
+                               (gfloat)Kb * y_scale);
+  gst_gl_shader_set_uniform_1f(converter->y_shader, "y_offset",
+                               full_range ? 0.0f : 16.0f / 255.0f);
+  ok = gst_projectm_nv12_converter_draw(converter, converter->y_shader,
+                                        y_texture, GST_VIDEO_INFO_WIDTH(info),
+                                        GST_VIDEO_INFO_HEIGHT(info));
+
+  if (ok) {
+    gst_gl_shader_use(converter->uv_shader);
+    gst_gl_shader_set_uniform_1i(converter->uv_shader, "tex", 0);
+    gst_gl_shader_set_uniform_1f(converter->uv_shader, "flip",
+                                 flip ? 1.0f : 0.0f);
+    gst_gl_shader_set_uniform_3f(
+        converter->uv_shader, "u_coeffs", (gfloat)-Kr / u_div * c_scale,
+        -Kg / u_div * c_scale, (gfloat)(1.0 - Kb) / u_div * c_scale);
+    gst_gl_shader_set_uniform_3f(
+        converter->uv_shader, "v_coeffs", (gfloat)(1.0 - Kr) / v_div * c_scale,
+        -Kg / v_div * c_scale, (gfloat)-Kb / v_div * c_scale);
+    gst_gl_shader_set_uniform_1f(converter->uv_shader, "uv_offset",
+                                 128.0f / 255.0f);
+    ok = gst_projectm_nv12_converter_draw(
+        converter, converter->uv_shader, uv_texture,
+        GST_VIDEO_INFO_COMP_WIDTH(info, 1), GST_VIDEO_INFO_COMP_HEIGHT(info, 1));
+  }
+
+  gl->FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           0, 0);
+  gst_gl_context_clear_shader(context);
+  gl->BindTexture(GL_TEXTURE_2D, 0);
+  gl->BindBuffer(GL_ARRAY_BUFFER, 0);
+  if (converter->vao != 0) {
+    gl->BindVertexArray(0);
+  }
+
+  if (!ok) {
+    return FALSE;
+  }
+
+  /* The encoder reads the planes through another device, which knows
+   * nothing of this context's command stream. */
+  if (gl->FenceSync) {
+    GLsync fence = gl->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    GLenum result = gl->ClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                       GST_PROJECTM_DMABUF_FENCE_TIMEOUT_NS);
+
+    gl->DeleteSync(fence);
+    if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) {
+      GST_WARNING("NV12 conversion fence wait failed (0x%x)", result);
+      return FALSE;
+    }
+  } else {
+    gl->Finish();
+  }
+
+  return TRUE;
+}
@@ -0,0 +1,93 @@
+#ifndef __GST_PROJECTM_DMABUF_H__
+#define __GST_PROJECTM_DMABUF_H__
+
+#include <gst/gl/gl.h>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief Caps feature of frames exported as DMABuf.
+ */
+#define GST_PROJECTM_CAPS_FEATURE_MEMORY_DMABUF "memory:DMABuf"
+
+/**
+ * @brief Converts RGBA render targets into NV12 textures on the GPU.
+ */
+typedef struct _GstProjectMNv12Converter GstProjectMNv12Converter;
+
+/**
+ * @brief Check whether textures of the context can be exported as DMABuf.
+ *
+ * Requires an EGL context with EGL_MESA_image_dma_buf_export and
+ * EGL_KHR_gl_texture_2D_image, and textures in the R8/RG8 formats NV12 is
+ * stored in. Always FALSE when GStreamer was built without EGL.
+ */
+gboolean gst_projectm_dmabuf_supported(GstGLContext *context);
+
+/**
+ * @brief Check whether caps request DMABuf memory.
+ */
+gboolean gst_projectm_caps_are_dmabuf(const GstCaps *caps);
+
+/**
+ * @brief Remove all DMABuf structures from caps, in place.
+ */
+void gst_projectm_caps_strip_dmabuf(GstCaps *caps);
+
+/**
+ * @brief Create a buffer pool of NV12 frames whose planes are GL textures
+ * exported as DMABuf file descriptors.
+ *
+ * Buffers contain one DMABuf memory per plane; the textures behind them are
+ * found with gst_projectm_dmabuf_buffer_get_textures().
+ */
+GstBufferPool *gst_projectm_dmabuf_pool_new(GstGLContext *context);
+
+/**
+ * @brief Look up the GL textures behind a buffer of a DMABuf pool.
+ *
+ * @param buffer Buffer from gst_projectm_dmabuf_pool_new().
+ * @param y_texture Receives the luma texture (R8, full size).
+ * @param uv_texture Receives the chroma texture (RG8, half size).
+ * @return FALSE if the buffer does not come from a DMABuf pool.
+ */
+gboolean gst_projectm_dmabuf_buffer_get_textures(GstBuffer *buffer,
+                                                 guint *y_texture,
+                                                 guint *uv_texture);
+
+/**
+ * @brief Create a converter. Must be called on the GL thread.
+ */
+GstProjectMNv12Converter *gst_projectm_nv12_converter_new(GstGLContext *context);
+
+/**
+ * @brief Free a converter. Must be called on the GL thread.
+ */
+void gst_projectm_nv12_converter_free(GstProjectMNv12Converter *converter);
+
+/**
+ * @brief Convert an RGBA texture into the two planes of an NV12 frame.
+ *
+ * Rows keep OpenGL's bottom-up order unless flip is set, matching the
+ * system memory readback. Colour matrix and range follow the colorimetry of
+ * info. Returns once the GPU has finished writing, so the planes can be
+ * handed to another device.
+ *
+ * @param converter Converter created on the current context.
+ * @param src_texture RGBA texture of the rendered frame.
+ * @param info Video info of the NV12 output.
+ * @param y_texture Luma plane texture.
+ * @param uv_texture Chroma plane texture.
+ * @param flip Output rows top-down.
+ * @return FALSE on GL errors.
+ */
+gboolean gst_projectm_nv12_converter_convert(
+    GstProjectMNv12Converter *converter, guint src_texture,
+    const GstVideoInfo *info, guint y_texture, guint uv_texture,
+    gboolean flip);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_DMABUF_H__ */
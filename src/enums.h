@@ -1,6 +1,7 @@
 #ifndef __GST_PROJECTM_ENUMS_H__
 #define __GST_PROJECTM_ENUMS_H__
 
+#include <glib-object.h>
 #include <glib.h>
 
 G_BEGIN_DECLS
@@ -25,9 +26,53 @@ enum {
   PROP_PRESET_LOCKED,
   PROP_TIMELINE_PATH,
   PROP_SHUFFLE_PRESETS,
-  PROP_ENABLE_PLAYLIST
+  PROP_ENABLE_PLAYLIST,
+  PROP_READBACK_MODE,
+  PROP_VERTICAL_FLIP,
+  PROP_COPY_THREADS,
+  PROP_RENDER_RATE,
+  PROP_KEYFRAME_INTERVAL,
+  PROP_KEYFRAME_TIMESTAMPS,
+  PROP_KEYFRAME_WARMUP,
+  PROP_PRESET_INDEX,
+  PROP_TEXTURE_PREFETCH_BUDGET,
+  PROP_COMPRESS_TEXTURES,
+  PROP_MAX_BATCH,
+  PROP_COLUMNS,
+  PROP_RENDER_PROFILE,
+  PROP_CPU_THREADS,
+  PROP_ANALYSIS_WINDOW,
+  PROP_ANALYSIS_HOP,
+  PROP_STATS
 };
 
+/**
+ * @brief Strategies for reading rendered frames back into system memory.
+ */
+typedef enum {
+  GST_PROJECTM_READBACK_AUTO,
+  GST_PROJECTM_READBACK_SYNC,
+  GST_PROJECTM_READBACK_PBO,
+  GST_PROJECTM_READBACK_PERSISTENT,
+  GST_PROJECTM_READBACK_ZERO_COPY
+} GstProjectMReadbackMode;
+
+#define GST_TYPE_PROJECTM_READBACK_MODE (gst_projectm_readback_mode_get_type())
+GType gst_projectm_readback_mode_get_type(void);
+
+/**
+ * @brief Tuning applied for the kind of OpenGL implementation rendering.
+ */
+typedef enum {
+  GST_PROJECTM_RENDER_PROFILE_AUTO,
+  GST_PROJECTM_RENDER_PROFILE_GPU,
+  GST_PROJECTM_RENDER_PROFILE_CPU
+} GstProjectMRenderProfile;
+
+#define GST_TYPE_PROJECTM_RENDER_PROFILE                                       \
+  (gst_projectm_render_profile_get_type())
+GType gst_projectm_render_profile_get_type(void);
+
 G_END_DECLS
 
 #endif /* __GST_PROJECTM_ENUMS_H__ */
@@ -0,0 +1,547 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "frame.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) ||          \
+    defined(_M_IX86)
+#define GST_PROJECTM_FRAME_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define GST_PROJECTM_FRAME_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define GST_PROJECTM_TARGET(isa) __attribute__((target(isa)))
+#else
+#define GST_PROJECTM_TARGET(isa)
+#endif
+
+typedef void (*GstProjectMCopyRowFunc)(guint8 *dest, const guint8 *src,
+                                       gsize pixels, const guint8 *swizzle,
+                                       gboolean stream);
+
+typedef struct {
+  const gchar *name;
+  GstProjectMCopyRowFunc copy_row;
+  gboolean supports_swizzle;
+  gboolean supports_stream;
+} GstProjectMCopyImpl;
+
+static void gst_projectm_swizzle_pixels(guint8 *dest, const guint8 *src,
+                                        gsize pixels, const guint8 *swizzle) {
+  for (gsize i = 0; i < pixels; i++) {
+    const guint8 *s = src + (i * 4);
+    guint8 *d = dest + (i * 4);
+    d[0] = s[swizzle[0]];
+    d[1] = s[swizzle[1]];
+    d[2] = s[swizzle[2]];
+    d[3] = s[swizzle[3]];
+  }
+}
+
+static void gst_projectm_copy_row_scalar(guint8 *dest, const guint8 *src,
+                                         gsize pixels, const guint8 *swizzle,
+                                         gboolean stream) {
+  if (swizzle == NULL) {
+    memcpy(dest, src, pixels * 4);
+  } else {
+    gst_projectm_swizzle_pixels(dest, src, pixels, swizzle);
+  }
+}
+
+#ifdef GST_PROJECTM_FRAME_X86
+
+/* Number of leading pixels to handle before dest reaches the given
+ * alignment, so the vector body can use aligned (streaming) stores. */
+static gsize gst_projectm_head_pixels(const guint8 *dest, gsize alignment,
+                                      gsize pixels) {
+  gsize misalignment = (gsize)((guintptr)dest & (alignment - 1));
+  gsize head = misalignment == 0 ? 0 : (alignment - misalignment) / 4;
+
+  return MIN(head, pixels);
+}
+
+GST_PROJECTM_TARGET("sse2")
+static void gst_projectm_copy_row_sse2(guint8 *dest, const guint8 *src,
+                                       gsize pixels, const guint8 *swizzle,
+                                       gboolean stream) {
+  gsize head = stream ? gst_projectm_head_pixels(dest, 16, pixels) : 0;
+  gsize i = head;
+
+  memcpy(dest, src, head * 4);
+
+  if (stream) {
+    for (; i + 16 <= pixels; i += 16) {
+      __m128i a = _mm_loadu_si128((const __m128i *)(src + (i * 4)));
+      __m128i b = _mm_loadu_si128((const __m128i *)(src + (i * 4) + 16));
+      __m128i c = _mm_loadu_si128((const __m128i *)(src + (i * 4) + 32));
+      __m128i d = _mm_loadu_si128((const __m128i *)(src + (i * 4) + 48));
+      _mm_stream_si128((__m128i *)(dest + (i * 4)), a);
+      _mm_stream_si128((__m128i *)(dest + (i * 4) + 16), b);
+      _mm_stream_si128((__m128i *)(dest + (i * 4) + 32), c);
+      _mm_stream_si128((__m128i *)(dest + (i * 4) + 48), d);
+    }
+    for (; i + 4 <= pixels; i += 4) {
+      _mm_stream_si128((__m128i *)(dest + (i * 4)),
+                       _mm_loadu_si128((const __m128i *)(src + (i * 4))));
+    }
+  }
+
+  memcpy(dest + (i * 4), src + (i * 4), (pixels - i) * 4);
+}
+
+GST_PROJECTM_TARGET("ssse3")
+static void gst_projectm_copy_row_ssse3(guint8 *dest, const guint8 *src,
+                                        gsize pixels, const guint8 *swizzle,
+                                        gboolean stream) {
+  if (swizzle == NULL) {
+    gst_projectm_copy_row_sse2(dest, src, pixels, NULL, stream);
+    return;
+  }
+
+  gsize head = stream ? gst_projectm_head_pixels(dest, 16, pixels) : 0;
+  gsize i = head;
+  __m128i mask = _mm_setr_epi8(
+      swizzle[0], swizzle[1], swizzle[2], swizzle[3], 4 + swizzle[0],
+      4 + swizzle[1], 4 + swizzle[2], 4 + swizzle[3], 8 + swizzle[0],
+      8 + swizzle[1], 8 + swizzle[2], 8 + swizzle[3], 12 + swizzle[0],
+      12 + swizzle[1], 12 + swizzle[2], 12 + swizzle[3]);
+
+  gst_projectm_swizzle_pixels(dest, src, head, swizzle);
+
+  for (; i + 4 <= pixels; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + (i * 4)));
+    v = _mm_shuffle_epi8(v, mask);
+    if (stream) {
+      _mm_stream_si128((__m128i *)(dest + (i * 4)), v);
+    } else {
+      _mm_storeu_si128((__m128i *)(dest + (i * 4)), v);
+    }
+  }
+
+  gst_projectm_swizzle_pixels(dest + (i * 4), src + (i * 4), pixels - i,
+                              swizzle);
+}
+
+GST_PROJECTM_TARGET("avx2")
+static void gst_projectm_copy_row_avx2(guint8 *dest, const guint8 *src,
+                                       gsize pixels, const guint8 *swizzle,
+                                       gboolean stream) {
+  if (swizzle == NULL && !stream) {
+    memcpy(dest, src, pixels * 4);
+    return;
+  }
+
+  gsize head = stream ? gst_projectm_head_pixels(dest, 32, pixels) : 0;
+  gsize i = head;
+  guint8 lane[16];
+
+  for (guint p = 0; p < 4; p++) {
+    for (guint k = 0; k < 4; k++) {
+      lane[(p * 4) + k] = (guint8)((p * 4) + (swizzle ? swizzle[k] : k));
+    }
+  }
+  /* vpshufb shuffles within each 128-bit lane, so both lanes use the same
+   * per-pixel pattern. */
+  __m128i lane_mask = _mm_loadu_si128((const __m128i *)lane);
+  __m256i mask = _mm256_broadcastsi128_si256(lane_mask);
+
+  if (swizzle != NULL) {
+    gst_projectm_swizzle_pixels(dest, src, head, swizzle);
+  } else {
+    memcpy(dest, src, head * 4);
+  }
+
+  for (; i + 8 <= pixels; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + (i * 4)));
+    if (swizzle != NULL) {
+      v = _mm256_shuffle_epi8(v, mask);
+    }
+    if (stream) {
+      _mm256_stream_si256((__m256i *)(dest + (i * 4)), v);
+    } else {
+      _mm256_storeu_si256((__m256i *)(dest + (i * 4)), v);
+    }
+  }
+
+  gst_projectm_copy_row_scalar(dest + (i * 4), src + (i * 4), pixels - i,
+                               swizzle, FALSE);
+}
+
+GST_PROJECTM_TARGET("sse2")
+static void gst_projectm_stream_fence(void) { _mm_sfence(); }
+
+static gboolean gst_projectm_cpu_has(const gchar *feature) {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_cpu_init();
+  if (g_strcmp0(feature, "avx2") == 0) {
+    return __builtin_cpu_supports("avx2");
+  }
+  if (g_strcmp0(feature, "ssse3") == 0) {
+    return __builtin_cpu_supports("ssse3");
+  }
+  return __builtin_cpu_supports("sse2");
+#elif defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  int max_leaf = info[0];
+
+  __cpuid(info, 1);
+  gboolean sse2 = (info[3] & (1 << 26)) != 0;
+  gboolean ssse3 = (info[2] & (1 << 9)) != 0;
+  gboolean osxsave = (info[2] & (1 << 27)) != 0;
+  gboolean avx = (info[2] & (1 << 28)) != 0;
+
+  if (g_strcmp0(feature, "avx2") == 0) {
+    if (max_leaf < 7 || !osxsave || !avx ||
+        (_xgetbv(0) & 0x6) != 0x6) {
+      return FALSE;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+  }
+  if (g_strcmp0(feature, "ssse3") == 0) {
+    return ssse3;
+  }
+  return sse2;
+#else
+  return FALSE;
+#endif
+}
+
+#endif /* GST_PROJECTM_FRAME_X86 */
+
+#ifdef GST_PROJECTM_FRAME_NEON
+
+static void gst_projectm_copy_row_neon(guint8 *dest, const guint8 *src,
+                                       gsize pixels, const guint8 *swizzle,
+                                       gboolean stream) {
+  if (swizzle == NULL) {
+    memcpy(dest, src, pixels * 4);
+    return;
+  }
+
+  guint8 lane[16];
+  for (guint p = 0; p < 4; p++) {
+    for (guint k = 0; k < 4; k++) {
+      lane[(p * 4) + k] = (guint8)((p * 4) + swizzle[k]);
+    }
+  }
+  uint8x16_t mask = vld1q_u8(lane);
+  gsize i = 0;
+
+  for (; i + 4 <= pixels; i += 4) {
+    uint8x16_t v = vld1q_u8(src + (i * 4));
+    vst1q_u8(dest + (i * 4), vqtbl1q_u8(v, mask));
+  }
+
+  gst_projectm_swizzle_pixels(dest + (i * 4), src + (i * 4), pixels - i,
+                              swizzle);
+}
+
+#endif /* GST_PROJECTM_FRAME_NEON */
+
+static const GstProjectMCopyImpl copy_impls[] = {
+#ifdef GST_PROJECTM_FRAME_X86
+    {"avx2", gst_projectm_copy_row_avx2, TRUE, TRUE},
+    {"ssse3", gst_projectm_copy_row_ssse3, TRUE, TRUE},
+    {"sse2", gst_projectm_copy_row_sse2, FALSE, TRUE},
+#endif
+#ifdef GST_PROJECTM_FRAME_NEON
+    {"neon", gst_projectm_copy_row_neon, TRUE, FALSE},
+#endif
+    {"scalar", gst_projectm_copy_row_scalar, TRUE, FALSE},
+};
+
+static gboolean gst_projectm_copy_impl_usable(const GstProjectMCopyImpl *impl) {
+#ifdef GST_PROJECTM_FRAME_X86
+  if (impl->copy_row != gst_projectm_copy_row_scalar) {
+    return gst_projectm_cpu_has(impl->name);
+  }
+#endif
+  return TRUE;
+}
+
+static const GstProjectMCopyImpl *gst_projectm_copy_impl_get(void) {
+  static const GstProjectMCopyImpl *selected = NULL;
+
+  if (g_once_init_enter(&selected)) {
+    const gchar *cap = g_getenv("GST_PROJECTM_FRAME_COPY");
+    const GstProjectMCopyImpl *impl = &copy_impls[G_N_ELEMENTS(copy_impls) - 1];
+    gboolean cap_reached = (cap == NULL || *cap == '\0');
+
+    /* Table is ordered fastest first; an override skips entries until the
+     * requested one so it can only select an equal or lesser kernel. */
+    for (guint i = 0; i < G_N_ELEMENTS(copy_impls); i++) {
+      if (!cap_reached && g_ascii_strcasecmp(cap, copy_impls[i].name) == 0) {
+        cap_reached = TRUE;
+      }
+      if (cap_reached && gst_projectm_copy_impl_usable(&copy_impls[i])) {
+        impl = &copy_impls[i];
+        break;
+      }
+    }
+
+    g_once_init_leave(&selected, impl);
+  }
+
+  return selected;
+}
+
+const gchar *gst_projectm_frame_copy_impl_name(void) {
+  return gst_projectm_copy_impl_get()->name;
+}
+
+/* Copies rows of a frame of frame_size bytes. Whether streaming stores pay
+ * off depends on the whole frame evicting the cache, not on the rows one
+ * band of a parallel copy covers, so the size is passed down. */
+static void gst_projectm_frame_copy_rows(guint8 *dest, gsize dest_stride,
+                                         const guint8 *src, gsize src_stride,
+                                         gsize width, gsize height,
+                                         GstProjectMFrameCopyFlags flags,
+                                         const guint8 *swizzle,
+                                         gsize frame_size) {
+  const GstProjectMCopyImpl *impl = gst_projectm_copy_impl_get();
+  GstProjectMCopyRowFunc copy_row = impl->copy_row;
+  gsize row_size = width * 4;
+  gboolean flip = (flags & GST_PROJECTM_FRAME_COPY_FLIP) != 0;
+
+  if (swizzle != NULL && swizzle[0] == 0 && swizzle[1] == 1 &&
+      swizzle[2] == 2 && swizzle[3] == 3) {
+    swizzle = NULL;
+  }
+
+  gboolean stream = impl->supports_stream &&
+                    frame_size >= GST_PROJECTM_FRAME_STREAM_THRESHOLD &&
+                    ((guintptr)dest & 3) == 0 && (dest_stride & 3) == 0;
+
+  if (swizzle != NULL && !impl->supports_swizzle) {
+    copy_row = gst_projectm_copy_row_scalar;
+    stream = FALSE;
+  }
+
+  if (!flip && dest_stride == row_size && src_stride == row_size) {
+    /* Tightly packed on both sides: one long row. */
+    if (!stream && swizzle == NULL) {
+      memcpy(dest, src, row_size * height);
+      return;
+    }
+    copy_row(dest, src, width * height, swizzle, stream);
+  } else {
+    for (gsize y = 0; y < height; y++) {
+      gsize dest_row = flip ? (height - 1 - y) : y;
+      copy_row(dest + (dest_row * dest_stride), src + (y * src_stride), width,
+               swizzle, stream);
+    }
+  }
+
+#ifdef GST_PROJECTM_FRAME_X86
+  if (stream) {
+    /* Streaming stores are weakly ordered; make them visible before the
+     * frame is handed to another thread. */
+    gst_projectm_stream_fence();
+  }
+#endif
+}
+
+void gst_projectm_frame_copy_full(guint8 *dest, gsize dest_stride,
+                                  const guint8 *src, gsize src_stride,
+                                  gsize width, gsize height,
+                                  GstProjectMFrameCopyFlags flags,
+                                  const guint8 *swizzle) {
+  gst_projectm_frame_copy_rows(dest, dest_stride, src, src_stride, width,
+                               height, flags, swizzle, width * 4 * height);
+}
+
+void gst_projectm_frame_copy(guint8 *dest, gsize dest_stride,
+                             const guint8 *src, gsize src_stride,
+                             gsize row_size, gsize height) {
+  if ((row_size & 3) == 0) {
+    gst_projectm_frame_copy_full(dest, dest_stride, src, src_stride,
+                                 row_size / 4, height,
+                                 GST_PROJECTM_FRAME_COPY_NONE, NULL);
+    return;
+  }
+
+  for (gsize y = 0; y < height; y++) {
+    memcpy(dest + (y * dest_stride), src + (y * src_stride), row_size);
+  }
+}
+
+void gst_projectm_frame_flip_in_place(guint8 *data, gsize stride,
+                                      gsize row_size, gsize height) {
+  if (height < 2) {
+    return;
+  }
+
+  guint8 *scratch = g_malloc(row_size);
+
+  for (gsize top = 0, bottom = height - 1; top < bottom; top++, bottom--) {
+    guint8 *top_row = data + (top * stride);
+    guint8 *bottom_row = data + (bottom * stride);
+    memcpy(scratch, top_row, row_size);
+    memcpy(top_row, bottom_row, row_size);
+    memcpy(bottom_row, scratch, row_size);
+  }
+
+  g_free(scratch);
+}
+
+typedef struct {
+  guint8 *dest;
+  gsize dest_stride;
+  const guint8 *src;
+  gsize src_stride;
+  gsize width;
+  gsize height;
+  GstProjectMFrameCopyFlags flags;
+  const guint8 *swizzle;
+  /* Size of the whole frame the band belongs to. */
+  gsize frame_size;
+} GstProjectMFrameCopyBand;
+
+struct _GstProjectMFrameCopyPool {
+  guint threads;
+  GThreadPool *workers;
+  GstProjectMFrameCopyBand *bands;
+
+  GMutex lock;
+  GCond done;
+  guint pending;
+};
+
+static void gst_projectm_frame_copy_band(GstProjectMFrameCopyBand *band) {
+  gst_projectm_frame_copy_rows(band->dest, band->dest_stride, band->src,
+                               band->src_stride, band->width, band->height,
+                               band->flags, band->swizzle, band->frame_size);
+}
+
+static void gst_projectm_frame_copy_pool_worker(gpointer data,
+                                                gpointer user_data) {
+  GstProjectMFrameCopyPool *pool = (GstProjectMFrameCopyPool *)user_data;
+
+  gst_projectm_frame_copy_band((GstProjectMFrameCopyBand *)data);
+
+  g_mutex_lock(&pool->lock);
+  if (--pool->pending == 0) {
+    g_cond_signal(&pool->done);
+  }
+  g_mutex_unlock(&pool->lock);
+}
+
+GstProjectMFrameCopyPool *gst_projectm_frame_copy_pool_new(guint threads) {
+  GstProjectMFrameCopyPool *pool = g_new0(GstProjectMFrameCopyPool, 1);
+
+  if (threads == 0) {
+    threads = CLAMP(g_get_num_processors(), 1,
+                    GST_PROJECTM_FRAME_MAX_COPY_THREADS);
+  }
+
+  pool->threads = threads;
+  pool->bands = g_new0(GstProjectMFrameCopyBand, threads);
+  g_mutex_init(&pool->lock);
+  g_cond_init(&pool->done);
+
+  if (threads > 1) {
+    /* Exclusive threads are started up front and stay alive, so a frame
+     * never waits for thread creation. */
+    pool->workers = g_thread_pool_new(gst_projectm_frame_copy_pool_worker,
+                                      pool, (gint)threads - 1, TRUE, NULL);
+  }
+
+  return pool;
+}
+
+void gst_projectm_frame_copy_pool_free(GstProjectMFrameCopyPool *pool) {
+  if (pool == NULL) {
+    return;
+  }
+
+  if (pool->workers != NULL) {
+    g_thread_pool_free(pool->workers, TRUE, TRUE);
+  }
+
+  g_cond_clear(&pool->done);
+  g_mutex_clear(&pool->lock);
+  g_free(pool->bands);
+  g_free(pool);
+}
+
+guint gst_projectm_frame_copy_pool_get_threads(GstProjectMFrameCopyPool *pool) {
+  return pool->threads;
+}
+
+void gst_projectm_frame_copy_pool_copy(GstProjectMFrameCopyPool *pool,
+                                       guint8 *dest, gsize dest_stride,
+                                       const guint8 *src, gsize src_stride,
+                                       gsize width, gsize height,
+                                       GstProjectMFrameCopyFlags flags,
+                                       const guint8 *swizzle) {
+  gsize frame_size = width * 4 * height;
+  guint bands = 1;
+
+  if (pool->workers != NULL &&
+      frame_size >= GST_PROJECTM_FRAME_PARALLEL_THRESHOLD) {
+    bands = (guint)MIN(pool->threads,
+                       frame_size / GST_PROJECTM_FRAME_MIN_BAND_SIZE);
+    bands = (guint)MIN(bands, height);
+  }
+
+  if (bands <= 1) {
+    gst_projectm_frame_copy_full(dest, dest_stride, src, src_stride, width,
+                                 height, flags, swizzle);
+    return;
+  }
+
+  gboolean flip = (flags & GST_PROJECTM_FRAME_COPY_FLIP) != 0;
+  gsize first_row = 0;
+
+  for (guint i = 0; i < bands; i++) {
+    GstProjectMFrameCopyBand *band = &pool->bands[i];
+    gsize last_row = (height * (i + 1)) / bands;
+    gsize rows = last_row - first_row;
+
+    /* A flipped band keeps its own rows reversed and lands mirrored in the
+     * destination: source rows [first, last) fill destination rows
+     * [height - last, height - first). */
+    gsize dest_row = flip ? height - last_row : first_row;
+
+    band->dest = dest + (dest_row * dest_stride);
+    band->dest_stride = dest_stride;
+    band->src = src + (first_row * src_stride);
+    band->src_stride = src_stride;
+    band->width = width;
+    band->height = rows;
+    band->flags = flags;
+    band->swizzle = swizzle;
+    band->frame_size = frame_size;
+
+    first_row = last_row;
+  }
+
+  g_mutex_lock(&pool->lock);
+  pool->pending = bands - 1;
+  g_mutex_unlock(&pool->lock);
+
+  for (guint i = 1; i < bands; i++) {
+    g_thread_pool_push(pool->workers, &pool->bands[i], NULL);
+  }
+
+  gst_projectm_frame_copy_band(&pool->bands[0]);
+
+  g_mutex_lock(&pool->lock);
+  while (pool->pending > 0) {
+    g_cond_wait(&pool->done, &pool->lock);
+  }
+  g_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,129 @@
+#ifndef __GST_PROJECTM_FRAME_H__
+#define __GST_PROJECTM_FRAME_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief Frames at least this large are written with non-temporal stores,
+ * since they would not stay in cache for the consumer anyway.
+ */
+#define GST_PROJECTM_FRAME_STREAM_THRESHOLD (4 * 1024 * 1024)
+
+/**
+ * @brief Options for gst_projectm_frame_copy_full().
+ */
+typedef enum {
+  GST_PROJECTM_FRAME_COPY_NONE = 0,
+  /* Write source row 0 to the last destination row, e.g. to turn bottom-up
+   * OpenGL readback into top-down video. */
+  GST_PROJECTM_FRAME_COPY_FLIP = (1 << 0)
+} GstProjectMFrameCopyFlags;
+
+/**
+ * @brief Copy packed pixel rows between buffers with independent strides.
+ *
+ * @param dest Destination of the first row.
+ * @param dest_stride Destination bytes per row.
+ * @param src Source of the first row.
+ * @param src_stride Source bytes per row.
+ * @param row_size Bytes of pixel data per row.
+ * @param height Number of rows.
+ */
+void gst_projectm_frame_copy(guint8 *dest, gsize dest_stride,
+                             const guint8 *src, gsize src_stride,
+                             gsize row_size, gsize height);
+
+/**
+ * @brief Copy 32-bit pixels, optionally flipping rows and reordering the
+ * bytes of every pixel on the way.
+ *
+ * Uses the widest SIMD kernel the CPU supports (AVX2, SSSE3, SSE2 or NEON),
+ * selected once at runtime. The GST_PROJECTM_FRAME_COPY environment variable
+ * (scalar, sse2, ssse3, avx2, neon) caps the selection for benchmarking.
+ *
+ * @param dest Destination of the first row.
+ * @param dest_stride Destination bytes per row.
+ * @param src Source of the first row.
+ * @param src_stride Source bytes per row.
+ * @param width Pixels per row.
+ * @param height Number of rows.
+ * @param flags Copy options.
+ * @param swizzle NULL, or four byte indices: destination byte i of each
+ * pixel is taken from source byte swizzle[i].
+ */
+void gst_projectm_frame_copy_full(guint8 *dest, gsize dest_stride,
+                                  const guint8 *src, gsize src_stride,
+                                  gsize width, gsize height,
+                                  GstProjectMFrameCopyFlags flags,
+                                  const guint8 *swizzle);
+
+/**
+ * @brief Reverse the row order of a frame in place.
+ */
+void gst_projectm_frame_flip_in_place(guint8 *data, gsize stride,
+                                      gsize row_size, gsize height);
+
+/**
+ * @brief Name of the copy kernel selected for this CPU.
+ */
+const gchar *gst_projectm_frame_copy_impl_name(void);
+
+/**
+ * @brief Frames smaller than this are copied on the calling thread; handing
+ * them to workers costs more than it saves.
+ */
+#define GST_PROJECTM_FRAME_PARALLEL_THRESHOLD (2 * 1024 * 1024)
+
+/**
+ * @brief Smallest amount of pixel data given to one copy band.
+ */
+#define GST_PROJECTM_FRAME_MIN_BAND_SIZE (1024 * 1024)
+
+/**
+ * @brief Upper bound for the automatic copy thread count.
+ */
+#define GST_PROJECTM_FRAME_MAX_COPY_THREADS 8
+
+/**
+ * @brief Persistent worker threads that copy a frame in row bands.
+ */
+typedef struct _GstProjectMFrameCopyPool GstProjectMFrameCopyPool;
+
+/**
+ * @brief Create a copy pool.
+ *
+ * @param threads Number of bands copied concurrently, including the calling
+ * thread, or 0 to use one per CPU up to GST_PROJECTM_FRAME_MAX_COPY_THREADS.
+ * @return A new pool, free with gst_projectm_frame_copy_pool_free().
+ */
+GstProjectMFrameCopyPool *gst_projectm_frame_copy_pool_new(guint threads);
+
+/**
+ * @brief Stop the workers and free the pool.
+ */
+void gst_projectm_frame_copy_pool_free(GstProjectMFrameCopyPool *pool);
+
+/**
+ * @brief Number of bands the pool copies concurrently.
+ */
+guint gst_projectm_frame_copy_pool_get_threads(GstProjectMFrameCopyPool *pool);
+
+/**
+ * @brief Like gst_projectm_frame_copy_full(), but split into row bands that
+ * run on the pool's workers. The calling thread copies one band itself and
+ * returns once every band is done, so src may be released right after.
+ *
+ * A pool must only be used by one thread at a time.
+ */
+void gst_projectm_frame_copy_pool_copy(GstProjectMFrameCopyPool *pool,
+                                       guint8 *dest, gsize dest_stride,
+                                       const guint8 *src, gsize src_stride,
+                                       gsize width, gsize height,
+                                       GstProjectMFrameCopyFlags flags,
+                                       const guint8 *swizzle);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_FRAME_H__ */
@@ -0,0 +1,48 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "framegrid.h"
+
+guint64 gst_projectm_frame_grid_start(guint rate, gint fps_n, gint fps_d,
+                                      guint64 frame) {
+  if (rate == 0 || fps_n <= 0 || fps_d <= 0) {
+    return 0;
+  }
+
+  return gst_util_uint64_scale(frame, (guint64)rate * fps_d, fps_n);
+}
+
+guint gst_projectm_frame_grid_samples(guint rate, gint fps_n, gint fps_d,
+                                      guint64 frame) {
+  return (guint)(gst_projectm_frame_grid_start(rate, fps_n, fps_d, frame + 1) -
+                 gst_projectm_frame_grid_start(rate, fps_n, fps_d, frame));
+}
+
+guint gst_projectm_frame_grid_samples_from(guint rate, gint fps_n, gint fps_d,
+                                           guint64 position) {
+  if (rate == 0 || fps_n <= 0 || fps_d <= 0) {
+    return 0;
+  }
+
+  /* The frame after the one containing position, give or take the rounding
+   * of its start, which the second step corrects. */
+  guint64 frame =
+      gst_util_uint64_scale(position, fps_n, (guint64)rate * fps_d) + 1;
+  guint64 end = gst_projectm_frame_grid_start(rate, fps_n, fps_d, frame);
+
+  if (end <= position) {
+    end = gst_projectm_frame_grid_start(rate, fps_n, fps_d, frame + 1);
+  }
+
+  return (guint)(end - position);
+}
+
+GstClockTime gst_projectm_frame_grid_time(gint fps_n, gint fps_d,
+                                          guint64 frame) {
+  if (fps_n <= 0 || fps_d <= 0) {
+    return 0;
+  }
+
+  return gst_util_uint64_scale(frame, (guint64)fps_d * GST_SECOND, fps_n);
+}
@@ -0,0 +1,48 @@
+#ifndef __GST_PROJECTM_FRAME_GRID_H__
+#define __GST_PROJECTM_FRAME_GRID_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief Where video frames fall in an audio stream.
+ *
+ * Frame n starts at sample floor(n * rate * fps_d / fps_n). Rounding each
+ * boundary rather than each frame's length keeps fractional rates from
+ * drifting: 48 kHz at 30000/1001 alternates 1601 and 1602 samples and
+ * consumes exactly the stream's audio over time. All functions return 0
+ * for a zero rate or a non-positive frame rate.
+ */
+
+/**
+ * @brief First sample of a frame.
+ */
+guint64 gst_projectm_frame_grid_start(guint rate, gint fps_n, gint fps_d,
+                                      guint64 frame);
+
+/**
+ * @brief Samples per channel of a frame.
+ */
+guint gst_projectm_frame_grid_samples(guint rate, gint fps_n, gint fps_d,
+                                      guint64 frame);
+
+/**
+ * @brief Samples per channel from position up to the next frame boundary
+ * after it.
+ *
+ * For a position on a boundary this is the length of the frame starting
+ * there.
+ */
+guint gst_projectm_frame_grid_samples_from(guint rate, gint fps_n, gint fps_d,
+                                           guint64 position);
+
+/**
+ * @brief Time of the start of a frame, relative to frame 0.
+ */
+GstClockTime gst_projectm_frame_grid_time(gint fps_n, gint fps_d,
+                                          guint64 frame);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_FRAME_GRID_H__ */
@@ -35,7 +35,9 @@
 #endif
 
 #include "gstglbaseaudiovisualizer.h"
+#include <gst/base/gstadapter.h>
 #include <gst/gl/gl.h>
+#include <gst/video/gstvideopool.h>
 
 /**
  * SECTION:GstGLBaseAudioVisualizer
@@ -51,8 +53,20 @@
  * that ensure an OpenGL context is available and current in the calling thread
  * for initializing and cleaning up OpenGL dependent resources. The `gl_render`
  * virtual method is used to perform OpenGL rendering.
+ *
+ * #GstAudioVisualizer drops the audio of frames that QoS says are late
+ * without calling render. Subclasses implementing `gl_analyze` get that
+ * audio back, one frame at a time, before the next rendered frame.
  */
 
+/* Most dropped frames analysed before a render; older ones are skipped so
+ * catching up after a long stall does not cause another one. */
+#define GST_GL_BASE_AUDIO_VISUALIZER_MAX_ANALYZED_FRAMES 30
+
+/* Row alignment of system memory frames, a cache line and the widest
+ * vector store used when copying into them. */
+#define GST_GL_BASE_AUDIO_VISUALIZER_STRIDE_ALIGN 64
+
 #define GST_CAT_DEFAULT gst_gl_base_audio_visualizer_debug
 GST_DEBUG_CATEGORY_STATIC(GST_CAT_DEFAULT);
 
@@ -64,6 +78,16 @@ struct _GstGLBaseAudioVisualizerPrivate {
   gboolean gl_started;
 
   GRecMutex context_lock;
+
+  /* Incoming audio kept for gl_analyze, from analysis_pts on; frames
+   * rendered from next_frame_pts on have not been dropped. Only touched
+   * by the streaming thread. */
+  GstAdapter *analysis_adapter;
+  GstClockTime analysis_pts;
+  GstClockTime next_frame_pts;
+
+  /* Lower bound for the output pool size, set by the subclass. */
+  guint min_buffers;
 };
 
 /* Properties */
@@ -117,6 +141,10 @@ static gboolean gst_gl_base_audio_visualizer_find_gl_context_unlocked(
 
 static gboolean gst_gl_base_audio_visualizer_setup(GstAudioVisualizer *gstav);
 
+static GstPadProbeReturn
+gst_gl_base_audio_visualizer_sink_probe(GstPad *pad, GstPadProbeInfo *info,
+                                        gpointer user_data);
+
 static void
 gst_gl_base_audio_visualizer_class_init(GstGLBaseAudioVisualizerClass *klass) {
   GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
@@ -155,7 +183,20 @@ static void gst_gl_base_audio_visualizer_init(GstGLBaseAudioVisualizer *glav) {
   glav->priv->gl_result = TRUE;
   glav->context = NULL;
   g_rec_mutex_init(&glav->priv->context_lock);
+  glav->priv->analysis_adapter = gst_adapter_new();
+  glav->priv->analysis_pts = GST_CLOCK_TIME_NONE;
+  glav->priv->next_frame_pts = GST_CLOCK_TIME_NONE;
+  glav->priv->min_buffers = 0;
   gst_gl_base_audio_visualizer_start(glav);
+
+  GstPad *sinkpad = gst_element_get_static_pad(GST_ELEMENT(glav), "sink");
+  if (sinkpad != NULL) {
+    gst_pad_add_probe(sinkpad,
+                      GST_PAD_PROBE_TYPE_BUFFER |
+                          GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                      gst_gl_base_audio_visualizer_sink_probe, glav, NULL);
+    gst_object_unref(sinkpad);
+  }
 }
 
 static void gst_gl_base_audio_visualizer_finalize(GObject *object) {
@@ -163,6 +204,7 @@ static void gst_gl_base_audio_visualizer_finalize(GObject *object) {
   gst_gl_base_audio_visualizer_stop(glav);
 
   g_rec_mutex_clear(&glav->priv->context_lock);
+  g_clear_object(&glav->priv->analysis_adapter);
 
   G_OBJECT_CLASS(parent_class)->finalize(object);
 }
@@ -281,10 +323,168 @@ static gboolean gst_gl_base_audio_visualizer_default_gl_render(
   return TRUE;
 }
 
+static void
+gst_gl_base_audio_visualizer_reset_analysis(GstGLBaseAudioVisualizer *glav) {
+  gst_adapter_clear(glav->priv->analysis_adapter);
+  glav->priv->analysis_pts = GST_CLOCK_TIME_NONE;
+  glav->priv->next_frame_pts = GST_CLOCK_TIME_NONE;
+}
+
+static GstClockTime
+gst_gl_base_audio_visualizer_frame_duration(GstAudioVisualizer *bscope) {
+  if (GST_VIDEO_INFO_FPS_N(&bscope->vinfo) <= 0) {
+    return GST_CLOCK_TIME_NONE;
+  }
+
+  return gst_util_uint64_scale_int(GST_SECOND,
+                                   GST_VIDEO_INFO_FPS_D(&bscope->vinfo),
+                                   GST_VIDEO_INFO_FPS_N(&bscope->vinfo));
+}
+
+/* Drops analysis audio before pts. */
+static void
+gst_gl_base_audio_visualizer_flush_analysis(GstGLBaseAudioVisualizer *glav,
+                                            GstClockTime pts) {
+  GstAudioVisualizer *bscope = GST_AUDIO_VISUALIZER(glav);
+  GstGLBaseAudioVisualizerPrivate *priv = glav->priv;
+  gint bpf = GST_AUDIO_INFO_BPF(&bscope->ainfo);
+  gint rate = GST_AUDIO_INFO_RATE(&bscope->ainfo);
+
+  if (!GST_CLOCK_TIME_IS_VALID(priv->analysis_pts) || pts <= priv->analysis_pts ||
+      bpf == 0 || rate == 0) {
+    return;
+  }
+
+  guint64 frames =
+      gst_util_uint64_scale(pts - priv->analysis_pts, rate, GST_SECOND);
+  gsize bytes = MIN(frames * bpf, gst_adapter_available(priv->analysis_adapter));
+
+  gst_adapter_flush(priv->analysis_adapter, bytes);
+  priv->analysis_pts += gst_util_uint64_scale_int(GST_SECOND, bytes / bpf, rate);
+}
+
+/* Keeps a copy of the incoming audio while a subclass wants to analyse
+ * dropped frames, and forgets it when the stream jumps. */
+static GstPadProbeReturn
+gst_gl_base_audio_visualizer_sink_probe(GstPad *pad, GstPadProbeInfo *info,
+                                        gpointer user_data) {
+  GstGLBaseAudioVisualizer *glav = GST_GL_BASE_AUDIO_VISUALIZER(user_data);
+  GstGLBaseAudioVisualizerClass *klass =
+      GST_GL_BASE_AUDIO_VISUALIZER_GET_CLASS(glav);
+  GstGLBaseAudioVisualizerPrivate *priv = glav->priv;
+
+  if (klass->gl_analyze == NULL) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    switch (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info))) {
+    case GST_EVENT_FLUSH_STOP:
+    case GST_EVENT_SEGMENT:
+    case GST_EVENT_STREAM_START:
+      gst_gl_base_audio_visualizer_reset_analysis(glav);
+      break;
+    default:
+      break;
+    }
+    return GST_PAD_PROBE_OK;
+  }
+
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+
+  if (GST_BUFFER_IS_DISCONT(buffer) || !GST_BUFFER_PTS_IS_VALID(buffer)) {
+    gst_gl_base_audio_visualizer_reset_analysis(glav);
+    if (!GST_BUFFER_PTS_IS_VALID(buffer)) {
+      return GST_PAD_PROBE_OK;
+    }
+  }
+
+  if (gst_adapter_available(priv->analysis_adapter) == 0) {
+    priv->analysis_pts = GST_BUFFER_PTS(buffer);
+  }
+  gst_adapter_push(priv->analysis_adapter, gst_buffer_ref(buffer));
+
+  /* Bound the backlog while nothing is rendered. */
+  GstClockTime duration = gst_gl_base_audio_visualizer_frame_duration(
+      GST_AUDIO_VISUALIZER(glav));
+  GstClockTime end = GST_BUFFER_PTS(buffer) + (GST_BUFFER_DURATION_IS_VALID(buffer)
+                                                   ? GST_BUFFER_DURATION(buffer)
+                                                   : 0);
+  if (GST_CLOCK_TIME_IS_VALID(duration)) {
+    GstClockTime keep =
+        duration * (GST_GL_BASE_AUDIO_VISUALIZER_MAX_ANALYZED_FRAMES + 1);
+
+    if (end > keep) {
+      gst_gl_base_audio_visualizer_flush_analysis(glav, end - keep);
+    }
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Takes the audio of the frames dropped since the last render, at most
+ * GST_GL_BASE_AUDIO_VISUALIZER_MAX_ANALYZED_FRAMES of them. */
+static GstBuffer *
+gst_gl_base_audio_visualizer_take_dropped(GstGLBaseAudioVisualizer *glav,
+                                          GstClockTime pts, guint *n_frames,
+                                          gsize *frame_size,
+                                          GstClockTime *first_pts) {
+  GstAudioVisualizer *bscope = GST_AUDIO_VISUALIZER(glav);
+  GstGLBaseAudioVisualizerPrivate *priv = glav->priv;
+  GstClockTime duration = gst_gl_base_audio_visualizer_frame_duration(bscope);
+  GstBuffer *dropped = NULL;
+
+  *n_frames = 0;
+
+  if (!GST_CLOCK_TIME_IS_VALID(pts) || !GST_CLOCK_TIME_IS_VALID(duration)) {
+    return NULL;
+  }
+
+  if (GST_CLOCK_TIME_IS_VALID(priv->next_frame_pts) &&
+      pts > priv->next_frame_pts + duration / 2) {
+    guint64 missed = (pts - priv->next_frame_pts + duration / 2) / duration;
+    GstClockTime start = priv->next_frame_pts;
+
+    if (missed > GST_GL_BASE_AUDIO_VISUALIZER_MAX_ANALYZED_FRAMES) {
+      start += (missed - GST_GL_BASE_AUDIO_VISUALIZER_MAX_ANALYZED_FRAMES) *
+               duration;
+      missed = GST_GL_BASE_AUDIO_VISUALIZER_MAX_ANALYZED_FRAMES;
+    }
+
+    gst_gl_base_audio_visualizer_flush_analysis(glav, start);
+
+    *frame_size = gst_util_uint64_scale_int(duration,
+                                            GST_AUDIO_INFO_RATE(&bscope->ainfo),
+                                            GST_SECOND) *
+                  GST_AUDIO_INFO_BPF(&bscope->ainfo);
+    if (*frame_size > 0 && GST_CLOCK_TIME_IS_VALID(priv->analysis_pts) &&
+        priv->analysis_pts <= start) {
+      *n_frames = MIN(missed, gst_adapter_available(priv->analysis_adapter) /
+                                  *frame_size);
+    }
+    if (*n_frames > 0) {
+      *first_pts = start;
+      dropped = gst_adapter_get_buffer(priv->analysis_adapter,
+                                       *n_frames * *frame_size);
+    }
+  }
+
+  priv->next_frame_pts = pts + duration;
+  gst_gl_base_audio_visualizer_flush_analysis(glav, pts);
+
+  return dropped;
+}
+
 typedef struct {
   GstGLBaseAudioVisualizer *glav;
   GstBuffer *in_audio;
   GstVideoFrame *out_video;
+  /* Audio of frames dropped since the last render, n_dropped of
+   * dropped_size bytes each. */
+  GstBuffer *dropped_audio;
+  guint n_dropped;
+  gsize dropped_size;
+  GstClockTime dropped_pts;
 } GstGLRenderCallbackParams;
 
 static void
@@ -292,8 +492,22 @@ gst_gl_base_audio_visualizer_gl_thread_render_callback(gpointer params) {
   GstGLRenderCallbackParams *cb_params = (GstGLRenderCallbackParams *)params;
   GstGLBaseAudioVisualizerClass *klass =
       GST_GL_BASE_AUDIO_VISUALIZER_GET_CLASS(cb_params->glav);
+  GstClockTime duration = gst_gl_base_audio_visualizer_frame_duration(
+      GST_AUDIO_VISUALIZER(cb_params->glav));
+
+  // inside gl thread: catch up on the audio of dropped frames first
+  for (guint i = 0; i < cb_params->n_dropped; i++) {
+    GstBuffer *frame_audio = gst_buffer_copy_region(
+        cb_params->dropped_audio, GST_BUFFER_COPY_MEMORY,
+        i * cb_params->dropped_size, cb_params->dropped_size);
+
+    GST_BUFFER_PTS(frame_audio) = cb_params->dropped_pts + i * duration;
+    GST_BUFFER_DURATION(frame_audio) = duration;
+    klass->gl_analyze(cb_params->glav, frame_audio);
+    gst_buffer_unref(frame_audio);
+  }
 
-  // inside gl thread: call virtual render function with audio and video
+  // call virtual render function with audio and video
   cb_params->glav->priv->gl_result = klass->gl_render(
       cb_params->glav, cb_params->in_audio, cb_params->out_video);
 }
@@ -312,6 +526,19 @@ static gboolean gst_gl_base_audio_visualizer_render(GstAudioVisualizer *bscope,
   cb_params.glav = glav;
   cb_params.in_audio = audio;
   cb_params.out_video = video;
+  cb_params.dropped_audio = NULL;
+  cb_params.n_dropped = 0;
+
+  if (GST_GL_BASE_AUDIO_VISUALIZER_GET_CLASS(glav)->gl_analyze != NULL) {
+    cb_params.dropped_audio = gst_gl_base_audio_visualizer_take_dropped(
+        glav, GST_BUFFER_PTS(video->buffer), &cb_params.n_dropped,
+        &cb_params.dropped_size, &cb_params.dropped_pts);
+    if (cb_params.n_dropped > 0) {
+      GST_DEBUG_OBJECT(glav, "Analysing %u frames dropped before %" GST_TIME_FORMAT,
+                       cb_params.n_dropped,
+                       GST_TIME_ARGS(GST_BUFFER_PTS(video->buffer)));
+    }
+  }
 
   window = gst_gl_context_get_window(glav->context);
 
@@ -327,6 +554,8 @@ static gboolean gst_gl_base_audio_visualizer_render(GstAudioVisualizer *bscope,
 
   g_rec_mutex_unlock(&glav->priv->context_lock);
 
+  gst_clear_buffer(&cb_params.dropped_audio);
+
   if (glav->priv->gl_result) {
     glav->priv->n_frames++;
   } else {
@@ -493,6 +722,115 @@ error: {
 }
 }
 
+void gst_gl_base_audio_visualizer_set_min_buffers(GstGLBaseAudioVisualizer *glav,
+                                                  guint min_buffers) {
+  glav->priv->min_buffers = min_buffers;
+}
+
+gboolean
+gst_gl_base_audio_visualizer_ensure_gl_context(GstGLBaseAudioVisualizer *glav) {
+  gboolean ret;
+
+  g_return_val_if_fail(GST_IS_GL_BASE_AUDIO_VISUALIZER(glav), FALSE);
+
+  g_rec_mutex_lock(&glav->priv->context_lock);
+  ret = gst_gl_base_audio_visualizer_find_gl_context_unlocked(glav);
+  g_rec_mutex_unlock(&glav->priv->context_lock);
+
+  return ret;
+}
+
+static gboolean gst_gl_base_audio_visualizer_caps_are_gl_memory(GstCaps *caps) {
+  GstCapsFeatures *features;
+
+  if (caps == NULL || gst_caps_is_empty(caps)) {
+    return FALSE;
+  }
+
+  features = gst_caps_get_features(caps, 0);
+  return features != NULL &&
+         gst_caps_features_contains(features, GST_CAPS_FEATURE_MEMORY_GL_MEMORY);
+}
+
+/* System memory output: frames are written by the CPU, so a GL pool would
+ * only add an upload downstream. Keeps downstream's pool unless it is a
+ * GL one, and pads strides when downstream understands GstVideoMeta. */
+static gboolean
+gst_gl_base_audio_visualizer_decide_sysmem_allocation(
+    GstGLBaseAudioVisualizer *glav, GstQuery *query, GstCaps *caps) {
+  GstBufferPool *pool = NULL;
+  GstStructure *config;
+  GstVideoInfo vinfo;
+  GstAllocationParams params;
+  guint min = 0, max = 0, size;
+  gboolean update_pool = FALSE;
+
+  if (caps == NULL || !gst_video_info_from_caps(&vinfo, caps))
+    return FALSE;
+
+  if (gst_query_get_n_allocation_pools(query) > 0) {
+    gst_query_parse_nth_allocation_pool(query, 0, &pool, &size, &min, &max);
+    update_pool = TRUE;
+  }
+
+  if (pool && GST_IS_GL_BUFFER_POOL(pool)) {
+    gst_object_unref(pool);
+    pool = NULL;
+  }
+  if (!pool)
+    pool = gst_video_buffer_pool_new();
+
+  min = MAX(min, glav->priv->min_buffers);
+  if (max != 0 && max < min)
+    max = min;
+
+  config = gst_buffer_pool_get_config(pool);
+  gst_buffer_pool_config_add_option(config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+
+  if (gst_query_find_allocation_meta(query, GST_VIDEO_META_API_TYPE, NULL) &&
+      gst_buffer_pool_has_option(pool, GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT)) {
+    GstVideoAlignment align;
+
+    gst_video_alignment_reset(&align);
+    align.stride_align[0] = GST_GL_BASE_AUDIO_VISUALIZER_STRIDE_ALIGN - 1;
+    gst_video_info_align(&vinfo, &align);
+    gst_buffer_pool_config_add_option(config,
+                                      GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT);
+    gst_buffer_pool_config_set_video_alignment(config, &align);
+  }
+
+  size = vinfo.size;
+  gst_buffer_pool_config_set_params(config, caps, size, min, max);
+
+  gst_allocation_params_init(&params);
+  params.align = GST_GL_BASE_AUDIO_VISUALIZER_STRIDE_ALIGN - 1;
+  gst_buffer_pool_config_set_allocator(config, NULL, &params);
+
+  if (!gst_buffer_pool_set_config(pool, config)) {
+    /* The pool may have adjusted the config; take it if it still fits. */
+    config = gst_buffer_pool_get_config(pool);
+    if (!gst_buffer_pool_config_validate_params(config, caps, size, min, max) ||
+        !gst_buffer_pool_set_config(pool, config)) {
+      GST_WARNING_OBJECT(glav, "Unable to configure system memory pool");
+      gst_object_unref(pool);
+      return FALSE;
+    }
+  }
+
+  GST_DEBUG_OBJECT(glav,
+                   "System memory pool %" GST_PTR_FORMAT
+                   ": stride %d, %u-%u buffers",
+                   pool, GST_VIDEO_INFO_PLANE_STRIDE(&vinfo, 0), min, max);
+
+  if (update_pool)
+    gst_query_set_nth_allocation_pool(query, 0, pool, size, min, max);
+  else
+    gst_query_add_allocation_pool(query, pool, size, min, max);
+
+  gst_object_unref(pool);
+  return TRUE;
+}
+
 static gboolean
 gst_gl_base_audio_visualizer_decide_allocation(GstAudioVisualizer *gstav,
                                                GstQuery *query) {
@@ -514,6 +852,14 @@ gst_gl_base_audio_visualizer_decide_allocation(GstAudioVisualizer *gstav,
 
   gst_query_parse_allocation(query, &caps, NULL);
 
+  if (!gst_gl_base_audio_visualizer_caps_are_gl_memory(caps)) {
+    gboolean ret =
+        gst_gl_base_audio_visualizer_decide_sysmem_allocation(glav, query, caps);
+
+    gst_object_unref(context);
+    return ret;
+  }
+
   if (gst_query_get_n_allocation_pools(query) > 0) {
     gst_query_parse_nth_allocation_pool(query, 0, &pool, &size, &min, &max);
 
@@ -527,6 +873,9 @@ gst_gl_base_audio_visualizer_decide_allocation(GstAudioVisualizer *gstav,
     min = max = 0;
     update_pool = FALSE;
   }
+  min = MAX(min, glav->priv->min_buffers);
+  if (max != 0 && max < min)
+    max = min;
 
   if (!pool || !GST_IS_GL_BUFFER_POOL(pool)) {
     /* can't use this pool */
@@ -90,6 +90,9 @@ struct _GstGLBaseAudioVisualizer {
  * @gl_start: called in the GL thread to setup the element GL state.
  * @gl_stop: called in the GL thread to clean up the element GL state.
  * @gl_render: called in the GL thread to fill the current video texture.
+ * @gl_analyze: called in the GL thread, before the next gl_render, with the
+ * audio of each frame dropped for QoS, so analysis keeps up without
+ * rendering. Optional.
  * @setup: called when the format changes (delegate from
  * GstAudioVisualizer.setup)
  *
@@ -106,10 +109,37 @@ struct _GstGLBaseAudioVisualizerClass {
   gboolean (*gl_render)(GstGLBaseAudioVisualizer *glav, GstBuffer *audio,
                         GstVideoFrame *video);
   gboolean (*setup)(GstGLBaseAudioVisualizer *glav);
+  void (*gl_analyze)(GstGLBaseAudioVisualizer *glav, GstBuffer *audio);
   /*< private >*/
   gpointer _padding[GST_PADDING];
 };
 
+/**
+ * gst_gl_base_audio_visualizer_ensure_gl_context:
+ * @glav: a #GstGLBaseAudioVisualizer
+ *
+ * Find or create the OpenGL context and run gl_start on it, as
+ * decide_allocation would. Lets subclasses inspect the context while caps
+ * are still being negotiated.
+ *
+ * Returns: whether a usable context is available
+ */
+GST_GL_API
+gboolean
+gst_gl_base_audio_visualizer_ensure_gl_context(GstGLBaseAudioVisualizer *glav);
+
+/**
+ * gst_gl_base_audio_visualizer_set_min_buffers:
+ * @glav: a #GstGLBaseAudioVisualizer
+ * @min_buffers: lower bound for the output pool
+ *
+ * Set how many output buffers are preallocated, typically the number of
+ * frames the subclass keeps in flight. Applies from the next allocation.
+ */
+GST_GL_API
+void gst_gl_base_audio_visualizer_set_min_buffers(GstGLBaseAudioVisualizer *glav,
+                                                  guint min_buffers);
+
 G_END_DECLS
 
 #endif /* __GST_GL_BASE_AUDIO_VISUALIZER_H__ */
@@ -0,0 +1,301 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef USE_GLEW
+#include <GL/glew.h>
+#endif
+#include <gst/gl/gstglfuncs.h>
+
+#include <projectM-4/playlist.h>
+#include <projectM-4/projectM.h>
+
+#include "instance.h"
+
+#ifndef GL_RGBA8
+#define GL_RGBA8 0x8058
+#endif
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+#ifndef GL_COLOR_ATTACHMENT0
+#define GL_COLOR_ATTACHMENT0 0x8CE0
+#endif
+#ifndef GL_RENDERBUFFER
+#define GL_RENDERBUFFER 0x8D41
+#endif
+#ifndef GL_DEPTH_ATTACHMENT
+#define GL_DEPTH_ATTACHMENT 0x8D00
+#endif
+#ifndef GL_STENCIL_ATTACHMENT
+#define GL_STENCIL_ATTACHMENT 0x8D20
+#endif
+#ifndef GL_DEPTH24_STENCIL8
+#define GL_DEPTH24_STENCIL8 0x88F0
+#endif
+
+GST_DEBUG_CATEGORY_STATIC(gst_projectm_instance_debug);
+#define GST_CAT_DEFAULT gst_projectm_instance_debug
+
+struct _GstProjectMInstance {
+  GstGLContext *context;
+
+  projectm_handle handle;
+  projectm_playlist_handle playlist;
+
+  GLuint fbo;
+  GLuint texture;
+  GLuint depth;
+  guint width;
+  guint height;
+};
+
+static void gst_projectm_instance_init_debug(void) {
+  static gsize debug_initialized = 0;
+
+  if (g_once_init_enter(&debug_initialized)) {
+    GST_DEBUG_CATEGORY_INIT(gst_projectm_instance_debug, "projectm-instance",
+                            0, "projectM instances of multi-stream elements");
+    g_once_init_leave(&debug_initialized, 1);
+  }
+}
+
+static void gst_projectm_instance_gl_init(GstGLContext *context,
+                                          gpointer data) {
+  gboolean *ok = data;
+
+#ifdef USE_GLEW
+  *ok = glewInit() == GLEW_OK;
+#else
+  *ok = TRUE;
+#endif
+}
+
+gboolean gst_projectm_instance_find_gl_context(GstElement *element,
+                                               GstGLAPI gl_api,
+                                               GstGLDisplay **display,
+                                               GstGLContext **other_context,
+                                               GstGLContext **context) {
+  GError *error = NULL;
+  gboolean ok = FALSE;
+
+  gst_projectm_instance_init_debug();
+
+  if (!gst_gl_ensure_element_data(element, display, other_context))
+    return FALSE;
+
+  gst_gl_display_filter_gl_api(*display, gl_api);
+
+  if (*context != NULL && (*context)->display != *display)
+    gst_clear_object(context);
+
+  if (*context == NULL) {
+    GstGLContext *local = NULL;
+
+    if (gst_gl_query_local_gl_context(element, GST_PAD_SRC, &local)) {
+      if (local->display == *display)
+        *context = local;
+      else
+        gst_object_unref(local);
+    }
+  }
+
+  if (*context == NULL) {
+    GST_OBJECT_LOCK(*display);
+    do {
+      gst_clear_object(context);
+      *context = gst_gl_display_get_gl_context_for_thread(*display, NULL);
+      if (*context == NULL &&
+          !gst_gl_display_create_context(*display, *other_context, context,
+                                         &error)) {
+        GST_OBJECT_UNLOCK(*display);
+        GST_ELEMENT_ERROR(element, RESOURCE, NOT_FOUND,
+                          ("%s", error ? error->message
+                                       : "Failed to create OpenGL context"),
+                          (NULL));
+        g_clear_error(&error);
+        return FALSE;
+      }
+    } while (!gst_gl_display_add_context(*display, *context));
+    GST_OBJECT_UNLOCK(*display);
+  }
+
+  if ((gst_gl_context_get_gl_api(*context) & gl_api) == 0) {
+    GST_ELEMENT_ERROR(element, RESOURCE, BUSY,
+                      ("GL context does not support the required API"),
+                      (NULL));
+    gst_clear_object(context);
+    return FALSE;
+  }
+
+  gst_gl_context_thread_add(*context, gst_projectm_instance_gl_init, &ok);
+  if (!ok) {
+    GST_ELEMENT_ERROR(element, LIBRARY, INIT, ("GLEW initialization failed"),
+                      (NULL));
+    gst_clear_object(context);
+    return FALSE;
+  }
+
+  GST_INFO_OBJECT(element, "Using OpenGL context %" GST_PTR_FORMAT, *context);
+  return TRUE;
+}
+
+static gboolean
+gst_projectm_instance_create_framebuffer(GstProjectMInstance *instance) {
+  const GstGLFuncs *gl = instance->context->gl_vtable;
+  GLsizei width = (GLsizei)instance->width;
+  GLsizei height = (GLsizei)instance->height;
+
+  if (!gl->GenFramebuffers || !gl->BindFramebuffer ||
+      !gl->FramebufferTexture2D) {
+    GST_ERROR("GL context has no framebuffer object support");
+    return FALSE;
+  }
+
+  gl->GenTextures(1, &instance->texture);
+  gl->BindTexture(GL_TEXTURE_2D, instance->texture);
+  gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  gl->TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, NULL);
+  gl->BindTexture(GL_TEXTURE_2D, 0);
+
+  gl->GenFramebuffers(1, &instance->fbo);
+  gl->BindFramebuffer(GL_FRAMEBUFFER, instance->fbo);
+  gl->FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D, instance->texture, 0);
+
+  /* Presets use the stencil buffer for some of their effects. */
+  if (gl->GenRenderbuffers && gl->BindRenderbuffer &&
+      gl->RenderbufferStorage && gl->FramebufferRenderbuffer) {
+    gl->GenRenderbuffers(1, &instance->depth);
+    gl->BindRenderbuffer(GL_RENDERBUFFER, instance->depth);
+    gl->RenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width,
+                            height);
+    gl->FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                GL_RENDERBUFFER, instance->depth);
+    gl->FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT,
+                                GL_RENDERBUFFER, instance->depth);
+    gl->BindRenderbuffer(GL_RENDERBUFFER, 0);
+  }
+
+  if (gl->CheckFramebufferStatus) {
+    GLenum status = gl->CheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+      GST_ERROR("Incomplete framebuffer for %ux%u instance (status=0x%x)",
+                instance->width, instance->height, status);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+GstProjectMInstance *
+gst_projectm_instance_new(GstGLContext *context,
+                          const GstProjectMInstanceSettings *settings,
+                          guint width, guint height, gint fps_n, gint fps_d) {
+  gst_projectm_instance_init_debug();
+
+  GstProjectMInstance *instance = g_new0(GstProjectMInstance, 1);
+  instance->context = gst_object_ref(context);
+  instance->width = width;
+  instance->height = height;
+
+  if (!gst_projectm_instance_create_framebuffer(instance)) {
+    gst_projectm_instance_free(instance);
+    return NULL;
+  }
+
+  instance->handle = projectm_create();
+  if (instance->handle == NULL) {
+    GST_ERROR("projectm_create() failed");
+    gst_projectm_instance_free(instance);
+    return NULL;
+  }
+
+  if (settings->texture_dir_path != NULL) {
+    const gchar *paths[1] = {settings->texture_dir_path};
+    projectm_set_texture_search_paths(instance->handle, paths, 1);
+  }
+
+  projectm_set_beat_sensitivity(instance->handle, settings->beat_sensitivity);
+  projectm_set_mesh_size(instance->handle, settings->mesh_width,
+                         settings->mesh_height);
+  projectm_set_fps(instance->handle,
+                   (gint)((fps_n + fps_d / 2) / MAX(fps_d, 1)));
+  projectm_set_window_size(instance->handle, width, height);
+
+  if (settings->preset_path != NULL) {
+    instance->playlist = projectm_playlist_create(instance->handle);
+    projectm_playlist_set_shuffle(instance->playlist,
+                                  settings->shuffle_presets);
+    guint added = projectm_playlist_add_path(
+        instance->playlist, settings->preset_path, true, false);
+    GST_DEBUG("Loaded %u presets from %s", added, settings->preset_path);
+
+    if (settings->preset_duration > 0.0) {
+      projectm_set_preset_duration(instance->handle,
+                                   settings->preset_duration);
+    } else {
+      projectm_set_preset_duration(instance->handle, 999999.0);
+    }
+
+    // Start on a preset rather than the idle logo
+    if (added > 0) {
+      projectm_playlist_play_next(instance->playlist, true);
+    }
+  }
+
+  GST_DEBUG("Created %ux%u instance with FBO %u", width, height,
+            instance->fbo);
+
+  return instance;
+}
+
+void gst_projectm_instance_free(GstProjectMInstance *instance) {
+  const GstGLFuncs *gl = instance->context->gl_vtable;
+
+  if (instance->playlist != NULL) {
+    projectm_playlist_destroy(instance->playlist);
+  }
+  if (instance->handle != NULL) {
+    projectm_destroy(instance->handle);
+  }
+
+  if (instance->fbo != 0) {
+    gl->DeleteFramebuffers(1, &instance->fbo);
+  }
+  if (instance->texture != 0) {
+    gl->DeleteTextures(1, &instance->texture);
+  }
+  if (instance->depth != 0 && gl->DeleteRenderbuffers) {
+    gl->DeleteRenderbuffers(1, &instance->depth);
+  }
+
+  gst_object_unref(instance->context);
+  g_free(instance);
+}
+
+void gst_projectm_instance_add_pcm(GstProjectMInstance *instance,
+                                   const gint16 *data, guint samples) {
+  projectm_pcm_add_int16(instance->handle, data, samples, PROJECTM_STEREO);
+}
+
+void gst_projectm_instance_render(GstProjectMInstance *instance,
+                                  gdouble time) {
+  projectm_set_frame_time(instance->handle, time);
+  projectm_opengl_render_frame_fbo(instance->handle, instance->fbo);
+}
+
+GLuint gst_projectm_instance_get_framebuffer(GstProjectMInstance *instance) {
+  return instance->fbo;
+}
+
+void gst_projectm_instance_get_size(GstProjectMInstance *instance,
+                                    guint *width, guint *height) {
+  *width = instance->width;
+  *height = instance->height;
+}
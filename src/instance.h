@@ -0,0 +1,98 @@
+#ifndef __GST_PROJECTM_INSTANCE_H__
+#define __GST_PROJECTM_INSTANCE_H__
+
+#include <gst/gl/gl.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief Find the GL context for an element driving projectM instances.
+ *
+ * Uses the display and application context from the pipeline, a context
+ * shared by downstream elements, or creates one, and initialises GLEW on it
+ * when projectM was built against GLEW.
+ *
+ * @param element The element, used for context queries and errors.
+ * @param gl_api APIs the context may use.
+ * @param display The element's display, updated.
+ * @param other_context The application's context, updated.
+ * @param context Receives the context.
+ * @return FALSE with an element error posted if no usable context was found.
+ */
+gboolean gst_projectm_instance_find_gl_context(GstElement *element,
+                                               GstGLAPI gl_api,
+                                               GstGLDisplay **display,
+                                               GstGLContext **other_context,
+                                               GstGLContext **context);
+
+/**
+ * @brief Settings a standalone projectM instance is created with.
+ */
+typedef struct {
+  const gchar *preset_path;
+  const gchar *texture_dir_path;
+  gfloat beat_sensitivity;
+  gdouble preset_duration;
+  gulong mesh_width;
+  gulong mesh_height;
+  gboolean shuffle_presets;
+} GstProjectMInstanceSettings;
+
+/**
+ * @brief A projectM instance with a preset playlist and a framebuffer of its
+ * own, for elements that drive several instances on one GL context.
+ *
+ * Presets are played from a file or directory through projectM's playlist;
+ * preset packs and timelines are only supported by the projectm element.
+ * All functions must be called on the GL thread of the context the instance
+ * was created on.
+ */
+typedef struct _GstProjectMInstance GstProjectMInstance;
+
+/**
+ * @brief Create an instance rendering width x height frames at fps_n/fps_d.
+ *
+ * @return The instance, or NULL if projectM or the framebuffer could not be
+ * created.
+ */
+GstProjectMInstance *
+gst_projectm_instance_new(GstGLContext *context,
+                          const GstProjectMInstanceSettings *settings,
+                          guint width, guint height, gint fps_n, gint fps_d);
+
+/**
+ * @brief Destroy projectM and the framebuffer.
+ */
+void gst_projectm_instance_free(GstProjectMInstance *instance);
+
+/**
+ * @brief Feed interleaved stereo 16-bit samples.
+ *
+ * @param samples Samples per channel.
+ */
+void gst_projectm_instance_add_pcm(GstProjectMInstance *instance,
+                                   const gint16 *data, guint samples);
+
+/**
+ * @brief Render a frame into the instance's framebuffer.
+ *
+ * @param time Stream time of the frame in seconds.
+ */
+void gst_projectm_instance_render(GstProjectMInstance *instance, gdouble time);
+
+/**
+ * @brief Framebuffer the instance renders into; its colour attachment is
+ * RGBA8.
+ */
+GLuint gst_projectm_instance_get_framebuffer(GstProjectMInstance *instance);
+
+/**
+ * @brief Size the instance was created with.
+ */
+void gst_projectm_instance_get_size(GstProjectMInstance *instance,
+                                    guint *width, guint *height);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_INSTANCE_H__ */
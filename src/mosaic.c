@@ -0,0 +1,988 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/audio/audio.h>
+#include <gst/base/gstadapter.h>
+#include <gst/gl/gl.h>
+#include <gst/gl/gstglfuncs.h>
+#include <gst/video/gstvideopool.h>
+#include <gst/video/video.h>
+
+#include <stdlib.h>
+
+#ifndef GL_RGBA8
+#define GL_RGBA8 0x8058
+#endif
+#ifndef GL_COLOR_ATTACHMENT0
+#define GL_COLOR_ATTACHMENT0 0x8CE0
+#endif
+#ifndef GL_READ_FRAMEBUFFER
+#define GL_READ_FRAMEBUFFER 0x8CA8
+#endif
+#ifndef GL_DRAW_FRAMEBUFFER
+#define GL_DRAW_FRAMEBUFFER 0x8CA9
+#endif
+
+/* Output format picked when downstream accepts a range. */
+#define GST_PROJECTM_MOSAIC_DEFAULT_WIDTH 1920
+#define GST_PROJECTM_MOSAIC_DEFAULT_HEIGHT 1080
+#define GST_PROJECTM_MOSAIC_DEFAULT_FPS 30
+
+#include "caps.h"
+#include "config.h"
+#include "enums.h"
+#include "frame.h"
+#include "framegrid.h"
+#include "instance.h"
+#include "mosaic.h"
+
+GST_DEBUG_CATEGORY_STATIC(gst_projectm_mosaic_debug);
+#define GST_CAT_DEFAULT gst_projectm_mosaic_debug
+
+struct _GstProjectMMosaicPad {
+  GstAggregatorPad parent;
+
+  gchar *preset_path;
+
+  /* Aggregator thread only. */
+  GstAdapter *adapter;
+  GstAudioInfo ainfo;
+  gboolean released;
+
+  /* GL thread only. */
+  GstProjectMInstance *instance;
+};
+
+struct _GstProjectMMosaicPrivate {
+  GRecMutex context_lock;
+  GstGLDisplay *display;
+  GstGLContext *context;
+  GstGLContext *other_context;
+
+  /* Aggregator thread only. Frame n starts at base_pts + n / fps. */
+  GstVideoInfo vinfo;
+  GstBufferPool *pool;
+  GstClockTime base_pts;
+  guint64 frame;
+
+  /* GL thread only. */
+  GLuint fbo;
+  GLuint texture;
+  guint fbo_width;
+  guint fbo_height;
+  guint8 *staging;
+};
+
+typedef struct {
+  GstProjectMMosaic *mosaic;
+  GPtrArray *pads;
+  GstBuffer **audio;
+  GstBuffer *out;
+  gdouble time;
+  gboolean ok;
+} GstProjectMMosaicJob;
+
+G_DEFINE_TYPE(GstProjectMMosaicPad, gst_projectm_mosaic_pad,
+              GST_TYPE_AGGREGATOR_PAD);
+
+#define gst_projectm_mosaic_parent_class parent_class
+G_DEFINE_TYPE_WITH_CODE(GstProjectMMosaic, gst_projectm_mosaic,
+                        GST_TYPE_AGGREGATOR,
+                        G_ADD_PRIVATE(GstProjectMMosaic)
+                            GST_DEBUG_CATEGORY_INIT(gst_projectm_mosaic_debug,
+                                                    "projectmmosaic", 0,
+                                                    "projectM mosaic"));
+
+static GstStaticPadTemplate gst_projectm_mosaic_src_template =
+    GST_STATIC_PAD_TEMPLATE(
+        "src", GST_PAD_SRC, GST_PAD_ALWAYS,
+        GST_STATIC_CAPS("video/x-raw, format = (string) ABGR, "
+                        "width = (int) [ 16, 8192 ], "
+                        "height = (int) [ 16, 8192 ], "
+                        "framerate = (fraction) [ 1/1, MAX ]"));
+
+static const GstGLAPI gst_projectm_mosaic_gl_api =
+    GST_GL_API_OPENGL3 | GST_GL_API_GLES2;
+
+/* RGBA readback to ABGR output, as for the projectm element. */
+static const guint8 gst_projectm_mosaic_swizzle[4] = {3, 2, 1, 0};
+
+static void gst_projectm_mosaic_pad_set_property(GObject *object,
+                                                 guint prop_id,
+                                                 const GValue *value,
+                                                 GParamSpec *pspec) {
+  GstProjectMMosaicPad *pad = GST_PROJECTM_MOSAIC_PAD(object);
+
+  switch (prop_id) {
+  case PROP_PRESET_PATH:
+    GST_OBJECT_LOCK(pad);
+    g_free(pad->preset_path);
+    pad->preset_path = g_value_dup_string(value);
+    GST_OBJECT_UNLOCK(pad);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void gst_projectm_mosaic_pad_get_property(GObject *object,
+                                                 guint prop_id, GValue *value,
+                                                 GParamSpec *pspec) {
+  GstProjectMMosaicPad *pad = GST_PROJECTM_MOSAIC_PAD(object);
+
+  switch (prop_id) {
+  case PROP_PRESET_PATH:
+    GST_OBJECT_LOCK(pad);
+    g_value_set_string(value, pad->preset_path);
+    GST_OBJECT_UNLOCK(pad);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static GstFlowReturn gst_projectm_mosaic_pad_flush(GstAggregatorPad *aggpad,
+                                                   GstAggregator *agg) {
+  gst_adapter_clear(GST_PROJECTM_MOSAIC_PAD(aggpad)->adapter);
+  return GST_FLOW_OK;
+}
+
+static void gst_projectm_mosaic_pad_finalize(GObject *object) {
+  GstProjectMMosaicPad *pad = GST_PROJECTM_MOSAIC_PAD(object);
+
+  g_free(pad->preset_path);
+  g_object_unref(pad->adapter);
+
+  G_OBJECT_CLASS(gst_projectm_mosaic_pad_parent_class)->finalize(object);
+}
+
+static void
+gst_projectm_mosaic_pad_class_init(GstProjectMMosaicPadClass *klass) {
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+  GstAggregatorPadClass *aggpad_class = GST_AGGREGATOR_PAD_CLASS(klass);
+
+  gobject_class->set_property = gst_projectm_mosaic_pad_set_property;
+  gobject_class->get_property = gst_projectm_mosaic_pad_get_property;
+  gobject_class->finalize = gst_projectm_mosaic_pad_finalize;
+  aggpad_class->flush = GST_DEBUG_FUNCPTR(gst_projectm_mosaic_pad_flush);
+
+  g_object_class_install_property(
+      gobject_class, PROP_PRESET_PATH,
+      g_param_spec_string("preset", "Preset",
+                          "Preset file or directory of this tile, instead of "
+                          "the element's.",
+                          NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
+
+static void gst_projectm_mosaic_pad_init(GstProjectMMosaicPad *pad) {
+  pad->adapter = gst_adapter_new();
+  gst_audio_info_init(&pad->ainfo);
+}
+
+/* Bytes of audio frame n consumes from a pad, 0 before its caps are known. */
+static gsize gst_projectm_mosaic_pad_frame_bytes(GstProjectMMosaicPad *pad,
+                                                 const GstVideoInfo *vinfo,
+                                                 guint64 n) {
+  if (GST_AUDIO_INFO_FORMAT(&pad->ainfo) == GST_AUDIO_FORMAT_UNKNOWN) {
+    return 0;
+  }
+
+  return (gsize)gst_projectm_frame_grid_samples(
+             GST_AUDIO_INFO_RATE(&pad->ainfo), GST_VIDEO_INFO_FPS_N(vinfo),
+             GST_VIDEO_INFO_FPS_D(vinfo), n) *
+         GST_AUDIO_INFO_BPF(&pad->ainfo);
+}
+
+/* Rectangle of tile i of n in GL coordinates, whose rows count from the
+ * bottom; tiles are laid out from the top left. */
+static void gst_projectm_mosaic_tile_rect(GstProjectMMosaic *mosaic, guint n,
+                                          guint i, guint width, guint height,
+                                          guint *x, guint *y, guint *w,
+                                          guint *h) {
+  guint columns = mosaic->columns;
+
+  if (columns == 0) {
+    columns = 1;
+    while (columns * columns < n) {
+      columns++;
+    }
+  }
+  columns = MIN(columns, n);
+
+  guint rows = (n + columns - 1) / columns;
+
+  *w = width / columns;
+  *h = height / rows;
+  *x = (i % columns) * *w;
+  *y = height - (i / columns + 1) * *h;
+}
+
+static gboolean gst_projectm_mosaic_ensure_gl_context(GstProjectMMosaic *mosaic) {
+  GstProjectMMosaicPrivate *priv = mosaic->priv;
+  gboolean ret = TRUE;
+
+  g_rec_mutex_lock(&priv->context_lock);
+  if (priv->context == NULL) {
+    ret = gst_projectm_instance_find_gl_context(
+        GST_ELEMENT(mosaic), gst_projectm_mosaic_gl_api, &priv->display,
+        &priv->other_context, &priv->context);
+  }
+  g_rec_mutex_unlock(&priv->context_lock);
+
+  return ret;
+}
+
+static void gst_projectm_mosaic_release_target(GstProjectMMosaic *mosaic,
+                                               const GstGLFuncs *gl) {
+  GstProjectMMosaicPrivate *priv = mosaic->priv;
+
+  if (priv->fbo != 0) {
+    gl->DeleteFramebuffers(1, &priv->fbo);
+    priv->fbo = 0;
+  }
+  if (priv->texture != 0) {
+    gl->DeleteTextures(1, &priv->texture);
+    priv->texture = 0;
+  }
+  g_clear_pointer(&priv->staging, g_free);
+  priv->fbo_width = 0;
+  priv->fbo_height = 0;
+}
+
+/* Framebuffer the tiles are composited into. */
+static gboolean gst_projectm_mosaic_ensure_target(GstProjectMMosaic *mosaic,
+                                                  const GstGLFuncs *gl,
+                                                  guint width, guint height) {
+  GstProjectMMosaicPrivate *priv = mosaic->priv;
+
+  if (priv->fbo != 0 && priv->fbo_width == width &&
+      priv->fbo_height == height) {
+    return TRUE;
+  }
+
+  gst_projectm_mosaic_release_target(mosaic, gl);
+
+  gl->GenTextures(1, &priv->texture);
+  gl->BindTexture(GL_TEXTURE_2D, priv->texture);
+  gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  gl->TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, (GLsizei)width, (GLsizei)height,
+                 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  gl->BindTexture(GL_TEXTURE_2D, 0);
+
+  gl->GenFramebuffers(1, &priv->fbo);
+  gl->BindFramebuffer(GL_FRAMEBUFFER, priv->fbo);
+  gl->FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           priv->texture, 0);
+
+  if (gl->CheckFramebufferStatus &&
+      gl->CheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    GST_ERROR_OBJECT(mosaic, "Incomplete %ux%u mosaic framebuffer", width,
+                     height);
+    gst_projectm_mosaic_release_target(mosaic, gl);
+    return FALSE;
+  }
+
+  priv->staging = g_malloc((gsize)width * height * 4);
+  priv->fbo_width = width;
+  priv->fbo_height = height;
+
+  GST_DEBUG_OBJECT(mosaic, "Created %ux%u mosaic FBO %u", width, height,
+                   priv->fbo);
+  return TRUE;
+}
+
+/* Creates the pad's instance, or recreates it when its tile changed size. */
+static gboolean gst_projectm_mosaic_ensure_instance(GstProjectMMosaic *mosaic,
+                                                    GstProjectMMosaicPad *pad,
+                                                    GstGLContext *context,
+                                                    guint width, guint height) {
+  GstProjectMMosaicPrivate *priv = mosaic->priv;
+  guint instance_width, instance_height;
+
+  if (pad->instance != NULL) {
+    gst_projectm_instance_get_size(pad->instance, &instance_width,
+                                   &instance_height);
+    if (instance_width == width && instance_height == height) {
+      return TRUE;
+    }
+    g_clear_pointer(&pad->instance, gst_projectm_instance_free);
+  }
+
+  GST_OBJECT_LOCK(mosaic);
+  GST_OBJECT_LOCK(pad);
+  GstProjectMInstanceSettings settings = {
+      .preset_path =
+          pad->preset_path != NULL ? pad->preset_path : mosaic->preset_path,
+      .texture_dir_path = mosaic->texture_dir_path,
+      .beat_sensitivity = mosaic->beat_sensitivity,
+      .preset_duration = mosaic->preset_duration,
+      .mesh_width = mosaic->mesh_width,
+      .mesh_height = mosaic->mesh_height,
+      .shuffle_presets = mosaic->shuffle_presets,
+  };
+  pad->instance = gst_projectm_instance_new(
+      context, &settings, width, height, GST_VIDEO_INFO_FPS_N(&priv->vinfo),
+      GST_VIDEO_INFO_FPS_D(&priv->vinfo));
+  GST_OBJECT_UNLOCK(pad);
+  GST_OBJECT_UNLOCK(mosaic);
+
+  return pad->instance != NULL;
+}
+
+static void gst_projectm_mosaic_gl_render(GstGLContext *context,
+                                          gpointer data) {
+  GstProjectMMosaicJob *job = data;
+  GstProjectMMosaic *mosaic = job->mosaic;
+  GstProjectMMosaicPrivate *priv = mosaic->priv;
+  const GstGLFuncs *gl = context->gl_vtable;
+  guint width = GST_VIDEO_INFO_WIDTH(&priv->vinfo);
+  guint height = GST_VIDEO_INFO_HEIGHT(&priv->vinfo);
+  guint n = job->pads->len;
+  guint x, y, w, h;
+  GstVideoFrame frame;
+
+  if (!gl->BlitFramebuffer) {
+    GST_ERROR_OBJECT(mosaic, "GL context cannot blit framebuffers");
+    return;
+  }
+
+  if (!gst_projectm_mosaic_ensure_target(mosaic, gl, width, height)) {
+    return;
+  }
+
+  for (guint i = 0; i < n; i++) {
+    GstProjectMMosaicPad *pad = g_ptr_array_index(job->pads, i);
+    GstMapInfo map;
+
+    gst_projectm_mosaic_tile_rect(mosaic, n, i, width, height, &x, &y, &w, &h);
+    if (pad->released || w == 0 || h == 0) {
+      continue;
+    }
+
+    if (!gst_projectm_mosaic_ensure_instance(mosaic, pad, context, w, h)) {
+      return;
+    }
+
+    if (job->audio[i] != NULL &&
+        gst_buffer_map(job->audio[i], &map, GST_MAP_READ)) {
+      gst_projectm_instance_add_pcm(pad->instance, (const gint16 *)map.data,
+                                    map.size /
+                                        GST_AUDIO_INFO_BPF(&pad->ainfo));
+      gst_buffer_unmap(job->audio[i], &map);
+    }
+
+    gst_projectm_instance_render(pad->instance, job->time);
+  }
+
+  /* Composite on the GPU; tiles that do not divide the frame evenly leave a
+   * black border. */
+  gl->BindFramebuffer(GL_FRAMEBUFFER, priv->fbo);
+  gl->Viewport(0, 0, (GLsizei)width, (GLsizei)height);
+  gl->ClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+  gl->Clear(GL_COLOR_BUFFER_BIT);
+
+  for (guint i = 0; i < n; i++) {
+    GstProjectMMosaicPad *pad = g_ptr_array_index(job->pads, i);
+
+    gst_projectm_mosaic_tile_rect(mosaic, n, i, width, height, &x, &y, &w, &h);
+    if (pad->released || pad->instance == NULL || w == 0 || h == 0) {
+      continue;
+    }
+
+    gl->BindFramebuffer(GL_READ_FRAMEBUFFER,
+                        gst_projectm_instance_get_framebuffer(pad->instance));
+    gl->BindFramebuffer(GL_DRAW_FRAMEBUFFER, priv->fbo);
+    gl->BlitFramebuffer(0, 0, (GLint)w, (GLint)h, (GLint)x, (GLint)y,
+                        (GLint)(x + w), (GLint)(y + h), GL_COLOR_BUFFER_BIT,
+                        GL_NEAREST);
+  }
+
+  gl->BindFramebuffer(GL_FRAMEBUFFER, priv->fbo);
+  gl->ReadPixels(0, 0, (GLsizei)width, (GLsizei)height, GL_RGBA,
+                 GL_UNSIGNED_BYTE, priv->staging);
+
+  if (gst_video_frame_map(&frame, &priv->vinfo, job->out, GST_MAP_WRITE)) {
+    gst_projectm_frame_copy_full(
+        GST_VIDEO_FRAME_PLANE_DATA(&frame, 0),
+        GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0), priv->staging,
+        (gsize)width * 4, width, height,
+        mosaic->vertical_flip ? GST_PROJECTM_FRAME_COPY_FLIP
+                              : GST_PROJECTM_FRAME_COPY_NONE,
+        gst_projectm_mosaic_swizzle);
+    gst_video_frame_unmap(&frame);
+    job->ok = TRUE;
+  }
+}
+
+static GstFlowReturn gst_projectm_mosaic_aggregate(GstAggregator *agg,
+                                                   gboolean timeout) {
+  GstProjectMMosaic *mosaic = GST_PROJECTM_MOSAIC(agg);
+  GstProjectMMosaicPrivate *priv = mosaic->priv;
+  gboolean ready = TRUE;
+  gboolean all_eos = TRUE;
+  GstFlowReturn ret;
+
+  if (priv->pool == NULL) {
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  GPtrArray *pads = g_ptr_array_new_with_free_func(gst_object_unref);
+  GST_OBJECT_LOCK(mosaic);
+  for (GList *l = GST_ELEMENT(mosaic)->sinkpads; l != NULL; l = l->next) {
+    g_ptr_array_add(pads, gst_object_ref(l->data));
+  }
+  GST_OBJECT_UNLOCK(mosaic);
+
+  /* Queue a frame of audio from every pad; a pad that ran dry holds the
+   * frame back unless it is at EOS or a live deadline passed. */
+  for (guint i = 0; i < pads->len; i++) {
+    GstProjectMMosaicPad *pad = g_ptr_array_index(pads, i);
+    GstAggregatorPad *aggpad = GST_AGGREGATOR_PAD(pad);
+    gsize need =
+        gst_projectm_mosaic_pad_frame_bytes(pad, &priv->vinfo, priv->frame);
+    GstBuffer *buffer;
+
+    while (gst_adapter_available(pad->adapter) < need &&
+           (buffer = gst_aggregator_pad_pop_buffer(aggpad)) != NULL) {
+      gst_adapter_push(pad->adapter, buffer);
+    }
+
+    if (need > 0 && gst_adapter_available(pad->adapter) >= need) {
+      all_eos = FALSE;
+    } else if (!gst_aggregator_pad_is_eos(aggpad)) {
+      all_eos = FALSE;
+      if (need > 0 && !timeout) {
+        ready = FALSE;
+      }
+    }
+  }
+
+  if (all_eos || !ready) {
+    g_ptr_array_unref(pads);
+    return all_eos ? GST_FLOW_EOS : GST_FLOW_OK;
+  }
+
+  if (!GST_CLOCK_TIME_IS_VALID(priv->base_pts)) {
+    GST_OBJECT_LOCK(agg);
+    priv->base_pts = GST_AGGREGATOR_PAD(agg->srcpad)->segment.start;
+    GST_OBJECT_UNLOCK(agg);
+  }
+
+  gint fps_n = GST_VIDEO_INFO_FPS_N(&priv->vinfo);
+  gint fps_d = GST_VIDEO_INFO_FPS_D(&priv->vinfo);
+  GstClockTime pts =
+      priv->base_pts + gst_projectm_frame_grid_time(fps_n, fps_d, priv->frame);
+  GstClockTime end = priv->base_pts + gst_projectm_frame_grid_time(
+                                          fps_n, fps_d, priv->frame + 1);
+
+  GstProjectMMosaicJob job = {0};
+  job.mosaic = mosaic;
+  job.pads = pads;
+  job.audio = g_new0(GstBuffer *, pads->len);
+  job.time = (gdouble)pts / GST_SECOND;
+
+  for (guint i = 0; i < pads->len; i++) {
+    GstProjectMMosaicPad *pad = g_ptr_array_index(pads, i);
+    gsize size =
+        MIN(gst_projectm_mosaic_pad_frame_bytes(pad, &priv->vinfo, priv->frame),
+            gst_adapter_available(pad->adapter));
+
+    if (size > 0) {
+      job.audio[i] = gst_adapter_take_buffer(pad->adapter, size);
+    }
+  }
+
+  ret = gst_buffer_pool_acquire_buffer(priv->pool, &job.out, NULL);
+  if (ret == GST_FLOW_OK) {
+    gst_gl_context_thread_add(priv->context, gst_projectm_mosaic_gl_render,
+                              &job);
+  }
+
+  for (guint i = 0; i < pads->len; i++) {
+    gst_clear_buffer(&job.audio[i]);
+  }
+  g_free(job.audio);
+  g_ptr_array_unref(pads);
+
+  if (ret != GST_FLOW_OK) {
+    return ret;
+  }
+
+  if (!job.ok) {
+    gst_buffer_unref(job.out);
+    GST_ELEMENT_ERROR(mosaic, RESOURCE, FAILED,
+                      ("Failed to render mosaic frame"), (NULL));
+    return GST_FLOW_ERROR;
+  }
+
+  GST_BUFFER_PTS(job.out) = pts;
+  GST_BUFFER_DURATION(job.out) = end - pts;
+  priv->frame++;
+
+  GST_OBJECT_LOCK(agg);
+  GST_AGGREGATOR_PAD(agg->srcpad)->segment.position = end;
+  GST_OBJECT_UNLOCK(agg);
+
+  return gst_aggregator_finish_buffer(agg, job.out);
+}
+
+static gboolean gst_projectm_mosaic_sink_event(GstAggregator *agg,
+                                               GstAggregatorPad *aggpad,
+                                               GstEvent *event) {
+  GstProjectMMosaicPad *pad = GST_PROJECTM_MOSAIC_PAD(aggpad);
+
+  if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS) {
+    GstCaps *caps;
+
+    gst_event_parse_caps(event, &caps);
+    if (!gst_audio_info_from_caps(&pad->ainfo, caps)) {
+      gst_event_unref(event);
+      return FALSE;
+    }
+    gst_adapter_clear(pad->adapter);
+  }
+
+  return GST_AGGREGATOR_CLASS(parent_class)->sink_event(agg, aggpad, event);
+}
+
+static GstCaps *gst_projectm_mosaic_fixate_src_caps(GstAggregator *agg,
+                                                    GstCaps *caps) {
+  caps = gst_caps_make_writable(caps);
+
+  GstStructure *s = gst_caps_get_structure(caps, 0);
+  gst_structure_fixate_field_nearest_int(s, "width",
+                                         GST_PROJECTM_MOSAIC_DEFAULT_WIDTH);
+  gst_structure_fixate_field_nearest_int(s, "height",
+                                         GST_PROJECTM_MOSAIC_DEFAULT_HEIGHT);
+  gst_structure_fixate_field_nearest_fraction(
+      s, "framerate", GST_PROJECTM_MOSAIC_DEFAULT_FPS, 1);
+
+  return gst_caps_fixate(caps);
+}
+
+static gboolean gst_projectm_mosaic_negotiated_src_caps(GstAggregator *agg,
+                                                        GstCaps *caps) {
+  GstProjectMMosaic *mosaic = GST_PROJECTM_MOSAIC(agg);
+  GstProjectMMosaicPrivate *priv = mosaic->priv;
+  GstVideoInfo vinfo;
+
+  if (!gst_video_info_from_caps(&vinfo, caps) ||
+      GST_VIDEO_INFO_FPS_N(&vinfo) <= 0) {
+    return FALSE;
+  }
+
+  if (!gst_projectm_mosaic_ensure_gl_context(mosaic)) {
+    return FALSE;
+  }
+
+  GstBufferPool *pool = gst_video_buffer_pool_new();
+  GstStructure *config = gst_buffer_pool_get_config(pool);
+  gst_buffer_pool_config_set_params(config, caps, GST_VIDEO_INFO_SIZE(&vinfo),
+                                    2, 0);
+  if (!gst_buffer_pool_set_config(pool, config) ||
+      !gst_buffer_pool_set_active(pool, TRUE)) {
+    GST_WARNING_OBJECT(mosaic, "Could not activate buffer pool");
+    gst_object_unref(pool);
+    return FALSE;
+  }
+
+  if (priv->pool != NULL) {
+    gst_buffer_pool_set_active(priv->pool, FALSE);
+    gst_object_unref(priv->pool);
+  }
+  priv->pool = pool;
+
+  /* Continue the timeline where the previous format left off. */
+  if (priv->frame > 0) {
+    priv->base_pts +=
+        gst_projectm_frame_grid_time(GST_VIDEO_INFO_FPS_N(&priv->vinfo),
+                                     GST_VIDEO_INFO_FPS_D(&priv->vinfo),
+                                     priv->frame);
+    priv->frame = 0;
+  }
+  priv->vinfo = vinfo;
+
+  GST_INFO_OBJECT(mosaic, "Rendering %dx%d at %d/%d",
+                  GST_VIDEO_INFO_WIDTH(&vinfo), GST_VIDEO_INFO_HEIGHT(&vinfo),
+                  GST_VIDEO_INFO_FPS_N(&vinfo), GST_VIDEO_INFO_FPS_D(&vinfo));
+  return TRUE;
+}
+
+static GstFlowReturn gst_projectm_mosaic_flush(GstAggregator *agg) {
+  GstProjectMMosaicPrivate *priv = GST_PROJECTM_MOSAIC(agg)->priv;
+
+  priv->base_pts = GST_CLOCK_TIME_NONE;
+  priv->frame = 0;
+
+  return GST_FLOW_OK;
+}
+
+static gboolean gst_projectm_mosaic_start(GstAggregator *agg) {
+  GstProjectMMosaicPrivate *priv = GST_PROJECTM_MOSAIC(agg)->priv;
+
+  gst_video_info_init(&priv->vinfo);
+  priv->base_pts = GST_CLOCK_TIME_NONE;
+  priv->frame = 0;
+
+  return TRUE;
+}
+
+static void gst_projectm_mosaic_free_gl(GstGLContext *context, gpointer data) {
+  GstProjectMMosaic *mosaic = GST_PROJECTM_MOSAIC(data);
+
+  GST_OBJECT_LOCK(mosaic);
+  for (GList *l = GST_ELEMENT(mosaic)->sinkpads; l != NULL; l = l->next) {
+    GstProjectMMosaicPad *pad = l->data;
+    g_clear_pointer(&pad->instance, gst_projectm_instance_free);
+  }
+  GST_OBJECT_UNLOCK(mosaic);
+
+  gst_projectm_mosaic_release_target(mosaic, context->gl_vtable);
+}
+
+static gboolean gst_projectm_mosaic_stop(GstAggregator *agg) {
+  GstProjectMMosaic *mosaic = GST_PROJECTM_MOSAIC(agg);
+  GstProjectMMosaicPrivate *priv = mosaic->priv;
+
+  g_rec_mutex_lock(&priv->context_lock);
+  if (priv->context != NULL) {
+    gst_gl_context_thread_add(priv->context, gst_projectm_mosaic_free_gl,
+                              mosaic);
+  }
+  g_rec_mutex_unlock(&priv->context_lock);
+
+  if (priv->pool != NULL) {
+    gst_buffer_pool_set_active(priv->pool, FALSE);
+    gst_clear_object(&priv->pool);
+  }
+
+  return TRUE;
+}
+
+static void gst_projectm_mosaic_pad_free_gl(GstGLContext *context,
+                                            gpointer data) {
+  GstProjectMMosaicPad *pad = data;
+
+  g_clear_pointer(&pad->instance, gst_projectm_instance_free);
+}
+
+static void gst_projectm_mosaic_release_pad(GstElement *element, GstPad *pad) {
+  GstProjectMMosaic *mosaic = GST_PROJECTM_MOSAIC(element);
+  GstProjectMMosaicPrivate *priv = mosaic->priv;
+
+  /* A frame in flight skips the pad instead of recreating its instance. */
+  GST_PROJECTM_MOSAIC_PAD(pad)->released = TRUE;
+
+  g_rec_mutex_lock(&priv->context_lock);
+  if (priv->context != NULL) {
+    gst_gl_context_thread_add(priv->context, gst_projectm_mosaic_pad_free_gl,
+                              pad);
+  }
+  g_rec_mutex_unlock(&priv->context_lock);
+
+  GST_ELEMENT_CLASS(parent_class)->release_pad(element, pad);
+}
+
+static gboolean gst_projectm_mosaic_handle_context_query(GstProjectMMosaic *mosaic,
+                                                         GstQuery *query) {
+  GstProjectMMosaicPrivate *priv = mosaic->priv;
+  gboolean ret;
+
+  g_rec_mutex_lock(&priv->context_lock);
+  ret = gst_gl_handle_context_query(GST_ELEMENT(mosaic), query, priv->display,
+                                    priv->context, priv->other_context);
+  g_rec_mutex_unlock(&priv->context_lock);
+
+  return ret;
+}
+
+static gboolean gst_projectm_mosaic_src_query(GstAggregator *agg,
+                                              GstQuery *query) {
+  if (GST_QUERY_TYPE(query) == GST_QUERY_CONTEXT &&
+      gst_projectm_mosaic_handle_context_query(GST_PROJECTM_MOSAIC(agg),
+                                               query)) {
+    return TRUE;
+  }
+
+  return GST_AGGREGATOR_CLASS(parent_class)->src_query(agg, query);
+}
+
+static gboolean gst_projectm_mosaic_sink_query(GstAggregator *agg,
+                                               GstAggregatorPad *aggpad,
+                                               GstQuery *query) {
+  if (GST_QUERY_TYPE(query) == GST_QUERY_CONTEXT &&
+      gst_projectm_mosaic_handle_context_query(GST_PROJECTM_MOSAIC(agg),
+                                               query)) {
+    return TRUE;
+  }
+
+  return GST_AGGREGATOR_CLASS(parent_class)->sink_query(agg, aggpad, query);
+}
+
+static void gst_projectm_mosaic_set_context(GstElement *element,
+                                            GstContext *context) {
+  GstProjectMMosaicPrivate *priv = GST_PROJECTM_MOSAIC(element)->priv;
+
+  g_rec_mutex_lock(&priv->context_lock);
+  gst_gl_handle_set_context(element, context, &priv->display,
+                            &priv->other_context);
+  if (priv->display)
+    gst_gl_display_filter_gl_api(priv->display, gst_projectm_mosaic_gl_api);
+  g_rec_mutex_unlock(&priv->context_lock);
+
+  GST_ELEMENT_CLASS(parent_class)->set_context(element, context);
+}
+
+static GstStateChangeReturn
+gst_projectm_mosaic_change_state(GstElement *element,
+                                 GstStateChange transition) {
+  GstProjectMMosaicPrivate *priv = GST_PROJECTM_MOSAIC(element)->priv;
+  GstStateChangeReturn ret;
+
+  ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+  if (ret == GST_STATE_CHANGE_FAILURE)
+    return ret;
+
+  if (transition == GST_STATE_CHANGE_READY_TO_NULL) {
+    g_rec_mutex_lock(&priv->context_lock);
+    gst_clear_object(&priv->context);
+    gst_clear_object(&priv->other_context);
+    gst_clear_object(&priv->display);
+    g_rec_mutex_unlock(&priv->context_lock);
+  }
+
+  return ret;
+}
+
+static void gst_projectm_mosaic_set_property(GObject *object, guint prop_id,
+                                             const GValue *value,
+                                             GParamSpec *pspec) {
+  GstProjectMMosaic *mosaic = GST_PROJECTM_MOSAIC(object);
+
+  GST_OBJECT_LOCK(mosaic);
+  switch (prop_id) {
+  case PROP_PRESET_PATH:
+    g_free(mosaic->preset_path);
+    mosaic->preset_path = g_value_dup_string(value);
+    break;
+  case PROP_TEXTURE_DIR_PATH:
+    g_free(mosaic->texture_dir_path);
+    mosaic->texture_dir_path = g_value_dup_string(value);
+    break;
+  case PROP_BEAT_SENSITIVITY:
+    mosaic->beat_sensitivity = g_value_get_float(value);
+    break;
+  case PROP_PRESET_DURATION:
+    mosaic->preset_duration = g_value_get_double(value);
+    break;
+  case PROP_MESH_SIZE: {
+    gchar **parts = g_strsplit(g_value_get_string(value), ",", 2);
+
+    if (g_strv_length(parts) == 2) {
+      mosaic->mesh_width = atoi(parts[0]);
+      mosaic->mesh_height = atoi(parts[1]);
+    }
+    g_strfreev(parts);
+  } break;
+  case PROP_SHUFFLE_PRESETS:
+    mosaic->shuffle_presets = g_value_get_boolean(value);
+    break;
+  case PROP_VERTICAL_FLIP:
+    mosaic->vertical_flip = g_value_get_boolean(value);
+    break;
+  case PROP_COLUMNS:
+    mosaic->columns = g_value_get_uint(value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+  GST_OBJECT_UNLOCK(mosaic);
+}
+
+static void gst_projectm_mosaic_get_property(GObject *object, guint prop_id,
+                                             GValue *value, GParamSpec *pspec) {
+  GstProjectMMosaic *mosaic = GST_PROJECTM_MOSAIC(object);
+
+  GST_OBJECT_LOCK(mosaic);
+  switch (prop_id) {
+  case PROP_PRESET_PATH:
+    g_value_set_string(value, mosaic->preset_path);
+    break;
+  case PROP_TEXTURE_DIR_PATH:
+    g_value_set_string(value, mosaic->texture_dir_path);
+    break;
+  case PROP_BEAT_SENSITIVITY:
+    g_value_set_float(value, mosaic->beat_sensitivity);
+    break;
+  case PROP_PRESET_DURATION:
+    g_value_set_double(value, mosaic->preset_duration);
+    break;
+  case PROP_MESH_SIZE:
+    g_value_take_string(value, g_strdup_printf("%lu,%lu", mosaic->mesh_width,
+                                               mosaic->mesh_height));
+    break;
+  case PROP_SHUFFLE_PRESETS:
+    g_value_set_boolean(value, mosaic->shuffle_presets);
+    break;
+  case PROP_VERTICAL_FLIP:
+    g_value_set_boolean(value, mosaic->vertical_flip);
+    break;
+  case PROP_COLUMNS:
+    g_value_set_uint(value, mosaic->columns);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+  GST_OBJECT_UNLOCK(mosaic);
+}
+
+static void gst_projectm_mosaic_init(GstProjectMMosaic *mosaic) {
+  GstProjectMMosaicPrivate *priv =
+      gst_projectm_mosaic_get_instance_private(mosaic);
+
+  mosaic->priv = priv;
+
+  mosaic->preset_path = g_strdup(DEFAULT_PRESET_PATH);
+  mosaic->texture_dir_path = g_strdup(DEFAULT_TEXTURE_DIR_PATH);
+  mosaic->beat_sensitivity = DEFAULT_BEAT_SENSITIVITY;
+  mosaic->preset_duration = DEFAULT_PRESET_DURATION;
+  mosaic->shuffle_presets = DEFAULT_SHUFFLE_PRESETS;
+  mosaic->vertical_flip = DEFAULT_VERTICAL_FLIP;
+  mosaic->columns = DEFAULT_COLUMNS;
+
+  gchar **mesh = g_strsplit(DEFAULT_MESH_SIZE, ",", 2);
+  mosaic->mesh_width = atoi(mesh[0]);
+  mosaic->mesh_height = atoi(mesh[1]);
+  g_strfreev(mesh);
+
+  g_rec_mutex_init(&priv->context_lock);
+  gst_video_info_init(&priv->vinfo);
+  priv->base_pts = GST_CLOCK_TIME_NONE;
+}
+
+static void gst_projectm_mosaic_finalize(GObject *object) {
+  GstProjectMMosaic *mosaic = GST_PROJECTM_MOSAIC(object);
+
+  g_rec_mutex_clear(&mosaic->priv->context_lock);
+  g_free(mosaic->preset_path);
+  g_free(mosaic->texture_dir_path);
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void gst_projectm_mosaic_class_init(GstProjectMMosaicClass *klass) {
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GstAggregatorClass *agg_class = GST_AGGREGATOR_CLASS(klass);
+
+  gst_element_class_add_pad_template(
+      element_class,
+      gst_pad_template_new_with_gtype(
+          "sink_%u", GST_PAD_SINK, GST_PAD_REQUEST,
+          gst_caps_from_string(get_audio_sink_cap(0)),
+          GST_TYPE_PROJECTM_MOSAIC_PAD));
+  gst_element_class_add_static_pad_template_with_gtype(
+      element_class, &gst_projectm_mosaic_src_template,
+      GST_TYPE_AGGREGATOR_PAD);
+
+  gst_element_class_set_static_metadata(
+      element_class, "ProjectM Mosaic", "Generic",
+      "Tiles several ProjectM visualizations into one video frame",
+      "AnomieVision <anomievision@gmail.com> | Tristan Charpentier "
+      "<tristan_charpentier@hotmail.com>");
+
+  element_class->change_state =
+      GST_DEBUG_FUNCPTR(gst_projectm_mosaic_change_state);
+  element_class->release_pad =
+      GST_DEBUG_FUNCPTR(gst_projectm_mosaic_release_pad);
+  element_class->set_context =
+      GST_DEBUG_FUNCPTR(gst_projectm_mosaic_set_context);
+
+  agg_class->aggregate = GST_DEBUG_FUNCPTR(gst_projectm_mosaic_aggregate);
+  agg_class->sink_event = GST_DEBUG_FUNCPTR(gst_projectm_mosaic_sink_event);
+  agg_class->src_query = GST_DEBUG_FUNCPTR(gst_projectm_mosaic_src_query);
+  agg_class->sink_query = GST_DEBUG_FUNCPTR(gst_projectm_mosaic_sink_query);
+  agg_class->fixate_src_caps =
+      GST_DEBUG_FUNCPTR(gst_projectm_mosaic_fixate_src_caps);
+  agg_class->negotiated_src_caps =
+      GST_DEBUG_FUNCPTR(gst_projectm_mosaic_negotiated_src_caps);
+  agg_class->flush = GST_DEBUG_FUNCPTR(gst_projectm_mosaic_flush);
+  agg_class->start = GST_DEBUG_FUNCPTR(gst_projectm_mosaic_start);
+  agg_class->stop = GST_DEBUG_FUNCPTR(gst_projectm_mosaic_stop);
+  agg_class->get_next_time = gst_aggregator_simple_get_next_time;
+
+  gobject_class->set_property = gst_projectm_mosaic_set_property;
+  gobject_class->get_property = gst_projectm_mosaic_get_property;
+  gobject_class->finalize = gst_projectm_mosaic_finalize;
+
+  g_object_class_install_property(
+      gobject_class, PROP_PRESET_PATH,
+      g_param_spec_string("preset", "Preset",
+                          "Preset file or directory of tiles whose pad sets "
+                          "none. Applies to tiles created afterwards.",
+                          DEFAULT_PRESET_PATH,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_TEXTURE_DIR_PATH,
+      g_param_spec_string("texture-dir", "Texture Directory",
+                          "Sets the path to the directory containing textures "
+                          "used in the visualizer.",
+                          DEFAULT_TEXTURE_DIR_PATH,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_BEAT_SENSITIVITY,
+      g_param_spec_float(
+          "beat-sensitivity", "Beat Sensitivity",
+          "Controls the sensitivity to audio beats. Higher values make the "
+          "visualizer respond more strongly to beats.",
+          0.0, 5.0, DEFAULT_BEAT_SENSITIVITY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_PRESET_DURATION,
+      g_param_spec_double("preset-duration", "Preset Duration",
+                          "Sets the duration, in seconds, for each preset. A "
+                          "zero value causes the preset to play indefinitely.",
+                          0.0, 999999.0, DEFAULT_PRESET_DURATION,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_MESH_SIZE,
+      g_param_spec_string("mesh-size", "Mesh Size",
+                          "Sets the size of the mesh used in rendering. The "
+                          "format is 'width,height'.",
+                          DEFAULT_MESH_SIZE,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_SHUFFLE_PRESETS,
+      g_param_spec_boolean("shuffle-presets", "Shuffle Presets",
+                           "Play the presets of a directory in random order.",
+                           DEFAULT_SHUFFLE_PRESETS,
+                           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_VERTICAL_FLIP,
+      g_param_spec_boolean(
+          "vertical-flip", "Vertical Flip",
+          "Output frames top-down instead of in OpenGL's bottom-up row order.",
+          DEFAULT_VERTICAL_FLIP, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_COLUMNS,
+      g_param_spec_uint("columns", "Columns",
+                        "Tiles per row, 0 for the smallest square grid that "
+                        "holds every pad.",
+                        0, 64, DEFAULT_COLUMNS,
+                        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gst_type_mark_as_plugin_api(GST_TYPE_PROJECTM_MOSAIC_PAD, 0);
+}
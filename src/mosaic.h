@@ -0,0 +1,47 @@
+#ifndef __GST_PROJECTM_MOSAIC_H__
+#define __GST_PROJECTM_MOSAIC_H__
+
+#include <gst/base/gstaggregator.h>
+#include <gst/gst.h>
+
+typedef struct _GstProjectMMosaicPrivate GstProjectMMosaicPrivate;
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_PROJECTM_MOSAIC_PAD (gst_projectm_mosaic_pad_get_type())
+G_DECLARE_FINAL_TYPE(GstProjectMMosaicPad, gst_projectm_mosaic_pad, GST,
+                     PROJECTM_MOSAIC_PAD, GstAggregatorPad)
+
+#define GST_TYPE_PROJECTM_MOSAIC (gst_projectm_mosaic_get_type())
+G_DECLARE_FINAL_TYPE(GstProjectMMosaic, gst_projectm_mosaic, GST,
+                     PROJECTM_MOSAIC, GstAggregator)
+
+/**
+ * @brief Renders one projectM instance per "sink_%u" request pad and tiles
+ * them into a single output frame.
+ *
+ * Each instance renders into its own framebuffer and is blitted into its
+ * tile of the output framebuffer on the GPU, so the composited frame is read
+ * back once. Tiles fill a grid in pad order, left to right and top to
+ * bottom. A pad's "preset" property overrides the element's for its tile;
+ * the same audio can feed several tiles through a tee.
+ */
+struct _GstProjectMMosaic {
+  GstAggregator aggregator;
+
+  gchar *preset_path;
+  gchar *texture_dir_path;
+  gfloat beat_sensitivity;
+  gdouble preset_duration;
+  gulong mesh_width;
+  gulong mesh_height;
+  gboolean shuffle_presets;
+  gboolean vertical_flip;
+  guint columns;
+
+  GstProjectMMosaicPrivate *priv;
+};
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_MOSAIC_H__ */
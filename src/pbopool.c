@@ -0,0 +1,287 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gl/gstglfuncs.h>
+#include <gst/video/video.h>
+
+#include "pbopool.h"
+
+#ifndef GL_MAP_READ_BIT
+#define GL_MAP_READ_BIT 0x0001
+#endif
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_CLIENT_STORAGE_BIT
+#define GL_CLIENT_STORAGE_BIT 0x0200
+#endif
+
+#define GST_PROJECTM_PBO_MEMORY_TYPE "ProjectMPboMemory"
+
+GST_DEBUG_CATEGORY_STATIC(gst_projectm_pbo_pool_debug);
+#define GST_CAT_DEFAULT gst_projectm_pbo_pool_debug
+
+typedef struct {
+  GstAllocator parent;
+} GstProjectMPboAllocator;
+
+typedef struct {
+  GstAllocatorClass parent_class;
+} GstProjectMPboAllocatorClass;
+
+typedef struct {
+  GstBufferPool parent;
+
+  GstGLContext *context;
+  GstAllocator *allocator;
+  GstProjectMBufferStorageFunc buffer_storage;
+  GstVideoInfo info;
+  gboolean add_videometa;
+} GstProjectMPboPool;
+
+typedef struct {
+  GstBufferPoolClass parent_class;
+} GstProjectMPboPoolClass;
+
+typedef struct {
+  GstProjectMPboMemory *mem;
+  GstProjectMBufferStorageFunc buffer_storage;
+  gsize size;
+} GstProjectMPboCreateParams;
+
+G_DEFINE_TYPE(GstProjectMPboAllocator, gst_projectm_pbo_allocator,
+              GST_TYPE_ALLOCATOR);
+G_DEFINE_TYPE_WITH_CODE(
+    GstProjectMPboPool, gst_projectm_pbo_pool, GST_TYPE_BUFFER_POOL,
+    GST_DEBUG_CATEGORY_INIT(gst_projectm_pbo_pool_debug, "projectm-pbopool", 0,
+                            "projectM PBO-backed buffer pool"));
+
+static void gst_projectm_pbo_memory_create_gl(GstGLContext *context,
+                                              gpointer data) {
+  GstProjectMPboCreateParams *params = (GstProjectMPboCreateParams *)data;
+  GstProjectMPboMemory *mem = params->mem;
+  const GstGLFuncs *glFunctions = context->gl_vtable;
+  /* Write access too, since GstAudioVisualizer maps output frames
+   * read-write and may post-process them on the CPU. */
+  const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT |
+                           GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+  glFunctions->GenBuffers(1, &mem->pbo_id);
+  glFunctions->BindBuffer(GL_PIXEL_PACK_BUFFER, mem->pbo_id);
+  params->buffer_storage(GL_PIXEL_PACK_BUFFER, params->size, NULL,
+                         flags | GL_CLIENT_STORAGE_BIT);
+  mem->data = (guint8 *)glFunctions->MapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                                    params->size, flags);
+  glFunctions->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  if (mem->data == NULL) {
+    glFunctions->DeleteBuffers(1, &mem->pbo_id);
+    mem->pbo_id = 0;
+  }
+}
+
+static void gst_projectm_pbo_memory_destroy_gl(GstGLContext *context,
+                                               gpointer data) {
+  GstProjectMPboMemory *mem = (GstProjectMPboMemory *)data;
+  const GstGLFuncs *glFunctions = context->gl_vtable;
+
+  glFunctions->BindBuffer(GL_PIXEL_PACK_BUFFER, mem->pbo_id);
+  glFunctions->UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  glFunctions->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glFunctions->DeleteBuffers(1, &mem->pbo_id);
+}
+
+static gpointer gst_projectm_pbo_memory_map(GstMemory *mem, gsize maxsize,
+                                            GstMapFlags flags) {
+  /* Coherent persistent mapping: the pointer is valid for the lifetime of
+   * the memory and GPU writes are visible once their fence has signalled. */
+  return ((GstProjectMPboMemory *)mem)->data;
+}
+
+static void gst_projectm_pbo_memory_unmap(GstMemory *mem) {}
+
+static GstMemory *gst_projectm_pbo_memory_share(GstMemory *mem, gssize offset,
+                                                gssize size) {
+  GstProjectMPboMemory *pmem = (GstProjectMPboMemory *)mem;
+  GstMemory *parent = mem->parent != NULL ? mem->parent : mem;
+
+  if (size == -1) {
+    size = mem->size - offset;
+  }
+
+  GstProjectMPboMemory *sub = g_new0(GstProjectMPboMemory, 1);
+  gst_memory_init(GST_MEMORY_CAST(sub),
+                  GST_MINI_OBJECT_FLAGS(parent) |
+                      GST_MINI_OBJECT_FLAG_LOCK_READONLY,
+                  mem->allocator, parent, mem->maxsize, mem->align,
+                  mem->offset + offset, size);
+  sub->context = gst_object_ref(pmem->context);
+  sub->pbo_id = pmem->pbo_id;
+  sub->data = pmem->data;
+
+  return GST_MEMORY_CAST(sub);
+}
+
+static GstMemory *gst_projectm_pbo_allocator_alloc(GstAllocator *allocator,
+                                                   gsize size,
+                                                   GstAllocationParams *params) {
+  /* Buffer objects need a GL context, so memory only comes from the pool. */
+  return NULL;
+}
+
+static void gst_projectm_pbo_allocator_free(GstAllocator *allocator,
+                                            GstMemory *mem) {
+  GstProjectMPboMemory *pmem = (GstProjectMPboMemory *)mem;
+
+  if (mem->parent == NULL && pmem->pbo_id != 0) {
+    gst_gl_context_thread_add(pmem->context,
+                              gst_projectm_pbo_memory_destroy_gl, pmem);
+  }
+
+  gst_clear_object(&pmem->context);
+  g_free(pmem);
+}
+
+static void
+gst_projectm_pbo_allocator_class_init(GstProjectMPboAllocatorClass *klass) {
+  GstAllocatorClass *allocator_class = GST_ALLOCATOR_CLASS(klass);
+
+  allocator_class->alloc = gst_projectm_pbo_allocator_alloc;
+  allocator_class->free = gst_projectm_pbo_allocator_free;
+}
+
+static void gst_projectm_pbo_allocator_init(GstProjectMPboAllocator *self) {
+  GstAllocator *allocator = GST_ALLOCATOR_CAST(self);
+
+  allocator->mem_type = GST_PROJECTM_PBO_MEMORY_TYPE;
+  allocator->mem_map = gst_projectm_pbo_memory_map;
+  allocator->mem_unmap = gst_projectm_pbo_memory_unmap;
+  allocator->mem_share = gst_projectm_pbo_memory_share;
+
+  GST_OBJECT_FLAG_SET(allocator, GST_ALLOCATOR_FLAG_CUSTOM_ALLOC);
+}
+
+gboolean gst_projectm_is_pbo_memory(GstMemory *mem) {
+  return mem != NULL && mem->allocator != NULL &&
+         G_TYPE_CHECK_INSTANCE_TYPE(mem->allocator,
+                                    gst_projectm_pbo_allocator_get_type());
+}
+
+GLuint gst_projectm_pbo_memory_get_id(GstMemory *mem) {
+  g_return_val_if_fail(gst_projectm_is_pbo_memory(mem), 0);
+
+  return ((GstProjectMPboMemory *)mem)->pbo_id;
+}
+
+static const gchar **gst_projectm_pbo_pool_get_options(GstBufferPool *pool) {
+  static const gchar *options[] = {GST_BUFFER_POOL_OPTION_VIDEO_META, NULL};
+
+  return options;
+}
+
+static gboolean gst_projectm_pbo_pool_set_config(GstBufferPool *pool,
+                                                 GstStructure *config) {
+  GstProjectMPboPool *self = (GstProjectMPboPool *)pool;
+  GstCaps *caps = NULL;
+
+  if (!gst_buffer_pool_config_get_params(config, &caps, NULL, NULL, NULL) ||
+      caps == NULL) {
+    GST_WARNING_OBJECT(pool, "No caps in pool configuration");
+    return FALSE;
+  }
+
+  if (!gst_video_info_from_caps(&self->info, caps)) {
+    GST_WARNING_OBJECT(pool, "Failed to parse caps %" GST_PTR_FORMAT, caps);
+    return FALSE;
+  }
+
+  self->add_videometa = gst_buffer_pool_config_has_option(
+      config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+
+  return GST_BUFFER_POOL_CLASS(gst_projectm_pbo_pool_parent_class)
+      ->set_config(pool, config);
+}
+
+static GstFlowReturn
+gst_projectm_pbo_pool_alloc_buffer(GstBufferPool *pool, GstBuffer **buffer,
+                                   GstBufferPoolAcquireParams *params) {
+  GstProjectMPboPool *self = (GstProjectMPboPool *)pool;
+  gsize size = GST_VIDEO_INFO_SIZE(&self->info);
+  GstProjectMPboMemory *mem = g_new0(GstProjectMPboMemory, 1);
+  GstProjectMPboCreateParams create_params = {mem, self->buffer_storage, size};
+
+  gst_gl_context_thread_add(self->context, gst_projectm_pbo_memory_create_gl,
+                            &create_params);
+
+  if (mem->data == NULL) {
+    GST_WARNING_OBJECT(pool, "Failed to create mapped buffer of %zu bytes",
+                       size);
+    g_free(mem);
+    return GST_FLOW_ERROR;
+  }
+
+  gst_memory_init(GST_MEMORY_CAST(mem), 0, self->allocator, NULL, size, 0, 0,
+                  size);
+  mem->context = gst_object_ref(self->context);
+
+  GST_DEBUG_OBJECT(pool, "Allocated buffer object %u (%zu bytes)",
+                   mem->pbo_id, size);
+
+  *buffer = gst_buffer_new();
+  gst_buffer_append_memory(*buffer, GST_MEMORY_CAST(mem));
+
+  if (self->add_videometa) {
+    gst_buffer_add_video_meta_full(
+        *buffer, GST_VIDEO_FRAME_FLAG_NONE, GST_VIDEO_INFO_FORMAT(&self->info),
+        GST_VIDEO_INFO_WIDTH(&self->info), GST_VIDEO_INFO_HEIGHT(&self->info),
+        GST_VIDEO_INFO_N_PLANES(&self->info), self->info.offset,
+        self->info.stride);
+  }
+
+  return GST_FLOW_OK;
+}
+
+static void gst_projectm_pbo_pool_finalize(GObject *object) {
+  GstProjectMPboPool *self = (GstProjectMPboPool *)object;
+
+  gst_clear_object(&self->allocator);
+  gst_clear_object(&self->context);
+
+  G_OBJECT_CLASS(gst_projectm_pbo_pool_parent_class)->finalize(object);
+}
+
+static void gst_projectm_pbo_pool_class_init(GstProjectMPboPoolClass *klass) {
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+  GstBufferPoolClass *pool_class = GST_BUFFER_POOL_CLASS(klass);
+
+  gobject_class->finalize = gst_projectm_pbo_pool_finalize;
+
+  pool_class->get_options = gst_projectm_pbo_pool_get_options;
+  pool_class->set_config = gst_projectm_pbo_pool_set_config;
+  pool_class->alloc_buffer = gst_projectm_pbo_pool_alloc_buffer;
+}
+
+static void gst_projectm_pbo_pool_init(GstProjectMPboPool *self) {
+  gst_video_info_init(&self->info);
+}
+
+GstBufferPool *gst_projectm_pbo_pool_new(GstGLContext *context,
+                                         GstProjectMBufferStorageFunc
+                                             buffer_storage) {
+  GstProjectMPboPool *self = g_object_new(gst_projectm_pbo_pool_get_type(), NULL);
+
+  gst_object_ref_sink(self);
+  self->context = gst_object_ref(context);
+  self->buffer_storage = buffer_storage;
+  self->allocator = g_object_new(gst_projectm_pbo_allocator_get_type(), NULL);
+  gst_object_ref_sink(self->allocator);
+
+  return GST_BUFFER_POOL_CAST(self);
+}
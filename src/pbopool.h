@@ -0,0 +1,62 @@
+#ifndef __GST_PROJECTM_PBO_POOL_H__
+#define __GST_PROJECTM_PBO_POOL_H__
+
+#include <gst/gl/gl.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief glBufferStorage(), which GstGLFuncs does not expose on the
+ * GStreamer versions we support.
+ */
+typedef void(GSTGLAPI *GstProjectMBufferStorageFunc)(GLenum target,
+                                                    GLsizeiptr size,
+                                                    const void *data,
+                                                    GLbitfield flags);
+
+/**
+ * @brief Memory backed by a persistently mapped pixel pack buffer, so the
+ * GPU can read pixels straight into a buffer that is pushed downstream.
+ *
+ * Mapping never blocks: the producer must wait for its readback to finish
+ * before handing the buffer on.
+ */
+typedef struct {
+  GstMemory mem;
+
+  GstGLContext *context;
+  GLuint pbo_id;
+  guint8 *data;
+} GstProjectMPboMemory;
+
+/**
+ * @brief Check whether memory was allocated by a PBO pool.
+ */
+gboolean gst_projectm_is_pbo_memory(GstMemory *mem);
+
+/**
+ * @brief Name of the buffer object behind PBO memory, to be bound as
+ * GL_PIXEL_PACK_BUFFER on the memory's context.
+ */
+GLuint gst_projectm_pbo_memory_get_id(GstMemory *mem);
+
+/**
+ * @brief Create a buffer pool whose buffers wrap persistently mapped pixel
+ * pack buffers on the given context.
+ *
+ * Buffers are created on demand, so with a max_buffers of 0 the pool grows
+ * as far as downstream holds on to frames. Memory is released on the GL
+ * thread once the last buffer referencing it is gone.
+ *
+ * @param context GL context to create the buffer objects on.
+ * @param buffer_storage glBufferStorage() of that context.
+ * @return A new pool.
+ */
+GstBufferPool *gst_projectm_pbo_pool_new(GstGLContext *context,
+                                         GstProjectMBufferStorageFunc
+                                             buffer_storage);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_PBO_POOL_H__ */
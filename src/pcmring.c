@@ -0,0 +1,102 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "pcmring.h"
+
+/* Two channels per sample. */
+#define GST_PROJECTM_PCM_RING_CHANNELS 2
+
+struct _GstProjectMPcmRing {
+  gint16 *data;
+  /* Power of two, so positions wrap with a mask. */
+  guint capacity;
+  guint64 written;
+};
+
+GstProjectMPcmRing *gst_projectm_pcm_ring_new(guint capacity) {
+  GstProjectMPcmRing *ring = g_new0(GstProjectMPcmRing, 1);
+
+  ring->capacity = 1u << g_bit_storage(MAX(capacity, 2) - 1);
+  ring->data = g_new0(gint16, (gsize)ring->capacity *
+                                  GST_PROJECTM_PCM_RING_CHANNELS);
+
+  return ring;
+}
+
+void gst_projectm_pcm_ring_free(GstProjectMPcmRing *ring) {
+  if (ring == NULL) {
+    return;
+  }
+
+  g_free(ring->data);
+  g_free(ring);
+}
+
+guint gst_projectm_pcm_ring_get_capacity(const GstProjectMPcmRing *ring) {
+  return ring->capacity;
+}
+
+void gst_projectm_pcm_ring_clear(GstProjectMPcmRing *ring) {
+  ring->written = 0;
+}
+
+/* Copies samples between the ring and a linear buffer starting at ring
+ * position pos, in two parts where the span wraps. */
+static void gst_projectm_pcm_ring_copy(const GstProjectMPcmRing *ring,
+                                       guint64 pos, gint16 *linear,
+                                       guint samples, gboolean to_ring) {
+  guint index = (guint)(pos & (ring->capacity - 1));
+  guint first = MIN(samples, ring->capacity - index);
+  gsize sample_size = sizeof(gint16) * GST_PROJECTM_PCM_RING_CHANNELS;
+  gint16 *slot = ring->data + (gsize)index * GST_PROJECTM_PCM_RING_CHANNELS;
+  gint16 *rest = linear + (gsize)first * GST_PROJECTM_PCM_RING_CHANNELS;
+
+  if (to_ring) {
+    memcpy(slot, linear, first * sample_size);
+    memcpy(ring->data, rest, (samples - first) * sample_size);
+  } else {
+    memcpy(linear, slot, first * sample_size);
+    memcpy(rest, ring->data, (samples - first) * sample_size);
+  }
+}
+
+void gst_projectm_pcm_ring_write(GstProjectMPcmRing *ring, const gint16 *data,
+                                 guint samples) {
+  /* Only the newest capacity samples survive the write. */
+  if (samples > ring->capacity) {
+    guint skip = samples - ring->capacity;
+
+    data += (gsize)skip * GST_PROJECTM_PCM_RING_CHANNELS;
+    ring->written += skip;
+    samples = ring->capacity;
+  }
+
+  gst_projectm_pcm_ring_copy(ring, ring->written, (gint16 *)data, samples,
+                             TRUE);
+  ring->written += samples;
+}
+
+guint gst_projectm_pcm_ring_read(const GstProjectMPcmRing *ring, guint back,
+                                 gint16 *dest, guint samples) {
+  guint64 available = MIN(ring->written, (guint64)ring->capacity);
+  guint copied = 0;
+
+  if (back < available) {
+    copied = (guint)MIN((guint64)samples, available - back);
+  }
+
+  memset(dest, 0,
+         (gsize)(samples - copied) * GST_PROJECTM_PCM_RING_CHANNELS *
+             sizeof(gint16));
+  if (copied > 0) {
+    gst_projectm_pcm_ring_copy(
+        ring, ring->written - back - copied,
+        dest + (gsize)(samples - copied) * GST_PROJECTM_PCM_RING_CHANNELS,
+        copied, FALSE);
+  }
+
+  return copied;
+}
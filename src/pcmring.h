@@ -0,0 +1,64 @@
+#ifndef __GST_PROJECTM_PCM_RING_H__
+#define __GST_PROJECTM_PCM_RING_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief History of interleaved stereo S16 audio.
+ *
+ * Keeps the most recent samples so that analysis windows can be cut from
+ * the stream independently of the size of the chunks written to it. The
+ * ring takes no locks; writes and reads must not run concurrently.
+ */
+typedef struct _GstProjectMPcmRing GstProjectMPcmRing;
+
+/**
+ * @brief Create a ring holding at least capacity stereo samples.
+ */
+GstProjectMPcmRing *gst_projectm_pcm_ring_new(guint capacity);
+
+/**
+ * @brief Free a ring.
+ */
+void gst_projectm_pcm_ring_free(GstProjectMPcmRing *ring);
+
+/**
+ * @brief Number of stereo samples the ring keeps.
+ */
+guint gst_projectm_pcm_ring_get_capacity(const GstProjectMPcmRing *ring);
+
+/**
+ * @brief Forget all samples written so far.
+ */
+void gst_projectm_pcm_ring_clear(GstProjectMPcmRing *ring);
+
+/**
+ * @brief Append samples, overwriting the oldest once the ring is full.
+ *
+ * @param ring The ring.
+ * @param data Interleaved stereo S16 samples.
+ * @param samples Number of stereo samples in data.
+ */
+void gst_projectm_pcm_ring_write(GstProjectMPcmRing *ring, const gint16 *data,
+                                 guint samples);
+
+/**
+ * @brief Copy the samples samples that end back samples before the newest.
+ *
+ * Samples that were never written or have been overwritten are returned as
+ * silence at the start of dest.
+ *
+ * @param ring The ring.
+ * @param back Samples between the end of the window and the newest sample.
+ * @param dest Receives samples interleaved stereo S16 samples.
+ * @param samples Length of the window.
+ * @return The number of samples copied from the ring, at the end of dest.
+ */
+guint gst_projectm_pcm_ring_read(const GstProjectMPcmRing *ring, guint back,
+                                 gint16 *dest, guint samples);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_PCM_RING_H__ */
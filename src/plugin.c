@@ -49,44 +49,119 @@
 #ifndef GL_DEPTH24_STENCIL8
 #define GL_DEPTH24_STENCIL8 0x88F0
 #endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_CLIENT_STORAGE_BIT
+#define GL_CLIENT_STORAGE_BIT 0x0200
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#endif
+#ifndef GL_SYNC_FLUSH_COMMANDS_BIT
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#endif
+#ifndef GL_ALREADY_SIGNALED
+#define GL_ALREADY_SIGNALED 0x911A
+#endif
+#ifndef GL_CONDITION_SATISFIED
+#define GL_CONDITION_SATISFIED 0x911C
+#endif
+#ifndef GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX
+#define GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX 0x9048
+#endif
+#ifndef GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX
+#define GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX 0x9049
+#endif
+#ifndef GL_TEXTURE_FREE_MEMORY_ATI
+#define GL_TEXTURE_FREE_MEMORY_ATI 0x87FC
+#endif
+#ifndef GL_PACK_ROW_LENGTH
+#define GL_PACK_ROW_LENGTH 0x0D02
+#endif
+#ifndef GL_IMPLEMENTATION_COLOR_READ_TYPE
+#define GL_IMPLEMENTATION_COLOR_READ_TYPE 0x8B9A
+#endif
+#ifndef GL_IMPLEMENTATION_COLOR_READ_FORMAT
+#define GL_IMPLEMENTATION_COLOR_READ_FORMAT 0x8B9B
+#endif
+#ifndef GL_BGRA_EXT
+#define GL_BGRA_EXT 0x80E1
+#endif
 
-#define GST_PROJECTM_TIMELINE_EPSILON (1e-6)
 #define GST_PROJECTM_PBO_COUNT 3
-
+#define GST_PROJECTM_PBO_FENCE_TIMEOUT_NS (G_GUINT64_CONSTANT(1000000000))
+#define GST_PROJECTM_GPU_MEMORY_QUERY_INTERVAL 60
+/* Timeline presets read ahead of the current one, and the workers reading
+ * them, when texture-prefetch-budget is set. */
+#define GST_PROJECTM_TEXTURE_LOOKAHEAD 2
+#define GST_PROJECTM_TEXTURE_THREADS 2
+/* Upper bound of analysis-window and analysis-hop, over a second of audio
+ * at 48 kHz. */
+#define GST_PROJECTM_MAX_ANALYSIS_SAMPLES 65536
+
+/* Marks output frames that keyframe-only mode drops before they leave the
+ * element. */
+#define GST_PROJECTM_BUFFER_FLAG_SKIP (GST_BUFFER_FLAG_LAST << 0)
+
+#include "batch.h"
 #include "caps.h"
 #include "config.h"
 #include "debug.h"
+#include "dmabuf.h"
 #include "enums.h"
+#include "frame.h"
+#include "framegrid.h"
 #include "gstglbaseaudiovisualizer.h"
+#include "mosaic.h"
+#include "pbopool.h"
+#include "pcmring.h"
 #include "plugin.h"
 #include "projectm.h"
+#include "stats.h"
+#include "texturecache.h"
+#include "texturetranscode.h"
+#include "timeline.h"
 
 GST_DEBUG_CATEGORY_STATIC(gst_projectm_debug);
 #define GST_CAT_DEFAULT gst_projectm_debug
 
-typedef struct {
-  gdouble start_time;
-  gdouble duration;
-  gdouble end_time;
-  gchar *preset;
-  gchar *complexity;
-} GstProjectMTimelineEntry;
+typedef enum {
+  GST_PROJECTM_GPU_MEMORY_QUERY_NONE,
+  GST_PROJECTM_GPU_MEMORY_QUERY_NVX,
+  GST_PROJECTM_GPU_MEMORY_QUERY_ATI
+} GstProjectMGpuMemoryQuery;
 
-static void gst_projectm_timeline_entry_free(gpointer data);
 static void gst_projectm_timeline_reset(GstProjectM *plugin);
 static gboolean gst_projectm_load_timeline(GstProjectM *plugin,
                                            const gchar *path);
 static void gst_projectm_activate_timeline(GstProjectM *plugin);
 static void gst_projectm_timeline_update(GstProjectM *plugin,
                                          gdouble elapsed_seconds);
-static gchar *gst_projectm_resolve_preset_path(GstProjectM *plugin,
-                                               const gchar *preset_value);
-static gint gst_projectm_timeline_find_target_index(GstProjectM *plugin,
-                                                    gdouble elapsed_seconds);
-
+static void gst_projectm_prefetch_timeline_textures(GstProjectM *plugin,
+                                                    gint index);
+
+static GstPadProbeReturn gst_projectm_sink_event_probe(GstPad *pad,
+                                                       GstPadProbeInfo *info,
+                                                       gpointer user_data);
+static GstFlowReturn gst_projectm_sink_chain(GstPad *pad, GstObject *parent,
+                                             GstBuffer *buffer);
+static GstPad *gst_projectm_request_new_pad(GstElement *element,
+                                            GstPadTemplate *templ,
+                                            const gchar *name,
+                                            const GstCaps *caps);
+static void gst_projectm_release_pad(GstElement *element, GstPad *pad);
+static gboolean gst_projectm_load_archive_preset(GstProjectM *plugin,
+                                                 projectm_handle handle,
+                                                 const gchar *name,
+                                                 gboolean smooth_transition);
 static gboolean gst_projectm_ensure_pbos(GstProjectM *plugin,
                                          const GstGLFuncs *glFunctions,
-                                         gsize width, gsize height);
+                                         gsize width, gsize height,
+                                         gboolean persistent);
 static void gst_projectm_release_pbos(GstProjectM *plugin,
                                       const GstGLFuncs *glFunctions);
 static gboolean gst_projectm_ensure_render_target(GstProjectM *plugin,
@@ -97,12 +172,50 @@ static void gst_projectm_release_render_target(GstProjectM *plugin,
 static gboolean gst_projectm_download_frame_with_pbo(
     GstProjectM *plugin, const GstGLFuncs *glFunctions, GstVideoFrame *video,
     gsize width, gsize height);
-static void gst_projectm_copy_to_frame(GstVideoFrame *video, const guint8 *src,
+static void gst_projectm_copy_to_frame(GstProjectM *plugin,
+                                       GstVideoFrame *video, const guint8 *src,
                                        gsize width, gsize height);
+static gboolean gst_projectm_get_read_format(GstProjectM *plugin,
+                                             GLenum *format, GLenum *type);
 
 struct _GstProjectMPrivate {
   GLenum gl_format;
+  /* Byte order of the output format relative to GL_RGBA/GL_UNSIGNED_BYTE. */
+  guint8 swizzle[4];
+  /* Format the copy paths read with GL_UNSIGNED_BYTE: GL_RGBA, or GL_BGRA_EXT
+   * where a GLES implementation prefers it. read_swizzle maps its bytes to
+   * the output format while copying into the frame. */
+  GLenum read_format;
+  guint8 read_swizzle[4];
+  /* GLES context; GLES 2 has no pixel pack buffers, packed pixel types or
+   * GL_ABGR_EXT. */
+  gboolean gles;
+  gboolean gles3;
+  /* Synchronous readback target for outputs GLES cannot read directly. */
+  guint8 *staging;
+  gsize staging_size;
   projectm_handle handle;
+  projectm_playlist_handle playlist;
+
+  /* Set from any thread to have the GL thread reset projectM before the
+   * next render; state_dirty records whether there is anything to reset. */
+  gint reset_pending;
+  gboolean state_dirty;
+
+  /* Set by the timeline-path setter; the GL thread loads the timeline. */
+  gint timeline_pending;
+
+  /* Set by setup when caps change on a running instance, so the GL thread
+   * applies the new size and rate before the next render. */
+  gint reconfigure_pending;
+
+  /* Stream audio analysis windows are cut from with analysis-window set.
+   * pcm_end is the stream position, in samples from the first frame, of
+   * the newest sample written; pcm_window is the block handed to projectM.
+   * GL thread only. */
+  GstProjectMPcmRing *pcm_ring;
+  guint64 pcm_end;
+  gint16 *pcm_window;
 
   GstClockTime first_frame_time;
   gboolean first_frame_received;
@@ -122,6 +235,17 @@ struct _GstProjectMPrivate {
   guint pbo_index;
   gboolean pbo_initialized;
   gboolean pbo_frame_valid;
+  /* render_frame_count of the frame read into each slot, and of the frame
+   * the last ring readback copied out. */
+  guint64 pbo_slot_frame[GST_PROJECTM_PBO_COUNT];
+  guint64 pbo_copied_frame;
+
+  /* Persistent ring: immutable storage mapped once at creation, with a
+   * fence per slot marking when its readback has landed. */
+  GstProjectMBufferStorageFunc buffer_storage;
+  gboolean pbo_persistent;
+  guint8 *pbo_mapped[GST_PROJECTM_PBO_COUNT];
+  GLsync pbo_fences[GST_PROJECTM_PBO_COUNT];
 
   GLuint fbo_id;
   GLuint fbo_texture_id;
@@ -133,8 +257,117 @@ struct _GstProjectMPrivate {
 
   gboolean headless_mode;
   gboolean headless_checked;
+
+  /* Rendering on a software rasterizer, or render-profile=cpu; decided in
+   * gl_start. mesh_size_set keeps an explicit mesh-size over the CPU
+   * profile's. */
+  gboolean cpu_profile;
+  gboolean mesh_size_set;
+
+  GstProjectMStats stats;
+  gint64 copy_us;
+  GstProjectMFrameCopyPool *copy_pool;
+  guint copy_pool_threads;
+  GstProjectMGpuMemoryQuery gpu_memory_query;
+
+  /* Decimation: renders are spread over output frames by accumulating
+   * render-rate against the output rate; skipped frames repeat the FBO. */
+  guint64 render_rate_acc;
+  GLuint last_rendered_fbo;
+
+  /* Keyframe-only mode: sorted keyframe-timestamps, guarded by the object
+   * lock since the GL thread reads them. */
+  GArray *keyframe_times;
+
+  /* DMABuf output: NV12 planes converted from the FBO texture on the GPU
+   * and exported to downstream without a readback. */
+  gboolean dmabuf_supported;
+  gboolean dmabuf_output;
+  /* The base class's shader, put aside while the output is DMABuf. */
+  gboolean shader_overridden;
+  GstAudioVisualizerShader saved_shader;
+  GstProjectMNv12Converter *nv12_converter;
+
+  /* Packs given as archive files. The projectM playlist only handles files,
+   * so archive presets are switched by our own preset-switch callback,
+   * with archive_position as the playlist cursor. Textures are read from
+   * an extracted copy since projectM only loads them from disk. */
+  GstProjectMArchive *preset_archive;
+  GstProjectMArchive *texture_archive;
+  const gchar *texture_archive_dir;
+  gboolean archive_playlist;
+  gint archive_position;
+
+  /* Reads the textures of upcoming presets ahead of projectM, when
+   * texture-prefetch-budget is set. Swapped under the object lock for the stats
+   * getter. */
+  GstProjectMTextureCache *texture_cache;
+
+  /* View of the texture directory with S3TC .dds files substituted for
+   * already transcoded images, when compress-textures is set. */
+  GstProjectMTextureTranscoder *texture_transcoder;
+
+  /* Frames dropped for QoS whose audio was still fed to projectM. */
+  gint analyzed_frames;
+
+  /* Optional audio_src request pad. Each input buffer is pushed on it
+   * after the parent's chain has rendered the frames it completes, so a
+   * muxer gets audio and video interleaved from this element. The pad is
+   * set and cleared under the object lock. */
+  GstPad *audio_srcpad;
+  GstPadChainFunction parent_chain;
 };
 
+GType gst_projectm_readback_mode_get_type(void) {
+  static gsize readback_mode_type = 0;
+  static const GEnumValue readback_modes[] = {
+      {GST_PROJECTM_READBACK_AUTO,
+       "Pick the fastest readback path supported by the context", "auto"},
+      {GST_PROJECTM_READBACK_SYNC, "Synchronous glReadPixels into the frame",
+       "sync"},
+      {GST_PROJECTM_READBACK_PBO,
+       "Asynchronous readback through a ring of pixel buffer objects", "pbo"},
+      {GST_PROJECTM_READBACK_PERSISTENT,
+       "Asynchronous readback through a persistently mapped buffer ring "
+       "(GL 4.4 or ARB/EXT_buffer_storage)",
+       "persistent"},
+      {GST_PROJECTM_READBACK_ZERO_COPY,
+       "Read pixels straight into persistently mapped output buffers, "
+       "skipping the frame copy but waiting for each readback",
+       "zero-copy"},
+      {0, NULL, NULL}};
+
+  if (g_once_init_enter(&readback_mode_type)) {
+    GType type =
+        g_enum_register_static("GstProjectMReadbackMode", readback_modes);
+    g_once_init_leave(&readback_mode_type, type);
+  }
+
+  return (GType)readback_mode_type;
+}
+
+GType gst_projectm_render_profile_get_type(void) {
+  static gsize render_profile_type = 0;
+  static const GEnumValue render_profiles[] = {
+      {GST_PROJECTM_RENDER_PROFILE_AUTO,
+       "CPU profile when the GL renderer is a software rasterizer", "auto"},
+      {GST_PROJECTM_RENDER_PROFILE_GPU, "Tuned for a GPU", "gpu"},
+      {GST_PROJECTM_RENDER_PROFILE_CPU,
+       "Tuned for a software rasterizer such as Mesa llvmpipe: FBO-only "
+       "rendering, a smaller default mesh and readback without packed "
+       "pixel types",
+       "cpu"},
+      {0, NULL, NULL}};
+
+  if (g_once_init_enter(&render_profile_type)) {
+    GType type =
+        g_enum_register_static("GstProjectMRenderProfile", render_profiles);
+    g_once_init_leave(&render_profile_type, type);
+  }
+
+  return (GType)render_profile_type;
+}
+
 G_DEFINE_TYPE_WITH_CODE(GstProjectM, gst_projectm,
                         GST_TYPE_GL_BASE_AUDIO_VISUALIZER,
                         G_ADD_PRIVATE(GstProjectM)
@@ -142,36 +375,6 @@ G_DEFINE_TYPE_WITH_CODE(GstProjectM, gst_projectm,
                                                     "projectm", 0,
                                                     "Plugin Root"));
 
-static void gst_projectm_timeline_entry_free(gpointer data) {
-  GstProjectMTimelineEntry *entry = (GstProjectMTimelineEntry *)data;
-  if (entry == NULL) {
-    return;
-  }
-
-  g_clear_pointer(&entry->preset, g_free);
-  g_clear_pointer(&entry->complexity, g_free);
-  g_free(entry);
-}
-
-static gint gst_projectm_timeline_entry_compare(gconstpointer a,
-                                                gconstpointer b) {
-  /* g_ptr_array_sort passes pointers-to-pointers: each argument is the
-     address of a slot in the GPtrArray, so we must dereference once to
-     obtain the actual GstProjectMTimelineEntry*. */
-  const GstProjectMTimelineEntry *left =
-      *(const GstProjectMTimelineEntry *const *)a;
-  const GstProjectMTimelineEntry *right =
-      *(const GstProjectMTimelineEntry *const *)b;
-
-  if (left->start_time < right->start_time) {
-    return -1;
-  }
-  if (left->start_time > right->start_time) {
-    return 1;
-  }
-  return 0;
-}
-
 static void gst_projectm_timeline_reset(GstProjectM *plugin) {
   GstProjectMPrivate *priv = plugin->priv;
 
@@ -194,85 +397,6 @@ static void gst_projectm_timeline_reset(GstProjectM *plugin) {
   }
 }
 
-static gchar *gst_projectm_resolve_preset_path(GstProjectM *plugin,
-                                               const gchar *preset_value) {
-  if (preset_value == NULL || *preset_value == '\0') {
-    return NULL;
-  }
-
-  if (g_path_is_absolute(preset_value)) {
-    return g_strdup(preset_value);
-  }
-
-  if (plugin->preset_path != NULL) {
-    return g_canonicalize_filename(preset_value, plugin->preset_path);
-  }
-
-  return g_strdup(preset_value);
-}
-
-static gint gst_projectm_timeline_find_target_index(GstProjectM *plugin,
-                                                    gdouble elapsed_seconds) {
-  GstProjectMPrivate *priv = plugin->priv;
-
-  if (!priv->timeline_entries || priv->timeline_entries->len == 0) {
-    return -1;
-  }
-
-  gint len = (gint)priv->timeline_entries->len;
-  gint current = priv->current_timeline_index;
-
-  if (current >= 0 && current < len) {
-    GstProjectMTimelineEntry *entry =
-        g_ptr_array_index(priv->timeline_entries, (guint)current);
-
-    if ((elapsed_seconds + GST_PROJECTM_TIMELINE_EPSILON) <
-        entry->start_time) {
-      current = -1;
-    } else {
-      gboolean before_next = TRUE;
-      if (current + 1 < len) {
-        GstProjectMTimelineEntry *next_entry =
-            g_ptr_array_index(priv->timeline_entries, (guint)(current + 1));
-        before_next =
-            (elapsed_seconds + GST_PROJECTM_TIMELINE_EPSILON) <
-            next_entry->start_time;
-      }
-
-      if ((elapsed_seconds <= entry->end_time + GST_PROJECTM_TIMELINE_EPSILON) ||
-          before_next || current == len - 1) {
-        return current;
-      }
-    }
-  }
-
-  gint low = 0;
-  gint high = len - 1;
-  gint result = -1;
-
-  while (low <= high) {
-    gint mid = low + ((high - low) / 2);
-    GstProjectMTimelineEntry *entry =
-        g_ptr_array_index(priv->timeline_entries, (guint)mid);
-
-    if ((elapsed_seconds + GST_PROJECTM_TIMELINE_EPSILON) <
-        entry->start_time) {
-      high = mid - 1;
-      continue;
-    }
-
-    result = mid;
-
-    if (elapsed_seconds <= entry->end_time + GST_PROJECTM_TIMELINE_EPSILON) {
-      break;
-    }
-
-    low = mid + 1;
-  }
-
-  return result;
-}
-
 static gboolean gst_projectm_load_timeline(GstProjectM *plugin,
                                            const gchar *path) {
   GstProjectMPrivate *priv = plugin->priv;
@@ -285,114 +409,11 @@ static gboolean gst_projectm_load_timeline(GstProjectM *plugin,
     return FALSE;
   }
 
-  if (!g_file_test(path, G_FILE_TEST_EXISTS)) {
-    GST_WARNING_OBJECT(plugin, "Timeline file not found: %s", path);
-    return FALSE;
-  }
-
-  GKeyFile *key_file = g_key_file_new();
-  GError *error = NULL;
-
-  if (!g_key_file_load_from_file(key_file, path, G_KEY_FILE_NONE, &error)) {
-    GST_WARNING_OBJECT(plugin, "Failed to parse timeline file %s: %s", path,
-                       error != NULL ? error->message : "unknown error");
-    g_clear_error(&error);
-    g_key_file_free(key_file);
-    return FALSE;
-  }
-
-  gsize group_count = 0;
-  gchar **groups = g_key_file_get_groups(key_file, &group_count);
-
-  if (groups == NULL || group_count == 0) {
-    GST_WARNING_OBJECT(plugin, "Timeline file %s contains no segments", path);
-    g_strfreev(groups);
-    g_key_file_free(key_file);
-    return FALSE;
-  }
-
-  for (gsize i = 0; i < group_count; i++) {
-    const gchar *group = groups[i];
-    gboolean segment_valid = TRUE;
-
-    GError *value_error = NULL;
-    gdouble start =
-        g_key_file_get_double(key_file, group, "start", &value_error);
-    if (value_error != NULL) {
-      GST_WARNING_OBJECT(plugin,
-                         "Timeline segment '%s' missing valid 'start': %s",
-                         group, value_error->message);
-      g_clear_error(&value_error);
-      segment_valid = FALSE;
-    }
-
-    gdouble duration = 0.0;
-    if (segment_valid) {
-      duration =
-          g_key_file_get_double(key_file, group, "duration", &value_error);
-      if (value_error != NULL) {
-        GST_WARNING_OBJECT(plugin,
-                           "Timeline segment '%s' missing valid 'duration': "
-                           "%s",
-                           group, value_error->message);
-        g_clear_error(&value_error);
-        segment_valid = FALSE;
-      } else if (duration <= 0.0) {
-        GST_WARNING_OBJECT(plugin,
-                           "Timeline segment '%s' has non-positive duration",
-                           group);
-        segment_valid = FALSE;
-      }
-    }
-
-    gchar *preset = NULL;
-    if (segment_valid) {
-      preset = g_key_file_get_string(key_file, group, "preset", &value_error);
-      if (value_error != NULL || preset == NULL || *preset == '\0') {
-        GST_WARNING_OBJECT(plugin,
-                           "Timeline segment '%s' missing valid 'preset'",
-                           group);
-        g_clear_error(&value_error);
-        g_clear_pointer(&preset, g_free);
-        segment_valid = FALSE;
-      }
-    }
-
-    gchar *complexity = NULL;
-    if (segment_valid) {
-      complexity =
-          g_key_file_get_string(key_file, group, "complexity", NULL);
-      if (complexity != NULL && *complexity == '\0') {
-        g_clear_pointer(&complexity, g_free);
-      }
-    }
-
-    if (!segment_valid) {
-      continue;
-    }
-
-    GstProjectMTimelineEntry *entry = g_new0(GstProjectMTimelineEntry, 1);
-    entry->start_time = start;
-    entry->duration = duration;
-    entry->end_time = start + duration;
-    entry->preset = preset;
-    entry->complexity = complexity;
-
-    g_ptr_array_add(priv->timeline_entries, entry);
-  }
-
-  g_strfreev(groups);
-  g_key_file_free(key_file);
-
-  if (priv->timeline_entries->len == 0) {
-    GST_WARNING_OBJECT(plugin, "Timeline file %s did not yield any segments",
-                       path);
+  if (!gst_projectm_timeline_load_file(priv->timeline_entries, path,
+                                       G_OBJECT(plugin))) {
     return FALSE;
   }
 
-  g_ptr_array_sort(priv->timeline_entries,
-                   (GCompareFunc)gst_projectm_timeline_entry_compare);
-
   priv->timeline_active = TRUE;
   priv->timeline_initialized = FALSE;
   priv->current_timeline_index = -1;
@@ -412,6 +433,36 @@ static gboolean gst_projectm_load_timeline(GstProjectM *plugin,
   return TRUE;
 }
 
+/* Loads a timeline set through timeline-path since the last call, and
+ * activates it if projectM is running. Must be called on the GL thread. */
+static void gst_projectm_apply_pending_timeline(GstProjectM *plugin) {
+  GstProjectMPrivate *priv = plugin->priv;
+
+  if (!g_atomic_int_compare_and_exchange(&priv->timeline_pending, TRUE,
+                                         FALSE)) {
+    return;
+  }
+
+  GST_OBJECT_LOCK(plugin);
+  gchar *path = g_strdup(plugin->timeline_path);
+  GST_OBJECT_UNLOCK(plugin);
+
+  if (gst_projectm_load_timeline(plugin, path)) {
+    if (priv->handle != NULL) {
+      gst_projectm_activate_timeline(plugin);
+    }
+    GST_INFO_OBJECT(plugin, "Loaded timeline from %s with %u segments", path,
+                    priv->timeline_entries ? priv->timeline_entries->len : 0);
+  } else if (path != NULL) {
+    GST_WARNING_OBJECT(plugin,
+                       "Failed to load timeline from %s, falling back to "
+                       "internal preset selection",
+                       path);
+  }
+
+  g_free(path);
+}
+
 static void gst_projectm_activate_timeline(GstProjectM *plugin) {
   GstProjectMPrivate *priv = plugin->priv;
 
@@ -468,8 +519,8 @@ static void gst_projectm_timeline_update(GstProjectM *plugin,
     return;
   }
 
-  gint target_index =
-      gst_projectm_timeline_find_target_index(plugin, elapsed_seconds);
+  gint target_index = gst_projectm_timeline_find_target_index(
+      priv->timeline_entries, priv->current_timeline_index, elapsed_seconds);
 
   if (target_index < 0 ||
       target_index == priv->current_timeline_index ||
@@ -479,15 +530,6 @@ static void gst_projectm_timeline_update(GstProjectM *plugin,
 
   GstProjectMTimelineEntry *entry =
       g_ptr_array_index(priv->timeline_entries, (guint)target_index);
-  gchar *resolved = gst_projectm_resolve_preset_path(plugin, entry->preset);
-
-  if (resolved == NULL) {
-    GST_WARNING_OBJECT(plugin,
-                       "Unable to resolve preset path for timeline segment %d",
-                       target_index);
-    priv->current_timeline_index = target_index;
-    return;
-  }
 
   gboolean smooth_transition = TRUE;
   if (entry->complexity != NULL) {
@@ -500,6 +542,32 @@ static void gst_projectm_timeline_update(GstProjectM *plugin,
     }
   }
 
+  gst_projectm_prefetch_timeline_textures(plugin, target_index);
+
+  /* Relative names refer to members when the preset pack is an archive. */
+  if (priv->preset_archive != NULL && !g_path_is_absolute(entry->preset)) {
+    GST_INFO_OBJECT(plugin,
+                    "Timeline switch -> archive preset=%s index=%d "
+                    "start=%.2f duration=%.2f elapsed=%.3f smooth=%d",
+                    entry->preset, target_index, entry->start_time,
+                    entry->duration, elapsed_seconds, smooth_transition);
+    gst_projectm_load_archive_preset(plugin, priv->handle, entry->preset,
+                                     smooth_transition);
+    priv->current_timeline_index = target_index;
+    return;
+  }
+
+  gchar *resolved =
+      gst_projectm_resolve_preset_path(plugin->preset_path, entry->preset);
+
+  if (resolved == NULL) {
+    GST_WARNING_OBJECT(plugin,
+                       "Unable to resolve preset path for timeline segment %d",
+                       target_index);
+    priv->current_timeline_index = target_index;
+    return;
+  }
+
   GST_INFO_OBJECT(plugin,
                   "Timeline switch -> preset=%s index=%d start=%.2f duration=%.2f "
                   "elapsed=%.3f smooth=%d",
@@ -512,20 +580,52 @@ static void gst_projectm_timeline_update(GstProjectM *plugin,
   priv->current_timeline_index = target_index;
 }
 
-static void gst_projectm_copy_to_frame(GstVideoFrame *video, const guint8 *src,
-                                       gsize width, gsize height) {
-  guint8 *dest = (guint8 *)GST_VIDEO_FRAME_PLANE_DATA(video, 0);
-  gsize dest_stride = GST_VIDEO_FRAME_PLANE_STRIDE(video, 0);
-  gsize row_size = width * 4;
+static void gst_projectm_update_read_swizzle(GstProjectMPrivate *priv) {
+  /* Where R, G, B and A land in the bytes read back. */
+  static const guint8 rgba[4] = {0, 1, 2, 3};
+  static const guint8 bgra[4] = {2, 1, 0, 3};
+  const guint8 *read = priv->read_format == GL_BGRA_EXT ? bgra : rgba;
 
-  if (dest_stride == row_size) {
-    memcpy(dest, src, row_size * height);
-    return;
+  for (guint i = 0; i < 4; i++) {
+    priv->read_swizzle[i] = read[priv->swizzle[i]];
   }
+}
 
-  for (gsize y = 0; y < height; y++) {
-    memcpy(dest + (y * dest_stride), src + (y * row_size), row_size);
-  }
+static void gst_projectm_copy_to_frame(GstProjectM *plugin,
+                                       GstVideoFrame *video, const guint8 *src,
+                                       gsize width, gsize height) {
+  GstProjectMPrivate *priv = plugin->priv;
+  GstProjectMFrameCopyFlags flags = plugin->vertical_flip
+                                        ? GST_PROJECTM_FRAME_COPY_FLIP
+                                        : GST_PROJECTM_FRAME_COPY_NONE;
+
+  /* Workers persist across frames; only a changed copy-threads value
+   * recreates them. */
+  guint threads = plugin->copy_threads;
+  if (priv->copy_pool != NULL && priv->copy_pool_threads != threads) {
+    g_clear_pointer(&priv->copy_pool, gst_projectm_frame_copy_pool_free);
+  }
+  if (priv->copy_pool == NULL) {
+    priv->copy_pool = gst_projectm_frame_copy_pool_new(threads);
+    priv->copy_pool_threads = threads;
+    GST_DEBUG_OBJECT(plugin, "Copying frames with %u threads (%s kernel)",
+                     gst_projectm_frame_copy_pool_get_threads(priv->copy_pool),
+                     gst_projectm_frame_copy_impl_name());
+  }
+
+  gst_projectm_frame_copy_pool_copy(
+      priv->copy_pool, (guint8 *)GST_VIDEO_FRAME_PLANE_DATA(video, 0),
+      GST_VIDEO_FRAME_PLANE_STRIDE(video, 0), src, width * 4, width, height,
+      flags, priv->read_swizzle);
+}
+
+static void gst_projectm_copy_mapped_pbo(GstProjectM *plugin,
+                                         GstVideoFrame *video,
+                                         const guint8 *src, gsize width,
+                                         gsize height) {
+  gint64 start = g_get_monotonic_time();
+  gst_projectm_copy_to_frame(plugin, video, src, width, height);
+  plugin->priv->copy_us += g_get_monotonic_time() - start;
 }
 
 static gpointer gst_projectm_map_pbo(const GstGLFuncs *glFunctions, gsize size) {
@@ -547,9 +647,37 @@ static void gst_projectm_unmap_pbo(const GstGLFuncs *glFunctions) {
   }
 }
 
+static gboolean gst_projectm_create_persistent_pbos(
+    GstProjectM *plugin, const GstGLFuncs *glFunctions, gsize size) {
+  GstProjectMPrivate *priv = plugin->priv;
+  const GLbitfield flags =
+      GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+  for (guint i = 0; i < GST_PROJECTM_PBO_COUNT; i++) {
+    glFunctions->BindBuffer(GL_PIXEL_PACK_BUFFER, priv->pbo_ids[i]);
+    /* Client storage hints the driver to keep the ring in system memory,
+     * where the CPU reads it. */
+    priv->buffer_storage(GL_PIXEL_PACK_BUFFER, size, NULL,
+                         flags | GL_CLIENT_STORAGE_BIT);
+    priv->pbo_mapped[i] = (guint8 *)glFunctions->MapBufferRange(
+        GL_PIXEL_PACK_BUFFER, 0, size, flags);
+    if (priv->pbo_mapped[i] == NULL) {
+      GST_WARNING_OBJECT(plugin,
+                         "Failed to persistently map readback buffer %u",
+                         priv->pbo_ids[i]);
+      glFunctions->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+      return FALSE;
+    }
+  }
+  glFunctions->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  return TRUE;
+}
+
 static gboolean gst_projectm_ensure_pbos(GstProjectM *plugin,
                                          const GstGLFuncs *glFunctions,
-                                         gsize width, gsize height) {
+                                         gsize width, gsize height,
+                                         gboolean persistent) {
   GstProjectMPrivate *priv = plugin->priv;
 
   if (!glFunctions || !glFunctions->GenBuffers || !glFunctions->BindBuffer ||
@@ -557,25 +685,54 @@ static gboolean gst_projectm_ensure_pbos(GstProjectM *plugin,
     return FALSE;
   }
 
+  /* Pixel pack buffers and read mappings arrived with GLES 3. */
+  if (priv->gles && !priv->gles3) {
+    return FALSE;
+  }
+
   gsize row_size = width * 4;
   gsize required_size = row_size * height;
 
   if (priv->pbo_initialized && priv->pbo_size == required_size &&
-      priv->pbo_width == width && priv->pbo_height == height) {
+      priv->pbo_width == width && priv->pbo_height == height &&
+      priv->pbo_persistent == persistent) {
     return TRUE;
   }
 
+  /* Buffer storage is immutable, so a size change always recreates the
+   * ring. */
   gst_projectm_release_pbos(plugin, glFunctions);
 
   glFunctions->GenBuffers(GST_PROJECTM_PBO_COUNT, priv->pbo_ids);
-  for (guint i = 0; i < GST_PROJECTM_PBO_COUNT; i++) {
-    glFunctions->BindBuffer(GL_PIXEL_PACK_BUFFER, priv->pbo_ids[i]);
-    glFunctions->BufferData(GL_PIXEL_PACK_BUFFER, required_size, NULL,
-                            GL_STREAM_READ);
+
+  if (persistent &&
+      !gst_projectm_create_persistent_pbos(plugin, glFunctions,
+                                           required_size)) {
+    GST_WARNING_OBJECT(plugin, "Persistent readback unavailable, falling back "
+                               "to mapping buffers per frame");
+    /* Do not retry, and let release free the partially mapped ring. */
+    priv->buffer_storage = NULL;
+    priv->pbo_initialized = TRUE;
+    gst_projectm_release_pbos(plugin, glFunctions);
+    glFunctions->GenBuffers(GST_PROJECTM_PBO_COUNT, priv->pbo_ids);
+    persistent = FALSE;
+  }
+
+  if (!persistent) {
+    for (guint i = 0; i < GST_PROJECTM_PBO_COUNT; i++) {
+      glFunctions->BindBuffer(GL_PIXEL_PACK_BUFFER, priv->pbo_ids[i]);
+      glFunctions->BufferData(GL_PIXEL_PACK_BUFFER, required_size, NULL,
+                              GL_STREAM_READ);
+    }
+    glFunctions->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
   }
-  glFunctions->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  GST_DEBUG_OBJECT(plugin, "Created %s readback ring of %d x %zu bytes",
+                   persistent ? "persistent" : "mapped",
+                   GST_PROJECTM_PBO_COUNT, required_size);
 
   priv->pbo_initialized = TRUE;
+  priv->pbo_persistent = persistent;
   priv->pbo_width = width;
   priv->pbo_height = height;
   priv->pbo_size = required_size;
@@ -593,12 +750,28 @@ static void gst_projectm_release_pbos(GstProjectM *plugin,
     return;
   }
 
+  for (guint i = 0; i < GST_PROJECTM_PBO_COUNT; i++) {
+    if (priv->pbo_fences[i] != NULL && glFunctions &&
+        glFunctions->DeleteSync) {
+      glFunctions->DeleteSync(priv->pbo_fences[i]);
+    }
+    if (priv->pbo_mapped[i] != NULL && glFunctions &&
+        glFunctions->UnmapBuffer) {
+      glFunctions->BindBuffer(GL_PIXEL_PACK_BUFFER, priv->pbo_ids[i]);
+      glFunctions->UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+      glFunctions->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+  }
+
   if (glFunctions && glFunctions->DeleteBuffers) {
     glFunctions->DeleteBuffers(GST_PROJECTM_PBO_COUNT, priv->pbo_ids);
   }
 
   memset(priv->pbo_ids, 0, sizeof(priv->pbo_ids));
+  memset(priv->pbo_mapped, 0, sizeof(priv->pbo_mapped));
+  memset(priv->pbo_fences, 0, sizeof(priv->pbo_fences));
   priv->pbo_initialized = FALSE;
+  priv->pbo_persistent = FALSE;
   priv->pbo_size = 0;
   priv->pbo_width = 0;
   priv->pbo_height = 0;
@@ -606,6 +779,36 @@ static void gst_projectm_release_pbos(GstProjectM *plugin,
   priv->pbo_frame_valid = FALSE;
 }
 
+/* Substrings of GL_RENDERER, lower-cased, naming software rasterizers. */
+static const gchar *const gst_projectm_software_renderers[] = {
+    "llvmpipe", "softpipe", "lavapipe", "software rasterizer", "swiftshader",
+    NULL};
+
+static gboolean
+gst_projectm_is_software_renderer(GstProjectM *plugin,
+                                  const GstGLFuncs *glFunctions) {
+  const GLubyte *renderer =
+      glFunctions->GetString ? glFunctions->GetString(GL_RENDERER) : NULL;
+  gboolean software = FALSE;
+
+  if (renderer == NULL) {
+    return FALSE;
+  }
+
+  gchar *name = g_ascii_strdown((const gchar *)renderer, -1);
+  for (guint i = 0; gst_projectm_software_renderers[i] != NULL; i++) {
+    if (strstr(name, gst_projectm_software_renderers[i]) != NULL) {
+      software = TRUE;
+      break;
+    }
+  }
+  g_free(name);
+
+  GST_INFO_OBJECT(plugin, "GL renderer: %s%s", (const gchar *)renderer,
+                  software ? " (software)" : "");
+  return software;
+}
+
 static gboolean
 gst_projectm_check_headless_mode(GstProjectM *plugin,
                                   const GstGLFuncs *glFunctions) {
@@ -618,6 +821,16 @@ gst_projectm_check_headless_mode(GstProjectM *plugin,
   priv->headless_checked = TRUE;
   priv->headless_mode = FALSE;
 
+  /* A software rasterizer usually runs on a pbuffer or a hidden Xvfb
+   * window. Its default framebuffer reports complete, but that surface is
+   * not the output size and pixels outside it are undefined, so always
+   * render into our own FBO. */
+  if (priv->cpu_profile) {
+    priv->headless_mode = TRUE;
+    GST_INFO_OBJECT(plugin, "CPU render profile, rendering to an FBO only");
+    return TRUE;
+  }
+
   /* Check for environment variable to force FBO/headless mode */
   const gchar *force_fbo = g_getenv("GST_PROJECTM_FORCE_FBO");
   if (force_fbo && (g_ascii_strcasecmp(force_fbo, "1") == 0 ||
@@ -664,6 +877,87 @@ gst_projectm_check_headless_mode(GstProjectM *plugin,
   return priv->headless_mode;
 }
 
+static void gst_projectm_detect_gpu_memory_query(GstProjectM *plugin,
+                                                 GstGLContext *context) {
+  GstProjectMPrivate *priv = plugin->priv;
+
+  if (gst_gl_context_check_feature(context, "GL_NVX_gpu_memory_info")) {
+    priv->gpu_memory_query = GST_PROJECTM_GPU_MEMORY_QUERY_NVX;
+  } else if (gst_gl_context_check_feature(context, "GL_ATI_meminfo")) {
+    priv->gpu_memory_query = GST_PROJECTM_GPU_MEMORY_QUERY_ATI;
+  } else {
+    priv->gpu_memory_query = GST_PROJECTM_GPU_MEMORY_QUERY_NONE;
+  }
+
+  GST_DEBUG_OBJECT(plugin, "GPU memory query method: %d",
+                   priv->gpu_memory_query);
+}
+
+static void gst_projectm_detect_buffer_storage(GstProjectM *plugin,
+                                              GstGLContext *context) {
+  GstProjectMPrivate *priv = plugin->priv;
+  const GstGLFuncs *glFunctions = context->gl_vtable;
+
+  priv->buffer_storage = NULL;
+
+  if (!gst_gl_context_check_gl_version(
+           context, GST_GL_API_OPENGL | GST_GL_API_OPENGL3, 4, 4) &&
+      !gst_gl_context_check_feature(context, "GL_ARB_buffer_storage") &&
+      !gst_gl_context_check_feature(context, "GL_EXT_buffer_storage")) {
+    GST_DEBUG_OBJECT(plugin, "Buffer storage not supported, persistent "
+                             "readback unavailable");
+    return;
+  }
+
+  if (!glFunctions->MapBufferRange || !glFunctions->FenceSync ||
+      !glFunctions->ClientWaitSync || !glFunctions->DeleteSync) {
+    GST_DEBUG_OBJECT(plugin, "Missing map or sync functions, persistent "
+                             "readback unavailable");
+    return;
+  }
+
+  priv->buffer_storage = (GstProjectMBufferStorageFunc)
+      gst_gl_context_get_proc_address(context, "glBufferStorage");
+  if (priv->buffer_storage == NULL) {
+    priv->buffer_storage = (GstProjectMBufferStorageFunc)
+        gst_gl_context_get_proc_address(context, "glBufferStorageEXT");
+  }
+
+  GST_DEBUG_OBJECT(plugin, "Persistent readback %s",
+                   priv->buffer_storage != NULL ? "available" : "unavailable");
+}
+
+static void gst_projectm_update_gpu_memory(GstProjectM *plugin,
+                                           const GstGLFuncs *glFunctions) {
+  GstProjectMPrivate *priv = plugin->priv;
+
+  if (!glFunctions || !glFunctions->GetIntegerv) {
+    return;
+  }
+
+  switch (priv->gpu_memory_query) {
+  case GST_PROJECTM_GPU_MEMORY_QUERY_NVX: {
+    GLint total_kb = -1;
+    GLint available_kb = -1;
+    glFunctions->GetIntegerv(GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX,
+                             &total_kb);
+    glFunctions->GetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX,
+                             &available_kb);
+    gst_projectm_stats_set_gpu_memory(&priv->stats, total_kb, available_kb);
+    break;
+  }
+  case GST_PROJECTM_GPU_MEMORY_QUERY_ATI: {
+    /* Returns {free, largest free block, aux free, largest aux block} */
+    GLint free_kb[4] = {-1, -1, -1, -1};
+    glFunctions->GetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, free_kb);
+    gst_projectm_stats_set_gpu_memory(&priv->stats, -1, free_kb[0]);
+    break;
+  }
+  default:
+    break;
+  }
+}
+
 static gboolean
 gst_projectm_has_rt_support(GstProjectM *plugin,
                             const GstGLFuncs *glFunctions) {
@@ -748,7 +1042,7 @@ static gboolean gst_projectm_ensure_render_target(GstProjectM *plugin,
   if (glFunctions->DrawBuffers) {
     GLenum draw_buffer = GL_COLOR_ATTACHMENT0;
     glFunctions->DrawBuffers(1, &draw_buffer);
-  } else if (glFunctions->DrawBuffer) {
+  } else if (glFunctions->DrawBuffer && !priv->gles) {
     glFunctions->DrawBuffer(GL_COLOR_ATTACHMENT0);
   }
   if (glFunctions->ReadBuffer) {
@@ -816,6 +1110,24 @@ static gboolean gst_projectm_ensure_render_target(GstProjectM *plugin,
     return FALSE;
   }
 
+  /* GLES only guarantees GL_RGBA/GL_UNSIGNED_BYTE plus one format of the
+   * implementation's choosing for the bound framebuffer; BGRA is usually
+   * its native order, read without conversion. */
+  if (priv->gles && glFunctions->GetIntegerv) {
+    GLint read_format = 0;
+    GLint read_type = 0;
+    glFunctions->GetIntegerv(GL_IMPLEMENTATION_COLOR_READ_FORMAT, &read_format);
+    glFunctions->GetIntegerv(GL_IMPLEMENTATION_COLOR_READ_TYPE, &read_type);
+    priv->read_format =
+        read_format == GL_BGRA_EXT && read_type == GL_UNSIGNED_BYTE
+            ? GL_BGRA_EXT
+            : GL_RGBA;
+    gst_projectm_update_read_swizzle(priv);
+    GST_DEBUG_OBJECT(plugin,
+                     "Implementation read format 0x%x/0x%x, reading 0x%x",
+                     read_format, read_type, priv->read_format);
+  }
+
   priv->fbo_id = new_fbo;
   priv->fbo_texture_id = new_tex;
   priv->fbo_depth_buffer_id = new_depth;
@@ -874,31 +1186,104 @@ static void gst_projectm_release_render_target(GstProjectM *plugin,
   priv->fbo_warned_missing_support = FALSE;
 }
 
-static gboolean gst_projectm_download_frame_with_pbo(
-    GstProjectM *plugin, const GstGLFuncs *glFunctions, GstVideoFrame *video,
-    gsize width, gsize height) {
+static gboolean gst_projectm_wait_pbo_fence(GstProjectM *plugin,
+                                            const GstGLFuncs *glFunctions,
+                                            guint index) {
   GstProjectMPrivate *priv = plugin->priv;
+  GLsync fence = priv->pbo_fences[index];
 
-  if (!priv->pbo_initialized || !glFunctions || !glFunctions->BindBuffer) {
+  if (fence == NULL) {
+    return FALSE;
+  }
+
+  GLenum result = glFunctions->ClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                              GST_PROJECTM_PBO_FENCE_TIMEOUT_NS);
+  glFunctions->DeleteSync(fence);
+  priv->pbo_fences[index] = NULL;
+
+  if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) {
+    GST_WARNING_OBJECT(plugin, "Readback fence wait failed (0x%x)", result);
     return FALSE;
   }
 
+  return TRUE;
+}
+
+static gboolean gst_projectm_download_frame_with_persistent_pbo(
+    GstProjectM *plugin, const GstGLFuncs *glFunctions, GstVideoFrame *video,
+    gsize width, gsize height) {
+  GstProjectMPrivate *priv = plugin->priv;
+
   guint next_index = (priv->pbo_index + 1) % GST_PROJECTM_PBO_COUNT;
-  GLuint next_pbo = priv->pbo_ids[next_index];
 
-  glFunctions->BindBuffer(GL_PIXEL_PACK_BUFFER, next_pbo);
-  glFunctions->ReadPixels(0, 0, width, height, priv->gl_format,
-                          GL_UNSIGNED_INT_8_8_8_8, 0);
+  /* The slot's previous frame was consumed when it became the ready slot,
+   * so any fence left on it is stale. */
+  if (priv->pbo_fences[next_index] != NULL) {
+    glFunctions->DeleteSync(priv->pbo_fences[next_index]);
+    priv->pbo_fences[next_index] = NULL;
+  }
+
+  glFunctions->BindBuffer(GL_PIXEL_PACK_BUFFER, priv->pbo_ids[next_index]);
+  glFunctions->ReadPixels(0, 0, width, height, priv->read_format,
+                          GL_UNSIGNED_BYTE, 0);
   glFunctions->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  priv->pbo_fences[next_index] =
+      glFunctions->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  priv->pbo_slot_frame[next_index] = priv->render_frame_count;
 
+  /* Copy the previous frame while this one is in flight; on the first frame
+   * there is none yet, so wait for the one just issued. */
+  guint ready_index = priv->pbo_frame_valid ? priv->pbo_index : next_index;
   gboolean copied = FALSE;
 
-  if (priv->pbo_frame_valid) {
-    GLuint ready_pbo = priv->pbo_ids[priv->pbo_index];
+  if (gst_projectm_wait_pbo_fence(plugin, glFunctions, ready_index)) {
+    gst_projectm_copy_mapped_pbo(plugin, video, priv->pbo_mapped[ready_index],
+                                 width, height);
+    priv->pbo_copied_frame = priv->pbo_slot_frame[ready_index];
+    copied = TRUE;
+  }
+
+  priv->pbo_index = next_index;
+  priv->pbo_frame_valid = TRUE;
+
+  return copied;
+}
+
+static gboolean gst_projectm_download_frame_with_pbo(
+    GstProjectM *plugin, const GstGLFuncs *glFunctions, GstVideoFrame *video,
+    gsize width, gsize height) {
+  GstProjectMPrivate *priv = plugin->priv;
+
+  if (!priv->pbo_initialized || !glFunctions || !glFunctions->BindBuffer) {
+    return FALSE;
+  }
+
+  if (priv->pbo_persistent) {
+    return gst_projectm_download_frame_with_persistent_pbo(
+        plugin, glFunctions, video, width, height);
+  }
+
+  guint next_index = (priv->pbo_index + 1) % GST_PROJECTM_PBO_COUNT;
+  GLuint next_pbo = priv->pbo_ids[next_index];
+
+  /* Read plain bytes in the implementation's preferred order, which every
+   * driver supports without conversion; the reorder to the output format is
+   * folded into the copy. */
+  glFunctions->BindBuffer(GL_PIXEL_PACK_BUFFER, next_pbo);
+  glFunctions->ReadPixels(0, 0, width, height, priv->read_format,
+                          GL_UNSIGNED_BYTE, 0);
+  glFunctions->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  priv->pbo_slot_frame[next_index] = priv->render_frame_count;
+
+  gboolean copied = FALSE;
+
+  if (priv->pbo_frame_valid) {
+    GLuint ready_pbo = priv->pbo_ids[priv->pbo_index];
     glFunctions->BindBuffer(GL_PIXEL_PACK_BUFFER, ready_pbo);
     guint8 *mapped = (guint8 *)gst_projectm_map_pbo(glFunctions, priv->pbo_size);
     if (mapped != NULL) {
-      gst_projectm_copy_to_frame(video, mapped, width, height);
+      gst_projectm_copy_mapped_pbo(plugin, video, mapped, width, height);
+      priv->pbo_copied_frame = priv->pbo_slot_frame[priv->pbo_index];
       copied = TRUE;
       gst_projectm_unmap_pbo(glFunctions);
     }
@@ -912,7 +1297,8 @@ static gboolean gst_projectm_download_frame_with_pbo(
     glFunctions->BindBuffer(GL_PIXEL_PACK_BUFFER, next_pbo);
     guint8 *mapped = (guint8 *)gst_projectm_map_pbo(glFunctions, priv->pbo_size);
     if (mapped != NULL) {
-      gst_projectm_copy_to_frame(video, mapped, width, height);
+      gst_projectm_copy_mapped_pbo(plugin, video, mapped, width, height);
+      priv->pbo_copied_frame = priv->pbo_slot_frame[next_index];
       copied = TRUE;
       gst_projectm_unmap_pbo(glFunctions);
     }
@@ -921,6 +1307,371 @@ static gboolean gst_projectm_download_frame_with_pbo(
 
   return copied;
 }
+
+static gboolean gst_projectm_download_frame_zero_copy(
+    GstProjectM *plugin, const GstGLFuncs *glFunctions, GstMemory *mem,
+    gsize width, gsize height) {
+  /* Read in the output format directly, as the synchronous path does; there
+   * is no CPU pass left to reorder bytes in. GLES 2 has neither pack buffers
+   * nor fences. */
+  GstProjectMPrivate *priv = plugin->priv;
+  GLenum format, type;
+  if ((priv->gles && !priv->gles3) ||
+      !gst_projectm_get_read_format(plugin, &format, &type)) {
+    return FALSE;
+  }
+  glFunctions->BindBuffer(GL_PIXEL_PACK_BUFFER,
+                          gst_projectm_pbo_memory_get_id(mem));
+  glFunctions->ReadPixels(0, 0, width, height, format, type,
+                          (gpointer)(guintptr)mem->offset);
+  glFunctions->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  GLsync fence = glFunctions->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  GLenum result = glFunctions->ClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                              GST_PROJECTM_PBO_FENCE_TIMEOUT_NS);
+  glFunctions->DeleteSync(fence);
+
+  if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) {
+    GST_WARNING_OBJECT(plugin, "Zero-copy readback fence wait failed (0x%x)",
+                       result);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+typedef enum {
+  GST_PROJECTM_FRAME_OUTPUT,   /* keyframe-only mode off */
+  GST_PROJECTM_FRAME_KEYFRAME, /* render and read back */
+  GST_PROJECTM_FRAME_WARMUP,   /* render only, then drop */
+  GST_PROJECTM_FRAME_SKIP      /* feed audio only, then drop */
+} GstProjectMFrameAction;
+
+static gint gst_projectm_compare_clock_time(gconstpointer a, gconstpointer b) {
+  GstClockTime ta = *(const GstClockTime *)a;
+  GstClockTime tb = *(const GstClockTime *)b;
+
+  return ta < tb ? -1 : (ta > tb ? 1 : 0);
+}
+
+/* Parses a comma-separated list of keyframe times in seconds into a sorted
+ * array of clock times. NULL for an empty or malformed list. */
+static GArray *gst_projectm_parse_keyframe_timestamps(GstProjectM *plugin,
+                                                      const gchar *str) {
+  if (str == NULL || *str == '\0') {
+    return NULL;
+  }
+
+  gchar **parts = g_strsplit(str, ",", -1);
+  GArray *times = g_array_new(FALSE, FALSE, sizeof(GstClockTime));
+
+  for (guint i = 0; parts[i] != NULL; i++) {
+    gchar *part = g_strstrip(parts[i]);
+    gchar *end = NULL;
+    gdouble seconds = g_ascii_strtod(part, &end);
+
+    if (*part == '\0' || end == part || *end != '\0' || seconds < 0.0) {
+      GST_WARNING_OBJECT(plugin, "Invalid keyframe timestamp '%s' in '%s'",
+                         part, str);
+      g_clear_pointer(&times, g_array_unref);
+      break;
+    }
+
+    GstClockTime time = (GstClockTime)(seconds * GST_SECOND);
+    g_array_append_val(times, time);
+  }
+
+  g_strfreev(parts);
+
+  if (times != NULL) {
+    g_array_sort(times, gst_projectm_compare_clock_time);
+  }
+
+  return times;
+}
+
+/* Finds the first requested keyframe at or after pts. Returns FALSE when
+ * keyframe-only mode is off. */
+static gboolean gst_projectm_next_keyframe(GstProjectM *plugin,
+                                           GstClockTime pts,
+                                           GstClockTime *next) {
+  GstClockTime interval = plugin->keyframe_interval;
+  gboolean active = interval > 0;
+
+  *next = GST_CLOCK_TIME_NONE;
+  if (interval > 0) {
+    *next = (pts + interval - 1) / interval * interval;
+  }
+
+  GST_OBJECT_LOCK(plugin);
+  GArray *times = plugin->priv->keyframe_times;
+  if (times != NULL) {
+    active = TRUE;
+    for (guint i = 0; i < times->len; i++) {
+      GstClockTime time = g_array_index(times, GstClockTime, i);
+
+      if (time >= pts) {
+        *next = MIN(*next, time);
+        break;
+      }
+    }
+  }
+  GST_OBJECT_UNLOCK(plugin);
+
+  return active;
+}
+
+/* Decides what keyframe-only mode does with an output frame. A frame is a
+ * keyframe if a requested time falls within its duration; keyframe-warmup
+ * frames before it are rendered so feedback-based presets have built up. */
+static GstProjectMFrameAction gst_projectm_frame_action(GstProjectM *plugin,
+                                                        GstBuffer *buffer) {
+  GstAudioVisualizer *scope = GST_AUDIO_VISUALIZER(plugin);
+  GstClockTime pts = GST_BUFFER_PTS(buffer);
+  GstClockTime duration = GST_BUFFER_DURATION(buffer);
+  GstClockTime next;
+
+  if (!GST_CLOCK_TIME_IS_VALID(pts) ||
+      !gst_projectm_next_keyframe(plugin, pts, &next)) {
+    return GST_PROJECTM_FRAME_OUTPUT;
+  }
+
+  if (!GST_CLOCK_TIME_IS_VALID(duration)) {
+    duration = scope->vinfo.fps_n > 0
+                   ? gst_util_uint64_scale_int(GST_SECOND, scope->vinfo.fps_d,
+                                               scope->vinfo.fps_n)
+                   : 0;
+  }
+
+  if (!GST_CLOCK_TIME_IS_VALID(next)) {
+    return GST_PROJECTM_FRAME_SKIP;
+  }
+
+  if (next < pts + MAX(duration, 1)) {
+    return GST_PROJECTM_FRAME_KEYFRAME;
+  }
+
+  if (next - pts <= (guint64)plugin->keyframe_warmup * duration) {
+    return GST_PROJECTM_FRAME_WARMUP;
+  }
+
+  return GST_PROJECTM_FRAME_SKIP;
+}
+
+static GstPadProbeReturn gst_projectm_src_skip_probe(GstPad *pad,
+                                                     GstPadProbeInfo *info,
+                                                     gpointer user_data) {
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+
+  if (GST_BUFFER_FLAG_IS_SET(buffer, GST_PROJECTM_BUFFER_FLAG_SKIP)) {
+    return GST_PAD_PROBE_DROP;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static gboolean gst_projectm_convert_frame_nv12(GstProjectM *plugin,
+                                                GstGLContext *context,
+                                                GstVideoFrame *video,
+                                                gboolean using_fbo,
+                                                gsize width, gsize height) {
+  GstProjectMPrivate *priv = plugin->priv;
+  guint y_texture, uv_texture;
+
+  if (!using_fbo || priv->fbo_texture_id == 0) {
+    GST_ERROR_OBJECT(plugin, "DMABuf output needs an FBO render target");
+    return FALSE;
+  }
+
+  if ((gsize)GST_VIDEO_FRAME_WIDTH(video) != width ||
+      (gsize)GST_VIDEO_FRAME_HEIGHT(video) != height) {
+    GST_ERROR_OBJECT(plugin, "Render target %zux%zu does not match %dx%d frame",
+                     width, height, GST_VIDEO_FRAME_WIDTH(video),
+                     GST_VIDEO_FRAME_HEIGHT(video));
+    return FALSE;
+  }
+
+  if (!gst_projectm_dmabuf_buffer_get_textures(video->buffer, &y_texture,
+                                               &uv_texture)) {
+    GST_ERROR_OBJECT(plugin, "Output buffer is not from the DMABuf pool");
+    return FALSE;
+  }
+
+  if (priv->nv12_converter == NULL) {
+    priv->nv12_converter = gst_projectm_nv12_converter_new(context);
+    if (priv->nv12_converter == NULL) {
+      GST_ERROR_OBJECT(plugin, "Failed to create NV12 converter");
+      return FALSE;
+    }
+  }
+
+  return gst_projectm_nv12_converter_convert(
+      priv->nv12_converter, priv->fbo_texture_id, &video->info, y_texture,
+      uv_texture, plugin->vertical_flip);
+}
+
+/* Drops DMABuf from what downstream accepts when the GL context cannot
+ * export, so negotiation falls back to system memory. GstAudioVisualizer
+ * negotiates by querying the peer with the template caps; only answers that
+ * contain DMABuf need the context, which is found early for them. */
+static GstPadProbeReturn gst_projectm_src_caps_query_probe(
+    GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+  GstProjectM *plugin = GST_PROJECTM(user_data);
+  GstQuery *query = GST_PAD_PROBE_INFO_QUERY(info);
+  GstCaps *caps = NULL;
+
+  if (GST_QUERY_TYPE(query) != GST_QUERY_CAPS) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  gst_query_parse_caps_result(query, &caps);
+  if (!gst_projectm_caps_are_dmabuf(caps)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (gst_gl_base_audio_visualizer_ensure_gl_context(
+          GST_GL_BASE_AUDIO_VISUALIZER(plugin)) &&
+      plugin->priv->dmabuf_supported) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  GST_INFO_OBJECT(plugin, "DMABuf export unavailable, offering system memory");
+
+  caps = gst_caps_copy(caps);
+  gst_projectm_caps_strip_dmabuf(caps);
+  gst_query_set_caps_result(query, caps);
+  gst_caps_unref(caps);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static gboolean gst_projectm_decide_dmabuf_allocation(GstProjectM *plugin,
+                                                      GstQuery *query,
+                                                      GstCaps *caps) {
+  GstGLBaseAudioVisualizer *glav = GST_GL_BASE_AUDIO_VISUALIZER(plugin);
+  GstBufferPool *pool = gst_projectm_dmabuf_pool_new(glav->context);
+  GstStructure *config = gst_buffer_pool_get_config(pool);
+  GstVideoInfo info;
+  guint size;
+
+  gst_video_info_from_caps(&info, caps);
+  gst_buffer_pool_config_set_params(config, caps, (guint)info.size,
+                                    GST_PROJECTM_PBO_COUNT, 0);
+  gst_buffer_pool_config_add_option(config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+
+  if (!gst_buffer_pool_set_config(pool, config)) {
+    GST_ERROR_OBJECT(plugin, "Failed to configure DMABuf pool");
+    gst_object_unref(pool);
+    return FALSE;
+  }
+
+  /* The pool sizes buffers by the strides the driver picked. */
+  config = gst_buffer_pool_get_config(pool);
+  gst_buffer_pool_config_get_params(config, NULL, &size, NULL, NULL);
+  gst_structure_free(config);
+
+  if (gst_query_get_n_allocation_pools(query) > 0) {
+    gst_query_set_nth_allocation_pool(query, 0, pool, size,
+                                      GST_PROJECTM_PBO_COUNT, 0);
+  } else {
+    gst_query_add_allocation_pool(query, pool, size, GST_PROJECTM_PBO_COUNT, 0);
+  }
+
+  GST_DEBUG_OBJECT(plugin, "Using DMABuf output pool");
+  gst_object_unref(pool);
+
+  return TRUE;
+}
+
+static gboolean gst_projectm_decide_allocation(GstAudioVisualizer *scope,
+                                               GstQuery *query) {
+  GstProjectM *plugin = GST_PROJECTM(scope);
+  GstGLBaseAudioVisualizer *glav = GST_GL_BASE_AUDIO_VISUALIZER(scope);
+
+  /* Preallocate one frame per readback in flight plus the one being
+   * filled, so steady state does not allocate. */
+  gst_gl_base_audio_visualizer_set_min_buffers(
+      glav, plugin->readback_mode == GST_PROJECTM_READBACK_SYNC
+                ? 2
+                : GST_PROJECTM_PBO_COUNT + 1);
+
+  if (!GST_AUDIO_VISUALIZER_CLASS(gst_projectm_parent_class)
+           ->decide_allocation(scope, query)) {
+    return FALSE;
+  }
+
+  GstCaps *caps = NULL;
+  GstVideoInfo info;
+
+  gst_query_parse_allocation(query, &caps, NULL);
+  plugin->priv->dmabuf_output = gst_projectm_caps_are_dmabuf(caps);
+
+  /* The base class runs its shader over every output frame on the CPU,
+   * treating it as 4-byte pixels. On NV12 DMABufs that would read GPU
+   * memory back and overrun the luma plane, so it is switched off while
+   * they are negotiated. Not called with the base class's config lock
+   * held, so the property can be set here. */
+  if (plugin->priv->dmabuf_output && !plugin->priv->shader_overridden) {
+    g_object_get(plugin, "shader", &plugin->priv->saved_shader, NULL);
+    g_object_set(plugin, "shader", GST_AUDIO_VISUALIZER_SHADER_NONE, NULL);
+    plugin->priv->shader_overridden = TRUE;
+  } else if (!plugin->priv->dmabuf_output &&
+             plugin->priv->shader_overridden) {
+    g_object_set(plugin, "shader", plugin->priv->saved_shader, NULL);
+    plugin->priv->shader_overridden = FALSE;
+  }
+
+  if (plugin->priv->dmabuf_output) {
+    return gst_projectm_decide_dmabuf_allocation(plugin, query, caps);
+  }
+
+  /* The parent has found the context and run gl_start, so buffer storage
+   * support is known by now. Flipping needs a CPU pass, which rules out
+   * handing the readback buffer downstream as is, as does an output GLES
+   * cannot read in its own byte order. Zero-copy waits for each frame's
+   * readback on the GL thread, so it is only used when asked for; auto
+   * keeps the persistent ring, which overlaps the readback with the next
+   * render. */
+  GLenum read_format, read_type;
+  if (plugin->readback_mode != GST_PROJECTM_READBACK_ZERO_COPY ||
+      plugin->priv->buffer_storage == NULL || plugin->vertical_flip ||
+      !gst_projectm_get_read_format(plugin, &read_format, &read_type)) {
+    return TRUE;
+  }
+
+  if (caps == NULL || !gst_video_info_from_caps(&info, caps)) {
+    return TRUE;
+  }
+
+  GstBufferPool *pool =
+      gst_projectm_pbo_pool_new(glav->context, plugin->priv->buffer_storage);
+  GstStructure *config = gst_buffer_pool_get_config(pool);
+  guint size = (guint)GST_VIDEO_INFO_SIZE(&info);
+
+  /* No upper bound: the pool grows while downstream holds on to frames. */
+  gst_buffer_pool_config_set_params(config, caps, size, GST_PROJECTM_PBO_COUNT,
+                                    0);
+  gst_buffer_pool_config_add_option(config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+
+  if (!gst_buffer_pool_set_config(pool, config)) {
+    GST_WARNING_OBJECT(plugin, "Failed to configure zero-copy pool, using "
+                               "the default pool");
+    gst_object_unref(pool);
+    return TRUE;
+  }
+
+  if (gst_query_get_n_allocation_pools(query) > 0) {
+    gst_query_set_nth_allocation_pool(query, 0, pool, size,
+                                      GST_PROJECTM_PBO_COUNT, 0);
+  } else {
+    gst_query_add_allocation_pool(query, pool, size, GST_PROJECTM_PBO_COUNT, 0);
+  }
+
+  GST_DEBUG_OBJECT(plugin, "Using zero-copy readback pool");
+  gst_object_unref(pool);
+
+  return TRUE;
+}
 gboolean gst_projectm_timeline_is_active(GstProjectM *plugin) {
   if (plugin == NULL) {
     return FALSE;
@@ -949,8 +1700,19 @@ void gst_projectm_load_first_timeline_preset(GstProjectM *plugin, projectm_handl
     return;
   }
 
+  gst_projectm_prefetch_timeline_textures(plugin, 0);
+
+  if (priv->preset_archive != NULL && !g_path_is_absolute(entry->preset)) {
+    GST_INFO_OBJECT(plugin, "Loading first timeline preset from archive: %s",
+                    entry->preset);
+    gst_projectm_load_archive_preset(plugin, handle, entry->preset, FALSE);
+    priv->current_timeline_index = 0;
+    return;
+  }
+
   // Resolve the preset path
-  gchar *resolved = gst_projectm_resolve_preset_path(plugin, entry->preset);
+  gchar *resolved =
+      gst_projectm_resolve_preset_path(plugin->preset_path, entry->preset);
   if (resolved == NULL) {
     GST_WARNING_OBJECT(plugin,
                        "Unable to resolve first timeline preset path: %s",
@@ -970,6 +1732,248 @@ void gst_projectm_load_first_timeline_preset(GstProjectM *plugin, projectm_handl
   priv->current_timeline_index = 0;
 }
 
+static gboolean gst_projectm_load_archive_preset(GstProjectM *plugin,
+                                                 projectm_handle handle,
+                                                 const gchar *name,
+                                                 gboolean smooth_transition) {
+  GError *error = NULL;
+  gchar *data =
+      gst_projectm_archive_read(plugin->priv->preset_archive, name, &error);
+
+  if (data == NULL) {
+    GST_WARNING_OBJECT(plugin, "Unable to load archive preset: %s",
+                       error->message);
+    g_clear_error(&error);
+    return FALSE;
+  }
+
+  GST_DEBUG_OBJECT(plugin, "Loading archive preset %s", name);
+  projectm_load_preset_data(handle, data, smooth_transition);
+  g_free(data);
+  return TRUE;
+}
+
+/* Advances the archive playlist, in name order or at random like the
+ * projectM playlist. */
+static void gst_projectm_play_archive_preset(GstProjectM *plugin,
+                                             projectm_handle handle,
+                                             gboolean hard_cut) {
+  GstProjectMPrivate *priv = plugin->priv;
+  guint count = gst_projectm_archive_get_n_presets(priv->preset_archive);
+
+  if (count == 0) {
+    return;
+  }
+
+  if (plugin->shuffle_presets) {
+    priv->archive_position = g_random_int_range(0, (gint32)count);
+  } else {
+    priv->archive_position = (priv->archive_position + 1) % (gint)count;
+  }
+
+  const gchar *name = gst_projectm_archive_get_preset(
+      priv->preset_archive, (guint)priv->archive_position);
+
+  if (priv->texture_cache != NULL) {
+    gst_projectm_texture_cache_use(priv->texture_cache, name,
+                                   priv->preset_archive);
+    if (!plugin->shuffle_presets) {
+      gst_projectm_texture_cache_prefetch(
+          priv->texture_cache,
+          gst_projectm_archive_get_preset(
+              priv->preset_archive,
+              (guint)(priv->archive_position + 1) % count),
+          priv->preset_archive);
+    }
+  }
+
+  gst_projectm_load_archive_preset(plugin, handle, name, !hard_cut);
+}
+
+static void gst_projectm_archive_switch_requested(bool is_hard_cut,
+                                                  void *user_data) {
+  GstProjectM *plugin = GST_PROJECTM(user_data);
+
+  gst_projectm_play_archive_preset(plugin, plugin->priv->handle, is_hard_cut);
+}
+
+GstProjectMArchive *gst_projectm_get_preset_archive(GstProjectM *plugin) {
+  return plugin != NULL ? plugin->priv->preset_archive : NULL;
+}
+
+void gst_projectm_get_mesh_size(GstProjectM *plugin, gulong *width,
+                                gulong *height) {
+  *width = plugin->mesh_width;
+  *height = plugin->mesh_height;
+
+  if (plugin->priv->cpu_profile && !plugin->priv->mesh_size_set) {
+    gchar **parts = g_strsplit(DEFAULT_CPU_MESH_SIZE, ",", 2);
+    *width = atoi(parts[0]);
+    *height = atoi(parts[1]);
+    g_strfreev(parts);
+  }
+}
+
+gint gst_projectm_get_fps(GstProjectM *plugin) {
+  GstVideoInfo *vinfo = &GST_AUDIO_VISUALIZER(plugin)->vinfo;
+  gint fps_n = GST_VIDEO_INFO_FPS_N(vinfo);
+  gint fps_d = MAX(GST_VIDEO_INFO_FPS_D(vinfo), 1);
+
+  return MAX((fps_n + fps_d / 2) / fps_d, 1);
+}
+
+const gchar *gst_projectm_get_texture_search_path(GstProjectM *plugin) {
+  if (plugin->priv->texture_transcoder != NULL) {
+    return gst_projectm_texture_transcoder_get_dir(
+        plugin->priv->texture_transcoder);
+  }
+
+  if (plugin->priv->texture_archive_dir != NULL) {
+    return plugin->priv->texture_archive_dir;
+  }
+
+  return plugin->texture_dir_path;
+}
+
+void gst_projectm_start_archive_playlist(GstProjectM *plugin,
+                                         projectm_handle handle) {
+  GstProjectMPrivate *priv = plugin->priv;
+
+  priv->archive_playlist = TRUE;
+  priv->archive_position = -1;
+  projectm_set_preset_switch_requested_event_callback(
+      handle, gst_projectm_archive_switch_requested, plugin);
+
+  if (!plugin->preset_locked) {
+    gst_projectm_play_archive_preset(plugin, handle, TRUE);
+  }
+}
+
+/* Marks the timeline preset at index as used by the texture cache and
+ * queues the ones following it. */
+static void gst_projectm_prefetch_timeline_textures(GstProjectM *plugin,
+                                                    gint index) {
+  GstProjectMPrivate *priv = plugin->priv;
+
+  if (priv->texture_cache == NULL) {
+    return;
+  }
+
+  for (gint i = index; i <= index + GST_PROJECTM_TEXTURE_LOOKAHEAD &&
+                       i < (gint)priv->timeline_entries->len;
+       i++) {
+    GstProjectMTimelineEntry *entry =
+        g_ptr_array_index(priv->timeline_entries, (guint)i);
+    GstProjectMArchive *archive =
+        priv->preset_archive != NULL && !g_path_is_absolute(entry->preset)
+            ? priv->preset_archive
+            : NULL;
+    gchar *preset = archive != NULL
+                        ? g_strdup(entry->preset)
+                        : gst_projectm_resolve_preset_path(plugin->preset_path,
+                                                           entry->preset);
+
+    if (preset == NULL) {
+      continue;
+    }
+
+    if (i == index) {
+      gst_projectm_texture_cache_use(priv->texture_cache, preset, archive);
+    } else {
+      gst_projectm_texture_cache_prefetch(priv->texture_cache, preset,
+                                          archive);
+    }
+    g_free(preset);
+  }
+}
+
+/* Swaps the texture directory for a view with compressed textures, when
+ * the context can sample S3TC. projectM uploads .dds files as they are, so
+ * a context without it would only pay for decompressing them. */
+static void gst_projectm_start_texture_transcoder(GstProjectM *plugin,
+                                                  GstGLContext *context) {
+  const gchar *texture_dir = gst_projectm_get_texture_search_path(plugin);
+  GError *error = NULL;
+
+  if (!plugin->compress_textures || texture_dir == NULL ||
+      plugin->priv->texture_transcoder != NULL) {
+    return;
+  }
+
+  if (!gst_gl_context_check_feature(context,
+                                    "GL_EXT_texture_compression_s3tc")) {
+    GST_INFO_OBJECT(plugin, "Context lacks S3TC, using uncompressed textures");
+    return;
+  }
+
+  plugin->priv->texture_transcoder =
+      gst_projectm_texture_transcoder_new(texture_dir, &error);
+  if (plugin->priv->texture_transcoder == NULL) {
+    GST_WARNING_OBJECT(plugin, "Unable to use compressed textures: %s",
+                       error->message);
+    g_clear_error(&error);
+  }
+}
+
+/* Starts texture prefetching when a budget is set and there is a texture
+ * directory to read from. */
+static void gst_projectm_start_texture_cache(GstProjectM *plugin) {
+  const gchar *texture_dir = gst_projectm_get_texture_search_path(plugin);
+
+  if (plugin->texture_prefetch_budget == 0 || texture_dir == NULL ||
+      plugin->priv->texture_cache != NULL) {
+    return;
+  }
+
+  GstProjectMTextureCache *cache = gst_projectm_texture_cache_new(
+      texture_dir, (guint64)plugin->texture_prefetch_budget * 1024 * 1024,
+      GST_PROJECTM_TEXTURE_THREADS);
+
+  GST_OBJECT_LOCK(plugin);
+  plugin->priv->texture_cache = cache;
+  GST_OBJECT_UNLOCK(plugin);
+  GST_INFO_OBJECT(plugin, "Prefetching textures from %s, budget %u MiB",
+                  texture_dir, plugin->texture_prefetch_budget);
+}
+
+/* Opens preset and texture-dir when they name archives. Failures are
+ * logged and leave the path to projectM, which reports it as missing. */
+static void gst_projectm_open_archives(GstProjectM *plugin) {
+  GstProjectMPrivate *priv = plugin->priv;
+  GError *error = NULL;
+
+  if (priv->preset_archive == NULL &&
+      gst_projectm_archive_is_archive(plugin->preset_path)) {
+    priv->preset_archive =
+        gst_projectm_archive_open(plugin->preset_path, &error);
+    if (priv->preset_archive == NULL) {
+      GST_WARNING_OBJECT(plugin, "Unable to open preset archive: %s",
+                         error->message);
+      g_clear_error(&error);
+    } else {
+      GST_INFO_OBJECT(plugin, "Using preset archive %s with %u presets",
+                      plugin->preset_path,
+                      gst_projectm_archive_get_n_presets(priv->preset_archive));
+    }
+  }
+
+  if (priv->texture_archive == NULL &&
+      gst_projectm_archive_is_archive(plugin->texture_dir_path)) {
+    priv->texture_archive =
+        gst_projectm_archive_open(plugin->texture_dir_path, &error);
+    if (priv->texture_archive != NULL) {
+      priv->texture_archive_dir =
+          gst_projectm_archive_extract(priv->texture_archive, &error);
+    }
+    if (priv->texture_archive_dir == NULL) {
+      GST_WARNING_OBJECT(plugin, "Unable to use texture archive: %s",
+                         error->message);
+      g_clear_error(&error);
+      g_clear_pointer(&priv->texture_archive, gst_projectm_archive_unref);
+    }
+  }
+}
+
 void gst_projectm_set_property(GObject *object, guint property_id,
                                const GValue *value, GParamSpec *pspec) {
   GstProjectM *plugin = GST_PROJECTM(object);
@@ -979,10 +1983,12 @@ void gst_projectm_set_property(GObject *object, guint property_id,
 
   switch (property_id) {
   case PROP_PRESET_PATH:
-    plugin->preset_path = g_strdup(g_value_get_string(value));
+    g_free(plugin->preset_path);
+    plugin->preset_path = g_value_dup_string(value);
     break;
   case PROP_TEXTURE_DIR_PATH:
-    plugin->texture_dir_path = g_strdup(g_value_get_string(value));
+    g_free(plugin->texture_dir_path);
+    plugin->texture_dir_path = g_value_dup_string(value);
     break;
   case PROP_BEAT_SENSITIVITY:
     plugin->beat_sensitivity = g_value_get_float(value);
@@ -1014,6 +2020,7 @@ void gst_projectm_set_property(GObject *object, guint property_id,
 
       plugin->mesh_width = width;
       plugin->mesh_height = height;
+      plugin->priv->mesh_size_set = TRUE;
 
       g_strfreev(parts);
     }
@@ -1035,24 +2042,13 @@ void gst_projectm_set_property(GObject *object, guint property_id,
       new_path = NULL;
     }
 
+    /* Activating a timeline loads a preset, which compiles shaders, so it
+     * is left to the GL thread. */
+    GST_OBJECT_LOCK(plugin);
     g_free(plugin->timeline_path);
     plugin->timeline_path = new_path;
-
-    if (gst_projectm_load_timeline(plugin, plugin->timeline_path)) {
-      if (plugin->priv->handle != NULL) {
-        gst_projectm_activate_timeline(plugin);
-      }
-      GST_INFO_OBJECT(plugin, "Loaded timeline from %s with %u segments",
-                      plugin->timeline_path,
-                      plugin->priv->timeline_entries
-                          ? plugin->priv->timeline_entries->len
-                          : 0);
-    } else if (plugin->timeline_path != NULL) {
-      GST_WARNING_OBJECT(plugin,
-                         "Failed to load timeline from %s, falling back to "
-                         "internal preset selection",
-                         plugin->timeline_path);
-    }
+    GST_OBJECT_UNLOCK(plugin);
+    g_atomic_int_set(&plugin->priv->timeline_pending, TRUE);
     break;
   }
   case PROP_ENABLE_PLAYLIST:
@@ -1061,6 +2057,59 @@ void gst_projectm_set_property(GObject *object, guint property_id,
   case PROP_SHUFFLE_PRESETS:
     plugin->shuffle_presets = g_value_get_boolean(value);
     break;
+  case PROP_READBACK_MODE:
+    plugin->readback_mode = g_value_get_enum(value);
+    break;
+  case PROP_VERTICAL_FLIP:
+    plugin->vertical_flip = g_value_get_boolean(value);
+    break;
+  case PROP_COPY_THREADS:
+    plugin->copy_threads = g_value_get_uint(value);
+    break;
+  case PROP_RENDER_RATE:
+    plugin->render_rate_n = gst_value_get_fraction_numerator(value);
+    plugin->render_rate_d = gst_value_get_fraction_denominator(value);
+    break;
+  case PROP_KEYFRAME_INTERVAL:
+    plugin->keyframe_interval = g_value_get_uint64(value);
+    break;
+  case PROP_KEYFRAME_TIMESTAMPS: {
+    const gchar *timestamps = g_value_get_string(value);
+    GArray *times = gst_projectm_parse_keyframe_timestamps(plugin, timestamps);
+
+    GST_OBJECT_LOCK(plugin);
+    g_free(plugin->keyframe_timestamps);
+    plugin->keyframe_timestamps =
+        times != NULL ? g_strdup(timestamps) : NULL;
+    g_clear_pointer(&plugin->priv->keyframe_times, g_array_unref);
+    plugin->priv->keyframe_times = times;
+    GST_OBJECT_UNLOCK(plugin);
+  } break;
+  case PROP_KEYFRAME_WARMUP:
+    plugin->keyframe_warmup = g_value_get_uint(value);
+    break;
+  case PROP_PRESET_INDEX:
+    g_free(plugin->preset_index_path);
+    plugin->preset_index_path = g_value_dup_string(value);
+    break;
+  case PROP_TEXTURE_PREFETCH_BUDGET:
+    plugin->texture_prefetch_budget = g_value_get_uint(value);
+    break;
+  case PROP_COMPRESS_TEXTURES:
+    plugin->compress_textures = g_value_get_boolean(value);
+    break;
+  case PROP_RENDER_PROFILE:
+    plugin->render_profile = g_value_get_enum(value);
+    break;
+  case PROP_CPU_THREADS:
+    plugin->cpu_threads = g_value_get_uint(value);
+    break;
+  case PROP_ANALYSIS_WINDOW:
+    plugin->analysis_window = g_value_get_uint(value);
+    break;
+  case PROP_ANALYSIS_HOP:
+    plugin->analysis_hop = g_value_get_uint(value);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
     break;
@@ -1116,7 +2165,9 @@ void gst_projectm_get_property(GObject *object, guint property_id,
     g_value_set_boolean(value, plugin->preset_locked);
     break;
   case PROP_TIMELINE_PATH:
+    GST_OBJECT_LOCK(plugin);
     g_value_set_string(value, plugin->timeline_path);
+    GST_OBJECT_UNLOCK(plugin);
     break;
   case PROP_ENABLE_PLAYLIST:
     g_value_set_boolean(value, plugin->enable_playlist);
@@ -1124,87 +2175,563 @@ void gst_projectm_get_property(GObject *object, guint property_id,
   case PROP_SHUFFLE_PRESETS:
     g_value_set_boolean(value, plugin->shuffle_presets);
     break;
+  case PROP_READBACK_MODE:
+    g_value_set_enum(value, plugin->readback_mode);
+    break;
+  case PROP_VERTICAL_FLIP:
+    g_value_set_boolean(value, plugin->vertical_flip);
+    break;
+  case PROP_COPY_THREADS:
+    g_value_set_uint(value, plugin->copy_threads);
+    break;
+  case PROP_RENDER_RATE:
+    gst_value_set_fraction(value, plugin->render_rate_n, plugin->render_rate_d);
+    break;
+  case PROP_KEYFRAME_INTERVAL:
+    g_value_set_uint64(value, plugin->keyframe_interval);
+    break;
+  case PROP_KEYFRAME_TIMESTAMPS:
+    GST_OBJECT_LOCK(plugin);
+    g_value_set_string(value, plugin->keyframe_timestamps);
+    GST_OBJECT_UNLOCK(plugin);
+    break;
+  case PROP_KEYFRAME_WARMUP:
+    g_value_set_uint(value, plugin->keyframe_warmup);
+    break;
+  case PROP_PRESET_INDEX:
+    g_value_set_string(value, plugin->preset_index_path);
+    break;
+  case PROP_TEXTURE_PREFETCH_BUDGET:
+    g_value_set_uint(value, plugin->texture_prefetch_budget);
+    break;
+  case PROP_COMPRESS_TEXTURES:
+    g_value_set_boolean(value, plugin->compress_textures);
+    break;
+  case PROP_RENDER_PROFILE:
+    g_value_set_enum(value, plugin->render_profile);
+    break;
+  case PROP_CPU_THREADS:
+    g_value_set_uint(value, plugin->cpu_threads);
+    break;
+  case PROP_ANALYSIS_WINDOW:
+    g_value_set_uint(value, plugin->analysis_window);
+    break;
+  case PROP_ANALYSIS_HOP:
+    g_value_set_uint(value, plugin->analysis_hop);
+    break;
+  case PROP_STATS: {
+    GstStructure *stats =
+        gst_projectm_stats_to_structure(&plugin->priv->stats);
+
+    gst_structure_set(stats, "qos-analyzed-frames", G_TYPE_UINT64,
+                      (guint64)g_atomic_int_get(&plugin->priv->analyzed_frames),
+                      NULL);
+
+    GST_OBJECT_LOCK(plugin);
+    if (plugin->priv->texture_cache != NULL) {
+      gst_projectm_texture_cache_add_stats(plugin->priv->texture_cache, stats);
+    }
+    GST_OBJECT_UNLOCK(plugin);
+    g_value_take_boxed(value, stats);
+  } break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
     break;
   }
 }
 
-static void gst_projectm_init(GstProjectM *plugin) {
-  plugin->priv = gst_projectm_get_instance_private(plugin);
+static void gst_projectm_init(GstProjectM *plugin) {
+  plugin->priv = gst_projectm_get_instance_private(plugin);
+
+  plugin->priv->timeline_entries = gst_projectm_timeline_entries_new();
+  plugin->priv->current_timeline_index = -1;
+  plugin->priv->timeline_active = FALSE;
+  plugin->priv->timeline_initialized = FALSE;
+  plugin->priv->first_frame_received = FALSE;
+  plugin->priv->first_frame_time = GST_CLOCK_TIME_NONE;
+  plugin->priv->first_audio_received = FALSE;
+  plugin->priv->first_audio_time = GST_CLOCK_TIME_NONE;
+  plugin->priv->render_frame_count = 0;
+
+  // Set default values for properties
+  plugin->preset_path = DEFAULT_PRESET_PATH;
+  plugin->texture_dir_path = DEFAULT_TEXTURE_DIR_PATH;
+  plugin->timeline_path = DEFAULT_TIMELINE_PATH;
+  plugin->beat_sensitivity = DEFAULT_BEAT_SENSITIVITY;
+  plugin->hard_cut_duration = DEFAULT_HARD_CUT_DURATION;
+  plugin->hard_cut_enabled = DEFAULT_HARD_CUT_ENABLED;
+  plugin->hard_cut_sensitivity = DEFAULT_HARD_CUT_SENSITIVITY;
+  plugin->soft_cut_duration = DEFAULT_SOFT_CUT_DURATION;
+  plugin->preset_duration = DEFAULT_PRESET_DURATION;
+  plugin->enable_playlist = DEFAULT_ENABLE_PLAYLIST;
+  plugin->shuffle_presets = DEFAULT_SHUFFLE_PRESETS;
+  plugin->readback_mode = DEFAULT_READBACK_MODE;
+  plugin->vertical_flip = DEFAULT_VERTICAL_FLIP;
+  plugin->copy_threads = DEFAULT_COPY_THREADS;
+  plugin->render_rate_n = DEFAULT_RENDER_RATE_N;
+  plugin->render_rate_d = DEFAULT_RENDER_RATE_D;
+  plugin->keyframe_interval = DEFAULT_KEYFRAME_INTERVAL;
+  plugin->keyframe_timestamps = DEFAULT_KEYFRAME_TIMESTAMPS;
+  plugin->keyframe_warmup = DEFAULT_KEYFRAME_WARMUP;
+  plugin->preset_index_path = DEFAULT_PRESET_INDEX_PATH;
+  plugin->texture_prefetch_budget = DEFAULT_TEXTURE_PREFETCH_BUDGET;
+  plugin->compress_textures = DEFAULT_COMPRESS_TEXTURES;
+  plugin->render_profile = DEFAULT_RENDER_PROFILE;
+  plugin->cpu_threads = DEFAULT_CPU_THREADS;
+  plugin->analysis_window = DEFAULT_ANALYSIS_WINDOW;
+  plugin->analysis_hop = DEFAULT_ANALYSIS_HOP;
+
+  const gchar *meshSizeStr = DEFAULT_MESH_SIZE;
+  gint width, height;
+
+  gchar **parts = g_strsplit(meshSizeStr, ",", 2);
+
+  if (parts && g_strv_length(parts) == 2) {
+    width = atoi(parts[0]);
+    height = atoi(parts[1]);
+
+    plugin->mesh_width = width;
+    plugin->mesh_height = height;
+
+    g_strfreev(parts);
+  }
+
+  plugin->aspect_correction = DEFAULT_ASPECT_CORRECTION;
+  plugin->easter_egg = DEFAULT_EASTER_EGG;
+  plugin->preset_locked = DEFAULT_PRESET_LOCKED;
+  plugin->priv->handle = NULL;
+  plugin->priv->playlist = NULL;
+  plugin->priv->reset_pending = FALSE;
+  plugin->priv->timeline_pending = FALSE;
+  plugin->priv->pcm_ring = NULL;
+  plugin->priv->pcm_end = 0;
+  plugin->priv->pcm_window = NULL;
+  plugin->priv->reconfigure_pending = FALSE;
+  plugin->priv->state_dirty = FALSE;
+  memset(plugin->priv->pbo_ids, 0, sizeof(plugin->priv->pbo_ids));
+  plugin->priv->pbo_initialized = FALSE;
+  plugin->priv->pbo_frame_valid = FALSE;
+  plugin->priv->pbo_size = 0;
+  plugin->priv->pbo_width = 0;
+  plugin->priv->pbo_height = 0;
+  plugin->priv->pbo_index = 0;
+  plugin->priv->fbo_id = 0;
+  plugin->priv->fbo_texture_id = 0;
+  plugin->priv->fbo_depth_buffer_id = 0;
+  plugin->priv->fbo_width = 0;
+  plugin->priv->fbo_height = 0;
+  plugin->priv->fbo_initialized = FALSE;
+  plugin->priv->fbo_warned_missing_support = FALSE;
+  plugin->priv->headless_mode = FALSE;
+  plugin->priv->headless_checked = FALSE;
+  plugin->priv->cpu_profile = FALSE;
+  plugin->priv->mesh_size_set = FALSE;
+  plugin->priv->read_format = GL_RGBA;
+  plugin->priv->gles = FALSE;
+  plugin->priv->gles3 = FALSE;
+  plugin->priv->staging = NULL;
+  plugin->priv->staging_size = 0;
+  plugin->priv->copy_us = 0;
+  plugin->priv->gpu_memory_query = GST_PROJECTM_GPU_MEMORY_QUERY_NONE;
+  plugin->priv->render_rate_acc = 0;
+  plugin->priv->last_rendered_fbo = 0;
+  plugin->priv->keyframe_times = NULL;
+  plugin->priv->dmabuf_supported = FALSE;
+  plugin->priv->dmabuf_output = FALSE;
+  plugin->priv->shader_overridden = FALSE;
+  plugin->priv->saved_shader = GST_AUDIO_VISUALIZER_SHADER_NONE;
+  plugin->priv->nv12_converter = NULL;
+  plugin->priv->preset_archive = NULL;
+  plugin->priv->texture_archive = NULL;
+  plugin->priv->texture_archive_dir = NULL;
+  plugin->priv->archive_playlist = FALSE;
+  plugin->priv->archive_position = -1;
+  plugin->priv->texture_cache = NULL;
+  plugin->priv->texture_transcoder = NULL;
+  plugin->priv->analyzed_frames = 0;
+  gst_projectm_stats_init(&plugin->priv->stats);
+
+  GstPad *srcpad = gst_element_get_static_pad(GST_ELEMENT(plugin), "src");
+  gst_pad_add_probe(srcpad,
+                    GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM |
+                        GST_PAD_PROBE_TYPE_PULL,
+                    gst_projectm_src_caps_query_probe, plugin, NULL);
+  gst_pad_add_probe(srcpad, GST_PAD_PROBE_TYPE_BUFFER,
+                    gst_projectm_src_skip_probe, plugin, NULL);
+  gst_object_unref(srcpad);
+
+  GstPad *sinkpad = gst_element_get_static_pad(GST_ELEMENT(plugin), "sink");
+  gst_pad_add_probe(sinkpad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                    gst_projectm_sink_event_probe, plugin, NULL);
+  plugin->priv->audio_srcpad = NULL;
+  plugin->priv->parent_chain = GST_PAD_CHAINFUNC(sinkpad);
+  gst_pad_set_chain_function(sinkpad,
+                             GST_DEBUG_FUNCPTR(gst_projectm_sink_chain));
+  gst_object_unref(sinkpad);
+}
+
+static void gst_projectm_finalize(GObject *object) {
+  GstProjectM *plugin = GST_PROJECTM(object);
+  g_free(plugin->preset_path);
+  g_free(plugin->texture_dir_path);
+  g_free(plugin->timeline_path);
+  g_free(plugin->keyframe_timestamps);
+  g_free(plugin->preset_index_path);
+  g_clear_pointer(&plugin->priv->keyframe_times, g_array_unref);
+
+  if (plugin->priv->timeline_entries != NULL) {
+    g_ptr_array_free(plugin->priv->timeline_entries, TRUE);
+    plugin->priv->timeline_entries = NULL;
+  }
+
+  g_clear_pointer(&plugin->priv->copy_pool, gst_projectm_frame_copy_pool_free);
+  gst_projectm_stats_clear(&plugin->priv->stats);
+  G_OBJECT_CLASS(gst_projectm_parent_class)->finalize(object);
+}
+
+/* Forgets everything tied to the stream that just stopped, so the element
+ * can go back to PAUSED on a new input without recreating projectM: time
+ * is measured from the next stream's first buffer and the timeline starts
+ * over. The readback ring would otherwise hand out the old stream's last
+ * frame first. */
+static void gst_projectm_reset_stream(GstProjectM *plugin) {
+  GstProjectMPrivate *priv = plugin->priv;
+
+  priv->first_frame_received = FALSE;
+  priv->first_frame_time = GST_CLOCK_TIME_NONE;
+  priv->first_audio_received = FALSE;
+  priv->first_audio_time = GST_CLOCK_TIME_NONE;
+  priv->render_frame_count = 0;
+  priv->render_rate_acc = 0;
+  priv->last_rendered_fbo = 0;
+  priv->pbo_frame_valid = FALSE;
+  priv->current_timeline_index = -1;
+  priv->pcm_end = 0;
+  if (priv->pcm_ring != NULL) {
+    gst_projectm_pcm_ring_clear(priv->pcm_ring);
+  }
+}
+
+/* Asks the GL thread to reset projectM before its next render. Safe to call
+ * from any thread; also the class handler of the "reset" action signal. */
+static void gst_projectm_request_reset(GstProjectM *plugin) {
+  GST_DEBUG_OBJECT(plugin, "projectM reset requested");
+  g_atomic_int_set(&plugin->priv->reset_pending, TRUE);
+}
+
+static void gst_projectm_restart_presets(GstProjectM *plugin) {
+  GstProjectMPrivate *priv = plugin->priv;
+
+  if (gst_projectm_timeline_is_active(plugin)) {
+    gst_projectm_load_first_timeline_preset(plugin, priv->handle);
+  } else if (priv->archive_playlist && !plugin->preset_locked &&
+             gst_projectm_archive_get_n_presets(priv->preset_archive) > 0) {
+    priv->archive_position = -1;
+    gst_projectm_play_archive_preset(plugin, priv->handle, TRUE);
+  } else if (priv->playlist != NULL &&
+             projectm_playlist_size(priv->playlist) >= 1 &&
+             !plugin->preset_locked) {
+    if (plugin->shuffle_presets) {
+      projectm_playlist_play_next(priv->playlist, true);
+    } else {
+      projectm_playlist_set_position(priv->playlist, 0, true);
+    }
+  } else {
+    projectm_load_preset_file(priv->handle, "idle://", false);
+  }
+}
+
+/* Applies renegotiated caps to the running projectM instance instead of
+ * recreating it, so presets, textures and the PCM history carry over. The
+ * render target and readback ring follow the window size on the next
+ * render. Must be called on the GL thread. */
+static void gst_projectm_reconfigure(GstProjectM *plugin) {
+  GstAudioVisualizer *scope = GST_AUDIO_VISUALIZER(plugin);
+  GstProjectMPrivate *priv = plugin->priv;
+  size_t width = GST_VIDEO_INFO_WIDTH(&scope->vinfo);
+  size_t height = GST_VIDEO_INFO_HEIGHT(&scope->vinfo);
+  size_t old_width, old_height;
+
+  if (priv->handle == NULL) {
+    return;
+  }
+
+  projectm_get_window_size(priv->handle, &old_width, &old_height);
+  projectm_set_fps(priv->handle, gst_projectm_get_fps(plugin));
+
+  if (width != old_width || height != old_height) {
+    projectm_set_window_size(priv->handle, width, height);
+    /* The last render and any frame still in the ring have the old size. */
+    priv->last_rendered_fbo = 0;
+    priv->pbo_frame_valid = FALSE;
+  }
+
+  GST_INFO_OBJECT(plugin,
+                  "Reconfigured projectM from %zux%zu to %zux%zu at %d/%d fps",
+                  old_width, old_height, width, height,
+                  GST_VIDEO_INFO_FPS_N(&scope->vinfo),
+                  GST_VIDEO_INFO_FPS_D(&scope->vinfo));
+}
+
+/* Brings the projectM instance back to the state of a fresh one without
+ * destroying it, keeping its playlist, textures and compiled shaders: the
+ * PCM history is overwritten with silence and the starting preset is
+ * reloaded with a hard cut. Must be called on the GL thread. */
+static void gst_projectm_reset_state(GstProjectM *plugin) {
+  GstProjectMPrivate *priv = plugin->priv;
+
+  /* Nothing has been rendered since projectM was created or last reset. */
+  if (priv->handle == NULL || !priv->state_dirty) {
+    return;
+  }
+
+  gst_projectm_reset_stream(plugin);
+
+  gint64 start = g_get_monotonic_time();
+  guint samples = projectm_pcm_get_max_samples();
+  gfloat *silence = g_new0(gfloat, samples * 2);
+
+  projectm_pcm_add_float(priv->handle, silence, samples, PROJECTM_STEREO);
+  g_free(silence);
+
+  projectm_set_frame_time(priv->handle, 0.0);
+  gst_projectm_restart_presets(plugin);
+  priv->state_dirty = FALSE;
+
+  GST_INFO_OBJECT(plugin, "Reset projectM state in %" G_GINT64_FORMAT " us",
+                  g_get_monotonic_time() - start);
+}
+
+static GstPad *gst_projectm_get_audio_srcpad(GstProjectM *plugin) {
+  GstPad *pad;
+
+  GST_OBJECT_LOCK(plugin);
+  pad = plugin->priv->audio_srcpad != NULL
+            ? gst_object_ref(plugin->priv->audio_srcpad)
+            : NULL;
+  GST_OBJECT_UNLOCK(plugin);
+
+  return pad;
+}
+
+/* The audio stream gets its own stream id; other events apply as they
+ * are. */
+static GstEvent *gst_projectm_audio_src_event_for(GstPad *audio_srcpad,
+                                                  GstEvent *event) {
+  if (GST_EVENT_TYPE(event) == GST_EVENT_STREAM_START) {
+    GstElement *element = GST_ELEMENT(gst_pad_get_parent(audio_srcpad));
+    gchar *stream_id =
+        gst_pad_create_stream_id(audio_srcpad, element, "audio");
+    GstEvent *stream_start = gst_event_new_stream_start(stream_id);
+    guint group_id;
+
+    if (gst_event_parse_group_id(event, &group_id)) {
+      gst_event_set_group_id(stream_start, group_id);
+    }
+    g_free(stream_id);
+    gst_object_unref(element);
+    return stream_start;
+  }
+
+  return gst_event_ref(event);
+}
+
+static GstPadProbeReturn gst_projectm_sink_event_probe(GstPad *pad,
+                                                       GstPadProbeInfo *info,
+                                                       gpointer user_data) {
+  GstProjectM *plugin = GST_PROJECTM(user_data);
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+
+  switch (GST_EVENT_TYPE(event)) {
+  case GST_EVENT_STREAM_START:
+  case GST_EVENT_EOS:
+    gst_projectm_request_reset(plugin);
+    break;
+  default:
+    break;
+  }
+
+  GstPad *audio_srcpad = gst_projectm_get_audio_srcpad(plugin);
+  if (audio_srcpad != NULL) {
+    gst_pad_push_event(audio_srcpad,
+                       gst_projectm_audio_src_event_for(audio_srcpad, event));
+    gst_object_unref(audio_srcpad);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstFlowReturn gst_projectm_sink_chain(GstPad *pad, GstObject *parent,
+                                             GstBuffer *buffer) {
+  GstProjectM *plugin = GST_PROJECTM(parent);
+  GstPad *audio_srcpad = gst_projectm_get_audio_srcpad(plugin);
+  GstBuffer *audio = audio_srcpad != NULL ? gst_buffer_ref(buffer) : NULL;
+  GstFlowReturn ret = plugin->priv->parent_chain(pad, parent, buffer);
+
+  if (audio_srcpad != NULL) {
+    GstFlowReturn audio_ret = gst_pad_push(audio_srcpad, audio);
+
+    /* An unlinked audio branch does not stop the video. */
+    if (ret == GST_FLOW_OK && audio_ret != GST_FLOW_OK &&
+        audio_ret != GST_FLOW_NOT_LINKED) {
+      ret = audio_ret;
+    }
+    gst_object_unref(audio_srcpad);
+  }
+
+  return ret;
+}
+
+static gboolean gst_projectm_audio_src_query(GstPad *pad, GstObject *parent,
+                                             GstQuery *query) {
+  if (GST_QUERY_TYPE(query) == GST_QUERY_CAPS) {
+    GstPad *sinkpad = gst_element_get_static_pad(GST_ELEMENT(parent), "sink");
+    GstCaps *caps = gst_pad_get_current_caps(sinkpad);
+    GstCaps *filter;
+
+    if (caps == NULL) {
+      caps = gst_pad_get_pad_template_caps(pad);
+    }
+    gst_query_parse_caps(query, &filter);
+    if (filter != NULL) {
+      GstCaps *intersection =
+          gst_caps_intersect_full(filter, caps, GST_CAPS_INTERSECT_FIRST);
+
+      gst_caps_unref(caps);
+      caps = intersection;
+    }
+    gst_query_set_caps_result(query, caps);
+    gst_caps_unref(caps);
+    gst_object_unref(sinkpad);
+    return TRUE;
+  }
+
+  return gst_pad_query_default(pad, parent, query);
+}
+
+/* Seeks and other upstream events go to the shared input; QoS and
+ * reconfiguration concern the video side only. */
+static gboolean gst_projectm_audio_src_event(GstPad *pad, GstObject *parent,
+                                             GstEvent *event) {
+  switch (GST_EVENT_TYPE(event)) {
+  case GST_EVENT_QOS:
+  case GST_EVENT_RECONFIGURE:
+  case GST_EVENT_NAVIGATION:
+    gst_event_unref(event);
+    return TRUE;
+  default: {
+    GstPad *sinkpad = gst_element_get_static_pad(GST_ELEMENT(parent), "sink");
+    gboolean ret = gst_pad_push_event(sinkpad, event);
+
+    gst_object_unref(sinkpad);
+    return ret;
+  }
+  }
+}
+
+static gboolean gst_projectm_copy_sticky_event(GstPad *pad, GstEvent **event,
+                                               gpointer user_data) {
+  GstPad *audio_srcpad = GST_PAD(user_data);
+  GstEvent *copy = gst_projectm_audio_src_event_for(audio_srcpad, *event);
 
-  plugin->priv->timeline_entries =
-      g_ptr_array_new_with_free_func(gst_projectm_timeline_entry_free);
-  plugin->priv->current_timeline_index = -1;
-  plugin->priv->timeline_active = FALSE;
-  plugin->priv->timeline_initialized = FALSE;
-  plugin->priv->first_frame_received = FALSE;
-  plugin->priv->first_frame_time = GST_CLOCK_TIME_NONE;
-  plugin->priv->first_audio_received = FALSE;
-  plugin->priv->first_audio_time = GST_CLOCK_TIME_NONE;
-  plugin->priv->render_frame_count = 0;
+  gst_pad_store_sticky_event(audio_srcpad, copy);
+  gst_event_unref(copy);
+  return TRUE;
+}
 
-  // Set default values for properties
-  plugin->preset_path = DEFAULT_PRESET_PATH;
-  plugin->texture_dir_path = DEFAULT_TEXTURE_DIR_PATH;
-  plugin->timeline_path = DEFAULT_TIMELINE_PATH;
-  plugin->beat_sensitivity = DEFAULT_BEAT_SENSITIVITY;
-  plugin->hard_cut_duration = DEFAULT_HARD_CUT_DURATION;
-  plugin->hard_cut_enabled = DEFAULT_HARD_CUT_ENABLED;
-  plugin->hard_cut_sensitivity = DEFAULT_HARD_CUT_SENSITIVITY;
-  plugin->soft_cut_duration = DEFAULT_SOFT_CUT_DURATION;
-  plugin->preset_duration = DEFAULT_PRESET_DURATION;
-  plugin->enable_playlist = DEFAULT_ENABLE_PLAYLIST;
-  plugin->shuffle_presets = DEFAULT_SHUFFLE_PRESETS;
+static GstPad *gst_projectm_request_new_pad(GstElement *element,
+                                            GstPadTemplate *templ,
+                                            const gchar *name,
+                                            const GstCaps *caps) {
+  GstProjectM *plugin = GST_PROJECTM(element);
+  GstPad *pad = gst_pad_new_from_template(templ, "audio_src");
+
+  gst_pad_set_query_function(pad,
+                             GST_DEBUG_FUNCPTR(gst_projectm_audio_src_query));
+  gst_pad_set_event_function(pad,
+                             GST_DEBUG_FUNCPTR(gst_projectm_audio_src_event));
+
+  GST_OBJECT_LOCK(plugin);
+  if (plugin->priv->audio_srcpad != NULL) {
+    GST_OBJECT_UNLOCK(plugin);
+    GST_WARNING_OBJECT(plugin, "audio_src pad already requested");
+    gst_object_unref(pad);
+    return NULL;
+  }
+  plugin->priv->audio_srcpad = pad;
+  GST_OBJECT_UNLOCK(plugin);
 
-  const gchar *meshSizeStr = DEFAULT_MESH_SIZE;
-  gint width, height;
+  gst_element_add_pad(element, pad);
 
-  gchar **parts = g_strsplit(meshSizeStr, ",", 2);
+  /* Requested mid-stream: replay stream-start, caps and segment. */
+  GstPad *sinkpad = gst_element_get_static_pad(element, "sink");
+  gst_pad_sticky_events_foreach(sinkpad, gst_projectm_copy_sticky_event, pad);
+  gst_object_unref(sinkpad);
 
-  if (parts && g_strv_length(parts) == 2) {
-    width = atoi(parts[0]);
-    height = atoi(parts[1]);
+  GST_DEBUG_OBJECT(plugin, "Forwarding audio on %" GST_PTR_FORMAT, pad);
+  return pad;
+}
 
-    plugin->mesh_width = width;
-    plugin->mesh_height = height;
+static void gst_projectm_release_pad(GstElement *element, GstPad *pad) {
+  GstProjectM *plugin = GST_PROJECTM(element);
 
-    g_strfreev(parts);
+  GST_OBJECT_LOCK(plugin);
+  if (plugin->priv->audio_srcpad == pad) {
+    plugin->priv->audio_srcpad = NULL;
   }
+  GST_OBJECT_UNLOCK(plugin);
 
-  plugin->aspect_correction = DEFAULT_ASPECT_CORRECTION;
-  plugin->easter_egg = DEFAULT_EASTER_EGG;
-  plugin->preset_locked = DEFAULT_PRESET_LOCKED;
-  plugin->priv->handle = NULL;
-  memset(plugin->priv->pbo_ids, 0, sizeof(plugin->priv->pbo_ids));
-  plugin->priv->pbo_initialized = FALSE;
-  plugin->priv->pbo_frame_valid = FALSE;
-  plugin->priv->pbo_size = 0;
-  plugin->priv->pbo_width = 0;
-  plugin->priv->pbo_height = 0;
-  plugin->priv->pbo_index = 0;
-  plugin->priv->fbo_id = 0;
-  plugin->priv->fbo_texture_id = 0;
-  plugin->priv->fbo_depth_buffer_id = 0;
-  plugin->priv->fbo_width = 0;
-  plugin->priv->fbo_height = 0;
-  plugin->priv->fbo_initialized = FALSE;
-  plugin->priv->fbo_warned_missing_support = FALSE;
-  plugin->priv->headless_mode = FALSE;
-  plugin->priv->headless_checked = FALSE;
+  gst_pad_set_active(pad, FALSE);
+  gst_element_remove_pad(element, pad);
 }
 
-static void gst_projectm_finalize(GObject *object) {
-  GstProjectM *plugin = GST_PROJECTM(object);
-  g_free(plugin->preset_path);
-  g_free(plugin->texture_dir_path);
-  g_free(plugin->timeline_path);
+/* llvmpipe reads LP_NUM_THREADS when it creates its screen, which happens
+ * with the first GL context of a display, so set it before the parent looks
+ * for a context. The environment is process-wide; an explicit setting wins. */
+static void gst_projectm_apply_cpu_threads(GstProjectM *plugin) {
+  if (plugin->cpu_threads == 0 ||
+      plugin->render_profile == GST_PROJECTM_RENDER_PROFILE_GPU) {
+    return;
+  }
 
-  if (plugin->priv->timeline_entries != NULL) {
-    g_ptr_array_free(plugin->priv->timeline_entries, TRUE);
-    plugin->priv->timeline_entries = NULL;
+  if (g_getenv("LP_NUM_THREADS") != NULL) {
+    GST_INFO_OBJECT(plugin, "LP_NUM_THREADS=%s is set, ignoring cpu-threads",
+                    g_getenv("LP_NUM_THREADS"));
+    return;
   }
-  G_OBJECT_CLASS(gst_projectm_parent_class)->finalize(object);
+
+  gchar *threads = g_strdup_printf("%u", plugin->cpu_threads);
+  g_setenv("LP_NUM_THREADS", threads, FALSE);
+  GST_INFO_OBJECT(plugin, "Set LP_NUM_THREADS=%s", threads);
+  g_free(threads);
+}
+
+static GstStateChangeReturn gst_projectm_change_state(GstElement *element,
+                                                      GstStateChange transition) {
+  GstProjectM *plugin = GST_PROJECTM(element);
+
+  if (transition == GST_STATE_CHANGE_NULL_TO_READY) {
+    gst_projectm_apply_cpu_threads(plugin);
+  }
+
+  GstStateChangeReturn ret =
+      GST_ELEMENT_CLASS(gst_projectm_parent_class)->change_state(element,
+                                                                 transition);
+
+  if (ret == GST_STATE_CHANGE_FAILURE) {
+    return ret;
+  }
+
+  switch (transition) {
+  case GST_STATE_CHANGE_PAUSED_TO_READY:
+    /* Streaming has stopped, so the GL thread no longer renders. */
+    gst_projectm_reset_stream(plugin);
+    break;
+  default:
+    break;
+  }
+
+  return ret;
 }
 
 static void gst_projectm_gl_stop(GstGLBaseAudioVisualizer *src) {
@@ -1212,20 +2739,49 @@ static void gst_projectm_gl_stop(GstGLBaseAudioVisualizer *src) {
   const GstGLFuncs *glFunctions =
       src->context ? src->context->gl_vtable : NULL;
 
+  g_clear_pointer(&plugin->priv->playlist, projectm_playlist_destroy);
+
   if (plugin->priv->handle) {
     GST_DEBUG_OBJECT(plugin, "Destroying ProjectM instance");
     projectm_destroy(plugin->priv->handle);
     plugin->priv->handle = NULL;
   }
 
+  g_clear_pointer(&plugin->priv->preset_archive, gst_projectm_archive_unref);
+  GST_OBJECT_LOCK(plugin);
+  GstProjectMTextureCache *texture_cache = plugin->priv->texture_cache;
+  plugin->priv->texture_cache = NULL;
+  GST_OBJECT_UNLOCK(plugin);
+  gst_projectm_texture_cache_free(texture_cache);
+  g_clear_pointer(&plugin->priv->texture_transcoder,
+                  gst_projectm_texture_transcoder_free);
+
+  g_clear_pointer(&plugin->priv->texture_archive, gst_projectm_archive_unref);
+  plugin->priv->texture_archive_dir = NULL;
+  plugin->priv->archive_playlist = FALSE;
+  plugin->priv->archive_position = -1;
+
   gst_projectm_release_pbos(plugin, glFunctions);
   gst_projectm_release_render_target(plugin, glFunctions);
+  g_clear_pointer(&plugin->priv->staging, g_free);
+  g_clear_pointer(&plugin->priv->pcm_ring, gst_projectm_pcm_ring_free);
+  g_clear_pointer(&plugin->priv->pcm_window, g_free);
+  plugin->priv->pcm_end = 0;
+  plugin->priv->staging_size = 0;
+  g_clear_pointer(&plugin->priv->nv12_converter,
+                  gst_projectm_nv12_converter_free);
+  plugin->priv->dmabuf_supported = FALSE;
+  plugin->priv->last_rendered_fbo = 0;
+  plugin->priv->render_rate_acc = 0;
   plugin->priv->current_timeline_index = -1;
   plugin->priv->timeline_initialized = FALSE;
   plugin->priv->first_frame_received = FALSE;
   plugin->priv->first_frame_time = GST_CLOCK_TIME_NONE;
+  plugin->priv->state_dirty = FALSE;
   plugin->priv->headless_checked = FALSE;
   plugin->priv->headless_mode = FALSE;
+  plugin->priv->cpu_profile = FALSE;
+  g_atomic_int_set(&plugin->priv->reconfigure_pending, FALSE);
 }
 
 static gboolean gst_projectm_gl_start(GstGLBaseAudioVisualizer *glav) {
@@ -1242,15 +2798,41 @@ static gboolean gst_projectm_gl_start(GstGLBaseAudioVisualizer *glav) {
   }
 #endif
 
+  gst_projectm_detect_gpu_memory_query(plugin, glav->context);
+  gst_projectm_detect_buffer_storage(plugin, glav->context);
+  plugin->priv->dmabuf_supported = gst_projectm_dmabuf_supported(glav->context);
+
+  plugin->priv->gles =
+      (gst_gl_context_get_gl_api(glav->context) & GST_GL_API_GLES2) != 0;
+  plugin->priv->gles3 =
+      plugin->priv->gles &&
+      gst_gl_context_check_gl_version(glav->context, GST_GL_API_GLES2, 3, 0);
+  plugin->priv->read_format = GL_RGBA;
+  gst_projectm_update_read_swizzle(plugin->priv);
+
+  plugin->priv->cpu_profile =
+      plugin->render_profile == GST_PROJECTM_RENDER_PROFILE_CPU ||
+      (plugin->render_profile == GST_PROJECTM_RENDER_PROFILE_AUTO &&
+       gst_projectm_is_software_renderer(plugin, glFunctions));
+  if (plugin->priv->cpu_profile) {
+    gulong mesh_width, mesh_height;
+    gst_projectm_get_mesh_size(plugin, &mesh_width, &mesh_height);
+    GST_INFO_OBJECT(plugin, "Using the CPU render profile (mesh %lux%lu)",
+                    mesh_width, mesh_height);
+  }
+
   /* Check for headless mode early - we need to create FBO before ProjectM init */
   gboolean is_headless = gst_projectm_check_headless_mode(plugin, glFunctions);
 
   if (is_headless) {
     GST_INFO_OBJECT(plugin, "Headless mode detected, creating FBO before ProjectM init");
 
-    /* Create FBO with a default size - will be resized on first render if needed */
-    /* Use 1920x1080 as initial size, common for video output */
-    gboolean fbo_ok = gst_projectm_ensure_render_target(plugin, glFunctions, 1920, 1080);
+    /* gl_start runs from decide_allocation, after setup, so the negotiated
+     * size is known and the first render reuses this target. */
+    GstVideoInfo *vinfo = &GST_AUDIO_VISUALIZER(glav)->vinfo;
+    gboolean fbo_ok = gst_projectm_ensure_render_target(
+        plugin, glFunctions, MAX(GST_VIDEO_INFO_WIDTH(vinfo), 1),
+        MAX(GST_VIDEO_INFO_HEIGHT(vinfo), 1));
     if (!fbo_ok) {
       GST_ERROR_OBJECT(plugin,
                        "Headless mode requires FBO but FBO creation failed");
@@ -1265,10 +2847,17 @@ static gboolean gst_projectm_gl_start(GstGLBaseAudioVisualizer *glav) {
     }
   }
 
+  /* projectm_init starts from the timeline, so it has to be loaded first. */
+  gst_projectm_apply_pending_timeline(plugin);
+
   // Check if ProjectM instance exists, and create if not
   if (!plugin->priv->handle) {
+    gst_projectm_open_archives(plugin);
+    gst_projectm_start_texture_transcoder(plugin, glav->context);
+    gst_projectm_start_texture_cache(plugin);
+
     // Create ProjectM instance
-    plugin->priv->handle = projectm_init(plugin);
+    plugin->priv->handle = projectm_init(plugin, &plugin->priv->playlist);
     if (!plugin->priv->handle) {
       GST_ERROR_OBJECT(plugin, "ProjectM could not be initialized");
       return FALSE;
@@ -1286,6 +2875,100 @@ static gboolean gst_projectm_gl_start(GstGLBaseAudioVisualizer *glav) {
   return TRUE;
 }
 
+/* Samples per channel taken from the stream for the frame starting consumed
+ * samples after the first one, on the shared frame grid. High frame rates
+ * get few samples per frame, but projectM analyses its own PCM history
+ * rather than the last frame's samples, so its analysis windows keep their
+ * length. */
+static guint gst_projectm_frame_samples(GstAudioVisualizer *scope,
+                                        guint64 consumed) {
+  return gst_projectm_frame_grid_samples_from(
+      GST_AUDIO_INFO_RATE(&scope->ainfo), GST_VIDEO_INFO_FPS_N(&scope->vinfo),
+      GST_VIDEO_INFO_FPS_D(&scope->vinfo), consumed);
+}
+
+/* Sets how much audio the base class flushes after this frame, which it
+ * reads back from req_spf once render returns. The position comes from the
+ * frame's timestamp, which the base class derives from the audio it has
+ * consumed, so frames dropped for QoS and discontinuities do not shift the
+ * schedule. Returns the frame's start in samples from the first frame, or
+ * FALSE when its timestamp does not place it. */
+static gboolean gst_projectm_schedule_audio(GstProjectM *plugin,
+                                            GstBuffer *video,
+                                            guint64 *start) {
+  GstAudioVisualizer *scope = GST_AUDIO_VISUALIZER(plugin);
+  GstClockTime first = plugin->priv->first_frame_time;
+  GstClockTime pts = GST_BUFFER_PTS(video);
+
+  if (!GST_CLOCK_TIME_IS_VALID(first) || !GST_CLOCK_TIME_IS_VALID(pts) ||
+      pts < first) {
+    return FALSE;
+  }
+
+  *start = gst_util_uint64_scale_round(
+      pts - first, GST_AUDIO_INFO_RATE(&scope->ainfo), GST_SECOND);
+  guint samples = gst_projectm_frame_samples(scope, *start);
+
+  if (samples > 0) {
+    scope->req_spf = samples;
+  }
+
+  return TRUE;
+}
+
+/* Hands a frame's audio to projectM. Without analysis-window it goes in as
+ * is, so what projectM analyses depends on the frame rate. Otherwise it is
+ * appended to the PCM ring and projectM gets the analysis-window samples
+ * ending at the last analysis-hop boundary, preceded by silence up to the
+ * samples projectM keeps so that nothing older enters its analysis. start
+ * places the audio in the stream, so the overlap between consecutive frames
+ * is written once; NULL appends it. Must be called on the GL thread. */
+static void gst_projectm_feed_pcm(GstProjectM *plugin, const gint16 *data,
+                                  guint samples, const guint64 *start) {
+  GstProjectMPrivate *priv = plugin->priv;
+  guint window = plugin->analysis_window;
+  guint hop = plugin->analysis_hop;
+
+  if (window == 0) {
+    projectm_pcm_add_int16(priv->handle, data, samples, PROJECTM_STEREO);
+    return;
+  }
+
+  guint max_samples = projectm_pcm_get_max_samples();
+  window = MIN(window, max_samples);
+
+  /* The ring holds a full window behind the newest hop boundary. */
+  if (priv->pcm_ring == NULL ||
+      gst_projectm_pcm_ring_get_capacity(priv->pcm_ring) < max_samples + hop) {
+    g_clear_pointer(&priv->pcm_ring, gst_projectm_pcm_ring_free);
+    priv->pcm_ring = gst_projectm_pcm_ring_new(max_samples + hop);
+    priv->pcm_end = 0;
+  }
+  if (priv->pcm_window == NULL) {
+    priv->pcm_window = g_new(gint16, max_samples * 2);
+  }
+
+  guint64 position = start != NULL ? *start : priv->pcm_end;
+  if (position < priv->pcm_end) {
+    guint skip = (guint)MIN((guint64)samples, priv->pcm_end - position);
+
+    data += skip * 2;
+    samples -= skip;
+    position += skip;
+  }
+  gst_projectm_pcm_ring_write(priv->pcm_ring, data, samples);
+  priv->pcm_end = MAX(priv->pcm_end, position + samples);
+
+  guint back = hop > 0 ? (guint)(priv->pcm_end % hop) : 0;
+  guint silence = max_samples - window;
+
+  memset(priv->pcm_window, 0, silence * 2 * sizeof(gint16));
+  gst_projectm_pcm_ring_read(priv->pcm_ring, back,
+                             priv->pcm_window + silence * 2, window);
+  projectm_pcm_add_int16(priv->handle, priv->pcm_window, max_samples,
+                         PROJECTM_STEREO);
+}
+
 static gboolean gst_projectm_setup(GstGLBaseAudioVisualizer *glav) {
   GstAudioVisualizer *bscope = GST_AUDIO_VISUALIZER(glav);
   GstProjectM *plugin = GST_PROJECTM(glav);
@@ -1294,9 +2977,17 @@ static gboolean gst_projectm_setup(GstGLBaseAudioVisualizer *glav) {
   gint depth = bscope->vinfo.finfo->pixel_stride[0] *
                ((bscope->vinfo.finfo->bits >= 8) ? 8 : 1);
 
-  // Calculate required samples per frame
-  bscope->req_spf =
-      (bscope->ainfo.channels * bscope->ainfo.rate * 2) / bscope->vinfo.fps_n;
+  // Samples per frame of the first frame; later frames are scheduled as they
+  // render
+  bscope->req_spf = gst_projectm_frame_samples(bscope, 0);
+  plugin->priv->render_rate_acc = 0;
+
+  /* Caps changed under a running instance; projectM is only touched on the
+   * GL thread, so the new size and rate are applied before the next render.
+   * A fresh instance picks them up in gl_start. */
+  if (plugin->priv->handle != NULL) {
+    g_atomic_int_set(&plugin->priv->reconfigure_pending, TRUE);
+  }
 
   // get GStreamer video format and map it to the corresponding OpenGL pixel
   // format
@@ -1307,17 +2998,24 @@ static gboolean gst_projectm_setup(GstGLBaseAudioVisualizer *glav) {
   switch (video_format) {
   case GST_VIDEO_FORMAT_ABGR:
     plugin->priv->gl_format = GL_RGBA;
+    memcpy(plugin->priv->swizzle, (const guint8[]){3, 2, 1, 0}, 4);
     break;
 
   case GST_VIDEO_FORMAT_RGBA:
     // GL_ABGR_EXT does not seem to be well-supported, does not work on Windows
     plugin->priv->gl_format = GL_ABGR_EXT;
+    memcpy(plugin->priv->swizzle, (const guint8[]){0, 1, 2, 3}, 4);
+    break;
+
+  case GST_VIDEO_FORMAT_NV12:
+    // Only offered as DMABuf, converted on the GPU without a readback
     break;
 
   default:
     GST_ERROR_OBJECT(plugin, "Unsupported video format: %d", video_format);
     return FALSE;
   }
+  gst_projectm_update_read_swizzle(plugin->priv);
 
   // Log audio info
   GST_DEBUG_OBJECT(
@@ -1336,6 +3034,115 @@ static gboolean gst_projectm_setup(GstGLBaseAudioVisualizer *glav) {
   return TRUE;
 }
 
+/* Decides whether this output frame gets a fresh projectM render or repeats
+ * the last one. Renders are spread evenly: each output frame adds
+ * render-rate to an accumulator and renders once it reaches the output rate.
+ * A new render target has nothing to repeat, so it is always rendered. */
+static gboolean gst_projectm_should_render(GstProjectM *plugin,
+                                           gboolean using_fbo) {
+  GstAudioVisualizer *scope = GST_AUDIO_VISUALIZER(plugin);
+  GstProjectMPrivate *priv = plugin->priv;
+
+  if (plugin->render_rate_n <= 0 || scope->vinfo.fps_n <= 0 || !using_fbo ||
+      priv->fbo_id != priv->last_rendered_fbo) {
+    return TRUE;
+  }
+
+  guint64 step = (guint64)plugin->render_rate_n * scope->vinfo.fps_d;
+  guint64 period = (guint64)plugin->render_rate_d * scope->vinfo.fps_n;
+
+  if (step >= period) {
+    return TRUE;
+  }
+
+  priv->render_rate_acc += step;
+  if (priv->render_rate_acc < period) {
+    return FALSE;
+  }
+
+  priv->render_rate_acc %= period;
+  return TRUE;
+}
+
+/* TRUE when the output format has the byte order of GL_RGBA with
+ * GL_UNSIGNED_BYTE, so no reordering is needed. */
+static gboolean gst_projectm_output_is_rgba(GstProjectM *plugin) {
+  static const guint8 identity[4] = {0, 1, 2, 3};
+
+  return memcmp(plugin->priv->swizzle, identity, 4) == 0;
+}
+
+/* Format and type reading the FBO straight in the output byte order. For
+ * RGBA output that is GL_RGBA/GL_UNSIGNED_BYTE rather than the equivalent
+ * GL_ABGR_EXT/GL_UNSIGNED_INT_8_8_8_8: every implementation supports it,
+ * and software rasterizers copy it row by row instead of converting each
+ * pixel. FALSE on GLES for other outputs, which need a reordering copy. */
+static gboolean gst_projectm_get_read_format(GstProjectM *plugin,
+                                             GLenum *format, GLenum *type) {
+  if (gst_projectm_output_is_rgba(plugin)) {
+    *format = GL_RGBA;
+    *type = GL_UNSIGNED_BYTE;
+    return TRUE;
+  }
+
+  if (plugin->priv->gles) {
+    return FALSE;
+  }
+
+  *format = plugin->priv->gl_format;
+  *type = GL_UNSIGNED_INT_8_8_8_8;
+  return TRUE;
+}
+
+/* Synchronous readback straight into the frame. Frames from a pool with
+ * padded strides are read with GL_PACK_ROW_LENGTH where the API has it,
+ * row by row otherwise. */
+static void gst_projectm_read_pixels_into_frame(GstProjectM *plugin,
+                                                GstGLContext *context,
+                                                GstVideoFrame *video,
+                                                gsize width, gsize height) {
+  const GstGLFuncs *glFunctions = context->gl_vtable;
+  GstProjectMPrivate *priv = plugin->priv;
+  guint8 *data = (guint8 *)GST_VIDEO_FRAME_PLANE_DATA(video, 0);
+  gsize stride = GST_VIDEO_FRAME_PLANE_STRIDE(video, 0);
+  GLenum format, type;
+
+  if (!gst_projectm_get_read_format(plugin, &format, &type)) {
+    gsize size = width * height * 4;
+
+    if (priv->staging_size < size) {
+      g_free(priv->staging);
+      priv->staging = g_malloc(size);
+      priv->staging_size = size;
+    }
+
+    glFunctions->ReadPixels(0, 0, width, height, priv->read_format,
+                            GL_UNSIGNED_BYTE, priv->staging);
+    gst_projectm_copy_to_frame(plugin, video, priv->staging, width, height);
+    return;
+  }
+
+  if (stride == width * 4) {
+    glFunctions->ReadPixels(0, 0, width, height, format, type, data);
+  } else if (gst_gl_context_check_gl_version(
+                 context, GST_GL_API_OPENGL | GST_GL_API_OPENGL3, 1, 0) ||
+             gst_gl_context_check_gl_version(context, GST_GL_API_GLES2, 3,
+                                             0)) {
+    glFunctions->PixelStorei(GL_PACK_ROW_LENGTH, (GLint)(stride / 4));
+    glFunctions->ReadPixels(0, 0, width, height, format, type, data);
+    glFunctions->PixelStorei(GL_PACK_ROW_LENGTH, 0);
+  } else {
+    for (gsize y = 0; y < height; y++) {
+      glFunctions->ReadPixels(0, (GLint)y, width, 1, format, type,
+                              data + y * stride);
+    }
+  }
+
+  if (plugin->vertical_flip) {
+    gst_projectm_frame_flip_in_place(data, stride, width * 4, height);
+  }
+}
+
 static double get_seconds_since_first_frame(GstProjectM *plugin,
                                             GstVideoFrame *frame) {
   if (!plugin->priv->first_frame_received) {
@@ -1377,13 +3184,49 @@ static double get_audio_elapsed_seconds(GstProjectM *plugin, GstBuffer *audio) {
   return (gdouble)elapsed_time / GST_SECOND;
 }
 
+/* Feeds the audio of a frame dropped for QoS and moves projectM's clock to
+ * it, without rendering or reading back. */
+static void gst_projectm_analyze(GstGLBaseAudioVisualizer *glav,
+                                 GstBuffer *audio) {
+  GstProjectM *plugin = GST_PROJECTM(glav);
+  GstProjectMPrivate *priv = plugin->priv;
+  GstMapInfo audioMap;
+
+  if (priv->handle == NULL ||
+      !gst_buffer_map(audio, &audioMap, GST_MAP_READ)) {
+    return;
+  }
+
+  projectm_set_frame_time(priv->handle,
+                          get_audio_elapsed_seconds(plugin, audio));
+  /* Dropped frames directly follow the last rendered one. */
+  gst_projectm_feed_pcm(plugin, (const gint16 *)audioMap.data,
+                        audioMap.size / 4, NULL);
+  gst_buffer_unmap(audio, &audioMap);
+
+  g_atomic_int_inc(&priv->analyzed_frames);
+}
+
 // TODO: CLEANUP & ADD DEBUGGING
 static gboolean gst_projectm_render(GstGLBaseAudioVisualizer *glav,
                                     GstBuffer *audio, GstVideoFrame *video) {
   GstProjectM *plugin = GST_PROJECTM(glav);
 
+  GstProjectMPrivate *priv = plugin->priv;
   GstMapInfo audioMap;
   gboolean result = TRUE;
+  gint64 frame_start = g_get_monotonic_time();
+  gint64 phase_start;
+
+  if (g_atomic_int_compare_and_exchange(&priv->reconfigure_pending, TRUE,
+                                        FALSE)) {
+    gst_projectm_reconfigure(plugin);
+  }
+  gst_projectm_apply_pending_timeline(plugin);
+  if (g_atomic_int_compare_and_exchange(&priv->reset_pending, TRUE, FALSE)) {
+    gst_projectm_reset_state(plugin);
+  }
+  priv->state_dirty = TRUE;
 
   // Use audio PTS as the authoritative clock for timeline decisions.
   // Audio PTS advances at the true playback rate regardless of video encoding
@@ -1391,6 +3234,10 @@ static gboolean gst_projectm_render(GstGLBaseAudioVisualizer *glav,
   double audio_elapsed = get_audio_elapsed_seconds(plugin, audio);
   double video_elapsed = get_seconds_since_first_frame(plugin, video);
 
+  guint64 audio_start;
+  gboolean audio_placed =
+      gst_projectm_schedule_audio(plugin, video->buffer, &audio_start);
+
   // Set projectM time from audio PTS so animations sync to audio, not encoding speed
   projectm_set_frame_time(plugin->priv->handle, audio_elapsed);
 
@@ -1410,6 +3257,7 @@ static gboolean gst_projectm_render(GstGLBaseAudioVisualizer *glav,
   }
 
   // AUDIO
+  phase_start = g_get_monotonic_time();
   gst_buffer_map(audio, &audioMap, GST_MAP_READ);
 
   // GST_DEBUG_OBJECT(plugin, "Audio Samples: %u, Offset: %lu, Offset End: %lu,
@@ -1417,8 +3265,24 @@ static gboolean gst_projectm_render(GstGLBaseAudioVisualizer *glav,
   //                  audioMap.size / 8, audio->offset, audio->offset_end,
   //                  bscope->ainfo.rate, bscope->vinfo.fps_n, bscope->req_spf);
 
-  projectm_pcm_add_int16(plugin->priv->handle, (gint16 *)audioMap.data,
-                         audioMap.size / 4, PROJECTM_STEREO);
+  gst_projectm_feed_pcm(plugin, (const gint16 *)audioMap.data,
+                        audioMap.size / 4, audio_placed ? &audio_start : NULL);
+  gst_projectm_stats_record(&priv->stats, GST_PROJECTM_PHASE_AUDIO,
+                            g_get_monotonic_time() - phase_start);
+
+  GstProjectMFrameAction action =
+      gst_projectm_frame_action(plugin, video->buffer);
+  gboolean output_frame = action == GST_PROJECTM_FRAME_OUTPUT ||
+                          action == GST_PROJECTM_FRAME_KEYFRAME;
+
+  if (!output_frame) {
+    GST_BUFFER_FLAG_SET(video->buffer, GST_PROJECTM_BUFFER_FLAG_SKIP);
+  }
+
+  if (action == GST_PROJECTM_FRAME_SKIP) {
+    gst_buffer_unmap(audio, &audioMap);
+    return TRUE;
+  }
 
   // GST_DEBUG_OBJECT(plugin, "Audio Data: %d %d %d %d", ((gint16
   // *)audioMap.data)[100], ((gint16 *)audioMap.data)[101], ((gint16
@@ -1465,30 +3329,107 @@ static gboolean gst_projectm_render(GstGLBaseAudioVisualizer *glav,
   }
 
   /* Use FBO-specific render function when we have an FBO, otherwise use default */
-  if (using_fbo && plugin->priv->fbo_id != 0) {
-    projectm_opengl_render_frame_fbo(plugin->priv->handle, plugin->priv->fbo_id);
-    GST_LOG_OBJECT(plugin, "Rendered frame to FBO %u", plugin->priv->fbo_id);
+  phase_start = g_get_monotonic_time();
+  if (action == GST_PROJECTM_FRAME_OUTPUT &&
+      !gst_projectm_should_render(plugin, using_fbo)) {
+    GST_LOG_OBJECT(plugin, "Repeating last render in FBO %u",
+                   plugin->priv->fbo_id);
   } else {
-    projectm_opengl_render_frame(plugin->priv->handle);
+    if (using_fbo && plugin->priv->fbo_id != 0) {
+      projectm_opengl_render_frame_fbo(plugin->priv->handle,
+                                       plugin->priv->fbo_id);
+      GST_LOG_OBJECT(plugin, "Rendered frame to FBO %u", plugin->priv->fbo_id);
+    } else {
+      projectm_opengl_render_frame(plugin->priv->handle);
+    }
+    priv->last_rendered_fbo = using_fbo ? priv->fbo_id : 0;
+    gl_error_handler(glav->context, plugin);
+    gst_projectm_stats_record(&priv->stats, GST_PROJECTM_PHASE_RENDER,
+                              g_get_monotonic_time() - phase_start);
   }
-  gl_error_handler(glav->context, plugin);
 
   /* Ensure FBO is still bound for ReadPixels */
   if (using_fbo && glFunctions && glFunctions->BindFramebuffer) {
     glFunctions->BindFramebuffer(GL_FRAMEBUFFER, plugin->priv->fbo_id);
   }
 
+  phase_start = g_get_monotonic_time();
+  priv->copy_us = 0;
+
   gboolean used_async = FALSE;
-  if (gst_projectm_ensure_pbos(plugin, glFunctions, windowWidth,
-                               windowHeight)) {
+  gboolean used_zero_copy = FALSE;
+  /* On a software rasterizer the readback ring overlaps nothing, as the
+   * "GPU" is the CPU doing the copy. A plain RGBA read lands in the frame
+   * in one pass; only outputs needing a byte reorder or flip still go
+   * through the ring, whose copy does both with SIMD on the copy threads. */
+  gboolean sync_readback =
+      plugin->readback_mode == GST_PROJECTM_READBACK_SYNC ||
+      (priv->cpu_profile &&
+       plugin->readback_mode == GST_PROJECTM_READBACK_AUTO &&
+       gst_projectm_output_is_rgba(plugin) && !plugin->vertical_flip);
+  GstMemory *out_mem = gst_buffer_n_memory(video->buffer) == 1
+                           ? gst_buffer_peek_memory(video->buffer, 0)
+                           : NULL;
+
+  if (!output_frame) {
+    /* Warm-up render for a later keyframe; the frame itself is dropped. */
+  } else if (priv->dmabuf_output) {
+    /* Nothing to read back: the planes behind the exported DMABufs are
+     * written on the GPU. */
+    used_zero_copy = gst_projectm_convert_frame_nv12(
+        plugin, glav->context, video, using_fbo, windowWidth, windowHeight);
+    if (!used_zero_copy) {
+      result = FALSE;
+    }
+  } else if (gst_projectm_is_pbo_memory(out_mem) && !plugin->vertical_flip &&
+             !sync_readback &&
+             (gsize)GST_VIDEO_FRAME_PLANE_STRIDE(video, 0) == windowWidth * 4 &&
+             (gsize)GST_VIDEO_FRAME_HEIGHT(video) == windowHeight) {
+    used_zero_copy = gst_projectm_download_frame_zero_copy(
+        plugin, glFunctions, out_mem, windowWidth, windowHeight);
+  }
+
+  gboolean persistent =
+      priv->buffer_storage != NULL &&
+      ((plugin->readback_mode == GST_PROJECTM_READBACK_AUTO &&
+        !priv->cpu_profile) ||
+       plugin->readback_mode == GST_PROJECTM_READBACK_PERSISTENT);
+  gboolean cpu_readback = output_frame && !priv->dmabuf_output;
+  if (cpu_readback && !used_zero_copy && !sync_readback &&
+      gst_projectm_ensure_pbos(plugin, glFunctions, windowWidth, windowHeight,
+                               persistent)) {
+    /* Warm-up and skipped frames read nothing back, so the ring's ready slot
+     * still holds the previous keyframe. Wait for this one instead. */
+    if (action == GST_PROJECTM_FRAME_KEYFRAME) {
+      priv->pbo_frame_valid = FALSE;
+    }
+
     used_async = gst_projectm_download_frame_with_pbo(
         plugin, glFunctions, video, windowWidth, windowHeight);
+
+    if (used_async && action == GST_PROJECTM_FRAME_KEYFRAME &&
+        priv->pbo_copied_frame != priv->render_frame_count) {
+      GST_ERROR_OBJECT(plugin,
+                       "Keyframe of render %" G_GUINT64_FORMAT
+                       " holds render %" G_GUINT64_FORMAT,
+                       priv->render_frame_count, priv->pbo_copied_frame);
+      result = FALSE;
+    }
+  }
+
+  if (cpu_readback && !used_async && !used_zero_copy) {
+    gst_projectm_read_pixels_into_frame(plugin, glav->context, video,
+                                        windowWidth, windowHeight);
   }
 
-  if (!used_async) {
-    glFunctions->ReadPixels(0, 0, windowWidth, windowHeight,
-                            plugin->priv->gl_format, GL_UNSIGNED_INT_8_8_8_8,
-                            (guint8 *)GST_VIDEO_FRAME_PLANE_DATA(video, 0));
+  /* Readback excludes the time spent copying mapped PBO data into the frame,
+   * which is accounted separately. */
+  gst_projectm_stats_record(&priv->stats, GST_PROJECTM_PHASE_READBACK,
+                            g_get_monotonic_time() - phase_start -
+                                priv->copy_us);
+  if (used_async) {
+    gst_projectm_stats_record(&priv->stats, GST_PROJECTM_PHASE_COPY,
+                              priv->copy_us);
   }
 
   if (using_fbo && glFunctions && glFunctions->BindFramebuffer) {
@@ -1504,6 +3445,14 @@ static gboolean gst_projectm_render(GstGLBaseAudioVisualizer *glav,
 
   gst_buffer_unmap(audio, &audioMap);
 
+  if (priv->gpu_memory_query != GST_PROJECTM_GPU_MEMORY_QUERY_NONE &&
+      priv->render_frame_count % GST_PROJECTM_GPU_MEMORY_QUERY_INTERVAL == 1) {
+    gst_projectm_update_gpu_memory(plugin, glFunctions);
+  }
+
+  gst_projectm_stats_record(&priv->stats, GST_PROJECTM_PHASE_FRAME,
+                            g_get_monotonic_time() - frame_start);
+
   // GST_DEBUG_OBJECT(plugin, "Video Data: %d %d\n",
   // GST_VIDEO_FRAME_N_PLANES(video), ((uint8_t
   // *)(GST_VIDEO_FRAME_PLANE_DATA(video, 0)))[0]);
@@ -1518,6 +3467,7 @@ static void gst_projectm_class_init(GstProjectMClass *klass) {
   GstElementClass *element_class = (GstElementClass *)klass;
   GstGLBaseAudioVisualizerClass *scope_class =
       GST_GL_BASE_AUDIO_VISUALIZER_CLASS(klass);
+  GstAudioVisualizerClass *visualizer_class = GST_AUDIO_VISUALIZER_CLASS(klass);
 
   // Setup audio and video caps
   const gchar *audio_sink_caps = get_audio_sink_cap(0);
@@ -1531,6 +3481,15 @@ static void gst_projectm_class_init(GstProjectMClass *klass) {
       GST_ELEMENT_CLASS(klass),
       gst_pad_template_new("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
                            gst_caps_from_string(audio_sink_caps)));
+  gst_element_class_add_pad_template(
+      GST_ELEMENT_CLASS(klass),
+      gst_pad_template_new("audio_src", GST_PAD_SRC, GST_PAD_REQUEST,
+                           gst_caps_from_string(audio_sink_caps)));
+
+  element_class->change_state = GST_DEBUG_FUNCPTR(gst_projectm_change_state);
+  element_class->request_new_pad =
+      GST_DEBUG_FUNCPTR(gst_projectm_request_new_pad);
+  element_class->release_pad = GST_DEBUG_FUNCPTR(gst_projectm_release_pad);
 
   gst_element_class_set_static_metadata(
       GST_ELEMENT_CLASS(klass), "ProjectM Visualizer", "Generic",
@@ -1547,14 +3506,17 @@ static void gst_projectm_class_init(GstProjectMClass *klass) {
       g_param_spec_string(
           "preset", "Preset",
           "Specifies the path to the preset file. The preset file determines "
-          "the visual style and behavior of the audio visualizer.",
+          "the visual style and behavior of the audio visualizer. May also "
+          "be a preset directory or a .zip, .tar or .tar.gz preset pack, "
+          "whose presets are loaded from memory.",
           DEFAULT_PRESET_PATH, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
   g_object_class_install_property(
       gobject_class, PROP_TEXTURE_DIR_PATH,
       g_param_spec_string("texture-dir", "Texture Directory",
                           "Sets the path to the directory containing textures "
-                          "used in the visualizer.",
+                          "used in the visualizer, or of a .zip, .tar or "
+                          ".tar.gz texture pack.",
                           DEFAULT_TEXTURE_DIR_PATH,
                           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
@@ -1669,13 +3631,191 @@ static void gst_projectm_class_init(GstProjectMClass *klass) {
           "and not locked. Playlist must be enabled for this to take effect.",
           DEFAULT_SHUFFLE_PRESETS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property(
+      gobject_class, PROP_READBACK_MODE,
+      g_param_spec_enum(
+          "readback-mode", "Readback Mode",
+          "Selects how rendered frames are read back from the GPU. 'auto' "
+          "uses the fastest path the GL context supports, never 'zero-copy', "
+          "which saves the frame copy but waits for every readback. "
+          "'persistent' and 'zero-copy' fall back to 'pbo' when buffer "
+          "storage is unavailable; 'zero-copy' is also skipped when "
+          "vertical-flip is set.",
+          GST_TYPE_PROJECTM_READBACK_MODE, DEFAULT_READBACK_MODE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_VERTICAL_FLIP,
+      g_param_spec_boolean(
+          "vertical-flip", "Vertical Flip",
+          "Output frames top-down instead of in OpenGL's bottom-up row order, "
+          "making a downstream videoflip unnecessary. The flip is folded into "
+          "the readback copy.",
+          DEFAULT_VERTICAL_FLIP, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_COPY_THREADS,
+      g_param_spec_uint(
+          "copy-threads", "Copy Threads",
+          "Number of threads that copy large frames out of the readback "
+          "buffer in row bands. 0 picks one per CPU (at most 8), 1 copies on "
+          "the GL thread only.",
+          0, 64, DEFAULT_COPY_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_RENDER_RATE,
+      gst_param_spec_fraction(
+          "render-rate", "Render Rate",
+          "Rate at which projectM renders, below the output framerate. Frames "
+          "in between repeat the last render while all audio is still fed to "
+          "projectM. 0/1 renders every output frame.",
+          0, 1, G_MAXINT, 1, DEFAULT_RENDER_RATE_N, DEFAULT_RENDER_RATE_D,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_KEYFRAME_INTERVAL,
+      g_param_spec_uint64(
+          "keyframe-interval", "Keyframe Interval",
+          "Keyframe-only mode: output only the frames at multiples of this "
+          "interval (in nanoseconds of buffer time). All audio is still fed "
+          "to projectM; other frames are neither rendered nor read back, and "
+          "are dropped. 0 disables.",
+          0, G_MAXUINT64, DEFAULT_KEYFRAME_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_KEYFRAME_TIMESTAMPS,
+      g_param_spec_string(
+          "keyframe-timestamps", "Keyframe Timestamps",
+          "Keyframe-only mode: comma-separated buffer times in seconds to "
+          "output frames at, e.g. \"5,30,62.5\". Combines with "
+          "keyframe-interval.",
+          DEFAULT_KEYFRAME_TIMESTAMPS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_KEYFRAME_WARMUP,
+      g_param_spec_uint(
+          "keyframe-warmup", "Keyframe Warm-up",
+          "Number of frames rendered, but not read back or output, ahead of "
+          "each keyframe so presets relying on previous frames settle.",
+          0, G_MAXUINT, DEFAULT_KEYFRAME_WARMUP,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_PRESET_INDEX,
+      g_param_spec_string(
+          "preset-index", "Preset Index",
+          "Index file for the preset directory. When set, the playlist is "
+          "filled from the index instead of walking the directory; only "
+          "directories whose mtime changed are rescanned, and the index is "
+          "created or updated as needed.",
+          DEFAULT_PRESET_INDEX_PATH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_TEXTURE_PREFETCH_BUDGET,
+      g_param_spec_uint(
+          "texture-prefetch-budget", "Texture Prefetch Budget",
+          "Size in MiB, counted as decoded texture size, of the textures of "
+          "upcoming timeline and archive playlist presets read ahead of the "
+          "switch so projectM does not stall on disk. This only bounds the "
+          "prefetch cache; it does not limit GPU memory, which projectM "
+          "allocates itself on first use. 0 disables prefetching. Hits, "
+          "misses and evictions are reported in stats.",
+          0, G_MAXUINT, DEFAULT_TEXTURE_PREFETCH_BUDGET,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_COMPRESS_TEXTURES,
+      g_param_spec_boolean(
+          "compress-textures", "Compress Textures",
+          "Give projectM S3TC-compressed (BC1/BC3) copies of JPEG, PNG and "
+          "BMP textures when the GL context supports them. Copies are made "
+          "in the background, cached by source, and used from the next "
+          "start on.",
+          DEFAULT_COMPRESS_TEXTURES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_RENDER_PROFILE,
+      g_param_spec_enum(
+          "render-profile", "Render Profile",
+          "Tuning for the OpenGL implementation. The CPU profile, picked "
+          "automatically for software rasterizers such as Mesa llvmpipe, "
+          "always renders into an FBO, uses a " DEFAULT_CPU_MESH_SIZE
+          " mesh unless mesh-size is set, and reads frames back without "
+          "packed pixel types or readback buffers.",
+          GST_TYPE_PROJECTM_RENDER_PROFILE, DEFAULT_RENDER_PROFILE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_CPU_THREADS,
+      g_param_spec_uint(
+          "cpu-threads", "CPU Threads",
+          "Rasterizer threads of Mesa llvmpipe (LP_NUM_THREADS), 0 for "
+          "Mesa's default of one per CPU. Applied when the element goes to "
+          "READY, so it only affects GL contexts created afterwards, and "
+          "ignored when LP_NUM_THREADS is already set.",
+          0, 1024, DEFAULT_CPU_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_ANALYSIS_WINDOW,
+      g_param_spec_uint(
+          "analysis-window", "Analysis Window",
+          "Samples of audio projectM analyses for each frame, cut from a "
+          "history of the stream independent of frame and buffer sizes. "
+          "Capped at the samples projectM keeps; shorter windows are "
+          "preceded by silence. 0 feeds each frame its own audio.",
+          0, GST_PROJECTM_MAX_ANALYSIS_SAMPLES, DEFAULT_ANALYSIS_WINDOW,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_ANALYSIS_HOP,
+      g_param_spec_uint(
+          "analysis-hop", "Analysis Hop",
+          "Samples the analysis window advances by, so analysis keeps its "
+          "cadence at any frame rate; frames in between repeat the last "
+          "window. 0 advances it with every frame. Only used with "
+          "analysis-window.",
+          0, GST_PROJECTM_MAX_ANALYSIS_SAMPLES, DEFAULT_ANALYSIS_HOP,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property(
+      gobject_class, PROP_STATS,
+      g_param_spec_boxed(
+          "stats", "Statistics",
+          "Per-phase frame timing (count, mean and percentiles in "
+          "microseconds for audio, render, readback, copy and the whole "
+          "frame) and GPU memory figures where the driver exposes them.",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstProjectM::reset:
+   *
+   * Action signal that returns projectM to its starting state before the
+   * next frame: audio history, timing, timeline position and the current
+   * preset. The projectM instance, playlist and GL resources are kept. The
+   * element does the same on stream-start and EOS.
+   */
+  g_signal_new_class_handler("reset", G_TYPE_FROM_CLASS(klass),
+                             G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+                             G_CALLBACK(gst_projectm_request_reset), NULL,
+                             NULL, NULL, G_TYPE_NONE, 0);
+
   gobject_class->finalize = gst_projectm_finalize;
 
   scope_class->supported_gl_api = GST_GL_API_OPENGL3 | GST_GL_API_GLES2;
   scope_class->gl_start = GST_DEBUG_FUNCPTR(gst_projectm_gl_start);
   scope_class->gl_stop = GST_DEBUG_FUNCPTR(gst_projectm_gl_stop);
   scope_class->gl_render = GST_DEBUG_FUNCPTR(gst_projectm_render);
+  scope_class->gl_analyze = GST_DEBUG_FUNCPTR(gst_projectm_analyze);
   scope_class->setup = GST_DEBUG_FUNCPTR(gst_projectm_setup);
+
+  visualizer_class->decide_allocation =
+      GST_DEBUG_FUNCPTR(gst_projectm_decide_allocation);
 }
 
 static gboolean plugin_init(GstPlugin *plugin) {
@@ -1683,7 +3823,11 @@ static gboolean plugin_init(GstPlugin *plugin) {
                           "projectM visualizer plugin");
 
   return gst_element_register(plugin, "projectm", GST_RANK_NONE,
-                              GST_TYPE_PROJECTM);
+                              GST_TYPE_PROJECTM) &&
+         gst_element_register(plugin, "projectmbatch", GST_RANK_NONE,
+                              GST_TYPE_PROJECTM_BATCH) &&
+         gst_element_register(plugin, "projectmmosaic", GST_RANK_NONE,
+                              GST_TYPE_PROJECTM_MOSAIC);
 }
 
 GST_PLUGIN_DEFINE(GST_VERSION_MAJOR, GST_VERSION_MINOR, projectm,
@@ -1,6 +1,8 @@
 #ifndef __GST_PROJECTM_H__
 #define __GST_PROJECTM_H__
 
+#include "archive.h"
+#include "enums.h"
 #include "gstglbaseaudiovisualizer.h"
 #include <gst/gst.h>
 #include <projectM-4/projectM.h>
@@ -33,6 +35,21 @@ struct _GstProjectM {
   gboolean preset_locked;
   gboolean enable_playlist;
   gboolean shuffle_presets;
+  GstProjectMReadbackMode readback_mode;
+  gboolean vertical_flip;
+  guint copy_threads;
+  gint render_rate_n;
+  gint render_rate_d;
+  GstClockTime keyframe_interval;
+  gchar *keyframe_timestamps;
+  guint keyframe_warmup;
+  gchar *preset_index_path;
+  guint texture_prefetch_budget;
+  gboolean compress_textures;
+  GstProjectMRenderProfile render_profile;
+  guint cpu_threads;
+  guint analysis_window;
+  guint analysis_hop;
 
   GstProjectMPrivate *priv;
 };
@@ -69,6 +86,25 @@ gboolean gst_projectm_timeline_is_active(GstProjectM *plugin);
 /* Load the first preset from timeline immediately to avoid showing the idle preset */
 void gst_projectm_load_first_timeline_preset(GstProjectM *plugin, projectm_handle handle);
 
+/* Preset archive opened from the preset property, or NULL */
+GstProjectMArchive *gst_projectm_get_preset_archive(GstProjectM *plugin);
+
+/* Directory projectM loads textures from: texture-dir, or the extracted copy
+ * of a texture archive */
+const gchar *gst_projectm_get_texture_search_path(GstProjectM *plugin);
+
+/* Mesh projectM is created with: mesh-size, or the CPU profile's default
+ * when mesh-size was not set */
+void gst_projectm_get_mesh_size(GstProjectM *plugin, gulong *width,
+                                gulong *height);
+
+/* Output frame rate rounded to the whole frames per second projectM takes */
+gint gst_projectm_get_fps(GstProjectM *plugin);
+
+/* Switch presets from the preset archive, standing in for the playlist */
+void gst_projectm_start_archive_playlist(GstProjectM *plugin,
+                                         projectm_handle handle);
+
 G_END_DECLS
 
 #endif /* __GST_PROJECTM_H__ */
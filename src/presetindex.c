@@ -0,0 +1,535 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+
+#include "presetindex.h"
+
+GST_DEBUG_CATEGORY_STATIC(gst_projectm_preset_index_debug);
+#define GST_CAT_DEFAULT gst_projectm_preset_index_debug
+
+#define GST_PROJECTM_PRESET_INDEX_HEADER "# gst-projectm preset index 1"
+
+/* Backstop for filesystems without inode numbers; preset packs are rarely
+ * more than a few levels deep. */
+#define GST_PROJECTM_PRESET_INDEX_MAX_DEPTH 32
+
+/* Scan state: the previous index regrouped by directory, so unchanged
+ * directories can be carried over without touching their files. */
+typedef struct {
+  GstProjectMPresetIndex *index;
+  GObject *log_object;
+  /* Relative directory -> GPtrArray of its previous entries. */
+  GHashTable *old_files;
+  /* Relative directory -> GPtrArray of its previous subdirectory names. */
+  GHashTable *old_children;
+  GHashTable *old_directories;
+  /* "dev:ino" of every directory walked, so a directory reached again
+   * through a symlink (or a loop such as "x -> .") is indexed once. */
+  GHashTable *visited;
+  gboolean changed;
+  guint directories_scanned;
+} GstProjectMPresetIndexScan;
+
+static void gst_projectm_preset_index_init_debug(void) {
+  static gsize debug_initialized = 0;
+
+  if (g_once_init_enter(&debug_initialized)) {
+    GST_DEBUG_CATEGORY_INIT(gst_projectm_preset_index_debug,
+                            "projectm-preset-index", 0,
+                            "projectM preset directory index");
+    g_once_init_leave(&debug_initialized, 1);
+  }
+}
+
+static void gst_projectm_preset_index_entry_free(gpointer data) {
+  GstProjectMPresetIndexEntry *entry = data;
+
+  if (entry == NULL) {
+    return;
+  }
+
+  g_free(entry->path);
+  g_free(entry->hash);
+  g_free(entry->tags);
+  g_free(entry);
+}
+
+static gint gst_projectm_preset_index_entry_compare(gconstpointer a,
+                                                    gconstpointer b) {
+  const GstProjectMPresetIndexEntry *left =
+      *(const GstProjectMPresetIndexEntry *const *)a;
+  const GstProjectMPresetIndexEntry *right =
+      *(const GstProjectMPresetIndexEntry *const *)b;
+
+  return strcmp(left->path, right->path);
+}
+
+static GstProjectMPresetIndex *gst_projectm_preset_index_new(const gchar *root) {
+  GstProjectMPresetIndex *index = g_new0(GstProjectMPresetIndex, 1);
+
+  index->root = g_strdup(root);
+  index->entries =
+      g_ptr_array_new_with_free_func(gst_projectm_preset_index_entry_free);
+  index->directories = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                             g_free);
+  return index;
+}
+
+void gst_projectm_preset_index_free(GstProjectMPresetIndex *index) {
+  if (index == NULL) {
+    return;
+  }
+
+  g_free(index->root);
+  g_ptr_array_unref(index->entries);
+  g_hash_table_unref(index->directories);
+  g_free(index);
+}
+
+static void gst_projectm_preset_index_set_directory(GHashTable *directories,
+                                                    const gchar *path,
+                                                    gint64 mtime) {
+  gint64 *value = g_new(gint64, 1);
+
+  *value = mtime;
+  g_hash_table_insert(directories, g_strdup(path), value);
+}
+
+/* Same extensions projectm_playlist_add_path() picks up. */
+static gboolean gst_projectm_preset_index_is_preset(const gchar *name) {
+  const gchar *dot = strrchr(name, '.');
+
+  return dot != NULL && (g_ascii_strcasecmp(dot, ".milk") == 0 ||
+                         g_ascii_strcasecmp(dot, ".prjm") == 0);
+}
+
+static gchar *gst_projectm_preset_index_join(const gchar *directory,
+                                             const gchar *name) {
+  return *directory == '\0' ? g_strdup(name)
+                            : g_strconcat(directory, "/", name, NULL);
+}
+
+static gchar *gst_projectm_preset_index_hash_file(const gchar *path) {
+  gchar *contents = NULL;
+  gsize length = 0;
+
+  if (!g_file_get_contents(path, &contents, &length, NULL)) {
+    return NULL;
+  }
+
+  gchar *hash = g_compute_checksum_for_data(G_CHECKSUM_SHA1,
+                                            (const guchar *)contents, length);
+  g_free(contents);
+  return hash;
+}
+
+static GstProjectMPresetIndexEntry *
+gst_projectm_preset_index_take_old_entry(GstProjectMPresetIndexScan *scan,
+                                         const gchar *directory,
+                                         const gchar *path,
+                                         const GStatBuf *st) {
+  GPtrArray *files = g_hash_table_lookup(scan->old_files, directory);
+
+  if (files == NULL) {
+    return NULL;
+  }
+
+  for (guint i = 0; i < files->len; i++) {
+    GstProjectMPresetIndexEntry *entry = g_ptr_array_index(files, i);
+
+    if (entry != NULL && strcmp(entry->path, path) == 0 &&
+        entry->size == (guint64)st->st_size &&
+        entry->mtime == (gint64)st->st_mtime) {
+      files->pdata[i] = NULL;
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+static void gst_projectm_preset_index_visit(GstProjectMPresetIndexScan *scan,
+                                            const gchar *directory,
+                                            guint depth);
+
+/* Lists a directory whose contents are unknown or have changed. */
+static void gst_projectm_preset_index_rescan(GstProjectMPresetIndexScan *scan,
+                                             const gchar *directory,
+                                             const gchar *absolute,
+                                             guint depth) {
+  GError *error = NULL;
+  GDir *dir = g_dir_open(absolute, 0, &error);
+
+  if (dir == NULL) {
+    GST_WARNING_OBJECT(scan->log_object, "Unable to list %s: %s", absolute,
+                       error->message);
+    g_clear_error(&error);
+    return;
+  }
+
+  scan->directories_scanned++;
+  scan->changed = TRUE;
+
+  const gchar *name;
+  while ((name = g_dir_read_name(dir)) != NULL) {
+    gchar *child_absolute = g_build_filename(absolute, name, NULL);
+    gchar *child = gst_projectm_preset_index_join(directory, name);
+    GStatBuf st;
+
+    if (g_stat(child_absolute, &st) != 0) {
+      /* Dangling symlink or removed while listing. */
+    } else if (S_ISDIR(st.st_mode)) {
+      gst_projectm_preset_index_visit(scan, child, depth + 1);
+    } else if (S_ISREG(st.st_mode) &&
+               gst_projectm_preset_index_is_preset(name)) {
+      GstProjectMPresetIndexEntry *entry =
+          gst_projectm_preset_index_take_old_entry(scan, directory, child,
+                                                   &st);
+
+      if (entry == NULL) {
+        entry = g_new0(GstProjectMPresetIndexEntry, 1);
+        entry->path = g_strdup(child);
+        entry->size = st.st_size;
+        entry->mtime = st.st_mtime;
+        entry->hash = gst_projectm_preset_index_hash_file(child_absolute);
+        entry->cost = -1.0;
+      }
+      g_ptr_array_add(scan->index->entries, entry);
+    }
+
+    g_free(child);
+    g_free(child_absolute);
+  }
+
+  g_dir_close(dir);
+}
+
+/* Carries over a directory that has not changed since the last scan. */
+static void gst_projectm_preset_index_keep(GstProjectMPresetIndexScan *scan,
+                                           const gchar *directory,
+                                           guint depth) {
+  GPtrArray *files = g_hash_table_lookup(scan->old_files, directory);
+  GPtrArray *children = g_hash_table_lookup(scan->old_children, directory);
+
+  for (guint i = 0; files != NULL && i < files->len; i++) {
+    if (files->pdata[i] != NULL) {
+      g_ptr_array_add(scan->index->entries, files->pdata[i]);
+      files->pdata[i] = NULL;
+    }
+  }
+
+  for (guint i = 0; children != NULL && i < children->len; i++) {
+    gchar *child = gst_projectm_preset_index_join(
+        directory, g_ptr_array_index(children, i));
+    gst_projectm_preset_index_visit(scan, child, depth + 1);
+    g_free(child);
+  }
+}
+
+static void gst_projectm_preset_index_visit(GstProjectMPresetIndexScan *scan,
+                                            const gchar *directory,
+                                            guint depth) {
+  if (depth > GST_PROJECTM_PRESET_INDEX_MAX_DEPTH ||
+      g_hash_table_contains(scan->index->directories, directory)) {
+    return;
+  }
+
+  gchar *absolute = g_build_filename(scan->index->root, directory, NULL);
+  GStatBuf st;
+
+  if (g_stat(absolute, &st) != 0 || !S_ISDIR(st.st_mode)) {
+    /* Removed since the last scan. */
+    scan->changed = TRUE;
+    g_free(absolute);
+    return;
+  }
+
+  if (st.st_ino != 0) {
+    gchar *id = g_strdup_printf("%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT,
+                                (guint64)st.st_dev, (guint64)st.st_ino);
+
+    if (!g_hash_table_add(scan->visited, id)) {
+      GST_DEBUG_OBJECT(scan->log_object,
+                       "Skipping %s, already indexed through another path",
+                       absolute);
+      g_free(absolute);
+      return;
+    }
+  }
+
+  gst_projectm_preset_index_set_directory(scan->index->directories, directory,
+                                          st.st_mtime);
+
+  gint64 *old_mtime = g_hash_table_lookup(scan->old_directories, directory);
+  if (old_mtime != NULL && *old_mtime == (gint64)st.st_mtime) {
+    gst_projectm_preset_index_keep(scan, directory, depth);
+  } else {
+    gst_projectm_preset_index_rescan(scan, directory, absolute, depth);
+  }
+
+  g_free(absolute);
+}
+
+static gchar *gst_projectm_preset_index_dirname(const gchar *path) {
+  const gchar *slash = strrchr(path, '/');
+
+  return slash == NULL ? g_strdup("") : g_strndup(path, slash - path);
+}
+
+static GPtrArray *gst_projectm_preset_index_group(GHashTable *groups,
+                                                  const gchar *key,
+                                                  GDestroyNotify free_func) {
+  GPtrArray *group = g_hash_table_lookup(groups, key);
+
+  if (group == NULL) {
+    group = g_ptr_array_new_with_free_func(free_func);
+    g_hash_table_insert(groups, g_strdup(key), group);
+  }
+
+  return group;
+}
+
+/* Parses an index file into a fresh index; NULL if missing, malformed or
+ * written for another root. */
+static GstProjectMPresetIndex *
+gst_projectm_preset_index_read(const gchar *root, const gchar *index_path,
+                               GObject *log_object) {
+  gchar *contents = NULL;
+  GError *error = NULL;
+
+  if (!g_file_get_contents(index_path, &contents, NULL, &error)) {
+    if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+      GST_WARNING_OBJECT(log_object, "Unable to read preset index %s: %s",
+                         index_path, error->message);
+    }
+    g_clear_error(&error);
+    return NULL;
+  }
+
+  GstProjectMPresetIndex *index = gst_projectm_preset_index_new(root);
+  gchar **lines = g_strsplit(contents, "\n", -1);
+  gboolean valid = lines[0] != NULL &&
+                   strcmp(lines[0], GST_PROJECTM_PRESET_INDEX_HEADER) == 0;
+
+  g_free(contents);
+
+  for (guint i = 1; valid && lines[i] != NULL; i++) {
+    if (*lines[i] == '\0') {
+      continue;
+    }
+
+    gchar **fields = g_strsplit(lines[i], "\t", -1);
+    guint count = g_strv_length(fields);
+
+    if (count == 2 && strcmp(fields[0], "root") == 0) {
+      gchar *recorded = g_strcompress(fields[1]);
+      valid = strcmp(recorded, root) == 0;
+      g_free(recorded);
+    } else if (count == 3 && strcmp(fields[0], "d") == 0) {
+      gchar *path = g_strcompress(fields[1]);
+      gst_projectm_preset_index_set_directory(
+          index->directories, path, g_ascii_strtoll(fields[2], NULL, 10));
+      g_free(path);
+    } else if (count == 7 && strcmp(fields[0], "p") == 0) {
+      GstProjectMPresetIndexEntry *entry =
+          g_new0(GstProjectMPresetIndexEntry, 1);
+
+      entry->path = g_strcompress(fields[1]);
+      entry->size = g_ascii_strtoull(fields[2], NULL, 10);
+      entry->mtime = g_ascii_strtoll(fields[3], NULL, 10);
+      entry->hash = *fields[4] != '\0' ? g_strdup(fields[4]) : NULL;
+      entry->cost =
+          *fields[5] != '\0' ? g_ascii_strtod(fields[5], NULL) : -1.0;
+      entry->tags = *fields[6] != '\0' ? g_strcompress(fields[6]) : NULL;
+      g_ptr_array_add(index->entries, entry);
+    } else {
+      valid = FALSE;
+    }
+
+    g_strfreev(fields);
+  }
+
+  g_strfreev(lines);
+
+  if (!valid) {
+    GST_INFO_OBJECT(log_object,
+                    "Preset index %s is stale or belongs to another "
+                    "directory; rebuilding it",
+                    index_path);
+    gst_projectm_preset_index_free(index);
+    return NULL;
+  }
+
+  return index;
+}
+
+GstProjectMPresetIndex *gst_projectm_preset_index_load(const gchar *root,
+                                                       const gchar *index_path,
+                                                       GObject *log_object) {
+  gst_projectm_preset_index_init_debug();
+
+  if (!g_file_test(root, G_FILE_TEST_IS_DIR)) {
+    return NULL;
+  }
+
+  gint64 start = g_get_monotonic_time();
+  GstProjectMPresetIndex *old =
+      gst_projectm_preset_index_read(root, index_path, log_object);
+  GstProjectMPresetIndexScan scan = {0};
+
+  scan.index = gst_projectm_preset_index_new(root);
+  scan.log_object = log_object;
+  scan.visited = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  scan.old_files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                         (GDestroyNotify)g_ptr_array_unref);
+  scan.old_children = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                            (GDestroyNotify)g_ptr_array_unref);
+
+  if (old != NULL) {
+    scan.old_directories = g_hash_table_ref(old->directories);
+
+    /* Regroup the previous scan by directory; entries left in old_files
+     * after the walk are presets that disappeared. */
+    while (old->entries->len > 0) {
+      GstProjectMPresetIndexEntry *entry =
+          g_ptr_array_steal_index_fast(old->entries, old->entries->len - 1);
+      gchar *directory = gst_projectm_preset_index_dirname(entry->path);
+
+      g_ptr_array_add(
+          gst_projectm_preset_index_group(scan.old_files, directory,
+                                          gst_projectm_preset_index_entry_free),
+          entry);
+      g_free(directory);
+    }
+
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, old->directories);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+      const gchar *path = key;
+      const gchar *slash = strrchr(path, '/');
+
+      if (*path == '\0') {
+        continue;
+      }
+
+      gchar *parent = gst_projectm_preset_index_dirname(path);
+      g_ptr_array_add(gst_projectm_preset_index_group(scan.old_children,
+                                                      parent, g_free),
+                      g_strdup(slash != NULL ? slash + 1 : path));
+      g_free(parent);
+    }
+
+    gst_projectm_preset_index_free(old);
+  } else {
+    scan.old_directories =
+        g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    scan.changed = TRUE;
+  }
+
+  gst_projectm_preset_index_visit(&scan, "", 0);
+
+  /* Anything not carried over means presets were removed. */
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init(&iter, scan.old_files);
+  while (!scan.changed && g_hash_table_iter_next(&iter, NULL, &value)) {
+    GPtrArray *files = value;
+
+    for (guint i = 0; i < files->len; i++) {
+      if (files->pdata[i] != NULL) {
+        scan.changed = TRUE;
+        break;
+      }
+    }
+  }
+
+  g_ptr_array_sort(scan.index->entries,
+                   gst_projectm_preset_index_entry_compare);
+
+  GST_INFO_OBJECT(log_object,
+                  "Preset index of %s: %u presets in %u directories, %u "
+                  "rescanned, %" G_GINT64_FORMAT " us",
+                  root, scan.index->entries->len,
+                  g_hash_table_size(scan.index->directories),
+                  scan.directories_scanned, g_get_monotonic_time() - start);
+
+  if (scan.changed) {
+    GError *error = NULL;
+
+    if (!gst_projectm_preset_index_save(scan.index, index_path, &error)) {
+      GST_WARNING_OBJECT(log_object, "Unable to write preset index %s: %s",
+                         index_path, error->message);
+      g_clear_error(&error);
+    }
+  }
+
+  g_hash_table_unref(scan.visited);
+  g_hash_table_unref(scan.old_files);
+  g_hash_table_unref(scan.old_children);
+  g_hash_table_unref(scan.old_directories);
+
+  return scan.index;
+}
+
+gboolean gst_projectm_preset_index_save(GstProjectMPresetIndex *index,
+                                        const gchar *index_path,
+                                        GError **error) {
+  GString *out = g_string_new(GST_PROJECTM_PRESET_INDEX_HEADER "\n");
+  gchar *escaped = g_strescape(index->root, NULL);
+  gchar number[G_ASCII_DTOSTR_BUF_SIZE];
+
+  g_string_append_printf(out, "root\t%s\n", escaped);
+  g_free(escaped);
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, index->directories);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    escaped = g_strescape(key, NULL);
+    g_string_append_printf(out, "d\t%s\t%" G_GINT64_FORMAT "\n", escaped,
+                           *(gint64 *)value);
+    g_free(escaped);
+  }
+
+  for (guint i = 0; i < index->entries->len; i++) {
+    GstProjectMPresetIndexEntry *entry =
+        g_ptr_array_index(index->entries, i);
+
+    escaped = g_strescape(entry->path, NULL);
+    g_string_append_printf(out, "p\t%s\t%" G_GUINT64_FORMAT
+                                "\t%" G_GINT64_FORMAT "\t%s\t",
+                           escaped, entry->size, entry->mtime,
+                           entry->hash != NULL ? entry->hash : "");
+    g_free(escaped);
+
+    if (entry->cost >= 0.0) {
+      g_string_append(out, g_ascii_dtostr(number, sizeof(number), entry->cost));
+    }
+
+    escaped = g_strescape(entry->tags != NULL ? entry->tags : "", NULL);
+    g_string_append_printf(out, "\t%s\n", escaped);
+    g_free(escaped);
+  }
+
+  gboolean ok = g_file_set_contents(index_path, out->str, out->len, error);
+  g_string_free(out, TRUE);
+  return ok;
+}
+
+gchar **gst_projectm_preset_index_get_paths(GstProjectMPresetIndex *index) {
+  gchar **paths = g_new0(gchar *, index->entries->len + 1);
+
+  for (guint i = 0; i < index->entries->len; i++) {
+    GstProjectMPresetIndexEntry *entry =
+        g_ptr_array_index(index->entries, i);
+    paths[i] = g_build_filename(index->root, entry->path, NULL);
+  }
+
+  return paths;
+}
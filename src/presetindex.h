@@ -0,0 +1,84 @@
+#ifndef __GST_PROJECTM_PRESET_INDEX_H__
+#define __GST_PROJECTM_PRESET_INDEX_H__
+
+#include <glib-object.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief One preset file of a preset directory index.
+ */
+typedef struct {
+  /* Path relative to the index root, '/'-separated. */
+  gchar *path;
+  guint64 size;
+  /* Modification time in seconds since the epoch. */
+  gint64 mtime;
+  /* Hex SHA-1 of the file contents. */
+  gchar *hash;
+  /* Render cost supplied by external tooling, negative if unknown. */
+  gdouble cost;
+  /* Comma-separated tags supplied by external tooling, may be NULL. */
+  gchar *tags;
+} GstProjectMPresetIndexEntry;
+
+/**
+ * @brief Index of all presets below a directory.
+ *
+ * Besides the presets, the index records the modification time of every
+ * directory it covers. Adding, removing or renaming a file changes its
+ * directory's mtime, so revalidation only needs to stat directories and
+ * rescan the ones that changed.
+ */
+typedef struct {
+  gchar *root;
+  /* GstProjectMPresetIndexEntry, sorted by path. */
+  GPtrArray *entries;
+  /* Relative directory path -> mtime, stored in a gint64. */
+  GHashTable *directories;
+} GstProjectMPresetIndex;
+
+/**
+ * @brief Load the index of a preset directory, bringing it up to date.
+ *
+ * Reads index_path if it exists and describes root, rescans the
+ * directories that changed since it was written (or the whole tree without
+ * a usable index) and writes the result back when anything changed. A
+ * failure to write is logged and otherwise ignored, so read-only preset
+ * stores still work.
+ *
+ * Files edited in place keep their recorded size, mtime and hash until
+ * their directory changes.
+ *
+ * @param root Preset directory.
+ * @param index_path Index file to read and update.
+ * @param log_object Object to attribute log messages to, may be NULL.
+ * @return The index, or NULL if root is not a directory.
+ */
+GstProjectMPresetIndex *gst_projectm_preset_index_load(const gchar *root,
+                                                       const gchar *index_path,
+                                                       GObject *log_object);
+
+/**
+ * @brief Write an index file atomically.
+ */
+gboolean gst_projectm_preset_index_save(GstProjectMPresetIndex *index,
+                                        const gchar *index_path,
+                                        GError **error);
+
+/**
+ * @brief List the absolute paths of all indexed presets.
+ *
+ * @return A NULL-terminated array in path order, free with g_strfreev().
+ */
+gchar **gst_projectm_preset_index_get_paths(GstProjectMPresetIndex *index);
+
+/**
+ * @brief Free an index.
+ */
+void gst_projectm_preset_index_free(GstProjectMPresetIndex *index);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_PRESET_INDEX_H__ */
@@ -8,15 +8,19 @@
 #include <projectM-4/projectM.h>
 
 #include "plugin.h"
+#include "presetindex.h"
 #include "projectm.h"
 
 GST_DEBUG_CATEGORY_STATIC(projectm_debug);
 #define GST_CAT_DEFAULT projectm_debug
 
-projectm_handle projectm_init(GstProjectM *plugin) {
+projectm_handle projectm_init(GstProjectM *plugin,
+                              projectm_playlist_handle *playlist_out) {
   projectm_handle handle = NULL;
   projectm_playlist_handle playlist = NULL;
 
+  *playlist_out = NULL;
+
   GST_DEBUG_CATEGORY_INIT(projectm_debug, "projectm", 0, "ProjectM");
 
   GstAudioVisualizer *bscope = GST_AUDIO_VISUALIZER(plugin);
@@ -35,7 +39,13 @@ projectm_handle projectm_init(GstProjectM *plugin) {
   }
 
   gboolean timeline_active = gst_projectm_timeline_is_active(plugin);
-  gboolean use_playlist = plugin->enable_playlist && !timeline_active;
+  GstProjectMArchive *archive = gst_projectm_get_preset_archive(plugin);
+  // The playlist library only loads preset files; archives are switched by
+  // the element itself
+  gboolean archive_playlist =
+      archive != NULL && plugin->enable_playlist && !timeline_active;
+  gboolean use_playlist =
+      plugin->enable_playlist && !timeline_active && archive == NULL;
 
   if (timeline_active) {
     GST_INFO_OBJECT(plugin,
@@ -82,12 +92,28 @@ projectm_handle projectm_init(GstProjectM *plugin) {
 
   // Load preset file if path is provided
   if (plugin->preset_path != NULL && playlist != NULL) {
-    int added_count =
-        projectm_playlist_add_path(playlist, plugin->preset_path, true, false);
+    GstProjectMPresetIndex *index = NULL;
+    int added_count;
+
+    if (plugin->preset_index_path != NULL) {
+      index = gst_projectm_preset_index_load(
+          plugin->preset_path, plugin->preset_index_path, G_OBJECT(plugin));
+    }
+
+    if (index != NULL) {
+      gchar **paths = gst_projectm_preset_index_get_paths(index);
+      added_count = projectm_playlist_add_presets(
+          playlist, (const char **)paths, g_strv_length(paths), false);
+      g_strfreev(paths);
+      gst_projectm_preset_index_free(index);
+    } else {
+      added_count = projectm_playlist_add_path(playlist, plugin->preset_path,
+                                               true, false);
+    }
     GST_INFO("Loaded preset path: %s, presets found: %d", plugin->preset_path,
              added_count);
   } else if (plugin->preset_path != NULL && playlist == NULL &&
-             !timeline_active) {
+             !timeline_active && archive == NULL) {
     GST_INFO(
         "Preset directory provided (%s) but playlist is disabled; timeline "
         "or direct preset loading will handle switching",
@@ -95,8 +121,9 @@ projectm_handle projectm_init(GstProjectM *plugin) {
   }
 
   // Set texture search path if directory path is provided
-  if (plugin->texture_dir_path != NULL) {
-    const gchar *texturePaths[1] = {plugin->texture_dir_path};
+  const gchar *texture_path = gst_projectm_get_texture_search_path(plugin);
+  if (texture_path != NULL) {
+    const gchar *texturePaths[1] = {texture_path};
     projectm_set_texture_search_paths(handle, texturePaths, 1);
   }
 
@@ -108,7 +135,7 @@ projectm_handle projectm_init(GstProjectM *plugin) {
   projectm_set_soft_cut_duration(handle, plugin->soft_cut_duration);
 
   // Set preset duration, or set to in infinite duration if zero
-  if (plugin->preset_duration > 0.0 && playlist != NULL) {
+  if (plugin->preset_duration > 0.0 && (playlist != NULL || archive_playlist)) {
     projectm_set_preset_duration(handle, plugin->preset_duration);
   } else {
     projectm_set_preset_duration(handle, 999999.0);
@@ -123,17 +150,22 @@ projectm_handle projectm_init(GstProjectM *plugin) {
     // For timeline mode, load the first preset directly
     GST_INFO("Timeline mode: loading first preset immediately to avoid idle screen");
     gst_projectm_load_first_timeline_preset(plugin, handle);
+  } else if (archive_playlist) {
+    gst_projectm_start_archive_playlist(plugin, handle);
   }
 
-  projectm_set_mesh_size(handle, plugin->mesh_width, plugin->mesh_height);
+  gulong mesh_width, mesh_height;
+  gst_projectm_get_mesh_size(plugin, &mesh_width, &mesh_height);
+  projectm_set_mesh_size(handle, mesh_width, mesh_height);
   projectm_set_aspect_correction(handle, plugin->aspect_correction);
   projectm_set_easter_egg(handle, plugin->easter_egg);
   projectm_set_preset_locked(handle, plugin->preset_locked);
 
-  projectm_set_fps(handle, GST_VIDEO_INFO_FPS_N(&bscope->vinfo));
+  projectm_set_fps(handle, gst_projectm_get_fps(plugin));
   projectm_set_window_size(handle, GST_VIDEO_INFO_WIDTH(&bscope->vinfo),
                            GST_VIDEO_INFO_HEIGHT(&bscope->vinfo));
 
+  *playlist_out = playlist;
   return handle;
 }
 
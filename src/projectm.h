@@ -4,14 +4,20 @@
 #include <glib.h>
 
 #include "plugin.h"
+#include <projectM-4/playlist.h>
 #include <projectM-4/projectM.h>
 
 G_BEGIN_DECLS
 
 /**
  * @brief Initialize ProjectM
+ *
+ * @param plugin The element whose properties configure the instance.
+ * @param playlist Receives the preset playlist, or NULL when the playlist is
+ * disabled. Must be destroyed before the returned instance.
  */
-projectm_handle projectm_init(GstProjectM *plugin);
+projectm_handle projectm_init(GstProjectM *plugin,
+                              projectm_playlist_handle *playlist);
 
 /**
  * @brief Render ProjectM
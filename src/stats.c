@@ -0,0 +1,143 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "stats.h"
+
+static const gchar *phase_names[GST_PROJECTM_PHASE_COUNT] = {
+    "audio", "render", "readback", "copy", "frame"};
+
+static guint gst_projectm_stats_bucket_index(gint64 duration_us) {
+  if (duration_us < 4) {
+    return duration_us < 0 ? 0 : (guint)duration_us;
+  }
+
+  // Four sub-buckets per power of two: the two bits below the MSB select the
+  // sub-bucket, so relative resolution stays at ~25% across the whole range.
+  guint bits = g_bit_storage((gulong)duration_us);
+  guint sub = (guint)((duration_us >> (bits - 3)) & 3);
+  guint index = ((bits - 2) * 4) + sub;
+
+  return MIN(index, GST_PROJECTM_STATS_BUCKETS - 1);
+}
+
+static gint64 gst_projectm_stats_bucket_upper_bound(guint index) {
+  if (index < 4) {
+    return index;
+  }
+
+  guint bits = (index / 4) + 2;
+  guint sub = index % 4;
+  gint64 lower = (gint64)(4 + sub) << (bits - 3);
+
+  return lower + ((gint64)1 << (bits - 3)) - 1;
+}
+
+static gint64 gst_projectm_stats_percentile(const GstProjectMPhaseStats *phase,
+                                            gdouble percentile) {
+  if (phase->count == 0) {
+    return 0;
+  }
+
+  guint64 rank = (guint64)((phase->count - 1) * percentile) + 1;
+  guint64 seen = 0;
+
+  for (guint i = 0; i < GST_PROJECTM_STATS_BUCKETS; i++) {
+    seen += phase->buckets[i];
+    if (seen >= rank) {
+      return MIN(gst_projectm_stats_bucket_upper_bound(i), phase->max_us);
+    }
+  }
+
+  return phase->max_us;
+}
+
+static void gst_projectm_stats_reset_unlocked(GstProjectMStats *stats) {
+  memset(stats->phases, 0, sizeof(stats->phases));
+  stats->gpu_memory_total_kb = -1;
+  stats->gpu_memory_available_kb = -1;
+}
+
+void gst_projectm_stats_init(GstProjectMStats *stats) {
+  g_mutex_init(&stats->lock);
+  gst_projectm_stats_reset_unlocked(stats);
+}
+
+void gst_projectm_stats_clear(GstProjectMStats *stats) {
+  g_mutex_clear(&stats->lock);
+}
+
+void gst_projectm_stats_reset(GstProjectMStats *stats) {
+  g_mutex_lock(&stats->lock);
+  gst_projectm_stats_reset_unlocked(stats);
+  g_mutex_unlock(&stats->lock);
+}
+
+void gst_projectm_stats_record(GstProjectMStats *stats, GstProjectMPhase phase,
+                               gint64 duration_us) {
+  g_return_if_fail(phase < GST_PROJECTM_PHASE_COUNT);
+
+  g_mutex_lock(&stats->lock);
+  GstProjectMPhaseStats *entry = &stats->phases[phase];
+
+  if (entry->count == 0 || duration_us < entry->min_us) {
+    entry->min_us = duration_us;
+  }
+  if (duration_us > entry->max_us) {
+    entry->max_us = duration_us;
+  }
+  entry->count++;
+  entry->total_us += duration_us;
+  entry->buckets[gst_projectm_stats_bucket_index(duration_us)]++;
+  g_mutex_unlock(&stats->lock);
+}
+
+void gst_projectm_stats_set_gpu_memory(GstProjectMStats *stats,
+                                       gint64 total_kb, gint64 available_kb) {
+  g_mutex_lock(&stats->lock);
+  stats->gpu_memory_total_kb = total_kb;
+  stats->gpu_memory_available_kb = available_kb;
+  g_mutex_unlock(&stats->lock);
+}
+
+GstStructure *gst_projectm_stats_to_structure(GstProjectMStats *stats) {
+  GstStructure *s = gst_structure_new_empty("application/x-projectm-stats");
+
+  g_mutex_lock(&stats->lock);
+
+  for (guint i = 0; i < GST_PROJECTM_PHASE_COUNT; i++) {
+    const GstProjectMPhaseStats *phase = &stats->phases[i];
+    const gchar *name = phase_names[i];
+    gchar *field;
+
+#define GST_PROJECTM_STATS_SET(suffix, type, value)                            \
+  field = g_strdup_printf("%s-" suffix, name);                                 \
+  gst_structure_set(s, field, type, value, NULL);                              \
+  g_free(field);
+
+    GST_PROJECTM_STATS_SET("count", G_TYPE_UINT64, phase->count);
+    GST_PROJECTM_STATS_SET(
+        "mean-us", G_TYPE_DOUBLE,
+        phase->count > 0 ? (gdouble)phase->total_us / phase->count : 0.0);
+    GST_PROJECTM_STATS_SET("min-us", G_TYPE_INT64, phase->min_us);
+    GST_PROJECTM_STATS_SET("p50-us", G_TYPE_INT64,
+                           gst_projectm_stats_percentile(phase, 0.50));
+    GST_PROJECTM_STATS_SET("p95-us", G_TYPE_INT64,
+                           gst_projectm_stats_percentile(phase, 0.95));
+    GST_PROJECTM_STATS_SET("p99-us", G_TYPE_INT64,
+                           gst_projectm_stats_percentile(phase, 0.99));
+    GST_PROJECTM_STATS_SET("max-us", G_TYPE_INT64, phase->max_us);
+
+#undef GST_PROJECTM_STATS_SET
+  }
+
+  gst_structure_set(s, "gpu-memory-total-kb", G_TYPE_INT64,
+                    stats->gpu_memory_total_kb, "gpu-memory-available-kb",
+                    G_TYPE_INT64, stats->gpu_memory_available_kb, NULL);
+
+  g_mutex_unlock(&stats->lock);
+
+  return s;
+}
@@ -0,0 +1,89 @@
+#ifndef __GST_PROJECTM_STATS_H__
+#define __GST_PROJECTM_STATS_H__
+
+#include <glib.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief Number of latency histogram buckets per phase.
+ *
+ * Buckets are log-linear (four per power of two, in microseconds), so the
+ * last bucket covers everything above roughly two seconds.
+ */
+#define GST_PROJECTM_STATS_BUCKETS 80
+
+/**
+ * @brief Phases of a rendered frame that are timed individually.
+ */
+typedef enum {
+  GST_PROJECTM_PHASE_AUDIO,
+  GST_PROJECTM_PHASE_RENDER,
+  GST_PROJECTM_PHASE_READBACK,
+  GST_PROJECTM_PHASE_COPY,
+  GST_PROJECTM_PHASE_FRAME,
+  GST_PROJECTM_PHASE_COUNT
+} GstProjectMPhase;
+
+typedef struct {
+  guint64 count;
+  gint64 total_us;
+  gint64 min_us;
+  gint64 max_us;
+  guint64 buckets[GST_PROJECTM_STATS_BUCKETS];
+} GstProjectMPhaseStats;
+
+typedef struct {
+  GMutex lock;
+  GstProjectMPhaseStats phases[GST_PROJECTM_PHASE_COUNT];
+  gint64 gpu_memory_total_kb;
+  gint64 gpu_memory_available_kb;
+} GstProjectMStats;
+
+/**
+ * @brief Initialize the statistics block. Must be paired with
+ * gst_projectm_stats_clear().
+ */
+void gst_projectm_stats_init(GstProjectMStats *stats);
+
+/**
+ * @brief Release resources held by the statistics block.
+ */
+void gst_projectm_stats_clear(GstProjectMStats *stats);
+
+/**
+ * @brief Drop all recorded samples.
+ */
+void gst_projectm_stats_reset(GstProjectMStats *stats);
+
+/**
+ * @brief Record the duration of one phase.
+ *
+ * @param stats The statistics block.
+ * @param phase The phase that was timed.
+ * @param duration_us Duration in microseconds.
+ */
+void gst_projectm_stats_record(GstProjectMStats *stats, GstProjectMPhase phase,
+                               gint64 duration_us);
+
+/**
+ * @brief Store the most recent GPU memory figures, -1 if unknown.
+ */
+void gst_projectm_stats_set_gpu_memory(GstProjectMStats *stats,
+                                       gint64 total_kb, gint64 available_kb);
+
+/**
+ * @brief Snapshot the statistics as a GstStructure.
+ *
+ * Each phase contributes "<phase>-count", "-mean-us", "-p50-us", "-p95-us",
+ * "-p99-us" and "-max-us" fields. Percentiles are upper bounds of the
+ * histogram bucket the sample falls into.
+ *
+ * @return A newly allocated structure named "application/x-projectm-stats".
+ */
+GstStructure *gst_projectm_stats_to_structure(GstProjectMStats *stats);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_STATS_H__ */
@@ -0,0 +1,531 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+
+#ifdef G_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "texturecache.h"
+
+GST_DEBUG_CATEGORY_STATIC(gst_projectm_texture_cache_debug);
+#define GST_CAT_DEFAULT gst_projectm_texture_cache_debug
+
+/* Texture directories are searched this deep, like projectM's scanner. */
+#define GST_PROJECTM_TEXTURE_CACHE_MAX_DEPTH 8
+
+typedef struct {
+  gchar *name;
+  gchar *path;
+  /* Decoded size including mipmaps, 0 until read. */
+  guint64 bytes;
+  gboolean resident;
+  /* Not in the texture directory; projectM will not find it either. */
+  gboolean missing;
+  GList *lru_link;
+} GstProjectMCachedTexture;
+
+typedef enum {
+  GST_PROJECTM_TEXTURE_TASK_PRESET,
+  GST_PROJECTM_TEXTURE_TASK_TEXTURE
+} GstProjectMTextureTaskType;
+
+typedef struct {
+  GstProjectMTextureTaskType type;
+  gchar *name;
+  GstProjectMArchive *archive;
+} GstProjectMTextureTask;
+
+struct _GstProjectMTextureCache {
+  gchar *texture_dir;
+  guint64 budget_bytes;
+  GThreadPool *pool;
+  gint stopping;
+
+  /* Texture name -> file; built by the first worker that needs it. */
+  GMutex index_lock;
+  GHashTable *files;
+
+  GMutex lock;
+  /* Preset -> GStrv of its textures; NULL value while being read. */
+  GHashTable *presets;
+  /* Texture name -> GstProjectMCachedTexture, queued or resident. */
+  GHashTable *textures;
+  /* Resident textures, most recently used first. */
+  GQueue lru;
+  guint64 resident_bytes;
+  guint64 hits;
+  guint64 misses;
+  guint64 evictions;
+};
+
+static void gst_projectm_texture_cache_init_debug(void) {
+  static gsize debug_initialized = 0;
+
+  if (g_once_init_enter(&debug_initialized)) {
+    GST_DEBUG_CATEGORY_INIT(gst_projectm_texture_cache_debug,
+                            "projectm-texture-cache", 0,
+                            "projectM texture prefetching");
+    g_once_init_leave(&debug_initialized, 1);
+  }
+}
+
+static gboolean gst_projectm_texture_cache_is_builtin(const gchar *name) {
+  static const gchar *const builtin[] = {
+      "main",     "blur1",       "blur2",       "blur3",       "noise_lq",
+      "noise_mq", "noise_hq",    "noisevol_lq", "noisevol_hq", "noise_lq_lite",
+      NULL};
+
+  if (g_str_has_prefix(name, "rand") && g_ascii_isdigit(name[4])) {
+    /* sampler_randNN picks a random texture each time. */
+    return TRUE;
+  }
+
+  return g_strv_contains(builtin, name);
+}
+
+gchar **gst_projectm_texture_cache_parse_preset(const gchar *preset_text) {
+  static const gchar *const prefixes[] = {"sampler_", "texsize_"};
+  GHashTable *names = g_hash_table_new(g_str_hash, g_str_equal);
+  GPtrArray *result = g_ptr_array_new();
+
+  for (guint p = 0; p < G_N_ELEMENTS(prefixes); p++) {
+    const gchar *cursor = preset_text;
+
+    while ((cursor = strstr(cursor, prefixes[p])) != NULL) {
+      /* Only whole identifiers. */
+      gboolean starts_word =
+          cursor == preset_text ||
+          !(g_ascii_isalnum(cursor[-1]) || cursor[-1] == '_');
+      const gchar *start = cursor + strlen(prefixes[p]);
+      const gchar *end = start;
+
+      while (g_ascii_isalnum(*end) || *end == '_') {
+        end++;
+      }
+      cursor = end;
+
+      if (!starts_word || end == start) {
+        continue;
+      }
+
+      gchar *name = g_ascii_strdown(start, end - start);
+
+      /* Filtering and wrap mode prefixes: fw_, fc_, pw_, pc_. */
+      if (strlen(name) > 3 && (name[0] == 'f' || name[0] == 'p') &&
+          (name[1] == 'w' || name[1] == 'c') && name[2] == '_') {
+        memmove(name, name + 3, strlen(name + 3) + 1);
+      }
+
+      if (gst_projectm_texture_cache_is_builtin(name) ||
+          g_hash_table_contains(names, name)) {
+        g_free(name);
+        continue;
+      }
+
+      g_hash_table_add(names, name);
+      g_ptr_array_add(result, name);
+    }
+  }
+
+  g_hash_table_unref(names);
+  g_ptr_array_add(result, NULL);
+  return (gchar **)g_ptr_array_free(result, FALSE);
+}
+
+gboolean gst_projectm_texture_cache_image_size(const guint8 *data, gsize size,
+                                               guint *width, guint *height) {
+  static const guint8 png_signature[8] = {0x89, 'P',  'N',  'G',
+                                          0x0d, 0x0a, 0x1a, 0x0a};
+
+  if (size >= 24 && memcmp(data, png_signature, 8) == 0) {
+    *width = GST_READ_UINT32_BE(data + 16);
+    *height = GST_READ_UINT32_BE(data + 20);
+    return TRUE;
+  }
+
+  if (size >= 4 && data[0] == 0xff && data[1] == 0xd8) {
+    gsize offset = 2;
+
+    while (offset + 9 <= size) {
+      if (data[offset] != 0xff) {
+        return FALSE;
+      }
+
+      guint8 marker = data[offset + 1];
+      if (marker == 0xff) {
+        offset++;
+        continue;
+      }
+
+      /* Start-of-frame markers carry the dimensions; C4, C8 and CC are
+       * other tables in the same range. */
+      if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 &&
+          marker != 0xc8 && marker != 0xcc) {
+        *height = GST_READ_UINT16_BE(data + offset + 5);
+        *width = GST_READ_UINT16_BE(data + offset + 7);
+        return TRUE;
+      }
+
+      offset += 2 + GST_READ_UINT16_BE(data + offset + 2);
+    }
+
+    return FALSE;
+  }
+
+  if (size >= 26 && data[0] == 'B' && data[1] == 'M') {
+    *width = ABS((gint32)GST_READ_UINT32_LE(data + 18));
+    *height = ABS((gint32)GST_READ_UINT32_LE(data + 22));
+    return TRUE;
+  }
+
+  if (size >= 20 && memcmp(data, "DDS ", 4) == 0) {
+    *height = GST_READ_UINT32_LE(data + 12);
+    *width = GST_READ_UINT32_LE(data + 16);
+    return TRUE;
+  }
+
+  /* TGA has no signature; accept the common image types. */
+  if (size >= 18 && (data[2] == 2 || data[2] == 3 || data[2] == 10 ||
+                     data[2] == 11)) {
+    *width = GST_READ_UINT16_LE(data + 12);
+    *height = GST_READ_UINT16_LE(data + 14);
+    return *width > 0 && *height > 0;
+  }
+
+  return FALSE;
+}
+
+static gboolean gst_projectm_texture_cache_is_image(const gchar *name) {
+  const gchar *dot = strrchr(name, '.');
+  static const gchar *const extensions[] = {".jpg", ".jpeg", ".png",
+                                            ".tga", ".bmp",  ".dds"};
+
+  for (guint i = 0; dot != NULL && i < G_N_ELEMENTS(extensions); i++) {
+    if (g_ascii_strcasecmp(dot, extensions[i]) == 0) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+static void gst_projectm_texture_cache_index_dir(GHashTable *files,
+                                                 const gchar *directory,
+                                                 guint depth) {
+  GDir *dir = g_dir_open(directory, 0, NULL);
+  const gchar *entry;
+
+  if (dir == NULL) {
+    return;
+  }
+
+  while ((entry = g_dir_read_name(dir)) != NULL) {
+    gchar *path = g_build_filename(directory, entry, NULL);
+
+    if (g_file_test(path, G_FILE_TEST_IS_DIR)) {
+      if (depth < GST_PROJECTM_TEXTURE_CACHE_MAX_DEPTH) {
+        gst_projectm_texture_cache_index_dir(files, path, depth + 1);
+      }
+    } else if (gst_projectm_texture_cache_is_image(entry)) {
+      const gchar *dot = strrchr(entry, '.');
+      gchar *name = g_ascii_strdown(entry, dot - entry);
+
+      if (!g_hash_table_contains(files, name)) {
+        g_hash_table_insert(files, name, g_strdup(path));
+      } else {
+        g_free(name);
+      }
+    }
+
+    g_free(path);
+  }
+
+  g_dir_close(dir);
+}
+
+static const gchar *gst_projectm_texture_cache_find(GstProjectMTextureCache *cache,
+                                                    const gchar *name) {
+  g_mutex_lock(&cache->index_lock);
+
+  if (cache->files == NULL) {
+    gint64 start = g_get_monotonic_time();
+
+    cache->files =
+        g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    gst_projectm_texture_cache_index_dir(cache->files, cache->texture_dir, 0);
+    GST_INFO("Indexed %u textures in %s in %" G_GINT64_FORMAT " us",
+             g_hash_table_size(cache->files), cache->texture_dir,
+             g_get_monotonic_time() - start);
+  }
+
+  const gchar *path = g_hash_table_lookup(cache->files, name);
+  g_mutex_unlock(&cache->index_lock);
+
+  return path;
+}
+
+/* Drops an evicted texture's file from the page cache, so the budget also
+ * bounds the memory prefetching holds on to. */
+static void gst_projectm_texture_cache_drop_pages(const gchar *path) {
+#if defined(G_OS_UNIX) && defined(POSIX_FADV_DONTNEED)
+  int fd = g_open(path, O_RDONLY, 0);
+
+  if (fd >= 0) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+#endif
+}
+
+/* Called with the lock held. */
+static void gst_projectm_texture_cache_evict(GstProjectMTextureCache *cache,
+                                             GstProjectMCachedTexture *keep) {
+  while (cache->resident_bytes > cache->budget_bytes &&
+         cache->lru.tail != NULL && cache->lru.tail->data != keep) {
+    GstProjectMCachedTexture *texture = g_queue_pop_tail(&cache->lru);
+
+    GST_LOG("Evicting texture %s (%" G_GUINT64_FORMAT " bytes)",
+            texture->name, texture->bytes);
+    cache->resident_bytes -= texture->bytes;
+    cache->evictions++;
+    gst_projectm_texture_cache_drop_pages(texture->path);
+    g_hash_table_remove(cache->textures, texture->name);
+  }
+}
+
+static void gst_projectm_texture_cache_load_texture(GstProjectMTextureCache *cache,
+                                                    const gchar *name) {
+  const gchar *path = gst_projectm_texture_cache_find(cache, name);
+  gchar *contents = NULL;
+  gsize size = 0;
+  guint width = 0, height = 0;
+
+  if (path == NULL || !g_file_get_contents(path, &contents, &size, NULL)) {
+    g_mutex_lock(&cache->lock);
+    GstProjectMCachedTexture *texture =
+        g_hash_table_lookup(cache->textures, name);
+    if (texture != NULL) {
+      texture->missing = TRUE;
+    }
+    g_mutex_unlock(&cache->lock);
+    GST_DEBUG("Texture %s not found", name);
+    return;
+  }
+
+  guint64 bytes = size;
+  if (gst_projectm_texture_cache_image_size((const guint8 *)contents, size,
+                                            &width, &height)) {
+    /* RGBA8 plus a full mipmap chain. */
+    bytes = (guint64)width * height * 4 * 4 / 3;
+  }
+  g_free(contents);
+
+  g_mutex_lock(&cache->lock);
+
+  GstProjectMCachedTexture *texture =
+      g_hash_table_lookup(cache->textures, name);
+  if (texture != NULL && !texture->resident) {
+    texture->path = g_strdup(path);
+    texture->bytes = bytes;
+    texture->resident = TRUE;
+    g_queue_push_head(&cache->lru, texture);
+    texture->lru_link = cache->lru.head;
+    cache->resident_bytes += bytes;
+    gst_projectm_texture_cache_evict(cache, texture);
+  }
+
+  g_mutex_unlock(&cache->lock);
+}
+
+/* Called with the lock held. */
+static void gst_projectm_texture_cache_queue_texture(GstProjectMTextureCache *cache,
+                                                     const gchar *name) {
+  if (g_hash_table_contains(cache->textures, name)) {
+    return;
+  }
+
+  GstProjectMCachedTexture *texture = g_new0(GstProjectMCachedTexture, 1);
+  texture->name = g_strdup(name);
+  g_hash_table_insert(cache->textures, texture->name, texture);
+
+  GstProjectMTextureTask *task = g_new0(GstProjectMTextureTask, 1);
+  task->type = GST_PROJECTM_TEXTURE_TASK_TEXTURE;
+  task->name = g_strdup(name);
+  g_thread_pool_push(cache->pool, task, NULL);
+}
+
+static void gst_projectm_texture_cache_load_preset(GstProjectMTextureCache *cache,
+                                                   const gchar *preset,
+                                                   GstProjectMArchive *archive) {
+  gchar *text = NULL;
+
+  if (archive != NULL) {
+    text = gst_projectm_archive_read(archive, preset, NULL);
+  } else {
+    g_file_get_contents(preset, &text, NULL, NULL);
+  }
+
+  gchar **names = text != NULL ? gst_projectm_texture_cache_parse_preset(text)
+                               : g_new0(gchar *, 1);
+  g_free(text);
+
+  g_mutex_lock(&cache->lock);
+  for (guint i = 0; names[i] != NULL; i++) {
+    gst_projectm_texture_cache_queue_texture(cache, names[i]);
+  }
+  g_hash_table_insert(cache->presets, g_strdup(preset), names);
+  g_mutex_unlock(&cache->lock);
+
+  GST_DEBUG("Preset %s samples %u textures", preset, g_strv_length(names));
+}
+
+static void gst_projectm_texture_cache_task_free(GstProjectMTextureTask *task) {
+  g_free(task->name);
+  g_clear_pointer(&task->archive, gst_projectm_archive_unref);
+  g_free(task);
+}
+
+static void gst_projectm_texture_cache_worker(gpointer data,
+                                              gpointer user_data) {
+  GstProjectMTextureTask *task = data;
+  GstProjectMTextureCache *cache = user_data;
+
+  if (g_atomic_int_get(&cache->stopping)) {
+    /* Shutting down, drain the queue. */
+  } else if (task->type == GST_PROJECTM_TEXTURE_TASK_PRESET) {
+    gst_projectm_texture_cache_load_preset(cache, task->name, task->archive);
+  } else {
+    gst_projectm_texture_cache_load_texture(cache, task->name);
+  }
+
+  gst_projectm_texture_cache_task_free(task);
+}
+
+static void gst_projectm_texture_free(gpointer data) {
+  GstProjectMCachedTexture *texture = data;
+
+  g_free(texture->name);
+  g_free(texture->path);
+  g_free(texture);
+}
+
+GstProjectMTextureCache *gst_projectm_texture_cache_new(const gchar *texture_dir,
+                                                        guint64 budget_bytes,
+                                                        guint threads) {
+  gst_projectm_texture_cache_init_debug();
+
+  GstProjectMTextureCache *cache = g_new0(GstProjectMTextureCache, 1);
+
+  cache->texture_dir = g_strdup(texture_dir);
+  cache->budget_bytes = budget_bytes;
+  g_mutex_init(&cache->index_lock);
+  g_mutex_init(&cache->lock);
+  cache->presets = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                         (GDestroyNotify)g_strfreev);
+  cache->textures = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                          gst_projectm_texture_free);
+  g_queue_init(&cache->lru);
+  cache->pool = g_thread_pool_new(gst_projectm_texture_cache_worker, cache,
+                                  MAX(threads, 1), FALSE, NULL);
+
+  return cache;
+}
+
+void gst_projectm_texture_cache_free(GstProjectMTextureCache *cache) {
+  if (cache == NULL) {
+    return;
+  }
+
+  /* Skip queued work, wait for running tasks. */
+  g_atomic_int_set(&cache->stopping, 1);
+  g_thread_pool_free(cache->pool, FALSE, TRUE);
+
+  g_queue_clear(&cache->lru);
+  g_hash_table_unref(cache->textures);
+  g_hash_table_unref(cache->presets);
+  g_clear_pointer(&cache->files, g_hash_table_unref);
+  g_mutex_clear(&cache->lock);
+  g_mutex_clear(&cache->index_lock);
+  g_free(cache->texture_dir);
+  g_free(cache);
+}
+
+void gst_projectm_texture_cache_prefetch(GstProjectMTextureCache *cache,
+                                         const gchar *preset,
+                                         GstProjectMArchive *archive) {
+  g_mutex_lock(&cache->lock);
+
+  if (!g_hash_table_contains(cache->presets, preset)) {
+    GstProjectMTextureTask *task = g_new0(GstProjectMTextureTask, 1);
+
+    g_hash_table_insert(cache->presets, g_strdup(preset), NULL);
+    task->type = GST_PROJECTM_TEXTURE_TASK_PRESET;
+    task->name = g_strdup(preset);
+    task->archive = archive != NULL ? gst_projectm_archive_ref(archive) : NULL;
+    g_thread_pool_push(cache->pool, task, NULL);
+  } else {
+    /* Known preset: make sure evicted textures come back. */
+    gchar **names = g_hash_table_lookup(cache->presets, preset);
+
+    for (guint i = 0; names != NULL && names[i] != NULL; i++) {
+      gst_projectm_texture_cache_queue_texture(cache, names[i]);
+    }
+  }
+
+  g_mutex_unlock(&cache->lock);
+}
+
+void gst_projectm_texture_cache_use(GstProjectMTextureCache *cache,
+                                    const gchar *preset,
+                                    GstProjectMArchive *archive) {
+  g_mutex_lock(&cache->lock);
+
+  gchar **names = g_hash_table_lookup(cache->presets, preset);
+
+  if (names == NULL) {
+    cache->misses++;
+    g_mutex_unlock(&cache->lock);
+    GST_DEBUG("Preset %s was not prefetched", preset);
+    gst_projectm_texture_cache_prefetch(cache, preset, archive);
+    return;
+  }
+
+  for (guint i = 0; names[i] != NULL; i++) {
+    GstProjectMCachedTexture *texture =
+        g_hash_table_lookup(cache->textures, names[i]);
+
+    if (texture != NULL && texture->missing) {
+      continue;
+    }
+
+    if (texture != NULL && texture->resident) {
+      cache->hits++;
+      g_queue_unlink(&cache->lru, texture->lru_link);
+      g_queue_push_head_link(&cache->lru, texture->lru_link);
+    } else {
+      cache->misses++;
+      gst_projectm_texture_cache_queue_texture(cache, names[i]);
+    }
+  }
+
+  g_mutex_unlock(&cache->lock);
+}
+
+void gst_projectm_texture_cache_add_stats(GstProjectMTextureCache *cache,
+                                          GstStructure *structure) {
+  g_mutex_lock(&cache->lock);
+  gst_structure_set(structure, "texture-hits", G_TYPE_UINT64, cache->hits,
+                    "texture-misses", G_TYPE_UINT64, cache->misses,
+                    "texture-evictions", G_TYPE_UINT64, cache->evictions,
+                    "texture-resident-bytes", G_TYPE_UINT64,
+                    cache->resident_bytes, "texture-prefetch-budget-bytes",
+                    G_TYPE_UINT64, cache->budget_bytes, NULL);
+  g_mutex_unlock(&cache->lock);
+}
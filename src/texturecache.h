@@ -0,0 +1,93 @@
+#ifndef __GST_PROJECTM_TEXTURE_CACHE_H__
+#define __GST_PROJECTM_TEXTURE_CACHE_H__
+
+#include <glib.h>
+#include <gst/gst.h>
+
+#include "archive.h"
+
+G_BEGIN_DECLS
+
+/**
+ * @brief Prefetches the textures of upcoming presets within a memory budget.
+ *
+ * projectM loads, decodes and uploads preset textures itself, synchronously
+ * on the GL thread, the first time a preset samples them. The cache works
+ * ahead of it: worker threads read upcoming presets, find the textures they
+ * sample and read those files so the first use is served from the page
+ * cache instead of stalling the frame on (network) storage. Textures are
+ * kept in an LRU sized by their decoded GPU footprint, read from the image
+ * header; evicted files are dropped from the page cache again.
+ */
+typedef struct _GstProjectMTextureCache GstProjectMTextureCache;
+
+/**
+ * @brief Create a cache for a texture directory.
+ *
+ * @param texture_dir Directory projectM loads textures from.
+ * @param budget_bytes Decoded size the prefetched textures may add up to.
+ * @param threads Worker threads reading presets and textures.
+ */
+GstProjectMTextureCache *gst_projectm_texture_cache_new(const gchar *texture_dir,
+                                                        guint64 budget_bytes,
+                                                        guint threads);
+
+/**
+ * @brief Stop the workers and free the cache.
+ */
+void gst_projectm_texture_cache_free(GstProjectMTextureCache *cache);
+
+/**
+ * @brief Queue a preset whose textures should be loaded ahead of use.
+ *
+ * Returns immediately; the preset is read on a worker thread.
+ *
+ * @param cache The cache.
+ * @param preset Preset file path, or member name when archive is set.
+ * @param archive Archive containing the preset, may be NULL.
+ */
+void gst_projectm_texture_cache_prefetch(GstProjectMTextureCache *cache,
+                                         const gchar *preset,
+                                         GstProjectMArchive *archive);
+
+/**
+ * @brief Record that a preset is being loaded.
+ *
+ * Counts a hit for each of its textures already prefetched and a miss for
+ * the others, and marks them most recently used. A preset that was never
+ * prefetched counts as a miss and is queued, so it is warm next time.
+ */
+void gst_projectm_texture_cache_use(GstProjectMTextureCache *cache,
+                                    const gchar *preset,
+                                    GstProjectMArchive *archive);
+
+/**
+ * @brief Add "texture-hits", "texture-misses", "texture-evictions",
+ * "texture-resident-bytes" and "texture-prefetch-budget-bytes" fields to a stats
+ * structure.
+ */
+void gst_projectm_texture_cache_add_stats(GstProjectMTextureCache *cache,
+                                          GstStructure *structure);
+
+/**
+ * @brief Extract the names of the textures a preset samples.
+ *
+ * Finds sampler_ and texsize_ references, drops filter/wrap prefixes and
+ * projectM's built-in and random textures.
+ *
+ * @return A NULL-terminated array of unique names, free with g_strfreev().
+ */
+gchar **gst_projectm_texture_cache_parse_preset(const gchar *preset_text);
+
+/**
+ * @brief Read the pixel size of a PNG, JPEG, TGA, BMP or DDS image from its
+ * header.
+ *
+ * @return FALSE if the format is not recognised.
+ */
+gboolean gst_projectm_texture_cache_image_size(const guint8 *data, gsize size,
+                                               guint *width, guint *height);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_TEXTURE_CACHE_H__ */
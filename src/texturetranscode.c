@@ -0,0 +1,726 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <gst/base/gsttypefindhelper.h>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#ifdef G_OS_UNIX
+#include <unistd.h>
+#endif
+
+#include "texturetranscode.h"
+
+GST_DEBUG_CATEGORY_STATIC(gst_projectm_texture_transcode_debug);
+#define GST_CAT_DEFAULT gst_projectm_texture_transcode_debug
+
+#define GST_PROJECTM_TEXTURE_TRANSCODE_MAX_DEPTH 8
+#define GST_PROJECTM_TEXTURE_DECODE_TIMEOUT (10 * GST_SECOND)
+
+#define GST_PROJECTM_DDS_HEADER_SIZE 128
+#define GST_PROJECTM_DDSD_CAPS 0x1
+#define GST_PROJECTM_DDSD_HEIGHT 0x2
+#define GST_PROJECTM_DDSD_WIDTH 0x4
+#define GST_PROJECTM_DDSD_PIXELFORMAT 0x1000
+#define GST_PROJECTM_DDSD_MIPMAPCOUNT 0x20000
+#define GST_PROJECTM_DDSD_LINEARSIZE 0x80000
+#define GST_PROJECTM_DDPF_FOURCC 0x4
+#define GST_PROJECTM_DDSCAPS_COMPLEX 0x8
+#define GST_PROJECTM_DDSCAPS_TEXTURE 0x1000
+#define GST_PROJECTM_DDSCAPS_MIPMAP 0x400000
+
+struct _GstProjectMTextureTranscoder {
+  gchar *texture_dir;
+  gchar *view_dir;
+};
+
+typedef struct {
+  gchar *source;
+  /* Cache entry for the source's path, size and mtime. */
+  gchar *ref;
+} GstProjectMTranscodeJob;
+
+/* Shared by all elements so a texture is only transcoded once per
+ * process; pending holds the refs being worked on. */
+static GMutex gst_projectm_transcode_lock;
+static GThreadPool *gst_projectm_transcode_pool = NULL;
+static GHashTable *gst_projectm_transcode_pending = NULL;
+
+static void gst_projectm_texture_transcode_init_debug(void) {
+  static gsize debug_initialized = 0;
+
+  if (g_once_init_enter(&debug_initialized)) {
+    GST_DEBUG_CATEGORY_INIT(gst_projectm_texture_transcode_debug,
+                            "projectm-texture-transcode", 0,
+                            "projectM compressed texture cache");
+    g_once_init_leave(&debug_initialized, 1);
+  }
+}
+
+static gchar *gst_projectm_texture_transcode_cache_dir(void) {
+  return g_build_filename(g_get_user_cache_dir(), "gst-projectm", "textures",
+                          NULL);
+}
+
+/* ---- BC1/BC3 encoding ---- */
+
+static guint16 gst_projectm_pack_565(const guint8 *rgb) {
+  return (guint16)(((rgb[0] * 31 + 127) / 255) << 11 |
+                   ((rgb[1] * 63 + 127) / 255) << 5 |
+                   ((rgb[2] * 31 + 127) / 255));
+}
+
+static void gst_projectm_unpack_565(guint16 color, gint *rgb) {
+  gint r = (color >> 11) & 0x1f, g = (color >> 5) & 0x3f, b = color & 0x1f;
+
+  rgb[0] = (r << 3) | (r >> 2);
+  rgb[1] = (g << 2) | (g >> 4);
+  rgb[2] = (b << 3) | (b >> 2);
+}
+
+/* Endpoints are the block's extremes along its principal axis, found by a
+ * few power iterations on the colour covariance. */
+static void gst_projectm_encode_color_block(const guint8 *block, guint8 *out) {
+  gfloat mean[3] = {0, 0, 0};
+  gfloat cov[6] = {0, 0, 0, 0, 0, 0};
+
+  for (guint i = 0; i < 16; i++) {
+    for (guint c = 0; c < 3; c++) {
+      mean[c] += block[i * 4 + c] / 16.0f;
+    }
+  }
+
+  for (guint i = 0; i < 16; i++) {
+    gfloat r = block[i * 4] - mean[0];
+    gfloat g = block[i * 4 + 1] - mean[1];
+    gfloat b = block[i * 4 + 2] - mean[2];
+
+    cov[0] += r * r;
+    cov[1] += r * g;
+    cov[2] += r * b;
+    cov[3] += g * g;
+    cov[4] += g * b;
+    cov[5] += b * b;
+  }
+
+  gfloat axis[3] = {1, 1, 1};
+  for (guint iteration = 0; iteration < 4; iteration++) {
+    gfloat next[3] = {
+        cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+        cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+        cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]};
+    gfloat scale =
+        MAX(MAX(ABS(next[0]), ABS(next[1])), ABS(next[2]));
+
+    if (scale < 1e-6f) {
+      break;
+    }
+    for (guint c = 0; c < 3; c++) {
+      axis[c] = next[c] / scale;
+    }
+  }
+
+  guint min_index = 0, max_index = 0;
+  gfloat min_dot = G_MAXFLOAT, max_dot = -G_MAXFLOAT;
+  for (guint i = 0; i < 16; i++) {
+    gfloat dot = block[i * 4] * axis[0] + block[i * 4 + 1] * axis[1] +
+                 block[i * 4 + 2] * axis[2];
+
+    if (dot < min_dot) {
+      min_dot = dot;
+      min_index = i;
+    }
+    if (dot > max_dot) {
+      max_dot = dot;
+      max_index = i;
+    }
+  }
+
+  guint16 c0 = gst_projectm_pack_565(block + max_index * 4);
+  guint16 c1 = gst_projectm_pack_565(block + min_index * 4);
+  guint32 indices = 0;
+
+  /* c0 > c1 selects four-colour mode in BC1. */
+  if (c0 < c1) {
+    guint16 swap = c0;
+    c0 = c1;
+    c1 = swap;
+  }
+
+  if (c0 != c1) {
+    gint palette[4][3];
+
+    gst_projectm_unpack_565(c0, palette[0]);
+    gst_projectm_unpack_565(c1, palette[1]);
+    for (guint c = 0; c < 3; c++) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    for (guint i = 0; i < 16; i++) {
+      guint best = 0;
+      gint best_error = G_MAXINT;
+
+      for (guint p = 0; p < 4; p++) {
+        gint dr = block[i * 4] - palette[p][0];
+        gint dg = block[i * 4 + 1] - palette[p][1];
+        gint db = block[i * 4 + 2] - palette[p][2];
+        gint error = dr * dr + dg * dg + db * db;
+
+        if (error < best_error) {
+          best_error = error;
+          best = p;
+        }
+      }
+      indices |= best << (2 * i);
+    }
+  }
+
+  GST_WRITE_UINT16_LE(out, c0);
+  GST_WRITE_UINT16_LE(out + 2, c1);
+  GST_WRITE_UINT32_LE(out + 4, indices);
+}
+
+static void gst_projectm_encode_alpha_block(const guint8 *block, guint8 *out) {
+  guint8 a0 = 0, a1 = 255;
+
+  for (guint i = 0; i < 16; i++) {
+    a0 = MAX(a0, block[i * 4 + 3]);
+    a1 = MIN(a1, block[i * 4 + 3]);
+  }
+
+  guint64 indices = 0;
+  if (a0 != a1) {
+    /* a0 > a1: eight-value mode. */
+    gint palette[8] = {a0, a1};
+
+    for (guint p = 2; p < 8; p++) {
+      palette[p] = ((8 - p) * a0 + (p - 1) * a1) / 7;
+    }
+
+    for (guint i = 0; i < 16; i++) {
+      guint best = 0;
+      gint best_error = G_MAXINT;
+
+      for (guint p = 0; p < 8; p++) {
+        gint error = ABS(block[i * 4 + 3] - palette[p]);
+
+        if (error < best_error) {
+          best_error = error;
+          best = p;
+        }
+      }
+      indices |= (guint64)best << (3 * i);
+    }
+  }
+
+  out[0] = a0;
+  out[1] = a1;
+  for (guint i = 0; i < 6; i++) {
+    out[2 + i] = (guint8)(indices >> (8 * i));
+  }
+}
+
+static gsize gst_projectm_dds_level_size(guint width, guint height,
+                                         guint block_size) {
+  return (gsize)MAX(1, (width + 3) / 4) * MAX(1, (height + 3) / 4) *
+         block_size;
+}
+
+static void gst_projectm_encode_level(const guint8 *rgba, guint width,
+                                      guint height, gboolean alpha,
+                                      guint8 *out) {
+  guint8 block[16 * 4];
+
+  for (guint by = 0; by < height; by += 4) {
+    for (guint bx = 0; bx < width; bx += 4) {
+      /* Partial blocks at the edges repeat the last row and column. */
+      for (guint y = 0; y < 4; y++) {
+        for (guint x = 0; x < 4; x++) {
+          guint sx = MIN(bx + x, width - 1);
+          guint sy = MIN(by + y, height - 1);
+
+          memcpy(block + (y * 4 + x) * 4, rgba + ((gsize)sy * width + sx) * 4,
+                 4);
+        }
+      }
+
+      if (alpha) {
+        gst_projectm_encode_alpha_block(block, out);
+        out += 8;
+      }
+      gst_projectm_encode_color_block(block, out);
+      out += 8;
+    }
+  }
+}
+
+/* 2x2 box filter; odd sizes repeat the last row or column. */
+static guint8 *gst_projectm_downsample(const guint8 *rgba, guint width,
+                                       guint height, guint *out_width,
+                                       guint *out_height) {
+  guint w = MAX(1, width / 2), h = MAX(1, height / 2);
+  guint8 *out = g_malloc((gsize)w * h * 4);
+
+  for (guint y = 0; y < h; y++) {
+    guint y0 = MIN(y * 2, height - 1), y1 = MIN(y * 2 + 1, height - 1);
+
+    for (guint x = 0; x < w; x++) {
+      guint x0 = MIN(x * 2, width - 1), x1 = MIN(x * 2 + 1, width - 1);
+
+      for (guint c = 0; c < 4; c++) {
+        out[((gsize)y * w + x) * 4 + c] =
+            (rgba[((gsize)y0 * width + x0) * 4 + c] +
+             rgba[((gsize)y0 * width + x1) * 4 + c] +
+             rgba[((gsize)y1 * width + x0) * 4 + c] +
+             rgba[((gsize)y1 * width + x1) * 4 + c] + 2) /
+            4;
+      }
+    }
+  }
+
+  *out_width = w;
+  *out_height = h;
+  return out;
+}
+
+guint8 *gst_projectm_texture_encode_dds(const guint8 *rgba, guint width,
+                                        guint height, gsize *size) {
+  gboolean alpha = FALSE;
+  for (gsize i = 0; i < (gsize)width * height && !alpha; i++) {
+    alpha = rgba[i * 4 + 3] != 255;
+  }
+
+  guint block_size = alpha ? 16 : 8;
+  guint levels = 1;
+  gsize total = GST_PROJECTM_DDS_HEADER_SIZE;
+
+  for (guint w = width, h = height;; levels++) {
+    total += gst_projectm_dds_level_size(w, h, block_size);
+    if (w == 1 && h == 1) {
+      break;
+    }
+    w = MAX(1, w / 2);
+    h = MAX(1, h / 2);
+  }
+
+  guint8 *data = g_malloc0(total);
+  memcpy(data, "DDS ", 4);
+  GST_WRITE_UINT32_LE(data + 4, 124);
+  GST_WRITE_UINT32_LE(data + 8, GST_PROJECTM_DDSD_CAPS |
+                                    GST_PROJECTM_DDSD_HEIGHT |
+                                    GST_PROJECTM_DDSD_WIDTH |
+                                    GST_PROJECTM_DDSD_PIXELFORMAT |
+                                    GST_PROJECTM_DDSD_MIPMAPCOUNT |
+                                    GST_PROJECTM_DDSD_LINEARSIZE);
+  GST_WRITE_UINT32_LE(data + 12, height);
+  GST_WRITE_UINT32_LE(data + 16, width);
+  GST_WRITE_UINT32_LE(data + 20,
+                      gst_projectm_dds_level_size(width, height, block_size));
+  GST_WRITE_UINT32_LE(data + 28, levels);
+  GST_WRITE_UINT32_LE(data + 76, 32);
+  GST_WRITE_UINT32_LE(data + 80, GST_PROJECTM_DDPF_FOURCC);
+  memcpy(data + 84, alpha ? "DXT5" : "DXT1", 4);
+  GST_WRITE_UINT32_LE(data + 108, GST_PROJECTM_DDSCAPS_TEXTURE |
+                                      GST_PROJECTM_DDSCAPS_COMPLEX |
+                                      GST_PROJECTM_DDSCAPS_MIPMAP);
+
+  guint8 *out = data + GST_PROJECTM_DDS_HEADER_SIZE;
+  guint8 *level = NULL;
+  const guint8 *pixels = rgba;
+  guint w = width, h = height;
+
+  for (guint i = 0; i < levels; i++) {
+    gst_projectm_encode_level(pixels, w, h, alpha, out);
+    out += gst_projectm_dds_level_size(w, h, block_size);
+
+    if (i + 1 < levels) {
+      guint8 *next = gst_projectm_downsample(pixels, w, h, &w, &h);
+
+      g_free(level);
+      level = next;
+      pixels = next;
+    }
+  }
+  g_free(level);
+
+  *size = total;
+  return data;
+}
+
+/* ---- Transcoding ---- */
+
+/* Decodes an image with whatever decoder GStreamer has for it into tightly
+ * packed RGBA. */
+static guint8 *gst_projectm_texture_decode(const gchar *path, guint *width,
+                                           guint *height, GError **error) {
+  gchar *contents;
+  gsize size;
+
+  if (!g_file_get_contents(path, &contents, &size, error)) {
+    return NULL;
+  }
+
+  GstBuffer *buffer = gst_buffer_new_wrapped(contents, size);
+  GstCaps *caps = gst_type_find_helper_for_buffer(NULL, buffer, NULL);
+
+  if (caps == NULL) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                "Unknown image type");
+    gst_buffer_unref(buffer);
+    return NULL;
+  }
+
+  GstSample *sample = gst_sample_new(buffer, caps, NULL, NULL);
+  GstCaps *rgba = gst_caps_new_simple("video/x-raw", "format", G_TYPE_STRING,
+                                      "RGBA", NULL);
+  GstSample *converted = gst_video_convert_sample(
+      sample, rgba, GST_PROJECTM_TEXTURE_DECODE_TIMEOUT, error);
+
+  gst_caps_unref(rgba);
+  gst_sample_unref(sample);
+  gst_caps_unref(caps);
+  gst_buffer_unref(buffer);
+
+  if (converted == NULL) {
+    return NULL;
+  }
+
+  GstVideoInfo info;
+  GstVideoFrame frame;
+  guint8 *pixels = NULL;
+
+  if (gst_video_info_from_caps(&info, gst_sample_get_caps(converted)) &&
+      gst_video_frame_map(&frame, &info, gst_sample_get_buffer(converted),
+                          GST_MAP_READ)) {
+    *width = GST_VIDEO_INFO_WIDTH(&info);
+    *height = GST_VIDEO_INFO_HEIGHT(&info);
+    pixels = g_malloc((gsize)*width * *height * 4);
+
+    for (guint y = 0; y < *height; y++) {
+      memcpy(pixels + (gsize)y * *width * 4,
+             (const guint8 *)GST_VIDEO_FRAME_PLANE_DATA(&frame, 0) +
+                 (gsize)y * GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0),
+             (gsize)*width * 4);
+    }
+    gst_video_frame_unmap(&frame);
+  } else {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                "Unable to map decoded image");
+  }
+
+  gst_sample_unref(converted);
+  return pixels;
+}
+
+#ifdef G_OS_UNIX
+/* Replaces link atomically, so readers never see a missing entry. */
+static gboolean gst_projectm_replace_symlink(const gchar *target,
+                                             const gchar *link) {
+  gchar *temporary = g_strdup_printf("%s.%d.tmp", link, getpid());
+  gboolean ok = symlink(target, temporary) == 0 &&
+                g_rename(temporary, link) == 0;
+
+  if (!ok) {
+    g_remove(temporary);
+  }
+  g_free(temporary);
+  return ok;
+}
+#endif
+
+static gboolean gst_projectm_transcode_texture(const gchar *source,
+                                               const gchar *ref,
+                                               GError **error) {
+#ifdef G_OS_UNIX
+  guint width, height;
+  guint8 *pixels = gst_projectm_texture_decode(source, &width, &height, error);
+
+  if (pixels == NULL) {
+    return FALSE;
+  }
+
+  /* Content hash: identical textures in different packs share a file. */
+  gchar *hash = g_compute_checksum_for_data(G_CHECKSUM_SHA1, pixels,
+                                            (gsize)width * height * 4);
+  gchar *name = g_strdup_printf("%s.dds", hash);
+  gchar *directory = g_path_get_dirname(ref);
+  gchar *path = g_build_filename(directory, name, NULL);
+  gboolean ok = TRUE;
+
+  if (!g_file_test(path, G_FILE_TEST_EXISTS)) {
+    gsize size;
+    guint8 *dds = gst_projectm_texture_encode_dds(pixels, width, height, &size);
+
+    ok = g_file_set_contents(path, (const gchar *)dds, size, error);
+    g_free(dds);
+  }
+
+  if (ok && !gst_projectm_replace_symlink(name, ref)) {
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errno),
+                "Unable to link %s: %s", ref, g_strerror(errno));
+    ok = FALSE;
+  }
+
+  if (ok) {
+    GST_DEBUG("Transcoded %s (%ux%u) to %s", source, width, height, path);
+  }
+  g_free(path);
+  g_free(directory);
+  g_free(name);
+  g_free(hash);
+  g_free(pixels);
+  return ok;
+#else
+  g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+              "Texture transcoding needs symlinks");
+  return FALSE;
+#endif
+}
+
+static void gst_projectm_transcode_worker(gpointer data, gpointer user_data) {
+  GstProjectMTranscodeJob *job = data;
+  GError *error = NULL;
+
+  if (!gst_projectm_transcode_texture(job->source, job->ref, &error)) {
+    /* Remembered, so the file is not retried on every start. */
+    gchar *failed = g_strdup_printf("%s.failed", job->ref);
+
+    GST_INFO("Not transcoding %s: %s", job->source, error->message);
+    g_file_set_contents(failed, "", 0, NULL);
+    g_free(failed);
+    g_clear_error(&error);
+  }
+
+  g_mutex_lock(&gst_projectm_transcode_lock);
+  g_hash_table_remove(gst_projectm_transcode_pending, job->ref);
+  g_mutex_unlock(&gst_projectm_transcode_lock);
+
+  g_free(job->source);
+  g_free(job->ref);
+  g_free(job);
+}
+
+static void gst_projectm_transcode_queue(const gchar *source,
+                                         const gchar *ref) {
+  g_mutex_lock(&gst_projectm_transcode_lock);
+
+  if (gst_projectm_transcode_pool == NULL) {
+    gst_projectm_transcode_pool = g_thread_pool_new(
+        gst_projectm_transcode_worker, NULL,
+        MAX(1, (gint)g_get_num_processors() / 2), FALSE, NULL);
+    gst_projectm_transcode_pending =
+        g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  }
+
+  if (!g_hash_table_contains(gst_projectm_transcode_pending, ref)) {
+    GstProjectMTranscodeJob *job = g_new0(GstProjectMTranscodeJob, 1);
+
+    job->source = g_strdup(source);
+    job->ref = g_strdup(ref);
+    g_hash_table_add(gst_projectm_transcode_pending, g_strdup(ref));
+    g_thread_pool_push(gst_projectm_transcode_pool, job, NULL);
+  }
+
+  g_mutex_unlock(&gst_projectm_transcode_lock);
+}
+
+/* ---- Directory view ---- */
+
+typedef struct {
+  const gchar *cache_dir;
+  guint compressed;
+  guint queued;
+  guint originals;
+} GstProjectMTextureViewStats;
+
+static gboolean gst_projectm_texture_is_transcodable(const gchar *name) {
+  gchar *lower = g_ascii_strdown(name, -1);
+  gboolean transcodable =
+      g_str_has_suffix(lower, ".jpg") || g_str_has_suffix(lower, ".jpeg") ||
+      g_str_has_suffix(lower, ".png") || g_str_has_suffix(lower, ".bmp");
+
+  g_free(lower);
+  return transcodable;
+}
+
+#ifdef G_OS_UNIX
+/* Cache entry for a source file, keyed by its path, size and mtime so
+ * checking it does not need to read the file. */
+static gchar *gst_projectm_texture_ref(const gchar *cache_dir,
+                                       const gchar *path) {
+  GStatBuf st;
+
+  if (g_stat(path, &st) != 0) {
+    return NULL;
+  }
+
+  gchar *key = g_strdup_printf("%s:%" G_GUINT64_FORMAT ":%" G_GINT64_FORMAT,
+                               path, (guint64)st.st_size, (gint64)st.st_mtime);
+  gchar *hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, key, -1);
+  gchar *ref = g_strdup_printf("%s%s%s.ref", cache_dir, G_DIR_SEPARATOR_S,
+                               hash);
+
+  g_free(hash);
+  g_free(key);
+  return ref;
+}
+
+static void gst_projectm_texture_view_add(GstProjectMTextureViewStats *stats,
+                                          const gchar *source,
+                                          const gchar *name,
+                                          const gchar *view_dir) {
+  gchar *ref = gst_projectm_texture_is_transcodable(name)
+                   ? gst_projectm_texture_ref(stats->cache_dir, source)
+                   : NULL;
+  gchar *link;
+
+  if (ref != NULL && g_file_test(ref, G_FILE_TEST_EXISTS)) {
+    /* projectM finds textures by name without extension. */
+    gchar *base = g_strndup(name, strrchr(name, '.') - name);
+    gchar *dds_name = g_strconcat(base, ".dds", NULL);
+
+    link = g_build_filename(view_dir, dds_name, NULL);
+    if (symlink(ref, link) == 0) {
+      stats->compressed++;
+    }
+    g_free(dds_name);
+    g_free(base);
+  } else {
+    link = g_build_filename(view_dir, name, NULL);
+    if (symlink(source, link) == 0) {
+      stats->originals++;
+    }
+
+    if (ref != NULL) {
+      gchar *failed = g_strdup_printf("%s.failed", ref);
+
+      if (!g_file_test(failed, G_FILE_TEST_EXISTS)) {
+        gst_projectm_transcode_queue(source, ref);
+        stats->queued++;
+      }
+      g_free(failed);
+    }
+  }
+
+  g_free(link);
+  g_free(ref);
+}
+
+static void gst_projectm_texture_view_build(GstProjectMTextureViewStats *stats,
+                                            const gchar *source_dir,
+                                            const gchar *view_dir,
+                                            guint depth) {
+  GDir *dir = g_dir_open(source_dir, 0, NULL);
+  const gchar *entry;
+
+  if (dir == NULL) {
+    return;
+  }
+
+  while ((entry = g_dir_read_name(dir)) != NULL) {
+    gchar *source = g_build_filename(source_dir, entry, NULL);
+
+    if (g_file_test(source, G_FILE_TEST_IS_DIR)) {
+      gchar *subdir = g_build_filename(view_dir, entry, NULL);
+
+      if (depth < GST_PROJECTM_TEXTURE_TRANSCODE_MAX_DEPTH &&
+          g_mkdir(subdir, 0755) == 0) {
+        gst_projectm_texture_view_build(stats, source, subdir, depth + 1);
+      }
+      g_free(subdir);
+    } else {
+      gst_projectm_texture_view_add(stats, source, entry, view_dir);
+    }
+
+    g_free(source);
+  }
+
+  g_dir_close(dir);
+}
+#endif
+
+static void gst_projectm_texture_view_remove(const gchar *path) {
+  if (!g_file_test(path, G_FILE_TEST_IS_SYMLINK) &&
+      g_file_test(path, G_FILE_TEST_IS_DIR)) {
+    GDir *dir = g_dir_open(path, 0, NULL);
+    const gchar *entry;
+
+    while (dir != NULL && (entry = g_dir_read_name(dir)) != NULL) {
+      gchar *child = g_build_filename(path, entry, NULL);
+
+      gst_projectm_texture_view_remove(child);
+      g_free(child);
+    }
+    if (dir != NULL) {
+      g_dir_close(dir);
+    }
+    g_rmdir(path);
+  } else {
+    g_remove(path);
+  }
+}
+
+GstProjectMTextureTranscoder *
+gst_projectm_texture_transcoder_new(const gchar *texture_dir, GError **error) {
+  gst_projectm_texture_transcode_init_debug();
+
+#ifdef G_OS_UNIX
+  gchar *cache_dir = gst_projectm_texture_transcode_cache_dir();
+
+  if (g_mkdir_with_parents(cache_dir, 0755) != 0) {
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errno),
+                "Unable to create %s: %s", cache_dir, g_strerror(errno));
+    g_free(cache_dir);
+    return NULL;
+  }
+
+  gchar *view_dir = g_dir_make_tmp("gst-projectm-textures-XXXXXX", error);
+  if (view_dir == NULL) {
+    g_free(cache_dir);
+    return NULL;
+  }
+
+  GstProjectMTextureViewStats stats = {cache_dir, 0, 0, 0};
+  gint64 start = g_get_monotonic_time();
+
+  gst_projectm_texture_view_build(&stats, texture_dir, view_dir, 0);
+  GST_INFO("Texture view of %s in %s: %u compressed, %u original, %u queued "
+           "for transcoding (%" G_GINT64_FORMAT " us)",
+           texture_dir, view_dir, stats.compressed, stats.originals,
+           stats.queued, g_get_monotonic_time() - start);
+  g_free(cache_dir);
+
+  GstProjectMTextureTranscoder *transcoder =
+      g_new0(GstProjectMTextureTranscoder, 1);
+  transcoder->texture_dir = g_strdup(texture_dir);
+  transcoder->view_dir = view_dir;
+  return transcoder;
+#else
+  g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+              "Texture transcoding needs symlinks");
+  return NULL;
+#endif
+}
+
+const gchar *
+gst_projectm_texture_transcoder_get_dir(GstProjectMTextureTranscoder *transcoder) {
+  return transcoder->view_dir;
+}
+
+void gst_projectm_texture_transcoder_free(GstProjectMTextureTranscoder *transcoder) {
+  if (transcoder == NULL) {
+    return;
+  }
+
+  gst_projectm_texture_view_remove(transcoder->view_dir);
+  g_free(transcoder->view_dir);
+  g_free(transcoder->texture_dir);
+  g_free(transcoder);
+}
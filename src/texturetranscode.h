@@ -0,0 +1,52 @@
+#ifndef __GST_PROJECTM_TEXTURE_TRANSCODE_H__
+#define __GST_PROJECTM_TEXTURE_TRANSCODE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief A view of a texture directory with GPU-compressed textures
+ * substituted for the JPEG and PNG files they were made from.
+ *
+ * projectM loads textures from disk and uploads .dds files without
+ * decoding them, so the view is a temporary directory of symlinks: to a
+ * cached S3TC .dds where one exists, to the original file otherwise.
+ * Missing .dds files are transcoded on background threads and picked up by
+ * the next view of the directory. Transcoded files are cached in
+ * $XDG_CACHE_HOME/gst-projectm/textures, keyed by a hash of their source.
+ */
+typedef struct _GstProjectMTextureTranscoder GstProjectMTextureTranscoder;
+
+/**
+ * @brief Build a view of texture_dir and queue the textures that have not
+ * been transcoded yet.
+ *
+ * @return The transcoder, or NULL with error set.
+ */
+GstProjectMTextureTranscoder *
+gst_projectm_texture_transcoder_new(const gchar *texture_dir, GError **error);
+
+/**
+ * @brief Directory to give projectM as its texture search path.
+ */
+const gchar *
+gst_projectm_texture_transcoder_get_dir(GstProjectMTextureTranscoder *transcoder);
+
+/**
+ * @brief Remove the view directory. Queued transcodes carry on.
+ */
+void gst_projectm_texture_transcoder_free(GstProjectMTextureTranscoder *transcoder);
+
+/**
+ * @brief Encode tightly packed RGBA pixels as a DDS file with a full
+ * mipmap chain, BC1 (DXT1) for opaque images and BC3 (DXT5) otherwise.
+ *
+ * @return The file contents, free with g_free().
+ */
+guint8 *gst_projectm_texture_encode_dds(const guint8 *rgba, guint width,
+                                        guint height, gsize *size);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_TEXTURE_TRANSCODE_H__ */
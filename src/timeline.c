@@ -0,0 +1,257 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+
+#include "timeline.h"
+
+GST_DEBUG_CATEGORY_STATIC(gst_projectm_timeline_debug);
+#define GST_CAT_DEFAULT gst_projectm_timeline_debug
+
+static void gst_projectm_timeline_init_debug(void) {
+  static gsize debug_initialized = 0;
+
+  if (g_once_init_enter(&debug_initialized)) {
+    GST_DEBUG_CATEGORY_INIT(gst_projectm_timeline_debug, "projectm-timeline",
+                            0, "projectM preset timeline");
+    g_once_init_leave(&debug_initialized, 1);
+  }
+}
+
+static void gst_projectm_timeline_entry_free(gpointer data) {
+  GstProjectMTimelineEntry *entry = (GstProjectMTimelineEntry *)data;
+  if (entry == NULL) {
+    return;
+  }
+
+  g_clear_pointer(&entry->preset, g_free);
+  g_clear_pointer(&entry->complexity, g_free);
+  g_free(entry);
+}
+
+static gint gst_projectm_timeline_entry_compare(gconstpointer a,
+                                                gconstpointer b) {
+  /* g_ptr_array_sort passes pointers-to-pointers: each argument is the
+     address of a slot in the GPtrArray, so we must dereference once to
+     obtain the actual GstProjectMTimelineEntry*. */
+  const GstProjectMTimelineEntry *left =
+      *(const GstProjectMTimelineEntry *const *)a;
+  const GstProjectMTimelineEntry *right =
+      *(const GstProjectMTimelineEntry *const *)b;
+
+  if (left->start_time < right->start_time) {
+    return -1;
+  }
+  if (left->start_time > right->start_time) {
+    return 1;
+  }
+  return 0;
+}
+
+GPtrArray *gst_projectm_timeline_entries_new(void) {
+  gst_projectm_timeline_init_debug();
+  return g_ptr_array_new_with_free_func(gst_projectm_timeline_entry_free);
+}
+
+gchar *gst_projectm_resolve_preset_path(const gchar *base_path,
+                                        const gchar *preset_value) {
+  if (preset_value == NULL || *preset_value == '\0') {
+    return NULL;
+  }
+
+  if (g_path_is_absolute(preset_value)) {
+    return g_strdup(preset_value);
+  }
+
+  if (base_path != NULL) {
+    return g_canonicalize_filename(preset_value, base_path);
+  }
+
+  return g_strdup(preset_value);
+}
+
+gint gst_projectm_timeline_find_target_index(GPtrArray *entries, gint current,
+                                             gdouble elapsed_seconds) {
+  if (!entries || entries->len == 0) {
+    return -1;
+  }
+
+  gint len = (gint)entries->len;
+
+  if (current >= 0 && current < len) {
+    GstProjectMTimelineEntry *entry =
+        g_ptr_array_index(entries, (guint)current);
+
+    if ((elapsed_seconds + GST_PROJECTM_TIMELINE_EPSILON) <
+        entry->start_time) {
+      current = -1;
+    } else {
+      gboolean before_next = TRUE;
+      if (current + 1 < len) {
+        GstProjectMTimelineEntry *next_entry =
+            g_ptr_array_index(entries, (guint)(current + 1));
+        before_next =
+            (elapsed_seconds + GST_PROJECTM_TIMELINE_EPSILON) <
+            next_entry->start_time;
+      }
+
+      if ((elapsed_seconds <= entry->end_time + GST_PROJECTM_TIMELINE_EPSILON) ||
+          before_next || current == len - 1) {
+        return current;
+      }
+    }
+  }
+
+  gint low = 0;
+  gint high = len - 1;
+  gint result = -1;
+
+  while (low <= high) {
+    gint mid = low + ((high - low) / 2);
+    GstProjectMTimelineEntry *entry = g_ptr_array_index(entries, (guint)mid);
+
+    if ((elapsed_seconds + GST_PROJECTM_TIMELINE_EPSILON) <
+        entry->start_time) {
+      high = mid - 1;
+      continue;
+    }
+
+    result = mid;
+
+    if (elapsed_seconds <= entry->end_time + GST_PROJECTM_TIMELINE_EPSILON) {
+      break;
+    }
+
+    low = mid + 1;
+  }
+
+  return result;
+}
+
+gboolean gst_projectm_timeline_parse(GPtrArray *entries, GKeyFile *key_file,
+                                     const gchar *source, GObject *log_object) {
+  gst_projectm_timeline_init_debug();
+
+  gsize group_count = 0;
+  gchar **groups = g_key_file_get_groups(key_file, &group_count);
+
+  if (groups == NULL || group_count == 0) {
+    GST_WARNING_OBJECT(log_object, "Timeline file %s contains no segments",
+                       source);
+    g_strfreev(groups);
+    return FALSE;
+  }
+
+  guint added = 0;
+
+  for (gsize i = 0; i < group_count; i++) {
+    const gchar *group = groups[i];
+    gboolean segment_valid = TRUE;
+
+    GError *value_error = NULL;
+    gdouble start =
+        g_key_file_get_double(key_file, group, "start", &value_error);
+    if (value_error != NULL) {
+      GST_WARNING_OBJECT(log_object,
+                         "Timeline segment '%s' missing valid 'start': %s",
+                         group, value_error->message);
+      g_clear_error(&value_error);
+      segment_valid = FALSE;
+    }
+
+    gdouble duration = 0.0;
+    if (segment_valid) {
+      duration =
+          g_key_file_get_double(key_file, group, "duration", &value_error);
+      if (value_error != NULL) {
+        GST_WARNING_OBJECT(log_object,
+                           "Timeline segment '%s' missing valid 'duration': "
+                           "%s",
+                           group, value_error->message);
+        g_clear_error(&value_error);
+        segment_valid = FALSE;
+      } else if (duration <= 0.0) {
+        GST_WARNING_OBJECT(log_object,
+                           "Timeline segment '%s' has non-positive duration",
+                           group);
+        segment_valid = FALSE;
+      }
+    }
+
+    gchar *preset = NULL;
+    if (segment_valid) {
+      preset = g_key_file_get_string(key_file, group, "preset", &value_error);
+      if (value_error != NULL || preset == NULL || *preset == '\0') {
+        GST_WARNING_OBJECT(log_object,
+                           "Timeline segment '%s' missing valid 'preset'",
+                           group);
+        g_clear_error(&value_error);
+        g_clear_pointer(&preset, g_free);
+        segment_valid = FALSE;
+      }
+    }
+
+    gchar *complexity = NULL;
+    if (segment_valid) {
+      complexity =
+          g_key_file_get_string(key_file, group, "complexity", NULL);
+      if (complexity != NULL && *complexity == '\0') {
+        g_clear_pointer(&complexity, g_free);
+      }
+    }
+
+    if (!segment_valid) {
+      continue;
+    }
+
+    GstProjectMTimelineEntry *entry = g_new0(GstProjectMTimelineEntry, 1);
+    entry->start_time = start;
+    entry->duration = duration;
+    entry->end_time = start + duration;
+    entry->preset = preset;
+    entry->complexity = complexity;
+
+    g_ptr_array_add(entries, entry);
+    added++;
+  }
+
+  g_strfreev(groups);
+
+  if (added == 0) {
+    GST_WARNING_OBJECT(log_object,
+                       "Timeline file %s did not yield any segments", source);
+    return FALSE;
+  }
+
+  g_ptr_array_sort(entries, (GCompareFunc)gst_projectm_timeline_entry_compare);
+
+  return TRUE;
+}
+
+gboolean gst_projectm_timeline_load_file(GPtrArray *entries, const gchar *path,
+                                         GObject *log_object) {
+  gst_projectm_timeline_init_debug();
+
+  if (!g_file_test(path, G_FILE_TEST_EXISTS)) {
+    GST_WARNING_OBJECT(log_object, "Timeline file not found: %s", path);
+    return FALSE;
+  }
+
+  GKeyFile *key_file = g_key_file_new();
+  GError *error = NULL;
+
+  if (!g_key_file_load_from_file(key_file, path, G_KEY_FILE_NONE, &error)) {
+    GST_WARNING_OBJECT(log_object, "Failed to parse timeline file %s: %s",
+                       path, error != NULL ? error->message : "unknown error");
+    g_clear_error(&error);
+    g_key_file_free(key_file);
+    return FALSE;
+  }
+
+  gboolean result =
+      gst_projectm_timeline_parse(entries, key_file, path, log_object);
+  g_key_file_free(key_file);
+
+  return result;
+}
@@ -0,0 +1,76 @@
+#ifndef __GST_PROJECTM_TIMELINE_H__
+#define __GST_PROJECTM_TIMELINE_H__
+
+#include <glib-object.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define GST_PROJECTM_TIMELINE_EPSILON (1e-6)
+
+/**
+ * @brief One preset segment of a timeline file.
+ */
+typedef struct {
+  gdouble start_time;
+  gdouble duration;
+  gdouble end_time;
+  gchar *preset;
+  gchar *complexity;
+} GstProjectMTimelineEntry;
+
+/**
+ * @brief Create an empty entry array that owns its entries.
+ */
+GPtrArray *gst_projectm_timeline_entries_new(void);
+
+/**
+ * @brief Parse timeline segments from a key file and append them, sorted by
+ * start time, to the entry array.
+ *
+ * Invalid segments are skipped with a warning logged against log_object.
+ *
+ * @param entries Array created by gst_projectm_timeline_entries_new().
+ * @param key_file Parsed timeline file, one group per segment.
+ * @param source Name of the timeline used in log messages.
+ * @param log_object Object to attribute log messages to, may be NULL.
+ * @return TRUE if at least one segment was added.
+ */
+gboolean gst_projectm_timeline_parse(GPtrArray *entries, GKeyFile *key_file,
+                                     const gchar *source, GObject *log_object);
+
+/**
+ * @brief Load and parse a timeline file.
+ *
+ * @see gst_projectm_timeline_parse()
+ */
+gboolean gst_projectm_timeline_load_file(GPtrArray *entries, const gchar *path,
+                                         GObject *log_object);
+
+/**
+ * @brief Find the segment that should be active at the given time.
+ *
+ * The current index is checked first so that sequential playback is O(1);
+ * other positions fall back to a binary search.
+ *
+ * @param entries Entries sorted by start time.
+ * @param current Currently active index, or -1.
+ * @param elapsed_seconds Stream time in seconds.
+ * @return The index of the target segment, or -1 before the first segment.
+ */
+gint gst_projectm_timeline_find_target_index(GPtrArray *entries, gint current,
+                                             gdouble elapsed_seconds);
+
+/**
+ * @brief Resolve a timeline preset value against the preset directory.
+ *
+ * @param base_path Preset directory, may be NULL.
+ * @param preset_value Absolute or relative preset path.
+ * @return A newly allocated path, or NULL if preset_value is empty.
+ */
+gchar *gst_projectm_resolve_preset_path(const gchar *base_path,
+                                        const gchar *preset_value);
+
+G_END_DECLS
+
+#endif /* __GST_PROJECTM_TIMELINE_H__ */
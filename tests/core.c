@@ -0,0 +1,821 @@
+/*
+ * gstprojectm-test-core: unit tests for the GL-independent parts of the
+ * projectm element.
+ */
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+#include <gst/audio/audio-format.h>
+#include <gst/gst.h>
+
+#ifdef G_OS_UNIX
+#include <unistd.h>
+#include <utime.h>
+#else
+#include <sys/utime.h>
+#endif
+
+#include "archive.h"
+#include "caps.h"
+#include "frame.h"
+#include "framegrid.h"
+#include "pcmring.h"
+#include "presetindex.h"
+#include "timeline.h"
+
+#define TEST_TAR_BLOCK 512
+
+static gchar *test_dir = NULL;
+
+/* Appends one ustar member to a tar being built in memory. */
+static void test_tar_add(GByteArray *tar, const gchar *name, gchar type,
+                         const guint8 *data, gsize size) {
+  guint8 header[TEST_TAR_BLOCK] = {0};
+  static const guint8 padding[TEST_TAR_BLOCK] = {0};
+  gchar *number;
+
+  g_strlcpy((gchar *)header, name, 100);
+  memcpy(header + 100, "0000644", 7);
+  number = g_strdup_printf("%011" G_GSIZE_MODIFIER "o", size);
+  memcpy(header + 124, number, 11);
+  g_free(number);
+  header[156] = (guint8)type;
+  memcpy(header + 257, "ustar", 6);
+  memcpy(header + 263, "00", 2);
+
+  g_byte_array_append(tar, header, TEST_TAR_BLOCK);
+  g_byte_array_append(tar, data, size);
+  if (size % TEST_TAR_BLOCK != 0) {
+    g_byte_array_append(tar, padding, TEST_TAR_BLOCK - size % TEST_TAR_BLOCK);
+  }
+}
+
+static gchar *test_tar_write(GByteArray *tar, const gchar *name) {
+  static const guint8 end[TEST_TAR_BLOCK * 2] = {0};
+  gchar *path = g_build_filename(test_dir, name, NULL);
+  GError *error = NULL;
+
+  g_byte_array_append(tar, end, sizeof(end));
+  g_file_set_contents(path, (const gchar *)tar->data, tar->len, &error);
+  g_assert_no_error(error);
+
+  return path;
+}
+
+static void test_write_file(const gchar *path, const gchar *contents) {
+  GError *error = NULL;
+
+  g_file_set_contents(path, contents, -1, &error);
+  g_assert_no_error(error);
+}
+
+/* The index compares directory mtimes in whole seconds, so changes made
+ * within one test need the mtime moved explicitly. */
+static void test_touch(const gchar *path, gint64 mtime) {
+  struct utimbuf times = {(time_t)mtime, (time_t)mtime};
+
+  g_assert_cmpint(g_utime(path, &times), ==, 0);
+}
+
+static void test_archive_binary_member(void) {
+  GByteArray *tar = g_byte_array_new();
+  guint8 binary[1000];
+  static const gchar preset[] = "[preset00]\nzoom=1.0\n";
+  GError *error = NULL;
+
+  /* A texture with NUL bytes throughout, as in any PNG or JPEG. */
+  for (guint i = 0; i < sizeof(binary); i++) {
+    binary[i] = (guint8)(i % 7 == 0 ? 0 : i * 31);
+  }
+
+  test_tar_add(tar, "textures/noise.png", '0', binary, sizeof(binary));
+  test_tar_add(tar, "presets/a.milk", '0', (const guint8 *)preset,
+               strlen(preset));
+  gchar *path = test_tar_write(tar, "binary.tar");
+  g_byte_array_unref(tar);
+
+  GstProjectMArchive *archive = gst_projectm_archive_open(path, &error);
+  g_assert_no_error(error);
+  g_assert_nonnull(archive);
+
+  g_assert_cmpuint(gst_projectm_archive_get_n_presets(archive), ==, 1);
+  g_assert_true(gst_projectm_archive_contains(archive, "noise.png"));
+
+  gchar *text = gst_projectm_archive_read(archive, "presets/a.milk", &error);
+  g_assert_no_error(error);
+  g_assert_cmpstr(text, ==, preset);
+  g_free(text);
+
+  const gchar *directory = gst_projectm_archive_extract(archive, &error);
+  g_assert_no_error(error);
+  g_assert_nonnull(directory);
+
+  gchar *texture =
+      g_build_filename(directory, "textures", "noise.png", NULL);
+  gchar *contents = NULL;
+  gsize length = 0;
+
+  g_file_get_contents(texture, &contents, &length, &error);
+  g_assert_no_error(error);
+  g_assert_cmpmem(contents, length, binary, sizeof(binary));
+
+  g_free(contents);
+  g_free(texture);
+  gst_projectm_archive_unref(archive);
+  g_free(path);
+}
+
+static void test_archive_malformed_pax(void) {
+  GByteArray *tar = g_byte_array_new();
+  static const gchar *records[] = {
+      /* Length beyond the header. */
+      "99999999999999999999999 path=a.milk\n",
+      /* Length ending inside its own digits. */
+      "2 path=a.milk\n",
+      /* No separator after the length. */
+      "12",
+  };
+  static const gchar preset[] = "[preset00]\n";
+  GError *error = NULL;
+
+  for (guint i = 0; i < G_N_ELEMENTS(records); i++) {
+    test_tar_add(tar, "PaxHeader", 'x', (const guint8 *)records[i],
+                 strlen(records[i]));
+  }
+  test_tar_add(tar, "b.milk", '0', (const guint8 *)preset, strlen(preset));
+  gchar *path = test_tar_write(tar, "pax.tar");
+  g_byte_array_unref(tar);
+
+  GstProjectMArchive *archive = gst_projectm_archive_open(path, &error);
+  g_assert_no_error(error);
+  g_assert_cmpuint(gst_projectm_archive_get_n_presets(archive), ==, 1);
+  g_assert_cmpstr(gst_projectm_archive_get_preset(archive, 0), ==, "b.milk");
+
+  gst_projectm_archive_unref(archive);
+  g_free(path);
+}
+
+static GstProjectMPresetIndex *test_index_load(const gchar *root,
+                                               const gchar *index_path,
+                                               guint expected) {
+  GstProjectMPresetIndex *index =
+      gst_projectm_preset_index_load(root, index_path, NULL);
+
+  g_assert_nonnull(index);
+  g_assert_cmpuint(index->entries->len, ==, expected);
+
+  return index;
+}
+
+static void test_preset_index_revalidate(void) {
+  gchar *root = g_build_filename(test_dir, "presets", NULL);
+  gchar *sub = g_build_filename(root, "sub", NULL);
+  gchar *a = g_build_filename(root, "a.milk", NULL);
+  gchar *b = g_build_filename(sub, "b.milk", NULL);
+  gchar *index_path = g_build_filename(test_dir, "presets.index", NULL);
+  GStatBuf st;
+
+  g_assert_cmpint(g_mkdir_with_parents(root, 0755), ==, 0);
+  test_write_file(a, "[preset00]\n");
+  gchar *notes = g_build_filename(root, "notes.txt", NULL);
+  test_write_file(notes, "not a preset");
+  g_free(notes);
+
+  GstProjectMPresetIndex *index = test_index_load(root, index_path, 1);
+  gst_projectm_preset_index_free(index);
+  g_assert_true(g_file_test(index_path, G_FILE_TEST_EXISTS));
+
+  /* A new directory is picked up through its parent's mtime. */
+  g_assert_cmpint(g_stat(root, &st), ==, 0);
+  g_assert_cmpint(g_mkdir(sub, 0755), ==, 0);
+  test_write_file(b, "[preset00]\n");
+  test_touch(root, (gint64)st.st_mtime + 10);
+
+  index = test_index_load(root, index_path, 2);
+  gchar **paths = gst_projectm_preset_index_get_paths(index);
+  g_assert_cmpuint(g_strv_length(paths), ==, 2);
+  g_assert_cmpstr(paths[0], ==, a);
+  g_assert_cmpstr(paths[1], ==, b);
+  g_strfreev(paths);
+  gst_projectm_preset_index_free(index);
+
+  /* A removed preset drops out, the untouched directory is kept. */
+  g_assert_cmpint(g_unlink(a), ==, 0);
+  test_touch(root, (gint64)st.st_mtime + 20);
+
+  index = test_index_load(root, index_path, 1);
+  g_assert_cmpstr(((GstProjectMPresetIndexEntry *)index->entries->pdata[0])
+                      ->path,
+                  ==, "sub/b.milk");
+  gst_projectm_preset_index_free(index);
+
+  /* Reloading with nothing changed gives the same index. */
+  index = test_index_load(root, index_path, 1);
+  gst_projectm_preset_index_free(index);
+
+  g_free(index_path);
+  g_free(b);
+  g_free(a);
+  g_free(sub);
+  g_free(root);
+}
+
+#ifdef G_OS_UNIX
+static void test_preset_index_symlinks(void) {
+  gchar *root = g_build_filename(test_dir, "linked", NULL);
+  gchar *sub = g_build_filename(root, "sub", NULL);
+  gchar *index_path = g_build_filename(test_dir, "linked.index", NULL);
+
+  g_assert_cmpint(g_mkdir_with_parents(sub, 0755), ==, 0);
+  gchar *preset = g_build_filename(sub, "a.milk", NULL);
+  test_write_file(preset, "[preset00]\n");
+
+  /* A second path to the same directory and a loop back to the root. */
+  gchar *alias = g_build_filename(root, "alias", NULL);
+  gchar *loop = g_build_filename(sub, "loop", NULL);
+  g_assert_cmpint(symlink(sub, alias), ==, 0);
+  g_assert_cmpint(symlink(root, loop), ==, 0);
+
+  GstProjectMPresetIndex *index = test_index_load(root, index_path, 1);
+  gst_projectm_preset_index_free(index);
+
+  g_free(loop);
+  g_free(alias);
+  g_free(preset);
+  g_free(index_path);
+  g_free(sub);
+  g_free(root);
+}
+#endif
+
+static GstProjectMTimelineEntry *test_timeline_entry(GPtrArray *entries,
+                                                     guint i) {
+  return g_ptr_array_index(entries, i);
+}
+
+static void test_timeline_parse(void) {
+  static const gchar timeline[] =
+      "[outro]\n"
+      "start=20\n"
+      "duration=5.5\n"
+      "preset=outro.milk\n"
+      "complexity=\n"
+      "[intro]\n"
+      "start=0\n"
+      "duration=10\n"
+      "preset=/abs/intro.milk\n"
+      "complexity=low\n"
+      "[no-start]\n"
+      "duration=1\n"
+      "preset=a.milk\n"
+      "[zero-duration]\n"
+      "start=30\n"
+      "duration=0\n"
+      "preset=a.milk\n"
+      "[no-preset]\n"
+      "start=40\n"
+      "duration=1\n"
+      "preset=\n"
+      "[bad-number]\n"
+      "start=soon\n"
+      "duration=1\n"
+      "preset=a.milk\n"
+      "[middle]\n"
+      "start=10\n"
+      "duration=10\n"
+      "preset=sub/middle.milk\n";
+  GKeyFile *key_file = g_key_file_new();
+  GPtrArray *entries = gst_projectm_timeline_entries_new();
+  GError *error = NULL;
+
+  g_key_file_load_from_data(key_file, timeline, -1, G_KEY_FILE_NONE, &error);
+  g_assert_no_error(error);
+
+  /* Invalid segments are skipped, the rest sorted by start time. */
+  g_assert_true(
+      gst_projectm_timeline_parse(entries, key_file, "timeline", NULL));
+  g_assert_cmpuint(entries->len, ==, 3);
+
+  GstProjectMTimelineEntry *entry = test_timeline_entry(entries, 0);
+  g_assert_cmpfloat(entry->start_time, ==, 0.0);
+  g_assert_cmpfloat(entry->end_time, ==, 10.0);
+  g_assert_cmpstr(entry->preset, ==, "/abs/intro.milk");
+  g_assert_cmpstr(entry->complexity, ==, "low");
+
+  entry = test_timeline_entry(entries, 1);
+  g_assert_cmpstr(entry->preset, ==, "sub/middle.milk");
+  g_assert_null(entry->complexity);
+
+  entry = test_timeline_entry(entries, 2);
+  g_assert_cmpfloat(entry->start_time, ==, 20.0);
+  g_assert_cmpfloat(entry->duration, ==, 5.5);
+  g_assert_cmpfloat(entry->end_time, ==, 25.5);
+  g_assert_cmpstr(entry->preset, ==, "outro.milk");
+  g_assert_null(entry->complexity);
+
+  g_ptr_array_unref(entries);
+  g_key_file_free(key_file);
+
+  /* Nothing usable at all. */
+  key_file = g_key_file_new();
+  entries = gst_projectm_timeline_entries_new();
+  g_key_file_load_from_data(key_file, "[only]\nstart=1\n", -1,
+                            G_KEY_FILE_NONE, &error);
+  g_assert_no_error(error);
+  g_assert_false(
+      gst_projectm_timeline_parse(entries, key_file, "timeline", NULL));
+  g_assert_cmpuint(entries->len, ==, 0);
+  g_ptr_array_unref(entries);
+  g_key_file_free(key_file);
+}
+
+static void test_timeline_load_file(void) {
+  gchar *path = g_build_filename(test_dir, "timeline.ini", NULL);
+  gchar *broken = g_build_filename(test_dir, "broken.ini", NULL);
+  gchar *missing = g_build_filename(test_dir, "missing.ini", NULL);
+  GPtrArray *entries = gst_projectm_timeline_entries_new();
+
+  test_write_file(path, "[b]\nstart=5\nduration=5\npreset=b.milk\n"
+                        "[a]\nstart=0\nduration=5\npreset=a.milk\n");
+  test_write_file(broken, "start=0\n[unterminated\n");
+
+  g_assert_true(gst_projectm_timeline_load_file(entries, path, NULL));
+  g_assert_cmpuint(entries->len, ==, 2);
+  g_assert_cmpstr(test_timeline_entry(entries, 0)->preset, ==, "a.milk");
+  g_assert_cmpstr(test_timeline_entry(entries, 1)->preset, ==, "b.milk");
+  g_ptr_array_set_size(entries, 0);
+
+  g_assert_false(gst_projectm_timeline_load_file(entries, broken, NULL));
+  g_assert_false(gst_projectm_timeline_load_file(entries, missing, NULL));
+  g_assert_cmpuint(entries->len, ==, 0);
+
+  g_ptr_array_unref(entries);
+  g_free(missing);
+  g_free(broken);
+  g_free(path);
+}
+
+/* The last segment that has started by elapsed, as a linear scan finds it. */
+static gint test_timeline_reference_index(GPtrArray *entries,
+                                          gdouble elapsed) {
+  gint result = -1;
+
+  for (guint i = 0; i < entries->len; i++) {
+    if (elapsed + GST_PROJECTM_TIMELINE_EPSILON >=
+        test_timeline_entry(entries, i)->start_time) {
+      result = (gint)i;
+    }
+  }
+
+  return result;
+}
+
+static void test_timeline_find_target_index(void) {
+  GKeyFile *key_file = g_key_file_new();
+  GPtrArray *entries = gst_projectm_timeline_entries_new();
+  GString *timeline = g_string_new(NULL);
+  GError *error = NULL;
+
+  /* Segments from 1 s on, with a gap after every fifth one. */
+  gdouble start = 1.0;
+  for (guint i = 0; i < 40; i++) {
+    gchar number[G_ASCII_DTOSTR_BUF_SIZE];
+
+    g_string_append_printf(timeline,
+                           "[s%u]\nstart=%s\nduration=2\npreset=%u.milk\n", i,
+                           g_ascii_dtostr(number, sizeof(number), start), i);
+    start += i % 5 == 4 ? 3.5 : 2.0;
+  }
+
+  g_key_file_load_from_data(key_file, timeline->str, -1, G_KEY_FILE_NONE,
+                            &error);
+  g_assert_no_error(error);
+  g_assert_true(
+      gst_projectm_timeline_parse(entries, key_file, "timeline", NULL));
+  g_assert_cmpuint(entries->len, ==, 40);
+
+  g_assert_cmpint(gst_projectm_timeline_find_target_index(NULL, -1, 1.0), ==,
+                  -1);
+  g_assert_cmpint(gst_projectm_timeline_find_target_index(entries, -1, 0.5),
+                  ==, -1);
+  g_assert_cmpint(gst_projectm_timeline_find_target_index(entries, 0, 0.5),
+                  ==, -1);
+  g_assert_cmpint(gst_projectm_timeline_find_target_index(entries, 0, 1.0),
+                  ==, 0);
+  g_assert_cmpint(gst_projectm_timeline_find_target_index(entries, 0, 3.5),
+                  ==, 1);
+  /* Inside a gap the previous segment stays active. */
+  g_assert_cmpint(gst_projectm_timeline_find_target_index(entries, -1, 11.5),
+                  ==, 4);
+  g_assert_cmpint(gst_projectm_timeline_find_target_index(entries, 4, 1000.0),
+                  ==, 39);
+
+  /* Sequential playback, seeks in both directions and stale hints all
+   * agree with a linear scan. Times stay off segment boundaries, where
+   * either neighbour is a valid answer. */
+  gint current = -1;
+  for (gdouble t = 0.1; t < 100.0; t += 0.25) {
+    current = gst_projectm_timeline_find_target_index(entries, current, t);
+    g_assert_cmpint(current, ==, test_timeline_reference_index(entries, t));
+  }
+
+  for (gint hint = -1; hint <= 45; hint++) {
+    for (gdouble t = 0.0; t < 100.0; t += 7.3) {
+      g_assert_cmpint(gst_projectm_timeline_find_target_index(entries, hint, t),
+                      ==, test_timeline_reference_index(entries, t));
+    }
+  }
+
+  g_string_free(timeline, TRUE);
+  g_ptr_array_unref(entries);
+  g_key_file_free(key_file);
+}
+
+static void test_resolve_preset_path(void) {
+  gchar *base = g_build_filename(test_dir, "presets", NULL);
+  gchar *absolute = g_build_filename(test_dir, "elsewhere", "a.milk", NULL);
+  gchar *expected = g_build_filename(base, "b.milk", NULL);
+  gchar *path;
+
+  g_assert_null(gst_projectm_resolve_preset_path(base, NULL));
+  g_assert_null(gst_projectm_resolve_preset_path(base, ""));
+
+  path = gst_projectm_resolve_preset_path(base, absolute);
+  g_assert_cmpstr(path, ==, absolute);
+  g_free(path);
+
+  path = gst_projectm_resolve_preset_path(base, "sub/../b.milk");
+  g_assert_cmpstr(path, ==, expected);
+  g_free(path);
+
+  path = gst_projectm_resolve_preset_path(NULL, "b.milk");
+  g_assert_cmpstr(path, ==, "b.milk");
+  g_free(path);
+
+  g_free(expected);
+  g_free(absolute);
+  g_free(base);
+}
+
+static void test_caps(void) {
+  GstCaps *audio = gst_caps_from_string(get_audio_sink_cap(0));
+  GstCaps *video = gst_caps_from_string(get_video_src_cap(0));
+  GstCaps *stereo = gst_caps_from_string(
+      "audio/x-raw, format = (string) " GST_AUDIO_NE(S16) ", "
+      "layout = (string) interleaved, channels = (int) 2, "
+      "rate = (int) 44100, channel-mask = (bitmask) 0x3");
+  GstCaps *abgr = gst_caps_from_string(
+      "video/x-raw, format = (string) ABGR, width = (int) 1280, "
+      "height = (int) 720, framerate = (fraction) 30000/1001");
+  GstCaps *rgba = gst_caps_from_string(
+      "video/x-raw, format = (string) RGBA, width = (int) 1280, "
+      "height = (int) 720, framerate = (fraction) 30/1");
+
+  g_assert_nonnull(audio);
+  g_assert_nonnull(video);
+  g_assert_false(gst_caps_is_empty(audio));
+  g_assert_false(gst_caps_is_empty(video));
+
+  g_assert_true(gst_caps_can_intersect(audio, stereo));
+  g_assert_true(gst_caps_can_intersect(video, abgr));
+  g_assert_false(gst_caps_can_intersect(video, rgba));
+
+#ifdef __linux__
+  /* DMABuf comes first so encoders that import it are preferred. */
+  GstCapsFeatures *features = gst_caps_get_features(video, 0);
+  g_assert_true(gst_caps_features_contains(features, "memory:DMABuf"));
+  g_assert_cmpstr(gst_structure_get_string(gst_caps_get_structure(video, 0),
+                                           "format"),
+                  ==, "NV12");
+#endif
+
+  g_assert_null(get_audio_sink_cap(1));
+  g_assert_null(get_video_src_cap(1));
+
+  gst_caps_unref(rgba);
+  gst_caps_unref(abgr);
+  gst_caps_unref(stereo);
+  gst_caps_unref(video);
+  gst_caps_unref(audio);
+}
+
+/* Straightforward per-byte version of gst_projectm_frame_copy_full(). */
+static void test_frame_copy_reference(guint8 *dest, gsize dest_stride,
+                                      const guint8 *src, gsize src_stride,
+                                      gsize width, gsize height,
+                                      GstProjectMFrameCopyFlags flags,
+                                      const guint8 *swizzle) {
+  for (gsize y = 0; y < height; y++) {
+    gsize src_y = (flags & GST_PROJECTM_FRAME_COPY_FLIP) ? height - 1 - y : y;
+    const guint8 *in = src + src_y * src_stride;
+    guint8 *out = dest + y * dest_stride;
+
+    for (gsize x = 0; x < width; x++) {
+      for (guint c = 0; c < 4; c++) {
+        out[x * 4 + c] = in[x * 4 + (swizzle != NULL ? swizzle[c] : c)];
+      }
+    }
+  }
+}
+
+static guint8 *test_frame_new(gsize size, guint32 seed) {
+  guint8 *data = g_malloc(size);
+
+  for (gsize i = 0; i < size; i++) {
+    seed = seed * 1664525u + 1013904223u;
+    data[i] = (guint8)(seed >> 24);
+  }
+
+  return data;
+}
+
+/* Copies a frame with the selected kernel, or the pool when given, and
+ * compares it, padding included, against the reference. dest_offset
+ * misaligns the destination. */
+static void test_frame_copy_check(GstProjectMFrameCopyPool *pool, gsize width,
+                                  gsize height, gsize src_padding,
+                                  gsize dest_padding, gsize dest_offset,
+                                  GstProjectMFrameCopyFlags flags,
+                                  const guint8 *swizzle) {
+  gsize src_stride = width * 4 + src_padding;
+  gsize dest_stride = width * 4 + dest_padding;
+  gsize dest_size = dest_offset + dest_stride * height;
+  guint8 *src = test_frame_new(src_stride * height, (guint32)width);
+  guint8 *dest = test_frame_new(dest_size, 1);
+  guint8 *expected = g_malloc(dest_size);
+
+  memcpy(expected, dest, dest_size);
+  test_frame_copy_reference(expected + dest_offset, dest_stride, src,
+                            src_stride, width, height, flags, swizzle);
+  if (pool != NULL) {
+    gst_projectm_frame_copy_pool_copy(pool, dest + dest_offset, dest_stride,
+                                      src, src_stride, width, height, flags,
+                                      swizzle);
+  } else {
+    gst_projectm_frame_copy_full(dest + dest_offset, dest_stride, src,
+                                 src_stride, width, height, flags, swizzle);
+  }
+
+  if (memcmp(dest, expected, dest_size) != 0) {
+    g_test_message("%s: %" G_GSIZE_FORMAT "x%" G_GSIZE_FORMAT
+                   ", src padding %" G_GSIZE_FORMAT
+                   ", dest padding %" G_GSIZE_FORMAT
+                   ", dest offset %" G_GSIZE_FORMAT ", flags %d, swizzle %s",
+                   gst_projectm_frame_copy_impl_name(), width, height,
+                   src_padding, dest_padding, dest_offset, flags,
+                   swizzle != NULL ? "yes" : "no");
+    g_test_fail();
+  }
+
+  g_free(expected);
+  g_free(dest);
+  g_free(src);
+}
+
+static const guint8 test_swizzle_reverse[4] = {3, 2, 1, 0};
+static const guint8 test_swizzle_rotate[4] = {1, 2, 3, 0};
+static const guint8 test_swizzle_identity[4] = {0, 1, 2, 3};
+
+static void test_frame_copy(void) {
+  static const guint8 *const swizzles[] = {
+      NULL, test_swizzle_identity, test_swizzle_reverse, test_swizzle_rotate};
+  static const GstProjectMFrameCopyFlags flags[] = {
+      GST_PROJECTM_FRAME_COPY_NONE, GST_PROJECTM_FRAME_COPY_FLIP};
+
+  g_test_message("Copy kernel: %s", gst_projectm_frame_copy_impl_name());
+
+  /* Widths around every vector size hit the kernels' tails. */
+  for (gsize width = 1; width <= 67; width++) {
+    for (guint f = 0; f < G_N_ELEMENTS(flags); f++) {
+      for (guint s = 0; s < G_N_ELEMENTS(swizzles); s++) {
+        test_frame_copy_check(NULL, width, 5, 0, 0, 0, flags[f], swizzles[s]);
+        test_frame_copy_check(NULL, width, 5, 12, 36, 0, flags[f],
+                              swizzles[s]);
+        test_frame_copy_check(NULL, width, 3, 0, 0, 4, flags[f], swizzles[s]);
+      }
+    }
+  }
+
+  /* Odd destination strides and offsets rule out streaming stores. */
+  test_frame_copy_check(NULL, 33, 4, 3, 1, 1, GST_PROJECTM_FRAME_COPY_NONE,
+                        NULL);
+  test_frame_copy_check(NULL, 33, 4, 3, 1, 3, GST_PROJECTM_FRAME_COPY_FLIP,
+                        test_swizzle_reverse);
+
+  /* Frames above the streaming threshold, packed and strided. */
+  test_frame_copy_check(NULL, 1280, 900, 0, 0, 0,
+                        GST_PROJECTM_FRAME_COPY_NONE, NULL);
+  test_frame_copy_check(NULL, 1280, 900, 0, 256, 0,
+                        GST_PROJECTM_FRAME_COPY_FLIP, test_swizzle_reverse);
+}
+
+static void test_frame_copy_pool(void) {
+  static const guint thread_counts[] = {1, 3, 0};
+
+  for (guint i = 0; i < G_N_ELEMENTS(thread_counts); i++) {
+    GstProjectMFrameCopyPool *pool =
+        gst_projectm_frame_copy_pool_new(thread_counts[i]);
+
+    if (thread_counts[i] > 0) {
+      g_assert_cmpuint(gst_projectm_frame_copy_pool_get_threads(pool), ==,
+                       thread_counts[i]);
+    }
+
+    /* Below the parallel threshold, then split into bands whose row
+     * counts do not divide evenly. */
+    test_frame_copy_check(pool, 64, 16, 0, 0, 0, GST_PROJECTM_FRAME_COPY_FLIP,
+                          test_swizzle_reverse);
+    test_frame_copy_check(pool, 1920, 1081, 0, 0, 0,
+                          GST_PROJECTM_FRAME_COPY_NONE, NULL);
+    test_frame_copy_check(pool, 1921, 1083, 8, 260, 0,
+                          GST_PROJECTM_FRAME_COPY_FLIP, test_swizzle_reverse);
+    test_frame_copy_check(pool, 1280, 2000, 0, 0, 4,
+                          GST_PROJECTM_FRAME_COPY_FLIP, test_swizzle_rotate);
+
+    gst_projectm_frame_copy_pool_free(pool);
+  }
+}
+
+static void test_frame_flip_in_place(void) {
+  for (gsize height = 1; height <= 6; height++) {
+    gsize stride = 40;
+    guint8 *data = test_frame_new(stride * height, (guint32)height);
+    guint8 *expected = g_malloc(stride * height);
+
+    for (gsize y = 0; y < height; y++) {
+      memcpy(expected + y * stride, data + (height - 1 - y) * stride, stride);
+    }
+
+    gst_projectm_frame_flip_in_place(data, stride, stride, height);
+    g_assert_cmpmem(data, stride * height, expected, stride * height);
+
+    g_free(expected);
+    g_free(data);
+  }
+}
+
+/* Sample n of the stream is (n + 1, -(n + 1)), so silence stands out. */
+static void test_pcm_fill(gint16 *data, guint first, guint samples) {
+  for (guint i = 0; i < samples; i++) {
+    data[i * 2] = (gint16)(first + i + 1);
+    data[i * 2 + 1] = (gint16)-(gint)(first + i + 1);
+  }
+}
+
+static void test_pcm_ring(void) {
+  GstProjectMPcmRing *ring = gst_projectm_pcm_ring_new(100);
+  gint16 chunk[2 * 300];
+  gint16 window[2 * 64];
+  guint written = 0;
+
+  g_assert_cmpuint(gst_projectm_pcm_ring_get_capacity(ring), ==, 128);
+
+  /* Nothing written yet: all silence. */
+  memset(window, 0x55, sizeof(window));
+  g_assert_cmpuint(gst_projectm_pcm_ring_read(ring, 0, window, 64), ==, 0);
+  for (guint i = 0; i < G_N_ELEMENTS(window); i++) {
+    g_assert_cmpint(window[i], ==, 0);
+  }
+
+  /* Partially filled: silence first, then the samples written so far. */
+  test_pcm_fill(chunk, 0, 40);
+  gst_projectm_pcm_ring_write(ring, chunk, 40);
+  written = 40;
+  g_assert_cmpuint(gst_projectm_pcm_ring_read(ring, 0, window, 64), ==, 40);
+  g_assert_cmpint(window[2 * 23], ==, 0);
+  g_assert_cmpint(window[2 * 24], ==, 1);
+  g_assert_cmpint(window[2 * 63], ==, 40);
+  g_assert_cmpint(window[2 * 63 + 1], ==, -40);
+
+  /* Writes wrapping around the end of the ring, in uneven chunks. */
+  for (guint size = 1; written < 1000; size = size * 3 % 97 + 1) {
+    test_pcm_fill(chunk, written, size);
+    gst_projectm_pcm_ring_write(ring, chunk, size);
+    written += size;
+
+    for (guint back = 0; back <= 64; back += 32) {
+      guint available = MIN(written, 128);
+      guint copied = back < available ? MIN(64, available - back) : 0;
+
+      g_assert_cmpuint(gst_projectm_pcm_ring_read(ring, back, window, 64), ==,
+                       copied);
+      for (guint i = 64 - copied; i < 64; i++) {
+        guint expected = written - back - 64 + i + 1;
+        g_assert_cmpint(window[i * 2], ==, (gint16)expected);
+        g_assert_cmpint(window[i * 2 + 1], ==, (gint16)-(gint)expected);
+      }
+    }
+  }
+
+  /* A write larger than the ring keeps only its newest samples. */
+  test_pcm_fill(chunk, written, 300);
+  gst_projectm_pcm_ring_write(ring, chunk, 300);
+  written += 300;
+  g_assert_cmpuint(gst_projectm_pcm_ring_read(ring, 100, window, 64), ==, 28);
+  g_assert_cmpint(window[2 * 35], ==, 0);
+  g_assert_cmpint(window[2 * 36], ==, (gint16)(written - 127));
+  g_assert_cmpint(window[2 * 63], ==, (gint16)(written - 100));
+
+  gst_projectm_pcm_ring_clear(ring);
+  g_assert_cmpuint(gst_projectm_pcm_ring_read(ring, 0, window, 64), ==, 0);
+
+  gst_projectm_pcm_ring_free(ring);
+}
+
+static void test_frame_grid_ntsc(void) {
+  guint64 position = 0;
+
+  /* 48 kHz at 29.97 fps: 1601.6 samples per frame, in a repeating pattern
+   * of three 1602s and two 1601s that never drifts from the stream. */
+  for (guint64 n = 0; n < 30000; n++) {
+    guint samples = gst_projectm_frame_grid_samples(48000, 30000, 1001, n);
+
+    g_assert_true(samples == 1601 || samples == 1602);
+    g_assert_cmpuint(gst_projectm_frame_grid_start(48000, 30000, 1001, n), ==,
+                     position);
+    g_assert_cmpuint(
+        gst_projectm_frame_grid_samples_from(48000, 30000, 1001, position), ==,
+        samples);
+    position += samples;
+  }
+
+  /* 30000 frames of 1001/30000 s are exactly 1001 s of audio. */
+  g_assert_cmpuint(position, ==, 1001 * 48000);
+  g_assert_cmpuint(gst_projectm_frame_grid_samples(48000, 30000, 1001, 0), ==,
+                   1601);
+  g_assert_cmpuint(gst_projectm_frame_grid_samples(48000, 30000, 1001, 1), ==,
+                   1602);
+  g_assert_cmpuint(gst_projectm_frame_grid_time(30000, 1001, 30000), ==,
+                   1001 * GST_SECOND);
+}
+
+static void test_frame_grid_rates(void) {
+  static const struct {
+    guint rate;
+    gint fps_n;
+    gint fps_d;
+  } cases[] = {
+      {44100, 30, 1},    {44100, 60000, 1001}, {48000, 120, 1},
+      {48000, 240, 1},   {44100, 24000, 1001}, {96000, 59940, 1000},
+  };
+
+  for (guint i = 0; i < G_N_ELEMENTS(cases); i++) {
+    guint rate = cases[i].rate;
+    gint fps_n = cases[i].fps_n;
+    gint fps_d = cases[i].fps_d;
+    guint64 frames = (guint64)fps_n * 10;
+    guint64 total = 0;
+
+    for (guint64 n = 0; n < frames; n++) {
+      total += gst_projectm_frame_grid_samples(rate, fps_n, fps_d, n);
+    }
+
+    /* Ten times the frame rate's numerator is a whole number of seconds. */
+    g_assert_cmpuint(total, ==, (guint64)rate * fps_d * 10);
+
+    /* Mid-frame positions count to the next boundary. */
+    guint64 start = gst_projectm_frame_grid_start(rate, fps_n, fps_d, 7);
+    guint samples = gst_projectm_frame_grid_samples(rate, fps_n, fps_d, 7);
+    g_assert_cmpuint(
+        gst_projectm_frame_grid_samples_from(rate, fps_n, fps_d, start + 1),
+        ==, samples - 1);
+  }
+
+  g_assert_cmpuint(gst_projectm_frame_grid_samples(0, 30, 1, 0), ==, 0);
+  g_assert_cmpuint(gst_projectm_frame_grid_samples_from(48000, 0, 1, 0), ==, 0);
+}
+
+int main(int argc, char *argv[]) {
+  GError *error = NULL;
+
+  test_dir = g_dir_make_tmp("gstprojectm-test-XXXXXX", &error);
+  g_assert_no_error(error);
+
+  /* Keep archive extraction out of the user's cache. */
+  g_setenv("XDG_CACHE_HOME", test_dir, TRUE);
+
+  g_test_init(&argc, &argv, NULL);
+  gst_init(&argc, &argv);
+
+  g_test_add_func("/archive/binary-member", test_archive_binary_member);
+  g_test_add_func("/archive/malformed-pax", test_archive_malformed_pax);
+  g_test_add_func("/preset-index/revalidate", test_preset_index_revalidate);
+#ifdef G_OS_UNIX
+  g_test_add_func("/preset-index/symlinks", test_preset_index_symlinks);
+#endif
+  g_test_add_func("/timeline/parse", test_timeline_parse);
+  g_test_add_func("/timeline/load-file", test_timeline_load_file);
+  g_test_add_func("/timeline/find-target-index",
+                  test_timeline_find_target_index);
+  g_test_add_func("/timeline/resolve-preset-path", test_resolve_preset_path);
+  g_test_add_func("/caps/templates", test_caps);
+  g_test_add_func("/frame/copy", test_frame_copy);
+  g_test_add_func("/frame/copy-pool", test_frame_copy_pool);
+  g_test_add_func("/frame/flip-in-place", test_frame_flip_in_place);
+  g_test_add_func("/frame-grid/ntsc", test_frame_grid_ntsc);
+  g_test_add_func("/frame-grid/rates", test_frame_grid_rates);
+  g_test_add_func("/pcm-ring/read-write", test_pcm_ring);
+
+  return g_test_run();
+}